@@ -0,0 +1,646 @@
+/** @file
+ *
+ *  A brief file description
+ *
+ *  @section license License
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+// zfs-bench measures the throughput of every checksum in zio_checksum_table
+// and every compressor in zio_compress_table, over a range of block sizes
+// and a few data corpora. Each result is reported in GB/s and, on x86, in
+// TSC cycles per byte; compression results also give the compression ratio
+// the way zio_compress_data() would store the block.
+//
+// Checksum speed does not depend on the data, so checksums are only run on
+// the first selected corpus.
+//
+// With -e, compression goes through zio_compress_data() itself, so that the
+// all-zero check and the early abort probe are included in the timings.
+
+#include <sys/zfs_context.h>
+#include <sys/zio.h>
+#include <sys/zio_checksum.h>
+#include <sys/zio_compress.h>
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <time.h>
+
+#define BENCH_MAX_SIZE      (16ULL << 20)
+#define BENCH_BATCH         8
+
+typedef void (*bench_fill_t)(uint8_t *, size_t);
+
+typedef struct bench_corpus {
+    const char *    name;
+    bench_fill_t    fill;
+    uint8_t *       data;
+} bench_corpus_t;
+
+typedef struct bench_result {
+    uint64_t        bytes;
+    uint64_t        ns;
+    uint64_t        cycles;
+} bench_result_t;
+
+static uint64_t bench_ns = 50 * 1000 * 1000;
+static uint64_t bench_min_size = 512;
+static uint64_t bench_max_size = BENCH_MAX_SIZE;
+static const char * bench_checksums;
+static const char * bench_compressors;
+static const char * bench_corpora;
+static boolean_t bench_parseable;
+static boolean_t bench_zio;
+static boolean_t bench_failed;
+
+// A xorshift64* generator, so that every run hashes the same data.
+static uint64_t
+bench_random(uint64_t * state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+static void
+bench_fill_zeros(uint8_t * buf, size_t len)
+{
+    bzero(buf, len);
+}
+
+static void
+bench_fill_random(uint8_t * buf, size_t len)
+{
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+
+    for (size_t i = 0; i < len; i += sizeof(uint64_t)) {
+        uint64_t r = bench_random(&state);
+
+        memcpy(buf + i, &r, MIN(sizeof(r), len - i));
+    }
+}
+
+// English-like prose: common words, punctuation and short lines.
+static void
+bench_fill_text(uint8_t * buf, size_t len)
+{
+    static const char * words[] = {
+        "the", "of", "and", "to", "in", "a", "is", "that", "for", "it",
+        "as", "was", "with", "be", "by", "on", "not", "he", "this", "are",
+        "or", "his", "from", "at", "which", "but", "have", "an", "had",
+        "they", "you", "were", "their", "one", "all", "we", "can", "her",
+        "has", "there", "been", "if", "more", "when", "will", "would",
+        "who", "so", "no", "storage", "pool", "block", "record", "data",
+        "transaction", "checksum", "compression", "device", "snapshot",
+        "dataset", "write", "read", "system", "file",
+    };
+    uint64_t state = 0x243f6a8885a308d3ULL;
+    size_t off = 0, line = 0;
+
+    while (off < len) {
+        uint64_t r = bench_random(&state);
+        const char * w = words[r % (sizeof(words) / sizeof(words[0]))];
+        char sep = ' ';
+
+        if (line > 64 + (r >> 58)) {
+            sep = '\n';
+            line = 0;
+        } else if ((r >> 8) % 13 == 0) {
+            sep = (r >> 16) % 3 == 0 ? '.' : ',';
+        }
+
+        for (; *w != '\0' && off < len; w++, line++) {
+            buf[off++] = *w;
+        }
+        if (sep != ' ' && sep != '\n' && off < len) {
+            buf[off++] = sep;
+            sep = ' ';
+        }
+        if (off < len) {
+            buf[off++] = sep;
+            line++;
+        }
+    }
+}
+
+// 8K pages in the style of a relational database heap: a header, an array
+// of line pointers growing up, rows growing down from the end of the page,
+// and zeroed free space in between.
+static void
+bench_fill_dbpages(uint8_t * buf, size_t len)
+{
+    static const char * names[] = {
+        "alice", "bob", "carol", "dave", "eve", "mallory", "trent", "peggy",
+    };
+    const size_t page = 8192;
+    uint64_t state = 0x13198a2e03707344ULL;
+    uint32_t rowid = 0;
+
+    bzero(buf, len);
+
+    for (size_t p = 0; p + page <= len; p += page) {
+        uint8_t * pg = buf + p;
+        uint64_t lsn = 0x1000000ULL + p;
+        uint16_t lower = 24, upper = page;
+        uint16_t fill = page * (60 + bench_random(&state) % 35) / 100;
+
+        while (page - upper + (lower - 24) < fill) {
+            uint64_t r = bench_random(&state);
+            const char * name = names[r % 8];
+            uint8_t row[64];
+            uint16_t rlen;
+            uint64_t ts = 1500000000ULL + rowid * 17 + (r >> 40) % 16;
+            uint32_t xmin = 1000 + rowid / 50;
+            uint32_t amount = (r >> 16) % 100000;
+
+            bzero(row, sizeof(row));
+            memcpy(row, &xmin, sizeof(xmin));
+            row[12] = 5;
+            row[18] = 0x18;
+            memcpy(row + 24, &rowid, sizeof(rowid));
+            memcpy(row + 28, &amount, sizeof(amount));
+            memcpy(row + 32, &ts, sizeof(ts));
+            row[40] = (strlen(name) + 1) << 1 | 1;
+            memcpy(row + 41, name, strlen(name));
+            rlen = P2ROUNDUP(41 + strlen(name), 8);
+
+            if (upper - rlen < lower + 4) {
+                break;
+            }
+            upper -= rlen;
+            memcpy(pg + upper, row, rlen);
+            pg[lower] = upper & 0xff;
+            pg[lower + 1] = (upper >> 8) | 0x80;
+            pg[lower + 2] = rlen << 1;
+            pg[lower + 3] = rlen >> 7;
+            lower += 4;
+            rowid++;
+        }
+
+        memcpy(pg, &lsn, sizeof(lsn));
+        memcpy(pg + 12, &lower, sizeof(lower));
+        memcpy(pg + 14, &upper, sizeof(upper));
+    }
+}
+
+static bench_corpus_t bench_corpus[] = {
+    { "zeros",      bench_fill_zeros,   NULL },
+    { "text",       bench_fill_text,    NULL },
+    { "random",     bench_fill_random,  NULL },
+    { "dbpages",    bench_fill_dbpages, NULL },
+};
+
+#define BENCH_NCORPORA  (sizeof(bench_corpus) / sizeof(bench_corpus[0]))
+
+static uint64_t
+bench_cycles(void)
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static uint64_t
+bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Is name in the comma separated list? A NULL list selects everything.
+static boolean_t
+bench_selected(const char * list, const char * name)
+{
+    size_t len = strlen(name);
+
+    if (list == NULL) {
+        return B_TRUE;
+    }
+
+    for (const char * p = list; p != NULL; p = strchr(p, ',')) {
+        if (*p == ',') {
+            p++;
+        }
+        if (strncmp(p, name, len) == 0 && (p[len] == ',' || p[len] == '\0')) {
+            return B_TRUE;
+        }
+    }
+
+    return B_FALSE;
+}
+
+static void
+bench_header(void)
+{
+    if (bench_parseable) {
+        printf("#op\talgorithm\tcorpus\tblocksize\tbytes\tns\tGB/s\t"
+                "cycles/byte\tratio\n");
+    } else {
+        printf("%-10s %-12s %-8s %9s %9s %8s %7s\n", "OP", "ALGORITHM",
+                "CORPUS", "BLOCKSIZE", "GB/s", "CYC/B", "RATIO");
+    }
+}
+
+static void
+bench_report(const char * op, const char * name, const char * corpus,
+        uint64_t bsize, const bench_result_t * br, double ratio)
+{
+    double gbps = (double)br->bytes / MAX(br->ns, 1);
+    double cpb = (double)br->cycles / MAX(br->bytes, 1);
+
+    if (bench_parseable) {
+        printf("%s\t%s\t%s\t%llu\t%llu\t%llu\t%.3f\t%.3f\t%.3f\n", op, name,
+                corpus, (u_longlong_t)bsize, (u_longlong_t)br->bytes,
+                (u_longlong_t)br->ns, gbps, cpb, ratio);
+    } else {
+        char size[16];
+
+        if (bsize >= (1 << 20)) {
+            snprintf(size, sizeof(size), "%lluM", (u_longlong_t)bsize >> 20);
+        } else if (bsize >= (1 << 10)) {
+            snprintf(size, sizeof(size), "%lluK", (u_longlong_t)bsize >> 10);
+        } else {
+            snprintf(size, sizeof(size), "%llu", (u_longlong_t)bsize);
+        }
+
+        printf("%-10s %-12s %-8s %9s %9.3f %8.3f %7.3f\n", op, name, corpus,
+                size, gbps, cpb, ratio);
+    }
+
+    fflush(stdout);
+}
+
+// Checksum consecutive blocks of the corpus, wrapping around at its end,
+// until the time budget is spent. Entries with a batch interface are also
+// measured in batches of equally sized blocks.
+static void
+bench_checksum(enum zio_checksum c, const bench_corpus_t * bc, uint64_t bsize)
+{
+    zio_checksum_info_t * ci = &zio_checksum_table[c];
+    uint64_t nblocks = BENCH_MAX_SIZE / bsize;
+    void * tmpl = NULL;
+    zio_cksum_salt_t salt;
+    bench_result_t br = { 0 };
+    zio_cksum_t zc[BENCH_BATCH];
+    uint64_t i = 0, start, cstart;
+
+    for (size_t j = 0; j < sizeof(salt.zcs_bytes); j++) {
+        salt.zcs_bytes[j] = j * 37;
+    }
+    if (ci->ci_tmpl_init != NULL) {
+        tmpl = ci->ci_tmpl_init(&salt);
+    }
+
+    start = bench_now();
+    cstart = bench_cycles();
+    do {
+        ci->ci_func[0](bc->data + (i++ % nblocks) * bsize, bsize, tmpl, zc);
+        br.bytes += bsize;
+        br.ns = bench_now() - start;
+    } while (br.ns < bench_ns);
+    br.cycles = bench_cycles() - cstart;
+
+    bench_report("checksum", ci->ci_name, bc->name, bsize, &br, 1.0);
+
+    if (ci->ci_batch != NULL && nblocks >= BENCH_BATCH) {
+        const void * data[BENCH_BATCH];
+        uint64_t size[BENCH_BATCH];
+
+        bzero(&br, sizeof(br));
+        i = 0;
+        start = bench_now();
+        cstart = bench_cycles();
+        do {
+            for (int j = 0; j < BENCH_BATCH; j++) {
+                data[j] = bc->data + (i++ % nblocks) * bsize;
+                size[j] = bsize;
+            }
+            ci->ci_batch(data, size, BENCH_BATCH, tmpl, zc);
+            br.bytes += BENCH_BATCH * bsize;
+            br.ns = bench_now() - start;
+        } while (br.ns < bench_ns);
+        br.cycles = bench_cycles() - cstart;
+
+        bench_report("batch", ci->ci_name, bc->name, bsize, &br, 1.0);
+    }
+
+    if (tmpl != NULL) {
+        ci->ci_tmpl_free(tmpl);
+    }
+}
+
+// Compress one block, returning its stored size: 0 for a hole, or more
+// than d_len if it is stored uncompressed.
+static size_t
+bench_compress_block(zio_compress_info_t * ci, enum zio_compress c,
+        const void * src, void * dst, uint64_t bsize, uint64_t d_len)
+{
+    if (bench_zio) {
+        return zio_compress_data(c, (void *)src, dst, bsize);
+    }
+
+    return ci->ci_compress((void *)src, dst, bsize, d_len, ci->ci_level);
+}
+
+// Restore a block stored by bench_compress_block() into dst, returning
+// nonzero if it does not decompress.
+static int
+bench_decompress_block(zio_compress_info_t * ci, const void * src,
+        const void * cbuf, size_t clen, void * dst, uint64_t bsize,
+        uint64_t d_len)
+{
+    if (clen == 0) {
+        bzero(dst, bsize);
+    } else if (clen <= d_len) {
+        return ci->ci_decompress((void *)cbuf, dst, clen, bsize,
+                ci->ci_level);
+    } else {
+        bcopy(src, dst, bsize);
+    }
+
+    return 0;
+}
+
+// Compress and then decompress consecutive blocks of the corpus. Like
+// zio_compress_data(), a block is only stored compressed if that saves at
+// least 12.5%; the ratio is that of the stored sizes.
+static void
+bench_compress(enum zio_compress c, const bench_corpus_t * bc, uint64_t bsize,
+        uint8_t * cbuf, uint8_t * dbuf)
+{
+    zio_compress_info_t * ci = &zio_compress_table[c];
+    uint64_t nblocks = MIN(BENCH_MAX_SIZE / bsize, 64);
+    uint64_t d_len = bsize - (bsize >> 3);
+    uint64_t stored = 0, i, start, cstart;
+    size_t * clen;
+    bench_result_t br = { 0 };
+    boolean_t failed = B_FALSE;
+
+    clen = kmem_alloc(nblocks * sizeof(size_t), KM_SLEEP);
+
+    // One pass for the sizes, so that decompression has its inputs.
+    for (i = 0; i < nblocks; i++) {
+        clen[i] = bench_compress_block(ci, c, bc->data + i * bsize,
+                cbuf + i * bsize, bsize, d_len);
+        stored += clen[i] <= d_len ? clen[i] : bsize;
+    }
+
+    i = 0;
+    start = bench_now();
+    cstart = bench_cycles();
+    do {
+        uint64_t b = i++ % nblocks;
+
+        (void) bench_compress_block(ci, c, bc->data + b * bsize,
+                cbuf + b * bsize, bsize, d_len);
+        br.bytes += bsize;
+        br.ns = bench_now() - start;
+    } while (br.ns < bench_ns);
+    br.cycles = bench_cycles() - cstart;
+
+    bench_report("compress", ci->ci_name, bc->name, bsize, &br,
+            (double)nblocks * bsize / MAX(stored, 1));
+
+    // Every block has to round trip before its decompression is timed.
+    for (i = 0; i < nblocks; i++) {
+        const uint8_t * src = bc->data + i * bsize;
+
+        if (bench_decompress_block(ci, src, cbuf + i * bsize, clen[i], dbuf,
+                bsize, d_len) != 0 || bcmp(dbuf, src, bsize) != 0) {
+            failed = B_TRUE;
+        }
+    }
+
+    bzero(&br, sizeof(br));
+    i = 0;
+    start = bench_now();
+    cstart = bench_cycles();
+    do {
+        uint64_t b = i++ % nblocks;
+
+        if (bench_decompress_block(ci, bc->data + b * bsize,
+                cbuf + b * bsize, clen[b], dbuf, bsize, d_len) != 0) {
+            failed = B_TRUE;
+        }
+        br.bytes += bsize;
+        br.ns = bench_now() - start;
+    } while (br.ns < bench_ns);
+    br.cycles = bench_cycles() - cstart;
+
+    if (failed) {
+        fprintf(stderr, "zfs-bench: %s does not round trip %s at %llu\n",
+                ci->ci_name, bc->name, (u_longlong_t)bsize);
+        bench_failed = B_TRUE;
+    }
+
+    bench_report("decompress", ci->ci_name, bc->name, bsize, &br,
+            (double)nblocks * bsize / MAX(stored, 1));
+
+    kmem_free(clen, nblocks * sizeof(size_t));
+}
+
+static uint64_t
+bench_parse_size(const char * arg)
+{
+    char * end;
+    uint64_t val = strtoull(arg, &end, 0);
+
+    switch (*end) {
+    case 'k': case 'K':
+        val <<= 10;
+        break;
+    case 'm': case 'M':
+        val <<= 20;
+        break;
+    case '\0':
+        break;
+    default:
+        fprintf(stderr, "zfs-bench: invalid size '%s'\n", arg);
+        exit(EX_USAGE);
+    }
+
+    return val;
+}
+
+static void
+bench_usage(FILE * fp)
+{
+    fprintf(fp,
+"Usage: zfs-bench [OPTION]...\n"
+"Measure ZFS checksum and compression throughput\n"
+"\n"
+"Options:\n"
+"  -c, --checksum=LIST   Checksums to run, by name (default: all)\n"
+"  -z, --compress=LIST   Compressors to run, by name (default: all)\n"
+"  -d, --data=LIST       Corpora: zeros, text, random, dbpages (default: all)\n"
+"  -s, --min-size=SIZE   Smallest block size (default: 512)\n"
+"  -S, --max-size=SIZE   Largest block size (default: 16M)\n"
+"  -t, --time=MSEC       Time spent on each measurement (default: 50)\n"
+"  -p, --parseable       Tab separated output with exact values\n"
+"  -e, --zio             Compress through zio_compress_data()\n"
+"  -h, --help            Show this help\n"
+"\n"
+"A LIST is comma separated; \"none\" skips a whole group.\n");
+}
+
+int
+main(int argc, char ** argv)
+{
+    static const struct option options[] = {
+        {"checksum", required_argument, NULL, 'c' },
+        {"compress", required_argument, NULL, 'z' },
+        {"data", required_argument, NULL, 'd' },
+        {"min-size", required_argument, NULL, 's' },
+        {"max-size", required_argument, NULL, 'S' },
+        {"time", required_argument, NULL, 't' },
+        {"parseable", no_argument, NULL, 'p' },
+        {"zio", no_argument, NULL, 'e' },
+        {"help", no_argument, NULL, 'h' },
+        {NULL, 0, NULL, '\0' }
+    };
+
+    const bench_corpus_t * first = NULL;
+    uint8_t * cbuf;
+    uint8_t * dbuf;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "c:z:d:s:S:t:peh", options,
+                    NULL)) != -1) {
+        switch (opt) {
+        case 'c':
+            bench_checksums = optarg;
+            break;
+        case 'z':
+            bench_compressors = optarg;
+            break;
+        case 'd':
+            bench_corpora = optarg;
+            break;
+        case 's':
+            bench_min_size = bench_parse_size(optarg);
+            break;
+        case 'S':
+            bench_max_size = bench_parse_size(optarg);
+            break;
+        case 't':
+            bench_ns = strtoull(optarg, NULL, 0) * 1000 * 1000;
+            break;
+        case 'p':
+            bench_parseable = B_TRUE;
+            break;
+        case 'e':
+            bench_zio = B_TRUE;
+            break;
+        case 'h':
+            bench_usage(stdout);
+            return EX_OK;
+        default:
+            bench_usage(stderr);
+            return EX_USAGE;
+        }
+    }
+
+    if (bench_min_size == 0 || bench_max_size > BENCH_MAX_SIZE ||
+            bench_min_size > bench_max_size) {
+        fprintf(stderr, "zfs-bench: block sizes must be within 1..16M\n");
+        return EX_USAGE;
+    }
+
+    zio_checksum_init();
+    zio_compress_init();
+
+    for (size_t i = 0; i < BENCH_NCORPORA; i++) {
+        bench_corpus_t * bc = &bench_corpus[i];
+
+        if (!bench_selected(bench_corpora, bc->name)) {
+            continue;
+        }
+
+        bc->data = kmem_alloc(BENCH_MAX_SIZE, KM_SLEEP);
+        bc->fill(bc->data, BENCH_MAX_SIZE);
+        if (first == NULL) {
+            first = bc;
+        }
+    }
+
+    cbuf = kmem_alloc(BENCH_MAX_SIZE, KM_SLEEP);
+    dbuf = kmem_alloc(BENCH_MAX_SIZE, KM_SLEEP);
+
+    bench_header();
+
+    for (enum zio_checksum c = 0; first != NULL &&
+            c < ZIO_CHECKSUM_FUNCTIONS; c++) {
+        zio_checksum_info_t * ci = &zio_checksum_table[c];
+
+        if (ci->ci_func[0] == NULL || ci->ci_func[0] ==
+                zio_checksum_table[ZIO_CHECKSUM_OFF].ci_func[0] ||
+                !bench_selected(bench_checksums, ci->ci_name)) {
+            continue;
+        }
+
+        for (uint64_t bs = bench_min_size; bs <= bench_max_size; bs <<= 1) {
+            bench_checksum(c, first, bs);
+        }
+    }
+
+    for (enum zio_compress c = 0; c < ZIO_COMPRESS_FUNCTIONS; c++) {
+        zio_compress_info_t * ci = &zio_compress_table[c];
+
+        if (ci->ci_compress == NULL ||
+                !bench_selected(bench_compressors, ci->ci_name)) {
+            continue;
+        }
+
+        for (size_t i = 0; i < BENCH_NCORPORA; i++) {
+            const bench_corpus_t * bc = &bench_corpus[i];
+
+            if (bc->data == NULL) {
+                continue;
+            }
+
+            for (uint64_t bs = bench_min_size; bs <= bench_max_size;
+                    bs <<= 1) {
+                bench_compress(c, bc, bs, cbuf, dbuf);
+            }
+        }
+    }
+
+    kmem_free(dbuf, BENCH_MAX_SIZE);
+    kmem_free(cbuf, BENCH_MAX_SIZE);
+    for (size_t i = 0; i < BENCH_NCORPORA; i++) {
+        if (bench_corpus[i].data != NULL) {
+            kmem_free(bench_corpus[i].data, BENCH_MAX_SIZE);
+        }
+    }
+
+    zio_compress_fini();
+    zio_checksum_fini();
+
+    return bench_failed ? EX_SOFTWARE : EX_OK;
+}
+
+/* vim: set sts=4 sw=4 ts=4 tw=79 et: */
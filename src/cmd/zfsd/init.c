@@ -40,6 +40,9 @@ extern uint_t rrw_tsd_key;
 // From zfs_ioctl.c.
 uint_t zfs_fsyncer_key;
 
+// From vdev_file_aio.c.
+extern void vdev_file_aio_nbio_init(void);
+
 void
 zfsd_init_phenom(void)
 {
@@ -47,6 +50,9 @@ zfsd_init_phenom(void)
 
     VERIFY3(ph_library_init(), ==, PH_OK);
     VERIFY3(ph_nbio_init(0), ==, PH_OK);
+
+    // Reap libaio vdev completions from the NBIO scheduler.
+    vdev_file_aio_nbio_init();
 }
 
 void
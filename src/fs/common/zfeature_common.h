@@ -56,6 +56,8 @@ typedef enum spa_feature {
 	SPA_FEATURE_SHA512,
 	SPA_FEATURE_SKEIN,
 	SPA_FEATURE_EDONR,
+	SPA_FEATURE_BLAKE3,
+	SPA_FEATURE_ZSTD_COMPRESS,
 	SPA_FEATURES
 } spa_feature_t;
 
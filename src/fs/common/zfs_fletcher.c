@@ -126,6 +126,47 @@
  *
  * For both cached and uncached data, both fletcher checksums are much faster
  * than sha-256, and slower than 'off', which doesn't touch the data at all.
+ *
+ * ----------------------------
+ * Lane-parallel Implementations
+ * ----------------------------
+ *
+ * The scalar loops below have a serial dependency chain through the
+ * accumulators, so they retire at most one input word per few cycles.  The
+ * SIMD implementations (zfs_fletcher_x86.c) instead split the input into N
+ * interleaved streams: lane j accumulates its own a, b, c and d over the
+ * words f_j, f_(j+N), f_(j+2N), ...  Since each lane has processed
+ * m = n / N words, the weight that word f_(kN+j) carries in the full
+ * checksum is a polynomial in t = m - k, and re-expressing those
+ * polynomials in the lane's own basis (1, t, t(t+1)/2, t(t+1)(t+2)/6)
+ * gives integer coefficients:
+ *
+ *	a = sum(A_j)
+ *	b = sum(N * B_j - j * A_j)
+ *	c = sum(N^2 * C_j + N(1 - 2j - N)/2 * B_j + j(j - 1)/2 * A_j)
+ *	d = sum(N^3 * D_j + beta_j * C_j + gamma_j * B_j + delta_j * A_j)
+ *
+ * where, writing p(t) = C(Nt - j + 2, 3), delta_j = p(0),
+ * gamma_j = p(0) - p(-1) and beta_j = p(-2) + 2 gamma_j - delta_j.  All of
+ * this holds modulo 2^64, so the lanes may overflow exactly like the scalar
+ * accumulators do.  fletcher_4_lanes_fini() applies these coefficients;
+ * fletcher-2 is the N-lane case of the first two lines, applied to each of
+ * its two 64-bit streams.
+ *
+ * Appending n words to a checksum (a, b, c, d) whose own suffix checksum is
+ * (a', b', c', d') is the same kind of recombination:
+ *
+ *	a + a'
+ *	b + n*a + b'
+ *	c + n*b + C(n+1, 2)*a + c'
+ *	d + n*c + C(n+1, 2)*b + C(n+2, 3)*a + d'
+ *
+ * which is how the incremental variants use the SIMD kernels.
+ *
+ * fletcher_init() checks which implementations the CPU supports, verifies
+ * them against the scalar code, times each on a cached buffer and selects
+ * the fastest.  The measured bandwidths are exported as the named kstats
+ * "zfs:0:fletcher_4_bench" and "zfs:0:fletcher_2_bench".
  */
 
 #include <sys/types.h>
@@ -133,17 +174,30 @@
 #include <sys/byteorder.h>
 #include <sys/zio.h>
 #include <sys/spa.h>
+#include <sys/kstat.h>
+#include <sys/kmem.h>
+#include <sys/zfs_bench.h>
+#include <zfs_fletcher.h>
 
-/*ARGSUSED*/
-void
-fletcher_2_native(const void *buf, uint64_t size,
-    const void *ctx_template, zio_cksum_t *zcp)
+/*
+ * Scalar implementations.  These continue from the state in zcp, which
+ * makes them usable both as the incremental variants and for the tails
+ * that the SIMD kernels leave behind.
+ */
+static void
+fletcher_2_scalar_incremental_native(const void *buf, uint64_t size,
+    zio_cksum_t *zcp)
 {
 	const uint64_t *ip = buf;
 	const uint64_t *ipend = ip + (size / sizeof (uint64_t));
 	uint64_t a0, b0, a1, b1;
 
-	for (a0 = b0 = a1 = b1 = 0; ip < ipend; ip += 2) {
+	a0 = zcp->zc_word[0];
+	a1 = zcp->zc_word[1];
+	b0 = zcp->zc_word[2];
+	b1 = zcp->zc_word[3];
+
+	for (; ip < ipend; ip += 2) {
 		a0 += ip[0];
 		a1 += ip[1];
 		b0 += a0;
@@ -153,16 +207,20 @@ fletcher_2_native(const void *buf, uint64_t size,
 	ZIO_SET_CHECKSUM(zcp, a0, a1, b0, b1);
 }
 
-/*ARGSUSED*/
-void
-fletcher_2_byteswap(const void *buf, uint64_t size,
-    const void *ctx_template, zio_cksum_t *zcp)
+static void
+fletcher_2_scalar_incremental_byteswap(const void *buf, uint64_t size,
+    zio_cksum_t *zcp)
 {
 	const uint64_t *ip = buf;
 	const uint64_t *ipend = ip + (size / sizeof (uint64_t));
 	uint64_t a0, b0, a1, b1;
 
-	for (a0 = b0 = a1 = b1 = 0; ip < ipend; ip += 2) {
+	a0 = zcp->zc_word[0];
+	a1 = zcp->zc_word[1];
+	b0 = zcp->zc_word[2];
+	b1 = zcp->zc_word[3];
+
+	for (; ip < ipend; ip += 2) {
 		a0 += BSWAP_64(ip[0]);
 		a1 += BSWAP_64(ip[1]);
 		b0 += a0;
@@ -172,16 +230,20 @@ fletcher_2_byteswap(const void *buf, uint64_t size,
 	ZIO_SET_CHECKSUM(zcp, a0, a1, b0, b1);
 }
 
-/*ARGSUSED*/
-void
-fletcher_4_native(const void *buf, uint64_t size,
-    const void *ctx_template, zio_cksum_t *zcp)
+static void
+fletcher_4_scalar_incremental_native(const void *buf, uint64_t size,
+    zio_cksum_t *zcp)
 {
 	const uint32_t *ip = buf;
 	const uint32_t *ipend = ip + (size / sizeof (uint32_t));
 	uint64_t a, b, c, d;
 
-	for (a = b = c = d = 0; ip < ipend; ip++) {
+	a = zcp->zc_word[0];
+	b = zcp->zc_word[1];
+	c = zcp->zc_word[2];
+	d = zcp->zc_word[3];
+
+	for (; ip < ipend; ip++) {
 		a += ip[0];
 		b += a;
 		c += b;
@@ -191,16 +253,20 @@ fletcher_4_native(const void *buf, uint64_t size,
 	ZIO_SET_CHECKSUM(zcp, a, b, c, d);
 }
 
-/*ARGSUSED*/
-void
-fletcher_4_byteswap(const void *buf, uint64_t size,
-    const void *ctx_template, zio_cksum_t *zcp)
+static void
+fletcher_4_scalar_incremental_byteswap(const void *buf, uint64_t size,
+    zio_cksum_t *zcp)
 {
 	const uint32_t *ip = buf;
 	const uint32_t *ipend = ip + (size / sizeof (uint32_t));
 	uint64_t a, b, c, d;
 
-	for (a = b = c = d = 0; ip < ipend; ip++) {
+	a = zcp->zc_word[0];
+	b = zcp->zc_word[1];
+	c = zcp->zc_word[2];
+	d = zcp->zc_word[3];
+
+	for (; ip < ipend; ip++) {
 		a += BSWAP_32(ip[0]);
 		b += a;
 		c += b;
@@ -210,48 +276,453 @@ fletcher_4_byteswap(const void *buf, uint64_t size,
 	ZIO_SET_CHECKSUM(zcp, a, b, c, d);
 }
 
+static void
+fletcher_2_scalar_native(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	ZIO_SET_CHECKSUM(zcp, 0, 0, 0, 0);
+	fletcher_2_scalar_incremental_native(buf, size, zcp);
+}
+
+static void
+fletcher_2_scalar_byteswap(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	ZIO_SET_CHECKSUM(zcp, 0, 0, 0, 0);
+	fletcher_2_scalar_incremental_byteswap(buf, size, zcp);
+}
+
+static void
+fletcher_4_scalar_native(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	ZIO_SET_CHECKSUM(zcp, 0, 0, 0, 0);
+	fletcher_4_scalar_incremental_native(buf, size, zcp);
+}
+
+static void
+fletcher_4_scalar_byteswap(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	ZIO_SET_CHECKSUM(zcp, 0, 0, 0, 0);
+	fletcher_4_scalar_incremental_byteswap(buf, size, zcp);
+}
+
+static boolean_t
+fletcher_scalar_valid(void)
+{
+	return (B_TRUE);
+}
+
+static const fletcher_ops_t fletcher_2_scalar_ops = {
+	.fo_name = "scalar",
+	.fo_blocksize = 2 * sizeof (uint64_t),
+	.fo_valid = fletcher_scalar_valid,
+	.fo_native = fletcher_2_scalar_native,
+	.fo_byteswap = fletcher_2_scalar_byteswap,
+};
+
+static const fletcher_ops_t fletcher_4_scalar_ops = {
+	.fo_name = "scalar",
+	.fo_blocksize = sizeof (uint32_t),
+	.fo_valid = fletcher_scalar_valid,
+	.fo_native = fletcher_4_scalar_native,
+	.fo_byteswap = fletcher_4_scalar_byteswap,
+};
+
+static const fletcher_ops_t *fletcher_2_algos[] = {
+	&fletcher_2_scalar_ops,
+#if defined(__x86_64__) && defined(__GNUC__)
+	&fletcher_2_sse2_ops,
+	&fletcher_2_avx2_ops,
+	&fletcher_2_avx512_ops,
+#endif
+};
+
+static const fletcher_ops_t *fletcher_4_algos[] = {
+	&fletcher_4_scalar_ops,
+#if defined(__x86_64__) && defined(__GNUC__)
+	&fletcher_4_sse2_ops,
+	&fletcher_4_avx2_ops,
+	&fletcher_4_avx512_ops,
+#endif
+};
+
+#define	FLETCHER_NALGOS(algos)	(sizeof (algos) / sizeof (algos[0]))
+
+/*
+ * The implementations in use.  These start out as the scalar code so that
+ * checksums work before fletcher_init(), and are only ever switched between
+ * implementations that produce identical results.
+ */
+static const fletcher_ops_t *volatile fletcher_2_impl = &fletcher_2_scalar_ops;
+static const fletcher_ops_t *volatile fletcher_4_impl = &fletcher_4_scalar_ops;
+
+/*
+ * Binomial coefficients C(n+1, 2) and C(n+2, 3) modulo 2^64, dividing
+ * before multiplying so that they stay exact for any block size.
+ */
+static uint64_t
+fletcher_tri(uint64_t n)
+{
+	return ((n & 1) ? n * ((n + 1) / 2) : (n / 2) * (n + 1));
+}
+
+static uint64_t
+fletcher_tet(uint64_t n)
+{
+	uint64_t f[3] = { n, n + 1, n + 2 };
+
+	f[n % 3 == 0 ? 0 : n % 3 == 1 ? 2 : 1] /= 3;
+	f[(n & 1) ? 1 : 0] /= 2;
+	return (f[0] * f[1] * f[2]);
+}
+
+static int64_t
+fletcher_c3(int64_t x)
+{
+	return (x * (x - 1) * (x - 2) / 6);
+}
+
 void
-fletcher_4_incremental_native(const void *buf, uint64_t size,
+fletcher_2_lanes_fini(const uint64_t *a, const uint64_t *b, int lanes,
     zio_cksum_t *zcp)
 {
-	const uint32_t *ip = buf;
-	const uint32_t *ipend = ip + (size / sizeof (uint32_t));
-	uint64_t a, b, c, d;
+	uint64_t ab[2][2] = { { 0, 0 }, { 0, 0 } };
+	uint64_t n = lanes / 2;
 
-	a = zcp->zc_word[0];
-	b = zcp->zc_word[1];
-	c = zcp->zc_word[2];
-	d = zcp->zc_word[3];
+	/*
+	 * Lane l carries sub-lane l / 2 of stream l % 2, where each stream
+	 * has been split n ways.
+	 */
+	for (int l = 0; l < lanes; l++) {
+		uint64_t k = l / 2;
 
-	for (; ip < ipend; ip++) {
-		a += ip[0];
-		b += a;
-		c += b;
-		d += c;
+		ab[l % 2][0] += a[l];
+		ab[l % 2][1] += n * b[l] - k * a[l];
 	}
 
-	ZIO_SET_CHECKSUM(zcp, a, b, c, d);
+	ZIO_SET_CHECKSUM(zcp, ab[0][0], ab[1][0], ab[0][1], ab[1][1]);
+}
+
+void
+fletcher_4_lanes_fini(const uint64_t *a, const uint64_t *b,
+    const uint64_t *c, const uint64_t *d, int lanes, zio_cksum_t *zcp)
+{
+	int64_t n = lanes;
+	uint64_t A = 0, B = 0, C = 0, D = 0;
+
+	for (int64_t j = 0; j < n; j++) {
+		int64_t delta = fletcher_c3(2 - j);
+		int64_t gamma = delta - fletcher_c3(2 - n - j);
+		int64_t beta = fletcher_c3(2 - 2 * n - j) + 2 * gamma - delta;
+
+		A += a[j];
+		B += n * b[j] - j * a[j];
+		C += n * n * c[j] + (n * (1 - 2 * j - n) / 2) * b[j] +
+		    (j * (j - 1) / 2) * a[j];
+		D += n * n * n * d[j] + beta * c[j] + gamma * b[j] +
+		    delta * a[j];
+	}
+
+	ZIO_SET_CHECKSUM(zcp, A, B, C, D);
+}
+
+/*
+ * Append the checksum "next" of n 32-bit words to zcp.
+ */
+static void
+fletcher_4_combine(zio_cksum_t *zcp, const zio_cksum_t *next, uint64_t n)
+{
+	uint64_t a = zcp->zc_word[0];
+	uint64_t b = zcp->zc_word[1];
+	uint64_t c = zcp->zc_word[2];
+	uint64_t d = zcp->zc_word[3];
+	uint64_t t2 = fletcher_tri(n);
+	uint64_t t3 = fletcher_tet(n);
+
+	ZIO_SET_CHECKSUM(zcp,
+	    a + next->zc_word[0],
+	    b + n * a + next->zc_word[1],
+	    c + n * b + t2 * a + next->zc_word[2],
+	    d + n * c + t2 * b + t3 * a + next->zc_word[3]);
+}
+
+static void
+fletcher_2_compute(const fletcher_ops_t *ops, boolean_t byteswap,
+    const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	uint64_t head = P2ALIGN(size, (uint64_t)ops->fo_blocksize);
+
+	if (head == 0) {
+		ZIO_SET_CHECKSUM(zcp, 0, 0, 0, 0);
+	} else if (byteswap) {
+		ops->fo_byteswap(buf, head, zcp);
+	} else {
+		ops->fo_native(buf, head, zcp);
+	}
+
+	if (size > head) {
+		if (byteswap) {
+			fletcher_2_scalar_incremental_byteswap(
+			    (const char *)buf + head, size - head, zcp);
+		} else {
+			fletcher_2_scalar_incremental_native(
+			    (const char *)buf + head, size - head, zcp);
+		}
+	}
+}
+
+static void
+fletcher_4_compute(const fletcher_ops_t *ops, boolean_t byteswap,
+    const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	uint64_t head = P2ALIGN(size, (uint64_t)ops->fo_blocksize);
+
+	if (head == 0) {
+		ZIO_SET_CHECKSUM(zcp, 0, 0, 0, 0);
+	} else if (byteswap) {
+		ops->fo_byteswap(buf, head, zcp);
+	} else {
+		ops->fo_native(buf, head, zcp);
+	}
+
+	if (size > head) {
+		if (byteswap) {
+			fletcher_4_scalar_incremental_byteswap(
+			    (const char *)buf + head, size - head, zcp);
+		} else {
+			fletcher_4_scalar_incremental_native(
+			    (const char *)buf + head, size - head, zcp);
+		}
+	}
+}
+
+/*ARGSUSED*/
+void
+fletcher_2_native(const void *buf, uint64_t size,
+    const void *ctx_template, zio_cksum_t *zcp)
+{
+	fletcher_2_compute(fletcher_2_impl, B_FALSE, buf, size, zcp);
+}
+
+/*ARGSUSED*/
+void
+fletcher_2_byteswap(const void *buf, uint64_t size,
+    const void *ctx_template, zio_cksum_t *zcp)
+{
+	fletcher_2_compute(fletcher_2_impl, B_TRUE, buf, size, zcp);
+}
+
+/*ARGSUSED*/
+void
+fletcher_4_native(const void *buf, uint64_t size,
+    const void *ctx_template, zio_cksum_t *zcp)
+{
+	fletcher_4_compute(fletcher_4_impl, B_FALSE, buf, size, zcp);
+}
+
+/*ARGSUSED*/
+void
+fletcher_4_byteswap(const void *buf, uint64_t size,
+    const void *ctx_template, zio_cksum_t *zcp)
+{
+	fletcher_4_compute(fletcher_4_impl, B_TRUE, buf, size, zcp);
+}
+
+/*
+ * Below this size the recombination costs more than the SIMD kernels save.
+ */
+#define	FLETCHER_MIN_SIMD	128
+
+void
+fletcher_4_incremental_native(const void *buf, uint64_t size,
+    zio_cksum_t *zcp)
+{
+	zio_cksum_t zc;
+
+	if (size < FLETCHER_MIN_SIMD) {
+		fletcher_4_scalar_incremental_native(buf, size, zcp);
+		return;
+	}
+
+	fletcher_4_compute(fletcher_4_impl, B_FALSE, buf, size, &zc);
+	fletcher_4_combine(zcp, &zc, size / sizeof (uint32_t));
 }
 
 void
 fletcher_4_incremental_byteswap(const void *buf, uint64_t size,
     zio_cksum_t *zcp)
 {
-	const uint32_t *ip = buf;
-	const uint32_t *ipend = ip + (size / sizeof (uint32_t));
-	uint64_t a, b, c, d;
+	zio_cksum_t zc;
 
-	a = zcp->zc_word[0];
-	b = zcp->zc_word[1];
-	c = zcp->zc_word[2];
-	d = zcp->zc_word[3];
+	if (size < FLETCHER_MIN_SIMD) {
+		fletcher_4_scalar_incremental_byteswap(buf, size, zcp);
+		return;
+	}
 
-	for (; ip < ipend; ip++) {
-		a += BSWAP_32(ip[0]);
-		b += a;
-		c += b;
-		d += c;
+	fletcher_4_compute(fletcher_4_impl, B_TRUE, buf, size, &zc);
+	fletcher_4_combine(zcp, &zc, size / sizeof (uint32_t));
+}
+
+static const fletcher_ops_t *
+fletcher_impl_find(const fletcher_ops_t **algos, int nalgos, const char *name)
+{
+	for (int i = 0; i < nalgos; i++) {
+		if (strcmp(algos[i]->fo_name, name) == 0 &&
+		    algos[i]->fo_valid())
+			return (algos[i]);
 	}
 
-	ZIO_SET_CHECKSUM(zcp, a, b, c, d);
+	return (NULL);
+}
+
+/*
+ * Force a particular implementation, by name.  Returns ENOTSUP if it is
+ * unknown or not supported by this CPU.
+ */
+int
+fletcher_2_impl_set(const char *name)
+{
+	const fletcher_ops_t *ops = fletcher_impl_find(fletcher_2_algos,
+	    FLETCHER_NALGOS(fletcher_2_algos), name);
+
+	if (ops == NULL)
+		return (SET_ERROR(ENOTSUP));
+
+	fletcher_2_impl = ops;
+	return (0);
+}
+
+int
+fletcher_4_impl_set(const char *name)
+{
+	const fletcher_ops_t *ops = fletcher_impl_find(fletcher_4_algos,
+	    FLETCHER_NALGOS(fletcher_4_algos), name);
+
+	if (ops == NULL)
+		return (SET_ERROR(ENOTSUP));
+
+	fletcher_4_impl = ops;
+	return (0);
+}
+
+const char *
+fletcher_2_impl_get(void)
+{
+	return (fletcher_2_impl->fo_name);
+}
+
+const char *
+fletcher_4_impl_get(void)
+{
+	return (fletcher_4_impl->fo_name);
+}
+
+#define	FLETCHER_BENCH_SIZE	(128 * 1024)
+
+typedef void fletcher_compute_impl_f(const fletcher_ops_t *, boolean_t,
+    const void *, uint64_t, zio_cksum_t *);
+
+typedef struct fletcher_bench {
+	const fletcher_ops_t	**fb_algos;
+	fletcher_compute_impl_f	*fb_compute;
+	const void		*fb_buf;
+} fletcher_bench_t;
+
+static kstat_t *fletcher_2_bench_ksp;
+static kstat_t *fletcher_4_bench_ksp;
+
+static const char *
+fletcher_bench_name(int i, void *arg)
+{
+	fletcher_bench_t *fb = arg;
+
+	return (fb->fb_algos[i]->fo_name);
+}
+
+static boolean_t
+fletcher_bench_valid(int i, void *arg)
+{
+	fletcher_bench_t *fb = arg;
+
+	return (fb->fb_algos[i]->fo_valid());
+}
+
+static boolean_t
+fletcher_bench_verify(int i, void *arg)
+{
+	fletcher_bench_t *fb = arg;
+
+	for (uint64_t sz = 0; sz <= 4096; sz += 16) {
+		for (int bswap = 0; bswap <= 1; bswap++) {
+			zio_cksum_t ref, zc;
+
+			fb->fb_compute(fb->fb_algos[0], bswap, fb->fb_buf, sz,
+			    &ref);
+			fb->fb_compute(fb->fb_algos[i], bswap, fb->fb_buf, sz,
+			    &zc);
+			if (!ZIO_CHECKSUM_EQUAL(ref, zc))
+				return (B_FALSE);
+		}
+	}
+
+	return (B_TRUE);
+}
+
+static uint64_t
+fletcher_bench_run(int i, void *arg)
+{
+	fletcher_bench_t *fb = arg;
+	zio_cksum_t zc;
+
+	fb->fb_compute(fb->fb_algos[i], B_FALSE, fb->fb_buf,
+	    FLETCHER_BENCH_SIZE, &zc);
+	return (FLETCHER_BENCH_SIZE);
+}
+
+static const zfs_bench_ops_t fletcher_2_bench_ops = {
+	.zbo_nimpls = FLETCHER_NALGOS(fletcher_2_algos),
+	.zbo_name = fletcher_bench_name,
+	.zbo_valid = fletcher_bench_valid,
+	.zbo_verify = fletcher_bench_verify,
+	.zbo_run = fletcher_bench_run,
+};
+
+static const zfs_bench_ops_t fletcher_4_bench_ops = {
+	.zbo_nimpls = FLETCHER_NALGOS(fletcher_4_algos),
+	.zbo_name = fletcher_bench_name,
+	.zbo_valid = fletcher_bench_valid,
+	.zbo_verify = fletcher_bench_verify,
+	.zbo_run = fletcher_bench_run,
+};
+
+/*
+ * Check each supported implementation against the scalar code, which is
+ * the first of each table, and use the fastest.
+ */
+void
+fletcher_init(void)
+{
+	void *buf = kmem_alloc(FLETCHER_BENCH_SIZE, KM_SLEEP);
+	fletcher_bench_t fb = { .fb_buf = buf };
+
+	zfs_bench_fill(buf, FLETCHER_BENCH_SIZE);
+
+	fb.fb_algos = fletcher_2_algos;
+	fb.fb_compute = fletcher_2_compute;
+	fletcher_2_impl = fletcher_2_algos[zfs_bench_select("fletcher_2_bench",
+	    &fletcher_2_bench_ops, &fb, NULL, &fletcher_2_bench_ksp)];
+
+	fb.fb_algos = fletcher_4_algos;
+	fb.fb_compute = fletcher_4_compute;
+	fletcher_4_impl = fletcher_4_algos[zfs_bench_select("fletcher_4_bench",
+	    &fletcher_4_bench_ops, &fb, NULL, &fletcher_4_bench_ksp)];
+
+	kmem_free(buf, FLETCHER_BENCH_SIZE);
+}
+
+void
+fletcher_fini(void)
+{
+	kstat_delete(fletcher_2_bench_ksp);
+	fletcher_2_bench_ksp = NULL;
+	kstat_delete(fletcher_4_bench_ksp);
+	fletcher_4_bench_ksp = NULL;
 }
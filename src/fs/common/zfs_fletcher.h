@@ -47,6 +47,43 @@ void fletcher_4_byteswap(const void *, uint64_t, const void *, zio_cksum_t *);
 void fletcher_4_incremental_native(const void *, uint64_t, zio_cksum_t *);
 void fletcher_4_incremental_byteswap(const void *, uint64_t, zio_cksum_t *);
 
+void fletcher_init(void);
+void fletcher_fini(void);
+int fletcher_2_impl_set(const char *);
+int fletcher_4_impl_set(const char *);
+const char *fletcher_2_impl_get(void);
+const char *fletcher_4_impl_get(void);
+
+/*
+ * Fletcher implementations.  fo_native and fo_byteswap compute the checksum
+ * of a buffer from a zero state; the size is always a multiple of
+ * fo_blocksize, and the caller finishes any remainder with scalar code.
+ */
+typedef void fletcher_compute_f(const void *, uint64_t, zio_cksum_t *);
+
+typedef struct fletcher_ops {
+	const char		*fo_name;
+	size_t			fo_blocksize;
+	boolean_t		(*fo_valid)(void);
+	fletcher_compute_f	*fo_native;
+	fletcher_compute_f	*fo_byteswap;
+} fletcher_ops_t;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+extern const fletcher_ops_t fletcher_2_sse2_ops;
+extern const fletcher_ops_t fletcher_2_avx2_ops;
+extern const fletcher_ops_t fletcher_2_avx512_ops;
+extern const fletcher_ops_t fletcher_4_sse2_ops;
+extern const fletcher_ops_t fletcher_4_avx2_ops;
+extern const fletcher_ops_t fletcher_4_avx512_ops;
+#endif
+
+/* Recombine per-lane accumulators into a checksum */
+void fletcher_2_lanes_fini(const uint64_t *, const uint64_t *, int,
+    zio_cksum_t *);
+void fletcher_4_lanes_fini(const uint64_t *, const uint64_t *,
+    const uint64_t *, const uint64_t *, int, zio_cksum_t *);
+
 #ifdef	__cplusplus
 }
 #endif
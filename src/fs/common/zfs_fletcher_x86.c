@@ -0,0 +1,391 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * SSE2, AVX2 and AVX-512 Fletcher kernels.
+ *
+ * Each kernel widens the input words into 64-bit lanes and keeps separate
+ * accumulators per lane, as described in zfs_fletcher.c, so the dependency
+ * chain advances by a full vector of input per step.  The kernels are
+ * compiled with per-function target attributes and are only selected by
+ * fletcher_init() when the CPU reports support for them.
+ */
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+#include <sys/types.h>
+#include <sys/spa.h>
+#include <zfs_fletcher.h>
+#include <immintrin.h>
+
+#define	FLETCHER_AVX2	__attribute__((target("avx2")))
+#define	FLETCHER_AVX512	__attribute__((target("avx2,avx512f")))
+#define	FLETCHER_INLINE	inline __attribute__((always_inline))
+
+static FLETCHER_INLINE __m128i
+fletcher_sse2_bswap32(__m128i v)
+{
+	v = _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16));
+	return (_mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+}
+
+static FLETCHER_INLINE __m128i
+fletcher_sse2_bswap64(__m128i v)
+{
+	return (fletcher_sse2_bswap32(_mm_shuffle_epi32(v,
+	    _MM_SHUFFLE(2, 3, 0, 1))));
+}
+
+static boolean_t
+fletcher_sse2_valid(void)
+{
+	return (B_TRUE);	/* part of the x86-64 baseline */
+}
+
+static FLETCHER_INLINE void
+fletcher_2_sse2(const void *buf, uint64_t size, boolean_t bswap,
+    zio_cksum_t *zcp)
+{
+	const __m128i *ip = buf;
+	const __m128i *ipend = ip + (size / sizeof (__m128i));
+	__m128i a = _mm_setzero_si128();
+	__m128i b = _mm_setzero_si128();
+	uint64_t la[2], lb[2];
+
+	for (; ip < ipend; ip++) {
+		__m128i v = _mm_loadu_si128(ip);
+
+		if (bswap)
+			v = fletcher_sse2_bswap64(v);
+		a = _mm_add_epi64(a, v);
+		b = _mm_add_epi64(b, a);
+	}
+
+	_mm_storeu_si128((__m128i *)la, a);
+	_mm_storeu_si128((__m128i *)lb, b);
+	fletcher_2_lanes_fini(la, lb, 2, zcp);
+}
+
+static void
+fletcher_2_sse2_native(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	fletcher_2_sse2(buf, size, B_FALSE, zcp);
+}
+
+static void
+fletcher_2_sse2_byteswap(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	fletcher_2_sse2(buf, size, B_TRUE, zcp);
+}
+
+const fletcher_ops_t fletcher_2_sse2_ops = {
+	.fo_name = "sse2",
+	.fo_blocksize = sizeof (__m128i),
+	.fo_valid = fletcher_sse2_valid,
+	.fo_native = fletcher_2_sse2_native,
+	.fo_byteswap = fletcher_2_sse2_byteswap,
+};
+
+static FLETCHER_INLINE void
+fletcher_4_sse2(const void *buf, uint64_t size, boolean_t bswap,
+    zio_cksum_t *zcp)
+{
+	const __m128i *ip = buf;
+	const __m128i *ipend = ip + (size / sizeof (__m128i));
+	const __m128i zero = _mm_setzero_si128();
+	__m128i a01 = zero, b01 = zero, c01 = zero, d01 = zero;
+	__m128i a23 = zero, b23 = zero, c23 = zero, d23 = zero;
+	uint64_t la[4], lb[4], lc[4], ld[4];
+
+	for (; ip < ipend; ip++) {
+		__m128i v = _mm_loadu_si128(ip);
+
+		if (bswap)
+			v = fletcher_sse2_bswap32(v);
+		a01 = _mm_add_epi64(a01, _mm_unpacklo_epi32(v, zero));
+		a23 = _mm_add_epi64(a23, _mm_unpackhi_epi32(v, zero));
+		b01 = _mm_add_epi64(b01, a01);
+		b23 = _mm_add_epi64(b23, a23);
+		c01 = _mm_add_epi64(c01, b01);
+		c23 = _mm_add_epi64(c23, b23);
+		d01 = _mm_add_epi64(d01, c01);
+		d23 = _mm_add_epi64(d23, c23);
+	}
+
+	_mm_storeu_si128((__m128i *)&la[0], a01);
+	_mm_storeu_si128((__m128i *)&la[2], a23);
+	_mm_storeu_si128((__m128i *)&lb[0], b01);
+	_mm_storeu_si128((__m128i *)&lb[2], b23);
+	_mm_storeu_si128((__m128i *)&lc[0], c01);
+	_mm_storeu_si128((__m128i *)&lc[2], c23);
+	_mm_storeu_si128((__m128i *)&ld[0], d01);
+	_mm_storeu_si128((__m128i *)&ld[2], d23);
+	fletcher_4_lanes_fini(la, lb, lc, ld, 4, zcp);
+}
+
+static void
+fletcher_4_sse2_native(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	fletcher_4_sse2(buf, size, B_FALSE, zcp);
+}
+
+static void
+fletcher_4_sse2_byteswap(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	fletcher_4_sse2(buf, size, B_TRUE, zcp);
+}
+
+const fletcher_ops_t fletcher_4_sse2_ops = {
+	.fo_name = "sse2",
+	.fo_blocksize = sizeof (__m128i),
+	.fo_valid = fletcher_sse2_valid,
+	.fo_native = fletcher_4_sse2_native,
+	.fo_byteswap = fletcher_4_sse2_byteswap,
+};
+
+static boolean_t
+fletcher_avx2_valid(void)
+{
+	__builtin_cpu_init();
+	return (__builtin_cpu_supports("avx2") ? B_TRUE : B_FALSE);
+}
+
+static FLETCHER_AVX2 FLETCHER_INLINE void
+fletcher_2_avx2(const void *buf, uint64_t size, boolean_t bswap,
+    zio_cksum_t *zcp)
+{
+	const __m256i *ip = buf;
+	const __m256i *ipend = ip + (size / sizeof (__m256i));
+	const __m256i mask = _mm256_setr_epi8(
+	    7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+	    7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+	__m256i a = _mm256_setzero_si256();
+	__m256i b = _mm256_setzero_si256();
+	uint64_t la[4], lb[4];
+
+	for (; ip < ipend; ip++) {
+		__m256i v = _mm256_loadu_si256(ip);
+
+		if (bswap)
+			v = _mm256_shuffle_epi8(v, mask);
+		a = _mm256_add_epi64(a, v);
+		b = _mm256_add_epi64(b, a);
+	}
+
+	_mm256_storeu_si256((__m256i *)la, a);
+	_mm256_storeu_si256((__m256i *)lb, b);
+	fletcher_2_lanes_fini(la, lb, 4, zcp);
+}
+
+static FLETCHER_AVX2 void
+fletcher_2_avx2_native(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	fletcher_2_avx2(buf, size, B_FALSE, zcp);
+}
+
+static FLETCHER_AVX2 void
+fletcher_2_avx2_byteswap(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	fletcher_2_avx2(buf, size, B_TRUE, zcp);
+}
+
+const fletcher_ops_t fletcher_2_avx2_ops = {
+	.fo_name = "avx2",
+	.fo_blocksize = sizeof (__m256i),
+	.fo_valid = fletcher_avx2_valid,
+	.fo_native = fletcher_2_avx2_native,
+	.fo_byteswap = fletcher_2_avx2_byteswap,
+};
+
+static FLETCHER_AVX2 FLETCHER_INLINE void
+fletcher_4_avx2(const void *buf, uint64_t size, boolean_t bswap,
+    zio_cksum_t *zcp)
+{
+	const __m128i *ip = buf;
+	const __m128i *ipend = ip + (size / sizeof (__m128i));
+	const __m128i mask = _mm_setr_epi8(
+	    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	__m256i a = _mm256_setzero_si256();
+	__m256i b = _mm256_setzero_si256();
+	__m256i c = _mm256_setzero_si256();
+	__m256i d = _mm256_setzero_si256();
+	uint64_t la[4], lb[4], lc[4], ld[4];
+
+	for (; ip < ipend; ip++) {
+		__m128i v = _mm_loadu_si128(ip);
+
+		if (bswap)
+			v = _mm_shuffle_epi8(v, mask);
+		a = _mm256_add_epi64(a, _mm256_cvtepu32_epi64(v));
+		b = _mm256_add_epi64(b, a);
+		c = _mm256_add_epi64(c, b);
+		d = _mm256_add_epi64(d, c);
+	}
+
+	_mm256_storeu_si256((__m256i *)la, a);
+	_mm256_storeu_si256((__m256i *)lb, b);
+	_mm256_storeu_si256((__m256i *)lc, c);
+	_mm256_storeu_si256((__m256i *)ld, d);
+	fletcher_4_lanes_fini(la, lb, lc, ld, 4, zcp);
+}
+
+static FLETCHER_AVX2 void
+fletcher_4_avx2_native(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	fletcher_4_avx2(buf, size, B_FALSE, zcp);
+}
+
+static FLETCHER_AVX2 void
+fletcher_4_avx2_byteswap(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	fletcher_4_avx2(buf, size, B_TRUE, zcp);
+}
+
+const fletcher_ops_t fletcher_4_avx2_ops = {
+	.fo_name = "avx2",
+	.fo_blocksize = sizeof (__m128i),
+	.fo_valid = fletcher_avx2_valid,
+	.fo_native = fletcher_4_avx2_native,
+	.fo_byteswap = fletcher_4_avx2_byteswap,
+};
+
+static boolean_t
+fletcher_avx512_valid(void)
+{
+	__builtin_cpu_init();
+	return (__builtin_cpu_supports("avx512f") &&
+	    __builtin_cpu_supports("avx2") ? B_TRUE : B_FALSE);
+}
+
+/*
+ * AVX-512F has no byte shuffle, so swap 64-bit words with rotates and
+ * shifts: halves, then 16-bit quarters, then the bytes within those.
+ */
+static FLETCHER_AVX512 FLETCHER_INLINE __m512i
+fletcher_avx512_bswap64(__m512i v)
+{
+	const __m512i mask = _mm512_set1_epi32(0x00ff00ff);
+
+	v = _mm512_ror_epi64(v, 32);
+	v = _mm512_ror_epi32(v, 16);
+	return (_mm512_or_si512(
+	    _mm512_slli_epi32(_mm512_and_si512(v, mask), 8),
+	    _mm512_and_si512(_mm512_srli_epi32(v, 8), mask)));
+}
+
+static FLETCHER_AVX512 FLETCHER_INLINE void
+fletcher_2_avx512(const void *buf, uint64_t size, boolean_t bswap,
+    zio_cksum_t *zcp)
+{
+	const __m512i *ip = buf;
+	const __m512i *ipend = ip + (size / sizeof (__m512i));
+	__m512i a = _mm512_setzero_si512();
+	__m512i b = _mm512_setzero_si512();
+	uint64_t la[8], lb[8];
+
+	for (; ip < ipend; ip++) {
+		__m512i v = _mm512_loadu_si512(ip);
+
+		if (bswap)
+			v = fletcher_avx512_bswap64(v);
+		a = _mm512_add_epi64(a, v);
+		b = _mm512_add_epi64(b, a);
+	}
+
+	_mm512_storeu_si512(la, a);
+	_mm512_storeu_si512(lb, b);
+	fletcher_2_lanes_fini(la, lb, 8, zcp);
+}
+
+static FLETCHER_AVX512 void
+fletcher_2_avx512_native(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	fletcher_2_avx512(buf, size, B_FALSE, zcp);
+}
+
+static FLETCHER_AVX512 void
+fletcher_2_avx512_byteswap(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	fletcher_2_avx512(buf, size, B_TRUE, zcp);
+}
+
+const fletcher_ops_t fletcher_2_avx512_ops = {
+	.fo_name = "avx512",
+	.fo_blocksize = sizeof (__m512i),
+	.fo_valid = fletcher_avx512_valid,
+	.fo_native = fletcher_2_avx512_native,
+	.fo_byteswap = fletcher_2_avx512_byteswap,
+};
+
+static FLETCHER_AVX512 FLETCHER_INLINE void
+fletcher_4_avx512(const void *buf, uint64_t size, boolean_t bswap,
+    zio_cksum_t *zcp)
+{
+	const __m256i *ip = buf;
+	const __m256i *ipend = ip + (size / sizeof (__m256i));
+	const __m256i mask = _mm256_setr_epi8(
+	    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+	    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	__m512i a = _mm512_setzero_si512();
+	__m512i b = _mm512_setzero_si512();
+	__m512i c = _mm512_setzero_si512();
+	__m512i d = _mm512_setzero_si512();
+	uint64_t la[8], lb[8], lc[8], ld[8];
+
+	for (; ip < ipend; ip++) {
+		__m256i v = _mm256_loadu_si256(ip);
+
+		if (bswap)
+			v = _mm256_shuffle_epi8(v, mask);
+		a = _mm512_add_epi64(a, _mm512_cvtepu32_epi64(v));
+		b = _mm512_add_epi64(b, a);
+		c = _mm512_add_epi64(c, b);
+		d = _mm512_add_epi64(d, c);
+	}
+
+	_mm512_storeu_si512(la, a);
+	_mm512_storeu_si512(lb, b);
+	_mm512_storeu_si512(lc, c);
+	_mm512_storeu_si512(ld, d);
+	fletcher_4_lanes_fini(la, lb, lc, ld, 8, zcp);
+}
+
+static FLETCHER_AVX512 void
+fletcher_4_avx512_native(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	fletcher_4_avx512(buf, size, B_FALSE, zcp);
+}
+
+static FLETCHER_AVX512 void
+fletcher_4_avx512_byteswap(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	fletcher_4_avx512(buf, size, B_TRUE, zcp);
+}
+
+const fletcher_ops_t fletcher_4_avx512_ops = {
+	.fo_name = "avx512",
+	.fo_blocksize = sizeof (__m256i),
+	.fo_valid = fletcher_avx512_valid,
+	.fo_native = fletcher_4_avx512_native,
+	.fo_byteswap = fletcher_4_avx512_byteswap,
+};
+
+#endif	/* __x86_64__ && __GNUC__ */
@@ -42,6 +42,21 @@
 static char *dprintf_string;
 static int dprintf_print_all;
 
+/*
+ * Output decorations requested in the debug string, parsed once by
+ * dprintf_setup() so that __dprintf() never has to rescan the string.
+ */
+#define	DPRINTF_OPT_PID		(1 << 0)
+#define	DPRINTF_OPT_TID		(1 << 1)
+#define	DPRINTF_OPT_CPU		(1 << 2)
+#define	DPRINTF_OPT_TIME	(1 << 3)
+#define	DPRINTF_OPT_LONG	(1 << 4)
+
+static uint_t dprintf_options;
+
+/* Large enough for any single dprintf line; longer lines are truncated. */
+#define	DPRINTF_BUFSZ		1024
+
 static pthread_once_t dprintf_once = PTHREAD_ONCE_INIT;
 
 static int
@@ -102,6 +117,17 @@ dprintf_setup(int *argc, char **argv)
 	if (dprintf_find_string("on"))
 		dprintf_print_all = 1;
 
+	if (dprintf_find_string("pid"))
+		dprintf_options |= DPRINTF_OPT_PID;
+	if (dprintf_find_string("tid"))
+		dprintf_options |= DPRINTF_OPT_TID;
+	if (dprintf_find_string("cpu"))
+		dprintf_options |= DPRINTF_OPT_CPU;
+	if (dprintf_find_string("time"))
+		dprintf_options |= DPRINTF_OPT_TIME;
+	if (dprintf_find_string("long"))
+		dprintf_options |= DPRINTF_OPT_LONG;
+
 	if (dprintf_string != NULL)
 		zfs_flags |= ZFS_DEBUG_DPRINTF;
 }
@@ -115,50 +141,92 @@ dprintf_setup_once(void)
 	dprintf_setup(&argc, argv);
 }
 
+/*
+ * Get rid of annoying "../common/" prefix to filename.
+ */
+static const char *
+dprintf_basename(const char *file)
+{
+	const char *newfile;
+
+	newfile = strrchr(file, '/');
+	if (newfile != NULL) {
+		newfile = newfile + 1; /* Get rid of leading / */
+	} else {
+		newfile = file;
+	}
+
+	return (newfile);
+}
+
 /*
  * =========================================================================
  * debug printfs
  * =========================================================================
  */
+
+/*
+ * Decide whether a dprintf() call site is enabled. This is called once per
+ * call site (see the dprintf() macro), which caches the result.
+ */
+int
+__dprintf_site_init(const char *file, const char *func)
+{
+	// To avoid having to initialize this from argv in every caller, just
+	// implicitly support the ZFS_DEBUG environment variable.
+	pthread_once(&dprintf_once, dprintf_setup_once);
+
+	if (dprintf_print_all ||
+	    dprintf_find_string(dprintf_basename(file)) ||
+	    dprintf_find_string(func))
+		return (1);
+
+	return (-1);
+}
+
 void
 __dprintf(const char *file, const char *func, int line, const char *fmt, ...)
 {
-	const char *newfile;
+	char buf[DPRINTF_BUFSZ];
+	size_t len = 0;
 	va_list adx;
 
-	// To avoid having to initialize this from argv in every caller, just
-	// implicitly support the ZFS_DEBUG environment variable.
 	pthread_once(&dprintf_once, dprintf_setup_once);
 
 	/*
-	 * Get rid of annoying "../common/" prefix to filename.
+	 * Format the whole line privately and emit it with a single fwrite so
+	 * that concurrent debug output does not interleave, and the stdout
+	 * lock is held only for one copy rather than for the whole format.
+	 * Going through stdio keeps ordering with other buffered stdout output.
 	 */
-	newfile = strrchr(file, '/');
-	if (newfile != NULL) {
-		newfile = newfile + 1; /* Get rid of leading / */
-	} else {
-		newfile = file;
-	}
-
-	if (dprintf_print_all ||
-	    dprintf_find_string(newfile) ||
-	    dprintf_find_string(func)) {
-		/* Print out just the function name if requested */
-		flockfile(stdout);
-		if (dprintf_find_string("pid"))
-			(void) printf("%d ", getpid());
-		if (dprintf_find_string("tid"))
-			(void) printf("%lu ", pthread_self());
-		if (dprintf_find_string("cpu"))
-			(void) printf("%u ", getcpuid());
-		if (dprintf_find_string("time"))
-			(void) printf("%lu ", gethrtime());
-		if (dprintf_find_string("long"))
-			(void) printf("%s, line %d: ", newfile, line);
-		(void) printf("%s: ", func);
+#define	DPRINTF_APPEND(...) \
+	if (len < sizeof (buf)) \
+		len += snprintf(buf + len, sizeof (buf) - len, __VA_ARGS__)
+
+	if (dprintf_options & DPRINTF_OPT_PID)
+		DPRINTF_APPEND("%d ", getpid());
+	if (dprintf_options & DPRINTF_OPT_TID)
+		DPRINTF_APPEND("%lu ", pthread_self());
+	if (dprintf_options & DPRINTF_OPT_CPU)
+		DPRINTF_APPEND("%u ", getcpuid());
+	if (dprintf_options & DPRINTF_OPT_TIME)
+		DPRINTF_APPEND("%lu ", gethrtime());
+	if (dprintf_options & DPRINTF_OPT_LONG)
+		DPRINTF_APPEND("%s, line %d: ", dprintf_basename(file), line);
+	DPRINTF_APPEND("%s: ", func);
+
+#undef DPRINTF_APPEND
+
+	if (len < sizeof (buf)) {
 		va_start(adx, fmt);
-		(void) vprintf(fmt, adx);
+		len += vsnprintf(buf + len, sizeof (buf) - len, fmt, adx);
 		va_end(adx);
-		funlockfile(stdout);
 	}
+
+	if (len >= sizeof (buf)) {
+		len = sizeof (buf) - 1;
+		buf[len - 1] = '\n';
+	}
+
+	(void) fwrite(buf, 1, len, stdout);
 }
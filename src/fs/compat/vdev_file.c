@@ -30,13 +30,47 @@
 #include <sys/zio.h>
 #include <sys/fs/zfs.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <inttypes.h>
+
+#include "vdev_file_impl.h"
 
 extern int vdev_disk_physio(vdev_t *,
     caddr_t, size_t, uint64_t, int, boolean_t);
 
-typedef struct vdev_file {
-        int             vf_fd;
-} vdev_file_t;
+// The SPL's <sys/sysmacros.h> hides glibc's, which declares these behind the
+// major() and minor() macros.
+extern unsigned int gnu_dev_major(dev_t);
+extern unsigned int gnu_dev_minor(dev_t);
+
+// How reads and writes are issued to newly opened vdevs. If io_uring is
+// unavailable the vdev falls back to libaio, and if that is unavailable too
+// (or the vdev is not O_DIRECT), to the taskq backend.
+int vdev_file_io_backend = VDEV_FILE_BACKEND_URING;
+
+// Number of vdevs that have been opened with each I/O backend, indexed by
+// vdev_file_backend_t, to tell which backends fell back to which.
+uint64_t vdev_file_backend_opens[VDEV_FILE_BACKENDS];
+
+// Number of submission queue entries in each vdev's io_uring, which bounds
+// the number of I/Os a vdev can have in flight.
+uint_t vdev_file_ring_entries = 256;
+
+// Number of I/Os a vdev can have in flight with the libaio backend.
+uint_t vdev_file_aio_entries = 256;
+
+// Number of threads issuing blocking I/O for each vdev with the taskq
+// backend. Every vdev has its own threads, so a slow or hung device cannot
+// hold up I/O to any other.
+uint_t vdev_file_taskq_threads = 32;
+
+// Open vdevs with O_SYNC, so that every write reaches stable storage before
+// it completes. By default, writes may sit in the device's volatile cache
+// until ZFS flushes it (DKIOCFLUSHWRITECACHE), which it does whenever it
+// needs earlier writes to be stable. ZIL writes are still issued with
+// RWF_DSYNC.
+int vdev_file_osync = 0;
 
 /*
  * Virtual device vector for files.
@@ -49,6 +83,7 @@ vdev_file_alloc(void)
 
 	vf = kmem_zalloc(sizeof (vdev_file_t), KM_SLEEP);
         vf->vf_fd = -1;
+        vf->vf_backend = VDEV_FILE_BACKEND_TASKQ;
 
         return vf;
 }
@@ -60,8 +95,10 @@ vdev_file_openat(vdev_file_t *vf, const char *path, int spa_mode)
 
         VERIFY3(vf->vf_fd, ==, -1);
 
-        // Do synchronous IO to provide the guarantees the upper layers want.
-        flags |= O_SYNC;
+        // Do synchronous IO if asked to. Otherwise we rely on cache flushes.
+        if (vdev_file_osync) {
+                flags |= O_SYNC;
+        }
 
         // Try to minimize kernel IO bufferring.
         flags |= O_DIRECT;
@@ -85,6 +122,165 @@ vdev_file_openat(vdev_file_t *vf, const char *path, int spa_mode)
         return vf->vf_fd == -1 ? errno : ESUCCESS;
 }
 
+// Read an attribute of the request queue of the block device that backs the
+// vdev. That is the vdev itself for a disk, or the device holding the file
+// system for a file. Partitions don't have a queue of their own, so look at
+// the parent device's. Returns B_FALSE if there is no such device (e.g. on
+// tmpfs) or the attribute can't be read.
+static boolean_t
+vdev_file_queue_attr(const struct stat *st, const char *attr, uint64_t *val)
+{
+        dev_t dev = S_ISBLK(st->st_mode) ? st->st_rdev : st->st_dev;
+        const char *dirs[] = { "queue", "../queue" };
+        char path[MAXPATHLEN];
+        FILE *fp;
+        int n;
+
+        for (int i = 0; i < 2; i++) {
+                (void) snprintf(path, sizeof(path),
+                    "/sys/dev/block/%u:%u/%s/%s", gnu_dev_major(dev),
+                    gnu_dev_minor(dev), dirs[i], attr);
+
+                if ((fp = fopen(path, "r")) == NULL) {
+                        continue;
+                }
+
+                n = fscanf(fp, "%" SCNu64, val);
+                fclose(fp);
+
+                if (n == 1) {
+                        return B_TRUE;
+                }
+        }
+
+        return B_FALSE;
+}
+
+// Look up the logical and physical sector sizes of the device. For a file,
+// these are the sector sizes of the device holding the file system. Sizes
+// that can't be determined are returned as 0.
+static void
+vdev_file_sector_size(vdev_file_t *vf, const struct stat *st,
+    uint64_t *logical, uint64_t *physical)
+{
+        *logical = 0;
+        *physical = 0;
+
+        if (S_ISBLK(st->st_mode)) {
+                int ssz;
+                unsigned int pbsz;
+
+                if (ioctl(vf->vf_fd, BLKSSZGET, &ssz) == 0) {
+                        *logical = ssz;
+                }
+
+                if (ioctl(vf->vf_fd, BLKPBSZGET, &pbsz) == 0) {
+                        *physical = pbsz;
+                }
+        } else {
+                (void) vdev_file_queue_attr(st, "logical_block_size",
+                    logical);
+                (void) vdev_file_queue_attr(st, "physical_block_size",
+                    physical);
+        }
+}
+
+// Return the ashift of the smallest write the device can do without a
+// read-modify-write cycle, i.e. its physical sector size.
+static uint64_t
+vdev_file_ashift(uint64_t logical, uint64_t physical)
+{
+        uint64_t size;
+
+        // O_DIRECT needs at least logical sector alignment; the physical
+        // sector is what avoids read-modify-write.
+        size = MAX(logical, physical);
+        if (size == 0 || !ISP2(size) || size > SPA_OLD_MAXBLOCKSIZE) {
+                return SPA_MINBLOCKSHIFT;
+        }
+
+        return MAX(highbit64(size) - 1, SPA_MINBLOCKSHIFT);
+}
+
+// Whether the vdev is backed by solid state storage. Files that don't live on
+// a block device at all (e.g. on tmpfs) count as non-rotational.
+static boolean_t
+vdev_file_nonrot(const struct stat *st)
+{
+        uint64_t rotational;
+
+        if (vdev_file_queue_attr(st, "rotational", &rotational)) {
+                return rotational == 0;
+        }
+
+        return S_ISREG(st->st_mode);
+}
+
+// Whether the vdev's writes are stable as soon as they complete, so that cache
+// flushes can be skipped. That is the case if the vdev was opened O_SYNC, or
+// if it is a block device doing direct I/O without a volatile write cache. A
+// file always needs flushing, if only for its file system's metadata.
+static boolean_t
+vdev_file_write_through(vdev_file_t *vf, const struct stat *st)
+{
+        char path[MAXPATHLEN];
+        char mode[32];
+        int flags = fcntl(vf->vf_fd, F_GETFL);
+        boolean_t through = B_FALSE;
+        FILE *fp;
+
+        if (flags & O_SYNC) {
+                return B_TRUE;
+        }
+
+        if (!S_ISBLK(st->st_mode) || !(flags & O_DIRECT)) {
+                return B_FALSE;
+        }
+
+        (void) snprintf(path, sizeof(path),
+            "/sys/dev/block/%u:%u/queue/write_cache",
+            gnu_dev_major(st->st_rdev), gnu_dev_minor(st->st_rdev));
+
+        if ((fp = fopen(path, "r")) != NULL) {
+                through = fgets(mode, sizeof(mode), fp) != NULL &&
+                    strncmp(mode, "write through", 13) == 0;
+                fclose(fp);
+        }
+
+        return through;
+}
+
+// Return whether the device can discard. Files are assumed to support hole
+// punching until a trim fails.
+static boolean_t
+vdev_file_discard_supported(const struct stat *st)
+{
+        uint64_t max_bytes;
+
+        if (S_ISBLK(st->st_mode) &&
+            vdev_file_queue_attr(st, "discard_max_bytes", &max_bytes)) {
+                return max_bytes != 0;
+        }
+
+        return B_TRUE;
+}
+
+// Number of I/Os worth keeping in flight to the vdev. Deeper rings than the
+// block device's request queue would only queue in the kernel.
+static uint_t
+vdev_file_queue_depth(vdev_file_t *vf, uint_t entries)
+{
+        struct stat st;
+        uint64_t depth;
+
+        if (fstat(vf->vf_fd, &st) == 0 &&
+            vdev_file_queue_attr(&st, "nr_requests", &depth) && depth > 0) {
+                return MIN(entries, depth);
+        }
+
+        return entries;
+}
+
 static void
 vdev_file_hold(vdev_t *vd)
 {
@@ -103,6 +299,8 @@ vdev_file_open(vdev_t *vd, uint64_t *psize, uint64_t *max_psize,
 {
 	vdev_file_t *vf;
 	struct stat vattr;
+        uint64_t logical, physical;
+        uint_t depth = 0, nthreads;
 	int error;
 
 	/*
@@ -138,6 +336,55 @@ vdev_file_open(vdev_t *vd, uint64_t *psize, uint64_t *max_psize,
 		return (error);
 	}
 
+        switch (vdev_file_io_backend) {
+        case VDEV_FILE_BACKEND_URING:
+                depth = vdev_file_queue_depth(vf, vdev_file_ring_entries);
+                error = vdev_file_ring_create(vf, depth);
+                if (error == 0) {
+                        vf->vf_backend = VDEV_FILE_BACKEND_URING;
+                        break;
+                }
+
+                zfs_dbgmsg("vdev %s: io_uring unavailable (error %d)",
+                    vd->vdev_path, error);
+                /* FALLTHROUGH */
+        case VDEV_FILE_BACKEND_AIO:
+                depth = vdev_file_queue_depth(vf, vdev_file_aio_entries);
+                error = vdev_file_aio_create(vf, depth);
+                if (error == 0) {
+                        vf->vf_backend = VDEV_FILE_BACKEND_AIO;
+                        break;
+                }
+
+                zfs_dbgmsg("vdev %s: libaio unavailable (error %d), "
+                    "using taskq I/O", vd->vdev_path, error);
+                break;
+        default:
+                break;
+        }
+
+        atomic_inc_64(&vdev_file_backend_opens[vf->vf_backend]);
+
+        // The taskq backend issues I/O from the vdev's own threads. The
+        // other backends trim (and libaio flushes) from a thread of their
+        // own.
+        nthreads = 1;
+        if (vf->vf_backend == VDEV_FILE_BACKEND_TASKQ) {
+                depth = vdev_file_queue_depth(vf, vdev_file_taskq_threads);
+                nthreads = depth;
+        }
+
+        vf->vf_taskq = taskq_create("vdev_file_taskq", nthreads, minclsyspri,
+            nthreads, INT_MAX, TASKQ_PREPOPULATE);
+
+        // Hold I/Os the backend cannot start right away in the vdev queue,
+        // where they can still be sorted and aggregated, rather than blocking
+        // the zio taskq thread that issues them.
+        vdev_queue_set_max_active(vd, depth);
+
+        // Every backend can issue vdev_queue's vectored aggregates.
+        vd->vdev_iovec = B_TRUE;
+
 skip_open:
 	/*
 	 * Determine the physical size of the file.
@@ -152,18 +399,42 @@ skip_open:
 		return (error);
 	}
 
-	/*
-	 * Make sure it's a regular file.
-	 */
-	if (!S_ISREG(vattr.st_mode)) {
-		vd->vdev_stat.vs_aux = VDEV_AUX_OPEN_FAILED;
-		return (SET_ERROR(ENODEV));
-	}
+        // Make sure it's a regular file or a block device.
+        switch (vattr.st_mode & S_IFMT) {
+        case S_IFREG:
+                *psize = vattr.st_size;
+                break;
+        case S_IFBLK:
+                if (ioctl(vf->vf_fd, BLKGETSIZE64, psize) == -1) {
+                        vd->vdev_stat.vs_aux = VDEV_AUX_OPEN_FAILED;
+                        return (errno);
+                }
+                break;
+        default:
+                vd->vdev_stat.vs_aux = VDEV_AUX_OPEN_FAILED;
+                return (SET_ERROR(ENODEV));
+        }
+
+        vdev_file_sector_size(vf, &vattr, &logical, &physical);
 
-        /* TODO: Add disk geometry support for block devices. */
+        *max_psize = *psize;
+        *ashift = vdev_file_ashift(logical, physical);
+        vd->vdev_nonrot = vdev_file_nonrot(&vattr);
 
-	*max_psize = *psize = vattr.st_size;
-	*ashift = SPA_MINBLOCKSHIFT;
+        // As in vdev_disk_open(), clear the nowritecache bit so that flushes
+        // are retried on reopen, unless the device needs no flushing at all.
+        vd->vdev_nowritecache = vdev_file_write_through(vf, &vattr);
+
+        // Likewise, retry trims on reopen unless the device cannot discard.
+        vd->vdev_notrim = !vdev_file_discard_supported(&vattr);
+
+        // Direct I/O buffers, offsets and lengths must be aligned to the
+        // logical sector size.
+        vf->vf_dio_align = 0;
+        if (fcntl(vf->vf_fd, F_GETFL) & O_DIRECT) {
+                vf->vf_dio_align = ISP2(logical) ?
+                    MAX(logical, SPA_MINBLOCKSIZE) : SPA_MINBLOCKSIZE;
+        }
 
 	return (0);
 }
@@ -176,42 +447,157 @@ vdev_file_close(vdev_t *vd)
 	if (vd->vdev_reopening || vf == NULL)
 		return;
 
+        vdev_file_ring_destroy(vf);
+        vdev_file_aio_destroy(vf);
+
+        if (vf->vf_taskq != NULL) {
+                taskq_destroy(vf->vf_taskq);
+        }
+
         if (vf->vf_fd != -1) {
                 fsync(vf->vf_fd);
                 close(vf->vf_fd);
         }
 
 	vd->vdev_delayed_close = B_FALSE;
+        vd->vdev_iovec = B_FALSE;
+        vdev_queue_set_max_active(vd, 0);
 	kmem_free(vf, sizeof (vdev_file_t));
 	vd->vdev_tsd = NULL;
 }
 
+// Return the RWF_* flags to write with. Writes someone is waiting on, such
+// as ZIL blocks, are issued at sync priority and are made stable before they
+// complete.
+int
+vdev_file_io_rwflags(zio_t *zio)
+{
+        if (zio->io_type == ZIO_TYPE_WRITE &&
+            zio->io_priority == ZIO_PRIORITY_SYNC_WRITE) {
+                return RWF_DSYNC;
+        }
+
+        return 0;
+}
+
+// Finish a read, write or flush. nbytes is the number of bytes transferred,
+// or a negated errno.
+void
+vdev_file_io_complete(zio_t *zio, ssize_t nbytes)
+{
+        if (nbytes < 0) {
+                zio->io_error = SET_ERROR(-nbytes);
+        } else if (nbytes != zio->io_size) {
+                zio->io_error = SET_ERROR(EIO);
+        }
+
+        zio_delay_interrupt(zio);
+}
+
+// Discard a range of the vdev, returning the number of bytes discarded or -1
+// with errno set.
+static ssize_t
+vdev_file_discard(vdev_file_t *vf, uint64_t offset, uint64_t size)
+{
+        struct stat st;
+
+        if (fstat(vf->vf_fd, &st) == -1) {
+                return -1;
+        }
+
+        if (S_ISBLK(st.st_mode)) {
+                uint64_t range[2] = { offset, size };
+
+                if (ioctl(vf->vf_fd, BLKDISCARD, range) == -1) {
+                        return -1;
+                }
+        } else if (fallocate(vf->vf_fd,
+            FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, size) == -1) {
+                return -1;
+        }
+
+        return size;
+}
+
 static void
 vdev_file_io_strategy(void *arg)
 {
         zio_t *zio = arg;
 	vdev_t *vd = zio->io_vd;
 	vdev_file_t *vf = vd->vdev_tsd;
+        iovec_t iov = { zio->io_data, zio->io_size };
+        iovec_t *iovp = &iov;
+        int iovcnt = 1;
 	ssize_t resid;
 
+        if (zio->io_iov != NULL) {
+                iovp = zio->io_iov;
+                iovcnt = zio->io_iovcnt;
+        }
+
 	switch (zio->io_type) {
         case ZIO_TYPE_READ:
-                resid = pread(vf->vf_fd, zio->io_data, zio->io_size, zio->io_offset);
+                resid = preadv2(vf->vf_fd, iovp, iovcnt, zio->io_offset, 0);
                 break;
         case ZIO_TYPE_WRITE:
-                resid = pwrite(vf->vf_fd, zio->io_data, zio->io_size, zio->io_offset);
+                resid = pwritev2(vf->vf_fd, iovp, iovcnt, zio->io_offset,
+                    vdev_file_io_rwflags(zio));
+                break;
+        case ZIO_TYPE_IOCTL:
+                if (zio->io_cmd == DKIOCFREE) {
+                        resid = vdev_file_discard(vf, zio->io_offset,
+                            zio->io_size);
+                        break;
+                }
+
+                ASSERT3U(zio->io_cmd, ==, DKIOCFLUSHWRITECACHE);
+                resid = fdatasync(vf->vf_fd);
                 break;
         default:
                 panic("invalid zio io_type=%d", zio->io_type);
         }
 
-        if (resid == -1) {
-		zio->io_error = SET_ERROR(errno);
-        } else if (resid != zio->io_size) {
-		zio->io_error = SET_ERROR(EIO);
+        vdev_file_io_complete(zio, resid == -1 ? -errno : resid);
+}
+
+// Check that an I/O meets the alignment requirements of direct I/O, rather
+// than letting the kernel fail it with EINVAL.
+static void
+vdev_file_verify_align(vdev_file_t *vf, zio_t *zio)
+{
+        uint64_t align = vf->vf_dio_align;
+
+        if (align == 0) {
+                return;
+        }
+
+        VERIFY0(P2PHASE(zio->io_offset, align));
+        VERIFY0(P2PHASE(zio->io_size, align));
+
+        if (zio->io_iov == NULL) {
+                VERIFY0(P2PHASE((uintptr_t)zio->io_data, align));
+                return;
         }
 
-	zio_delay_interrupt(zio);
+        for (uint_t i = 0; i < zio->io_iovcnt; i++) {
+                VERIFY0(P2PHASE((uintptr_t)zio->io_iov[i].iov_base, align));
+                VERIFY0(P2PHASE(zio->io_iov[i].iov_len, align));
+        }
+}
+
+// Flush the vdev's write cache asynchronously.
+static void
+vdev_file_flush(vdev_file_t *vf, zio_t *zio)
+{
+        switch (vf->vf_backend) {
+        case VDEV_FILE_BACKEND_URING:
+                vdev_file_ring_flush(vf, zio);
+                break;
+        default:
+                VERIFY3U(taskq_dispatch(vf->vf_taskq, vdev_file_io_strategy,
+                    zio, TQ_SLEEP), !=, 0);
+                break;
+        }
 }
 
 static void
@@ -228,11 +614,27 @@ vdev_file_io_start(zio_t *zio)
 			return;
 		}
 
-		if (zio->io_cmd == DKIOCFLUSHWRITECACHE) {
-			zio->io_error = fsync(vf->vf_fd) == -1 ? ESUCCESS : errno;
-                } else {
+		if (zio->io_cmd == DKIOCFREE) {
+                        if (vd->vdev_notrim) {
+                                zio->io_error = SET_ERROR(ENOTSUP);
+                        } else {
+                                // Discards can block, so issue them from the
+                                // vdev's taskq whatever the backend.
+                                VERIFY3U(taskq_dispatch(vf->vf_taskq,
+                                    vdev_file_io_strategy, zio, TQ_SLEEP),
+                                    !=, 0);
+                                return;
+                        }
+		} else if (zio->io_cmd != DKIOCFLUSHWRITECACHE) {
 			zio->io_error = SET_ERROR(ENOTSUP);
-		}
+		} else if (vd->vdev_nowritecache) {
+                        // Writes are already stable. Failing with ENOTSUP
+                        // makes zio_vdev_io_assess() remember that.
+			zio->io_error = SET_ERROR(ENOTSUP);
+                } else if (!zfs_nocacheflush) {
+                        vdev_file_flush(vf, zio);
+                        return;
+                }
 
 		zio_execute(zio);
 		return;
@@ -241,8 +643,66 @@ vdev_file_io_start(zio_t *zio)
 	ASSERT(zio->io_type == ZIO_TYPE_READ || zio->io_type == ZIO_TYPE_WRITE);
 	zio->io_target_timestamp = zio_handle_io_delay(zio);
 
-	VERIFY3U(taskq_dispatch(system_taskq, vdev_file_io_strategy, zio,
-	    TQ_SLEEP), !=, 0);
+        if (zfs_flags & ZFS_DEBUG_IO_ALIGN) {
+                vdev_file_verify_align(vf, zio);
+        }
+
+        switch (vf->vf_backend) {
+        case VDEV_FILE_BACKEND_URING:
+                vdev_file_ring_io_start(vf, zio);
+                break;
+        case VDEV_FILE_BACKEND_AIO:
+                vdev_file_aio_io_start(vf, zio);
+                break;
+        default:
+                VERIFY3U(taskq_dispatch(vf->vf_taskq, vdev_file_io_strategy,
+                    zio, TQ_SLEEP), !=, 0);
+                break;
+        }
+}
+
+// Batch the I/Os that vdev_queue_io_done() is about to issue into a single
+// io_uring or io_submit submission.
+static void
+vdev_file_io_plug(vdev_t *vd)
+{
+        vdev_file_t *vf = vd->vdev_tsd;
+
+        if (vf == NULL) {
+                return;
+        }
+
+        switch (vf->vf_backend) {
+        case VDEV_FILE_BACKEND_URING:
+                vdev_file_ring_plug(vf);
+                break;
+        case VDEV_FILE_BACKEND_AIO:
+                vdev_file_aio_plug(vf);
+                break;
+        default:
+                break;
+        }
+}
+
+static void
+vdev_file_io_unplug(vdev_t *vd)
+{
+        vdev_file_t *vf = vd->vdev_tsd;
+
+        if (vf == NULL) {
+                return;
+        }
+
+        switch (vf->vf_backend) {
+        case VDEV_FILE_BACKEND_URING:
+                vdev_file_ring_unplug(vf);
+                break;
+        case VDEV_FILE_BACKEND_AIO:
+                vdev_file_aio_unplug(vf);
+                break;
+        default:
+                break;
+        }
 }
 
 /* ARGSUSED */
@@ -296,6 +756,8 @@ vdev_ops_t vdev_file_ops = {
 	NULL,
 	vdev_file_hold,
 	vdev_file_rele,
+	vdev_file_io_plug,
+	vdev_file_io_unplug,
 	VDEV_TYPE_FILE,		/* name of this vdev type */
 	B_TRUE			/* leaf vdev */
 };
@@ -313,6 +775,8 @@ vdev_ops_t vdev_disk_ops = {
 	NULL,
 	vdev_file_hold,
 	vdev_file_rele,
+	vdev_file_io_plug,
+	vdev_file_io_unplug,
 	VDEV_TYPE_DISK,		/* name of this vdev type */
 	B_TRUE			/* leaf vdev */
 };
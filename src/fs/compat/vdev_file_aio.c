@@ -0,0 +1,439 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * libaio backend for file and disk vdevs.
+ *
+ * This is the fallback for kernels where io_uring is missing or disabled
+ * by policy.  Each open leaf vdev gets a kernel AIO context and an eventfd.
+ * Reads and writes are queued as iocbs and handed to io_submit(2) in
+ * batches, using the same plugging as the io_uring backend, and every
+ * iocb signals the eventfd when it completes.
+ *
+ * Completions are reaped when the eventfd becomes readable.  Once zfsd has
+ * started libphenom (see vdev_file_aio_nbio_init()), the eventfd is
+ * registered as an NBIO job and reaping runs on the phenom scheduler
+ * threads.  Otherwise, e.g. in the tests, each context gets a thread that
+ * blocks reading the eventfd.
+ *
+ * Linux only performs AIO asynchronously for O_DIRECT descriptors, so
+ * vdevs that had to be opened without O_DIRECT never use this backend.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/vdev_impl.h>
+#include <sys/zio.h>
+#include <sys/eventfd.h>
+#include <libaio.h>
+#include <phenom/defs.h>
+#include <phenom/job.h>
+#include <phenom/memory.h>
+#include <phenom/sysutil.h>
+
+#include "vdev_file_impl.h"
+
+struct vdev_file_aio {
+	io_context_t		va_ctx;
+	int			va_efd;		/* completion eventfd */
+	int			va_fd;		/* vdev descriptor */
+	uint_t			va_entries;	/* max I/Os in flight */
+
+	kmutex_t		va_lock;	/* protects everything below */
+	kcondvar_t		va_cv;		/* signalled as I/Os complete */
+	uint_t			va_plugged;	/* threads batching iocbs */
+	uint_t			va_inflight;	/* iocbs not yet reaped */
+	boolean_t		va_closing;
+
+	struct iocb		*va_iocbs;	/* va_entries iocbs */
+	struct iocb		**va_free;	/* stack of unused iocbs */
+	uint_t			va_nfree;
+	struct iocb		**va_queue;	/* iocbs not yet submitted */
+	uint_t			va_nqueued;
+
+	struct io_event		*va_events;	/* reap buffer */
+	ph_job_t		*va_job;	/* NBIO job, or NULL */
+	kthread_t		*va_reaper;	/* reaper thread, or NULL */
+};
+
+/*
+ * Set once libphenom's NBIO scheduler is available to drive completions.
+ */
+static boolean_t vdev_file_aio_nbio = B_FALSE;
+
+static void vdev_file_aio_job(ph_job_t *job, ph_iomask_t why, void *data);
+static void vdev_file_aio_job_dtor(ph_job_t *job);
+
+static struct ph_job_def vdev_file_aio_job_def = {
+	vdev_file_aio_job,
+	PH_MEMTYPE_INVALID,
+	vdev_file_aio_job_dtor
+};
+
+/*
+ * Called by zfsd once ph_nbio_init() has succeeded.  AIO contexts created
+ * afterwards reap their completions from the phenom scheduler.
+ */
+void
+vdev_file_aio_nbio_init(void)
+{
+	static const ph_memtype_def_t def = {
+		"zfs", "vdev_file_aio_job", sizeof (ph_job_t), PH_MEM_FLAGS_ZERO
+	};
+
+	vdev_file_aio_job_def.memtype = ph_memtype_register(&def);
+	VERIFY(vdev_file_aio_job_def.memtype != PH_MEMTYPE_INVALID);
+	vdev_file_aio_nbio = B_TRUE;
+}
+
+/*
+ * Hand every queued iocb to the kernel.  If the kernel is temporarily out
+ * of resources the iocbs stay queued and are retried by the next submitter
+ * or once completions have been reaped.  va_inflight counts the queued
+ * iocbs too, so it exceeds va_nqueued only while the kernel holds some.
+ */
+static void
+vdev_file_aio_submit(vdev_file_aio_t *va)
+{
+	struct iocb *iocb;
+	int n;
+
+	ASSERT(MUTEX_HELD(&va->va_lock));
+
+	while (va->va_nqueued > 0) {
+		n = io_submit(va->va_ctx, va->va_nqueued, va->va_queue);
+		if (n == -EINTR)
+			continue;
+		if (n == -EAGAIN) {
+			/*
+			 * Reaping a completion retries the submission, but
+			 * with nothing in the kernel no completion is coming,
+			 * so back off and retry here instead.
+			 */
+			if (va->va_inflight > va->va_nqueued)
+				break;
+			(void) cv_timedwait_hires(&va->va_cv, &va->va_lock,
+			    MSEC2NSEC(1), MSEC2NSEC(1), 0);
+			continue;
+		}
+
+		if (n < 0) {
+			/*
+			 * The first iocb was rejected outright; fail its zio
+			 * and carry on with the rest.
+			 */
+			iocb = va->va_queue[0];
+			vdev_file_io_complete(iocb->data, n);
+			va->va_free[va->va_nfree++] = iocb;
+			va->va_inflight--;
+			cv_broadcast(&va->va_cv);
+			n = 1;
+		}
+
+		ASSERT3U(n, <=, va->va_nqueued);
+		va->va_nqueued -= n;
+		bcopy(&va->va_queue[n], &va->va_queue[0],
+		    va->va_nqueued * sizeof (struct iocb *));
+	}
+}
+
+/*
+ * Consume every available completion event.  Called whenever the eventfd
+ * has been signalled.
+ */
+static void
+vdev_file_aio_reap(vdev_file_aio_t *va)
+{
+	struct timespec ts = { 0, 0 };
+	struct io_event *ev;
+	struct iocb *iocb;
+	int n;
+
+	for (;;) {
+		n = io_getevents(va->va_ctx, 0, va->va_entries,
+		    va->va_events, &ts);
+		if (n == -EINTR)
+			continue;
+		if (n < 0)
+			panic("io_getevents failed: %s", strerror(-n));
+		if (n == 0)
+			break;
+
+		for (int i = 0; i < n; i++) {
+			ev = &va->va_events[i];
+			vdev_file_io_complete(ev->data, (long)ev->res);
+		}
+
+		mutex_enter(&va->va_lock);
+		for (int i = 0; i < n; i++) {
+			iocb = va->va_events[i].obj;
+			va->va_free[va->va_nfree++] = iocb;
+		}
+		ASSERT3U(va->va_inflight, >=, n);
+		va->va_inflight -= n;
+		if (va->va_plugged == 0)
+			vdev_file_aio_submit(va);
+		cv_broadcast(&va->va_cv);
+		mutex_exit(&va->va_lock);
+	}
+}
+
+static void
+vdev_file_aio_drain_eventfd(vdev_file_aio_t *va)
+{
+	uint64_t count;
+
+	while (read(va->va_efd, &count, sizeof (count)) == -1 &&
+	    errno == EINTR)
+		continue;
+}
+
+static void
+vdev_file_aio_job(ph_job_t *job, ph_iomask_t why, void *data)
+{
+	vdev_file_aio_t *va = data;
+
+	vdev_file_aio_drain_eventfd(va);
+	vdev_file_aio_reap(va);
+
+	mutex_enter(&va->va_lock);
+	if (!va->va_closing)
+		ph_job_set_nbio(job, PH_IOMASK_READ, NULL);
+	mutex_exit(&va->va_lock);
+}
+
+static void *
+vdev_file_aio_reaper(void *arg)
+{
+	vdev_file_aio_t *va = arg;
+	boolean_t closing = B_FALSE;
+
+	while (!closing) {
+		vdev_file_aio_drain_eventfd(va);
+		vdev_file_aio_reap(va);
+
+		mutex_enter(&va->va_lock);
+		closing = va->va_closing;
+		mutex_exit(&va->va_lock);
+	}
+
+	return (NULL);
+}
+
+static void
+vdev_file_aio_free(vdev_file_aio_t *va)
+{
+	if (va->va_ctx != NULL)
+		(void) io_destroy(va->va_ctx);
+	if (va->va_efd != -1)
+		(void) close(va->va_efd);
+
+	kmem_free(va->va_events, va->va_entries * sizeof (struct io_event));
+	kmem_free(va->va_queue, va->va_entries * sizeof (struct iocb *));
+	kmem_free(va->va_free, va->va_entries * sizeof (struct iocb *));
+	kmem_free(va->va_iocbs, va->va_entries * sizeof (struct iocb));
+	cv_destroy(&va->va_cv);
+	mutex_destroy(&va->va_lock);
+	kmem_free(va, sizeof (vdev_file_aio_t));
+}
+
+/*
+ * The NBIO job owns the context once it is registered, and frees it only
+ * after phenom guarantees that no dispatch of the job is still running.
+ */
+static void
+vdev_file_aio_job_dtor(ph_job_t *job)
+{
+	vdev_file_aio_free(job->data);
+}
+
+int
+vdev_file_aio_create(vdev_file_t *vf, uint_t entries)
+{
+	vdev_file_aio_t *va;
+	int error;
+
+	ASSERT3P(vf->vf_aio, ==, NULL);
+
+	if ((fcntl(vf->vf_fd, F_GETFL) & O_DIRECT) == 0)
+		return (SET_ERROR(ENOTSUP));
+
+	entries = MAX(entries, 1);
+
+	va = kmem_zalloc(sizeof (vdev_file_aio_t), KM_SLEEP);
+	mutex_init(&va->va_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&va->va_cv, NULL, CV_DEFAULT, NULL);
+	va->va_fd = vf->vf_fd;
+	va->va_entries = entries;
+	va->va_iocbs = kmem_zalloc(entries * sizeof (struct iocb), KM_SLEEP);
+	va->va_free = kmem_zalloc(entries * sizeof (struct iocb *), KM_SLEEP);
+	va->va_queue = kmem_zalloc(entries * sizeof (struct iocb *), KM_SLEEP);
+	va->va_events = kmem_zalloc(entries * sizeof (struct io_event),
+	    KM_SLEEP);
+
+	for (uint_t i = 0; i < entries; i++)
+		va->va_free[va->va_nfree++] = &va->va_iocbs[i];
+
+	va->va_efd = eventfd(0, EFD_CLOEXEC |
+	    (vdev_file_aio_nbio ? EFD_NONBLOCK : 0));
+	if (va->va_efd == -1) {
+		error = errno;
+		goto fail;
+	}
+
+	if ((error = io_setup(entries, &va->va_ctx)) != 0) {
+		va->va_ctx = NULL;
+		error = -error;
+		goto fail;
+	}
+
+	if (vdev_file_aio_nbio) {
+		/*
+		 * Phenom requires threads it did not create to register
+		 * themselves before calling into it.
+		 */
+		VERIFY3S(ph_library_init(), ==, PH_OK);
+
+		va->va_job = ph_job_alloc(&vdev_file_aio_job_def);
+		if (va->va_job == NULL) {
+			error = SET_ERROR(ENOMEM);
+			goto fail;
+		}
+
+		va->va_job->fd = va->va_efd;
+		va->va_job->data = va;
+		ph_job_set_nbio(va->va_job, PH_IOMASK_READ, NULL);
+	} else {
+		va->va_reaper = thread_create(NULL, 0, vdev_file_aio_reaper,
+		    va, 0, &p0, TS_RUN, maxclsyspri);
+		if (va->va_reaper == NULL) {
+			error = SET_ERROR(EAGAIN);
+			goto fail;
+		}
+	}
+
+	vf->vf_aio = va;
+	return (0);
+
+fail:
+	vdev_file_aio_free(va);
+	return (error);
+}
+
+void
+vdev_file_aio_destroy(vdev_file_t *vf)
+{
+	vdev_file_aio_t *va = vf->vf_aio;
+	uint64_t one = 1;
+
+	if (va == NULL)
+		return;
+
+	vf->vf_aio = NULL;
+
+	/*
+	 * The vdev is closed only once its I/O has drained, but the reaper
+	 * may still be accounting for the last completions.
+	 */
+	mutex_enter(&va->va_lock);
+	ASSERT0(va->va_plugged);
+	while (va->va_inflight > 0)
+		cv_wait(&va->va_cv, &va->va_lock);
+	va->va_closing = B_TRUE;
+	mutex_exit(&va->va_lock);
+
+	if (va->va_job != NULL) {
+		VERIFY3S(ph_library_init(), ==, PH_OK);
+		ph_job_free(va->va_job);
+		return;
+	}
+
+	VERIFY3S(write(va->va_efd, &one, sizeof (one)), ==, sizeof (one));
+	thread_join(va->va_reaper);
+	vdev_file_aio_free(va);
+}
+
+void
+vdev_file_aio_io_start(vdev_file_t *vf, zio_t *zio)
+{
+	vdev_file_aio_t *va = vf->vf_aio;
+	struct iocb *iocb;
+
+	ASSERT(zio->io_type == ZIO_TYPE_READ || zio->io_type == ZIO_TYPE_WRITE);
+
+	mutex_enter(&va->va_lock);
+
+	while (va->va_nfree == 0) {
+		/*
+		 * Push out anything a plugged thread is holding back, or we
+		 * might wait for completions that were never submitted.
+		 */
+		vdev_file_aio_submit(va);
+		cv_wait(&va->va_cv, &va->va_lock);
+	}
+
+	iocb = va->va_free[--va->va_nfree];
+	if (zio->io_iov != NULL && zio->io_type == ZIO_TYPE_READ) {
+		io_prep_preadv(iocb, va->va_fd, zio->io_iov, zio->io_iovcnt,
+		    zio->io_offset);
+	} else if (zio->io_iov != NULL) {
+		io_prep_pwritev(iocb, va->va_fd, zio->io_iov, zio->io_iovcnt,
+		    zio->io_offset);
+	} else if (zio->io_type == ZIO_TYPE_READ) {
+		io_prep_pread(iocb, va->va_fd, zio->io_data, zio->io_size,
+		    zio->io_offset);
+	} else {
+		io_prep_pwrite(iocb, va->va_fd, zio->io_data, zio->io_size,
+		    zio->io_offset);
+	}
+	iocb->aio_rw_flags = vdev_file_io_rwflags(zio);
+	io_set_eventfd(iocb, va->va_efd);
+	iocb->data = zio;
+
+	va->va_queue[va->va_nqueued++] = iocb;
+	va->va_inflight++;
+
+	if (va->va_plugged == 0)
+		vdev_file_aio_submit(va);
+
+	mutex_exit(&va->va_lock);
+}
+
+void
+vdev_file_aio_plug(vdev_file_t *vf)
+{
+	vdev_file_aio_t *va = vf->vf_aio;
+
+	mutex_enter(&va->va_lock);
+	va->va_plugged++;
+	mutex_exit(&va->va_lock);
+}
+
+void
+vdev_file_aio_unplug(vdev_file_t *vf)
+{
+	vdev_file_aio_t *va = vf->vf_aio;
+
+	mutex_enter(&va->va_lock);
+	ASSERT3U(va->va_plugged, >, 0);
+	if (--va->va_plugged == 0)
+		vdev_file_aio_submit(va);
+	mutex_exit(&va->va_lock);
+}
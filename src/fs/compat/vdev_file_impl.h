@@ -0,0 +1,83 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef _VDEV_FILE_IMPL_H
+#define	_VDEV_FILE_IMPL_H
+
+#include <sys/zfs_context.h>
+#include <sys/vdev_impl.h>
+
+/*
+ * Private interfaces shared by the userland file and disk vdev and its
+ * asynchronous I/O backends.
+ */
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+typedef enum vdev_file_backend {
+	VDEV_FILE_BACKEND_TASKQ,	/* blocking pread/pwrite on a taskq */
+	VDEV_FILE_BACKEND_URING,	/* io_uring, one ring per vdev */
+	VDEV_FILE_BACKEND_AIO,		/* libaio, one context per vdev */
+	VDEV_FILE_BACKENDS
+} vdev_file_backend_t;
+
+typedef struct vdev_file_ring vdev_file_ring_t;
+typedef struct vdev_file_aio vdev_file_aio_t;
+
+typedef struct vdev_file {
+	int			vf_fd;
+	vdev_file_backend_t	vf_backend;
+	vdev_file_ring_t	*vf_ring;
+	vdev_file_aio_t		*vf_aio;
+	taskq_t			*vf_taskq;	/* blocking I/O, flush, trim */
+	uint64_t		vf_dio_align;	/* O_DIRECT alignment, or 0 */
+} vdev_file_t;
+
+extern int vdev_file_io_backend;
+extern uint64_t vdev_file_backend_opens[VDEV_FILE_BACKENDS];
+extern uint_t vdev_file_ring_entries;
+extern uint_t vdev_file_aio_entries;
+extern uint_t vdev_file_taskq_threads;
+
+extern int vdev_file_io_rwflags(zio_t *zio);
+extern void vdev_file_io_complete(zio_t *zio, ssize_t nbytes);
+
+extern int vdev_file_ring_create(vdev_file_t *vf, uint_t entries);
+extern void vdev_file_ring_destroy(vdev_file_t *vf);
+extern void vdev_file_ring_io_start(vdev_file_t *vf, zio_t *zio);
+extern void vdev_file_ring_flush(vdev_file_t *vf, zio_t *zio);
+extern void vdev_file_ring_plug(vdev_file_t *vf);
+extern void vdev_file_ring_unplug(vdev_file_t *vf);
+
+extern void vdev_file_aio_nbio_init(void);
+extern int vdev_file_aio_create(vdev_file_t *vf, uint_t entries);
+extern void vdev_file_aio_destroy(vdev_file_t *vf);
+extern void vdev_file_aio_io_start(vdev_file_t *vf, zio_t *zio);
+extern void vdev_file_aio_plug(vdev_file_t *vf);
+extern void vdev_file_aio_unplug(vdev_file_t *vf);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _VDEV_FILE_IMPL_H */
@@ -0,0 +1,489 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * io_uring backend for file and disk vdevs.
+ *
+ * Each open leaf vdev gets its own submission ring.  vdev_file_io_start()
+ * fills in a read or write SQE for the zio and publishes it; a reaper
+ * thread per ring waits for completions and hands each finished zio back
+ * to the pipeline with zio_interrupt(), so no thread is tied up for the
+ * duration of an I/O and queue depth is bounded only by the ring size.
+ *
+ * Submission can be batched: while a ring is plugged (see
+ * vdev_queue_io_done()) SQEs are only queued, and the final unplug enters
+ * all of them with a single io_uring_enter(2).  The vdev's descriptor is
+ * registered with the ring as a fixed file when the kernel allows it.
+ *
+ * Only the raw system call interface from <linux/io_uring.h> is used, so
+ * there is no dependency on liburing.  If the ring cannot be set up (the
+ * kernel predates IORING_OP_READ, or io_uring is disabled by policy),
+ * vdev_file_ring_create() fails and the vdev falls back to the libaio or
+ * taskq backend.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/vdev_impl.h>
+#include <sys/zio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "vdev_file_impl.h"
+
+struct vdev_file_ring {
+	int			vr_fd;		/* io_uring descriptor */
+	int			vr_file;	/* fd or fixed file index */
+	uint8_t			vr_sqe_flags;	/* IOSQE_FIXED_FILE if fixed */
+	uint_t			vr_entries;	/* SQ ring size */
+
+	kmutex_t		vr_lock;	/* protects the SQ and counts */
+	kcondvar_t		vr_cv;		/* signalled as I/Os complete */
+	uint_t			vr_plugged;	/* threads batching SQEs */
+	uint_t			vr_unsubmitted;	/* SQEs not yet entered */
+	uint_t			vr_inflight;	/* SQEs not yet reaped */
+
+	uint32_t		*vr_sq_head;
+	uint32_t		*vr_sq_tail;
+	uint32_t		vr_sq_mask;
+	uint32_t		*vr_sq_array;
+	struct io_uring_sqe	*vr_sqes;
+
+	uint32_t		*vr_cq_head;
+	uint32_t		*vr_cq_tail;
+	uint32_t		vr_cq_mask;
+	struct io_uring_cqe	*vr_cqes;
+
+	void			*vr_sq_ring;
+	size_t			vr_sq_ring_size;
+	void			*vr_cq_ring;
+	size_t			vr_cq_ring_size;
+	size_t			vr_sqes_size;
+
+	kthread_t		*vr_reaper;
+};
+
+/*
+ * user_data of the NOP that tells the reaper to exit.  zio pointers are
+ * never NULL.
+ */
+#define	VDEV_FILE_RING_EXIT	0
+
+static int
+io_uring_setup(uint_t entries, struct io_uring_params *p)
+{
+	return (syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int
+io_uring_enter(int fd, uint_t to_submit, uint_t min_complete, uint_t flags)
+{
+	return (syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+	    flags, NULL, 0));
+}
+
+static int
+io_uring_register(int fd, uint_t opcode, void *arg, uint_t nr_args)
+{
+	return (syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+/*
+ * Check that the kernel supports the non-vectored read and write opcodes,
+ * which were added together with IORING_REGISTER_PROBE in Linux 5.6.
+ */
+static boolean_t
+vdev_file_ring_probe(int fd)
+{
+	struct io_uring_probe *probe;
+	size_t size;
+	boolean_t ok = B_FALSE;
+
+	size = sizeof (*probe) + 256 * sizeof (struct io_uring_probe_op);
+	probe = kmem_zalloc(size, KM_SLEEP);
+
+	if (io_uring_register(fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+	    probe->last_op >= IORING_OP_WRITE) {
+		ok = (probe->ops[IORING_OP_READ].flags &
+		    IO_URING_OP_SUPPORTED) &&
+		    (probe->ops[IORING_OP_WRITE].flags &
+		    IO_URING_OP_SUPPORTED);
+	}
+
+	kmem_free(probe, size);
+	return (ok);
+}
+
+static void
+vdev_file_ring_unmap(vdev_file_ring_t *vr)
+{
+	if (vr->vr_sqes != NULL)
+		(void) munmap(vr->vr_sqes, vr->vr_sqes_size);
+	if (vr->vr_cq_ring != NULL && vr->vr_cq_ring != vr->vr_sq_ring)
+		(void) munmap(vr->vr_cq_ring, vr->vr_cq_ring_size);
+	if (vr->vr_sq_ring != NULL)
+		(void) munmap(vr->vr_sq_ring, vr->vr_sq_ring_size);
+}
+
+static int
+vdev_file_ring_map(vdev_file_ring_t *vr, struct io_uring_params *p)
+{
+	char *sq, *cq;
+
+	vr->vr_sq_ring_size = p->sq_off.array +
+	    p->sq_entries * sizeof (uint32_t);
+	vr->vr_cq_ring_size = p->cq_off.cqes +
+	    p->cq_entries * sizeof (struct io_uring_cqe);
+	vr->vr_sqes_size = p->sq_entries * sizeof (struct io_uring_sqe);
+
+	if (p->features & IORING_FEAT_SINGLE_MMAP) {
+		vr->vr_sq_ring_size = MAX(vr->vr_sq_ring_size,
+		    vr->vr_cq_ring_size);
+		vr->vr_cq_ring_size = vr->vr_sq_ring_size;
+	}
+
+	sq = mmap(NULL, vr->vr_sq_ring_size, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_POPULATE, vr->vr_fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED)
+		return (errno);
+	vr->vr_sq_ring = sq;
+
+	if (p->features & IORING_FEAT_SINGLE_MMAP) {
+		cq = sq;
+	} else {
+		cq = mmap(NULL, vr->vr_cq_ring_size, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, vr->vr_fd, IORING_OFF_CQ_RING);
+		if (cq == MAP_FAILED)
+			return (errno);
+	}
+	vr->vr_cq_ring = cq;
+
+	vr->vr_sqes = mmap(NULL, vr->vr_sqes_size, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_POPULATE, vr->vr_fd, IORING_OFF_SQES);
+	if (vr->vr_sqes == MAP_FAILED) {
+		vr->vr_sqes = NULL;
+		return (errno);
+	}
+
+	vr->vr_sq_head = (uint32_t *)(sq + p->sq_off.head);
+	vr->vr_sq_tail = (uint32_t *)(sq + p->sq_off.tail);
+	vr->vr_sq_mask = *(uint32_t *)(sq + p->sq_off.ring_mask);
+	vr->vr_sq_array = (uint32_t *)(sq + p->sq_off.array);
+
+	vr->vr_cq_head = (uint32_t *)(cq + p->cq_off.head);
+	vr->vr_cq_tail = (uint32_t *)(cq + p->cq_off.tail);
+	vr->vr_cq_mask = *(uint32_t *)(cq + p->cq_off.ring_mask);
+	vr->vr_cqes = (struct io_uring_cqe *)(cq + p->cq_off.cqes);
+
+	/*
+	 * SQEs are always filled in ring order, so the indirection array
+	 * can be set up once as the identity mapping.
+	 */
+	for (uint32_t i = 0; i < p->sq_entries; i++)
+		vr->vr_sq_array[i] = i;
+
+	return (0);
+}
+
+/*
+ * Enter every queued SQE into the kernel.  If the kernel is temporarily
+ * out of resources while it still holds SQEs of ours, the rest stay queued
+ * and are retried by the next submitter or by the reaper once completions
+ * have been consumed.  With nothing of ours in the kernel no completion
+ * is coming, so back off and retry here instead.
+ */
+static void
+vdev_file_ring_submit(vdev_file_ring_t *vr)
+{
+	int n;
+
+	ASSERT(MUTEX_HELD(&vr->vr_lock));
+
+	while (vr->vr_unsubmitted > 0) {
+		n = io_uring_enter(vr->vr_fd, vr->vr_unsubmitted, 0, 0);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EBUSY) {
+				if (vr->vr_inflight > vr->vr_unsubmitted)
+					break;
+				(void) cv_timedwait_hires(&vr->vr_cv,
+				    &vr->vr_lock, MSEC2NSEC(1), MSEC2NSEC(1),
+				    0);
+				continue;
+			}
+			panic("io_uring_enter failed: %s", strerror(errno));
+		}
+
+		ASSERT3U(n, <=, vr->vr_unsubmitted);
+		vr->vr_unsubmitted -= n;
+	}
+}
+
+/*
+ * Queue an SQE, waiting for a free slot if the ring is full.  Returns with
+ * the SQE zeroed and vr_lock held; the caller fills it in and calls
+ * vdev_file_ring_queue().
+ */
+static struct io_uring_sqe *
+vdev_file_ring_get_sqe(vdev_file_ring_t *vr)
+{
+	struct io_uring_sqe *sqe;
+
+	mutex_enter(&vr->vr_lock);
+
+	while (vr->vr_inflight >= vr->vr_entries) {
+		/*
+		 * Push out anything a plugged thread is holding back, or we
+		 * might wait for completions that were never submitted.
+		 */
+		vdev_file_ring_submit(vr);
+		cv_wait(&vr->vr_cv, &vr->vr_lock);
+	}
+
+	sqe = &vr->vr_sqes[*vr->vr_sq_tail & vr->vr_sq_mask];
+	bzero(sqe, sizeof (*sqe));
+	return (sqe);
+}
+
+static void
+vdev_file_ring_queue(vdev_file_ring_t *vr)
+{
+	ASSERT(MUTEX_HELD(&vr->vr_lock));
+
+	__atomic_store_n(vr->vr_sq_tail, *vr->vr_sq_tail + 1, __ATOMIC_RELEASE);
+	vr->vr_unsubmitted++;
+	vr->vr_inflight++;
+
+	if (vr->vr_plugged == 0)
+		vdev_file_ring_submit(vr);
+
+	mutex_exit(&vr->vr_lock);
+}
+
+static void *
+vdev_file_ring_reaper(void *arg)
+{
+	vdev_file_ring_t *vr = arg;
+	struct io_uring_cqe *cqe;
+	uint32_t head, tail;
+	boolean_t exiting = B_FALSE;
+	uint_t reaped;
+
+	while (!exiting) {
+		if (io_uring_enter(vr->vr_fd, 0, 1,
+		    IORING_ENTER_GETEVENTS) == -1 && errno != EINTR)
+			panic("io_uring_enter failed: %s", strerror(errno));
+
+		head = *vr->vr_cq_head;
+		tail = __atomic_load_n(vr->vr_cq_tail, __ATOMIC_ACQUIRE);
+
+		for (reaped = 0; head != tail; head++, reaped++) {
+			cqe = &vr->vr_cqes[head & vr->vr_cq_mask];
+			if (cqe->user_data == VDEV_FILE_RING_EXIT) {
+				exiting = B_TRUE;
+				continue;
+			}
+
+			vdev_file_io_complete(
+			    (zio_t *)(uintptr_t)cqe->user_data, cqe->res);
+		}
+
+		__atomic_store_n(vr->vr_cq_head, head, __ATOMIC_RELEASE);
+
+		if (reaped == 0)
+			continue;
+
+		mutex_enter(&vr->vr_lock);
+		ASSERT3U(vr->vr_inflight, >=, reaped);
+		vr->vr_inflight -= reaped;
+		if (vr->vr_plugged == 0)
+			vdev_file_ring_submit(vr);
+		cv_broadcast(&vr->vr_cv);
+		mutex_exit(&vr->vr_lock);
+	}
+
+	return (NULL);
+}
+
+int
+vdev_file_ring_create(vdev_file_t *vf, uint_t entries)
+{
+	struct io_uring_params params;
+	vdev_file_ring_t *vr;
+	int error;
+
+	ASSERT3P(vf->vf_ring, ==, NULL);
+
+	vr = kmem_zalloc(sizeof (vdev_file_ring_t), KM_SLEEP);
+	mutex_init(&vr->vr_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&vr->vr_cv, NULL, CV_DEFAULT, NULL);
+
+	bzero(&params, sizeof (params));
+	vr->vr_fd = io_uring_setup(MAX(entries, 1), &params);
+	if (vr->vr_fd == -1) {
+		error = errno;
+		goto fail;
+	}
+
+	if (!vdev_file_ring_probe(vr->vr_fd)) {
+		error = SET_ERROR(ENOTSUP);
+		goto fail;
+	}
+
+	if ((error = vdev_file_ring_map(vr, &params)) != 0)
+		goto fail;
+
+	vr->vr_entries = params.sq_entries;
+
+	if (io_uring_register(vr->vr_fd, IORING_REGISTER_FILES,
+	    &vf->vf_fd, 1) == 0) {
+		vr->vr_file = 0;
+		vr->vr_sqe_flags = IOSQE_FIXED_FILE;
+	} else {
+		vr->vr_file = vf->vf_fd;
+		vr->vr_sqe_flags = 0;
+	}
+
+	vr->vr_reaper = thread_create(NULL, 0, vdev_file_ring_reaper, vr, 0,
+	    &p0, TS_RUN, maxclsyspri);
+	if (vr->vr_reaper == NULL) {
+		error = SET_ERROR(EAGAIN);
+		goto fail;
+	}
+
+	vf->vf_ring = vr;
+	return (0);
+
+fail:
+	vdev_file_ring_unmap(vr);
+	if (vr->vr_fd != -1)
+		(void) close(vr->vr_fd);
+	cv_destroy(&vr->vr_cv);
+	mutex_destroy(&vr->vr_lock);
+	kmem_free(vr, sizeof (vdev_file_ring_t));
+	return (error);
+}
+
+void
+vdev_file_ring_destroy(vdev_file_t *vf)
+{
+	vdev_file_ring_t *vr = vf->vf_ring;
+	struct io_uring_sqe *sqe;
+
+	if (vr == NULL)
+		return;
+
+	/*
+	 * The vdev is closed only once its I/O has drained, but the reaper
+	 * may still be accounting for the last completions.
+	 */
+	mutex_enter(&vr->vr_lock);
+	ASSERT0(vr->vr_plugged);
+	while (vr->vr_inflight > 0)
+		cv_wait(&vr->vr_cv, &vr->vr_lock);
+	mutex_exit(&vr->vr_lock);
+
+	sqe = vdev_file_ring_get_sqe(vr);
+	sqe->opcode = IORING_OP_NOP;
+	sqe->user_data = VDEV_FILE_RING_EXIT;
+	vdev_file_ring_queue(vr);
+
+	thread_join(vr->vr_reaper);
+
+	vdev_file_ring_unmap(vr);
+	(void) close(vr->vr_fd);
+	cv_destroy(&vr->vr_cv);
+	mutex_destroy(&vr->vr_lock);
+	kmem_free(vr, sizeof (vdev_file_ring_t));
+	vf->vf_ring = NULL;
+}
+
+void
+vdev_file_ring_io_start(vdev_file_t *vf, zio_t *zio)
+{
+	vdev_file_ring_t *vr = vf->vf_ring;
+	struct io_uring_sqe *sqe;
+
+	ASSERT(zio->io_type == ZIO_TYPE_READ || zio->io_type == ZIO_TYPE_WRITE);
+
+	sqe = vdev_file_ring_get_sqe(vr);
+	if (zio->io_iov != NULL) {
+		sqe->opcode = (zio->io_type == ZIO_TYPE_READ) ?
+		    IORING_OP_READV : IORING_OP_WRITEV;
+		sqe->addr = (uintptr_t)zio->io_iov;
+		sqe->len = zio->io_iovcnt;
+	} else {
+		sqe->opcode = (zio->io_type == ZIO_TYPE_READ) ?
+		    IORING_OP_READ : IORING_OP_WRITE;
+		sqe->addr = (uintptr_t)zio->io_data;
+		sqe->len = zio->io_size;
+	}
+	sqe->flags = vr->vr_sqe_flags;
+	sqe->fd = vr->vr_file;
+	sqe->off = zio->io_offset;
+	sqe->rw_flags = vdev_file_io_rwflags(zio);
+	sqe->user_data = (uintptr_t)zio;
+	vdev_file_ring_queue(vr);
+}
+
+/*
+ * Queue an fdatasync(2) of the vdev.  It completes like a zero-length I/O.
+ */
+void
+vdev_file_ring_flush(vdev_file_t *vf, zio_t *zio)
+{
+	vdev_file_ring_t *vr = vf->vf_ring;
+	struct io_uring_sqe *sqe;
+
+	ASSERT3U(zio->io_type, ==, ZIO_TYPE_IOCTL);
+	ASSERT3U(zio->io_size, ==, 0);
+
+	sqe = vdev_file_ring_get_sqe(vr);
+	sqe->opcode = IORING_OP_FSYNC;
+	sqe->flags = vr->vr_sqe_flags;
+	sqe->fd = vr->vr_file;
+	sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+	sqe->user_data = (uintptr_t)zio;
+	vdev_file_ring_queue(vr);
+}
+
+void
+vdev_file_ring_plug(vdev_file_t *vf)
+{
+	vdev_file_ring_t *vr = vf->vf_ring;
+
+	mutex_enter(&vr->vr_lock);
+	vr->vr_plugged++;
+	mutex_exit(&vr->vr_lock);
+}
+
+void
+vdev_file_ring_unplug(vdev_file_t *vf)
+{
+	vdev_file_ring_t *vr = vf->vf_ring;
+
+	mutex_enter(&vr->vr_lock);
+	ASSERT3U(vr->vr_plugged, >, 0);
+	if (--vr->vr_plugged == 0)
+		vdev_file_ring_submit(vr);
+	mutex_exit(&vr->vr_lock);
+}
@@ -0,0 +1,419 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Memory vdevs.
+ *
+ * A "memory" leaf vdev stores its blocks in an anonymous mapping of
+ * vdev_memory_size bytes, so that the zio pipeline, the ARC and the DMU
+ * can be exercised and benchmarked without any storage underneath.  The
+ * mapping is made with MAP_NORESERVE, so only the space that has been
+ * written consumes memory, and trims give it back.  With
+ * vdev_memory_hugepages set, the mapping is backed by hugetlbfs pages if
+ * any are reserved, and by transparent huge pages otherwise.  The contents
+ * of a memory vdev are lost when it is closed, so a pool on memory vdevs
+ * cannot be exported and imported again.
+ *
+ * Reads and writes are copied when they are issued.  By default they then
+ * complete straight away.  vdev_memory_latency_model instead makes each
+ * I/O complete after a latency drawn from one of the following:
+ *
+ *	FIXED		vdev_memory_latency_ns
+ *	NORMAL		mean vdev_memory_latency_ns and standard deviation
+ *			vdev_memory_latency_stddev_ns, truncated at zero
+ *	LONGTAIL	Pareto with shape 2 and mean vdev_memory_latency_ns,
+ *			so that 1% of I/Os take more than 5 times the mean
+ *			and 0.1% more than 15 times, up to
+ *			VDEV_MEMORY_LONGTAIL_MAX times
+ *
+ * Delayed I/Os wait on the vdev's own taskq, whose vdev_memory_queue_depth
+ * threads model the number of I/Os the device can service at once.  The
+ * latencies come from a per-vdev pseudo-random generator seeded with
+ * vdev_memory_seed and the vdev's id, so a given pool layout sees the same
+ * sequence of latencies on every run.  No floating point is needed: the
+ * normal distribution is approximated by the sum of 12 uniform variables.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/vdev_impl.h>
+#include <sys/zio.h>
+#include <sys/fs/zfs.h>
+#include <sys/mman.h>
+
+#include "vdev_memory_impl.h"
+
+#define	VDEV_MEMORY_HUGEPAGE_SIZE	(2ULL << 20)
+#define	VDEV_MEMORY_LONGTAIL_MAX	1000
+
+typedef struct vdev_memory {
+	caddr_t		vm_base;
+	uint64_t	vm_size;	/* usable size of the mapping */
+	uint64_t	vm_maplen;	/* length of the mapping */
+	boolean_t	vm_hugetlb;	/* mapped from hugetlbfs */
+	vdev_memory_latency_t vm_model;
+	taskq_t		*vm_taskq;	/* delayed completions */
+	kmutex_t	vm_lock;	/* protects vm_random */
+	uint64_t	vm_random;	/* xorshift64* state */
+} vdev_memory_t;
+
+/*
+ * Size of newly opened memory vdevs.
+ */
+uint64_t vdev_memory_size = 1ULL << 30;
+
+/*
+ * Back newly opened memory vdevs with huge pages.
+ */
+int vdev_memory_hugepages = 0;
+
+/*
+ * How long I/Os to newly opened memory vdevs take; see above.
+ */
+int vdev_memory_latency_model = VDEV_MEMORY_LATENCY_NONE;
+uint64_t vdev_memory_latency_ns = 100000;
+uint64_t vdev_memory_latency_stddev_ns = 20000;
+
+/*
+ * Number of I/Os a memory vdev with a latency model services at once.
+ */
+uint_t vdev_memory_queue_depth = 32;
+
+/*
+ * Seed for the latencies of memory vdevs.
+ */
+uint64_t vdev_memory_seed = 0x2545f4914f6cdd1dULL;
+
+/*
+ * A xorshift64* generator.
+ */
+static uint64_t
+vdev_memory_random(vdev_memory_t *vm)
+{
+	uint64_t x;
+
+	mutex_enter(&vm->vm_lock);
+	x = vm->vm_random;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	vm->vm_random = x;
+	mutex_exit(&vm->vm_lock);
+
+	return (x * 0x2545f4914f6cdd1dULL);
+}
+
+static uint64_t
+vdev_memory_isqrt(uint64_t x)
+{
+	uint64_t r = 0;
+
+	for (uint64_t bit = 1ULL << 62; bit != 0; bit >>= 2) {
+		if (x >= r + bit) {
+			x -= r + bit;
+			r = (r >> 1) + bit;
+		} else {
+			r >>= 1;
+		}
+	}
+
+	return (r);
+}
+
+/*
+ * Return the latency of the next I/O, in nanoseconds.
+ */
+static hrtime_t
+vdev_memory_latency(vdev_memory_t *vm)
+{
+	int64_t mean = vdev_memory_latency_ns;
+	int64_t z;
+	uint64_t u;
+
+	switch (vm->vm_model) {
+	case VDEV_MEMORY_LATENCY_FIXED:
+		return (mean);
+	case VDEV_MEMORY_LATENCY_NORMAL:
+		/*
+		 * The sum of 12 uniform variables on [0, 1) has mean 6 and
+		 * variance 1.  z is that sum less 6, scaled by 2^16.
+		 */
+		z = -6LL << 16;
+		for (int i = 0; i < 12; i++)
+			z += vdev_memory_random(vm) >> 48;
+		z = mean + (z * (int64_t)vdev_memory_latency_stddev_ns >> 16);
+		return (MAX(z, 0));
+	case VDEV_MEMORY_LATENCY_LONGTAIL:
+		/*
+		 * If u is uniform on (0, 1], then xm / sqrt(u) is Pareto
+		 * distributed with scale xm and shape 2, and mean 2 * xm.
+		 */
+		u = (vdev_memory_random(vm) >> 32) + 1;
+		return (MIN((mean / 2) * 65536 / vdev_memory_isqrt(u),
+		    mean * VDEV_MEMORY_LONGTAIL_MAX));
+	default:
+		return (0);
+	}
+}
+
+/*
+ * Map the vdev's memory.  Returns 0 or an errno.
+ */
+static int
+vdev_memory_map(vdev_memory_t *vm, uint64_t size)
+{
+	int prot = PROT_READ | PROT_WRITE;
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+	void *base = MAP_FAILED;
+
+	vm->vm_size = size;
+	vm->vm_maplen = size;
+
+	if (vdev_memory_hugepages) {
+		vm->vm_maplen = P2ROUNDUP(size, VDEV_MEMORY_HUGEPAGE_SIZE);
+		base = mmap(NULL, vm->vm_maplen, prot, flags | MAP_HUGETLB,
+		    -1, 0);
+		vm->vm_hugetlb = (base != MAP_FAILED);
+	}
+
+	if (base == MAP_FAILED) {
+		base = mmap(NULL, vm->vm_maplen, prot, flags, -1, 0);
+		if (base == MAP_FAILED)
+			return (errno);
+
+		if (vdev_memory_hugepages)
+			(void) madvise(base, vm->vm_maplen, MADV_HUGEPAGE);
+	}
+
+	vm->vm_base = base;
+	return (0);
+}
+
+static int
+vdev_memory_open(vdev_t *vd, uint64_t *psize, uint64_t *max_psize,
+    uint64_t *ashift)
+{
+	vdev_memory_t *vm;
+	uint64_t size;
+	int error;
+
+	/*
+	 * A reopened vdev keeps its memory.
+	 */
+	if (vd->vdev_tsd != NULL) {
+		ASSERT(vd->vdev_reopening);
+		vm = vd->vdev_tsd;
+		goto skip_open;
+	}
+
+	size = P2ALIGN(vdev_memory_size, SPA_MINBLOCKSIZE);
+	vm = kmem_zalloc(sizeof (vdev_memory_t), KM_SLEEP);
+	mutex_init(&vm->vm_lock, NULL, MUTEX_DEFAULT, NULL);
+
+	error = vdev_memory_map(vm, size);
+	if (error != 0) {
+		mutex_destroy(&vm->vm_lock);
+		kmem_free(vm, sizeof (vdev_memory_t));
+		vd->vdev_stat.vs_aux = VDEV_AUX_OPEN_FAILED;
+		return (error);
+	}
+
+	vm->vm_random = vdev_memory_seed ^
+	    ((vd->vdev_id + 1) * 0x9e3779b97f4a7c15ULL);
+	if (vm->vm_random == 0)
+		vm->vm_random = 1;
+
+	vm->vm_model = vdev_memory_latency_model;
+	if (vm->vm_model < 0 || vm->vm_model >= VDEV_MEMORY_LATENCY_MODELS)
+		vm->vm_model = VDEV_MEMORY_LATENCY_NONE;
+
+	if (vm->vm_model != VDEV_MEMORY_LATENCY_NONE) {
+		uint_t depth = MAX(vdev_memory_queue_depth, 1);
+
+		vm->vm_taskq = taskq_create("vdev_memory_taskq", depth,
+		    minclsyspri, depth, INT_MAX, TASKQ_PREPOPULATE);
+		vdev_queue_set_max_active(vd, depth);
+	}
+
+	vd->vdev_tsd = vm;
+
+skip_open:
+	*psize = vm->vm_size;
+	*max_psize = vm->vm_size;
+	*ashift = SPA_MINBLOCKSHIFT;
+
+	/*
+	 * There is no cache to flush, and hugetlbfs pages cannot be
+	 * discarded piecemeal.
+	 */
+	vd->vdev_nowritecache = B_TRUE;
+	vd->vdev_notrim = vm->vm_hugetlb;
+	vd->vdev_nonrot = B_TRUE;
+	vd->vdev_iovec = B_TRUE;
+
+	return (0);
+}
+
+static void
+vdev_memory_close(vdev_t *vd)
+{
+	vdev_memory_t *vm = vd->vdev_tsd;
+
+	if (vd->vdev_reopening || vm == NULL)
+		return;
+
+	if (vm->vm_taskq != NULL)
+		taskq_destroy(vm->vm_taskq);
+
+	VERIFY0(munmap(vm->vm_base, vm->vm_maplen));
+	mutex_destroy(&vm->vm_lock);
+
+	vd->vdev_delayed_close = B_FALSE;
+	vd->vdev_iovec = B_FALSE;
+	vdev_queue_set_max_active(vd, 0);
+	kmem_free(vm, sizeof (vdev_memory_t));
+	vd->vdev_tsd = NULL;
+}
+
+/*
+ * Give the pages wholly inside a trimmed range back to the system.
+ */
+static void
+vdev_memory_discard(vdev_memory_t *vm, uint64_t offset, uint64_t size)
+{
+	uint64_t pagesize = PAGESIZE;
+	uint64_t start = P2ROUNDUP(offset, pagesize);
+	uint64_t end = P2ALIGN(offset + size, pagesize);
+
+	if (start < end)
+		(void) madvise(vm->vm_base + start, end - start, MADV_DONTNEED);
+}
+
+static void
+vdev_memory_copy(vdev_memory_t *vm, zio_t *zio)
+{
+	caddr_t addr = vm->vm_base + zio->io_offset;
+
+	VERIFY3U(zio->io_offset + zio->io_size, <=, vm->vm_size);
+
+	if (zio->io_iov == NULL) {
+		if (zio->io_type == ZIO_TYPE_READ)
+			bcopy(addr, zio->io_data, zio->io_size);
+		else
+			bcopy(zio->io_data, addr, zio->io_size);
+		return;
+	}
+
+	for (uint_t i = 0; i < zio->io_iovcnt; i++) {
+		iovec_t *iov = &zio->io_iov[i];
+
+		if (zio->io_type == ZIO_TYPE_READ)
+			bcopy(addr, iov->iov_base, iov->iov_len);
+		else
+			bcopy(iov->iov_base, addr, iov->iov_len);
+		addr += iov->iov_len;
+	}
+}
+
+/*
+ * Complete an I/O once its latency has passed.
+ */
+static void
+vdev_memory_delay(void *arg)
+{
+	zio_t *zio = arg;
+	hrtime_t now = gethrtime();
+
+	if (now < zio->io_target_timestamp)
+		delay(MAX(NSEC_TO_USEC(zio->io_target_timestamp - now), 1));
+
+	zio_interrupt(zio);
+}
+
+static void
+vdev_memory_io_start(zio_t *zio)
+{
+	vdev_t *vd = zio->io_vd;
+	vdev_memory_t *vm = vd->vdev_tsd;
+
+	if (zio->io_type == ZIO_TYPE_IOCTL) {
+		/* XXPOLICY */
+		if (!vdev_readable(vd)) {
+			zio->io_error = SET_ERROR(ENXIO);
+			zio_interrupt(zio);
+			return;
+		}
+
+		if (zio->io_cmd == DKIOCFREE && !vd->vdev_notrim)
+			vdev_memory_discard(vm, zio->io_offset, zio->io_size);
+		else
+			zio->io_error = SET_ERROR(ENOTSUP);
+
+		zio_execute(zio);
+		return;
+	}
+
+	ASSERT(zio->io_type == ZIO_TYPE_READ || zio->io_type == ZIO_TYPE_WRITE);
+
+	vdev_memory_copy(vm, zio);
+
+	if (vm->vm_taskq == NULL) {
+		zio_interrupt(zio);
+		return;
+	}
+
+	zio->io_target_timestamp = gethrtime() + vdev_memory_latency(vm);
+	VERIFY3U(taskq_dispatch(vm->vm_taskq, vdev_memory_delay, zio,
+	    TQ_SLEEP), !=, 0);
+}
+
+/* ARGSUSED */
+static void
+vdev_memory_io_done(zio_t *zio)
+{
+}
+
+/* ARGSUSED */
+static void
+vdev_memory_hold(vdev_t *vd)
+{
+}
+
+/* ARGSUSED */
+static void
+vdev_memory_rele(vdev_t *vd)
+{
+}
+
+vdev_ops_t vdev_memory_ops = {
+	vdev_memory_open,
+	vdev_memory_close,
+	vdev_default_asize,
+	vdev_memory_io_start,
+	vdev_memory_io_done,
+	NULL,
+	vdev_memory_hold,
+	vdev_memory_rele,
+	NULL,
+	NULL,
+	VDEV_TYPE_MEMORY,	/* name of this vdev type */
+	B_TRUE			/* leaf vdev */
+};
@@ -0,0 +1,55 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef _VDEV_MEMORY_IMPL_H
+#define	_VDEV_MEMORY_IMPL_H
+
+#include <sys/types.h>
+
+/*
+ * Tunables of the memory vdev, see vdev_memory.c.
+ */
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+typedef enum vdev_memory_latency {
+	VDEV_MEMORY_LATENCY_NONE,	/* complete when issued */
+	VDEV_MEMORY_LATENCY_FIXED,
+	VDEV_MEMORY_LATENCY_NORMAL,
+	VDEV_MEMORY_LATENCY_LONGTAIL,
+	VDEV_MEMORY_LATENCY_MODELS
+} vdev_memory_latency_t;
+
+extern uint64_t vdev_memory_size;
+extern int vdev_memory_hugepages;
+extern int vdev_memory_latency_model;
+extern uint64_t vdev_memory_latency_ns;
+extern uint64_t vdev_memory_latency_stddev_ns;
+extern uint_t vdev_memory_queue_depth;
+extern uint64_t vdev_memory_seed;
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _VDEV_MEMORY_IMPL_H */
@@ -0,0 +1,663 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * BLAKE3
+ *
+ * BLAKE3 splits its input into 1KB chunks, hashes every chunk on its own
+ * and combines the chunk chaining values in a binary tree whose left
+ * subtrees always hold a power of two chunks.  Because the chunks are
+ * independent, the x86 kernels in blake3_x86.c hash 4, 8 or 16 chunks at
+ * once, one per vector lane, and the tree is reduced with the same
+ * kernels.  blake3_init() verifies them against the portable code below
+ * and picks the fastest; the measured bandwidths are exported as the
+ * named kstat "zfs:0:blake3_bench".
+ *
+ * Records of at least zfs_blake3_parallel_min bytes are additionally cut
+ * into power-of-two subtrees that are hashed concurrently on the
+ * blake3_taskq, so that a single large dedup write is not limited to the
+ * bandwidth of one core.
+ *
+ * The checksum is always keyed: the pool's checksum salt is the 256-bit
+ * key, which makes BLAKE3 suitable for dedup and nopwrite.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/zio.h>
+#include <sys/zio_checksum.h>
+#include <sys/zfs_bench.h>
+#include <sys/zfs_blake3.h>
+
+/*
+ * Records at least this large are hashed by several threads.  Zero
+ * disables parallel hashing.
+ */
+uint64_t zfs_blake3_parallel_min = 1024 * 1024;
+
+/*
+ * Number of threads hashing the subtrees of large records.  Sampled by
+ * blake3_init().
+ */
+int zfs_blake3_threads = 4;
+
+const uint32_t blake3_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+/* The message word permutation, applied once per round. */
+static const uint8_t blake3_msg_schedule[7][16] = {
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+	{ 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 },
+	{ 3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1 },
+	{ 10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6 },
+	{ 12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4 },
+	{ 9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7 },
+	{ 11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13 }
+};
+
+/*
+ * The subtrees handed to a hash_many kernel are at most this many chunks,
+ * and large records are cut into at most this many parallel subtrees.
+ */
+#define	BLAKE3_LEAF_CHUNKS	16
+#define	BLAKE3_MAX_PIECES	16
+
+/* The key and domain flags of a checksum template. */
+typedef struct blake3_key {
+	uint32_t	bk_key[8];
+	uint8_t		bk_flags;
+} blake3_key_t;
+
+#define	ROTR32(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+
+#define	BLAKE3_G(v, a, b, c, d, x, y)					\
+{									\
+	v[a] += v[b] + (x);						\
+	v[d] = ROTR32(v[d] ^ v[a], 16);					\
+	v[c] += v[d];							\
+	v[b] = ROTR32(v[b] ^ v[c], 12);					\
+	v[a] += v[b] + (y);						\
+	v[d] = ROTR32(v[d] ^ v[a], 8);					\
+	v[c] += v[d];							\
+	v[b] = ROTR32(v[b] ^ v[c], 7);					\
+}
+
+static uint32_t
+blake3_load_le32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+	    ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+static void
+blake3_store_cv(const uint32_t cv[8], uint8_t *out)
+{
+	for (int i = 0; i < 8; i++) {
+		out[4 * i] = (uint8_t)cv[i];
+		out[4 * i + 1] = (uint8_t)(cv[i] >> 8);
+		out[4 * i + 2] = (uint8_t)(cv[i] >> 16);
+		out[4 * i + 3] = (uint8_t)(cv[i] >> 24);
+	}
+}
+
+/*
+ * Run one block through the compression function, updating the chaining
+ * value in place.  Only the first half of the output is ever needed.
+ */
+static void
+blake3_compress(uint32_t cv[8], const uint8_t *block, uint32_t block_len,
+    uint64_t counter, uint32_t flags)
+{
+	uint32_t m[16], v[16];
+
+	for (int i = 0; i < 16; i++)
+		m[i] = blake3_load_le32(block + 4 * i);
+
+	for (int i = 0; i < 8; i++)
+		v[i] = cv[i];
+	for (int i = 0; i < 4; i++)
+		v[8 + i] = blake3_iv[i];
+	v[12] = (uint32_t)counter;
+	v[13] = (uint32_t)(counter >> 32);
+	v[14] = block_len;
+	v[15] = flags;
+
+	for (int r = 0; r < 7; r++) {
+		const uint8_t *s = blake3_msg_schedule[r];
+
+		BLAKE3_G(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+		BLAKE3_G(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+		BLAKE3_G(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+		BLAKE3_G(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+		BLAKE3_G(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+		BLAKE3_G(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+		BLAKE3_G(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+		BLAKE3_G(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+	}
+
+	for (int i = 0; i < 8; i++)
+		cv[i] = v[i] ^ v[i + 8];
+}
+
+static void
+blake3_hash_many_generic(const uint8_t *const *inputs, size_t ninputs,
+    size_t nblocks, const uint32_t key[8], uint64_t counter,
+    boolean_t increment, uint8_t flags, uint8_t flags_start,
+    uint8_t flags_end, uint8_t *out)
+{
+	for (size_t i = 0; i < ninputs; i++) {
+		uint32_t cv[8];
+
+		bcopy(key, cv, sizeof (cv));
+		for (size_t b = 0; b < nblocks; b++) {
+			uint8_t bflags = flags;
+
+			if (b == 0)
+				bflags |= flags_start;
+			if (b == nblocks - 1)
+				bflags |= flags_end;
+			blake3_compress(cv, inputs[i] + b * BLAKE3_BLOCK_LEN,
+			    BLAKE3_BLOCK_LEN, counter, bflags);
+		}
+		blake3_store_cv(cv, out + i * BLAKE3_OUT_LEN);
+
+		if (increment)
+			counter++;
+	}
+}
+
+static boolean_t
+blake3_generic_valid(void)
+{
+	return (B_TRUE);
+}
+
+static const blake3_ops_t blake3_generic_ops = {
+	.bo_name = "generic",
+	.bo_valid = blake3_generic_valid,
+	.bo_hash_many = blake3_hash_many_generic,
+};
+
+static const blake3_ops_t *blake3_algos[] = {
+	&blake3_generic_ops,
+#if defined(__zfsd__) && defined(__x86_64__) && defined(__GNUC__)
+	&blake3_sse41_ops,
+	&blake3_avx2_ops,
+	&blake3_avx512_ops,
+#endif
+};
+
+#define	BLAKE3_NALGOS	(sizeof (blake3_algos) / sizeof (blake3_algos[0]))
+
+static const blake3_ops_t *volatile blake3_impl = &blake3_generic_ops;
+
+static taskq_t *blake3_taskq;
+
+/*
+ * Hash a chunk of at most BLAKE3_CHUNK_LEN bytes, possibly partial, into
+ * its chaining value.  flags_end is added to the last block.
+ */
+static void
+blake3_chunk(const blake3_key_t *bk, const uint8_t *data, size_t len,
+    uint64_t counter, uint8_t flags_end, uint32_t cv[8])
+{
+	uint8_t block[BLAKE3_BLOCK_LEN];
+	size_t nblocks = MAX(1, P2ROUNDUP(len, BLAKE3_BLOCK_LEN) /
+	    BLAKE3_BLOCK_LEN);
+
+	ASSERT3U(len, <=, BLAKE3_CHUNK_LEN);
+
+	bcopy(bk->bk_key, cv, sizeof (bk->bk_key));
+	for (size_t b = 0; b < nblocks; b++) {
+		const uint8_t *p = data + b * BLAKE3_BLOCK_LEN;
+		size_t blen = MIN(len - b * BLAKE3_BLOCK_LEN,
+		    BLAKE3_BLOCK_LEN);
+		uint8_t flags = bk->bk_flags;
+
+		if (blen < BLAKE3_BLOCK_LEN) {
+			bzero(block, sizeof (block));
+			bcopy(p, block, blen);
+			p = block;
+		}
+		if (b == 0)
+			flags |= BLAKE3_CHUNK_START;
+		if (b == nblocks - 1)
+			flags |= BLAKE3_CHUNK_END | flags_end;
+		blake3_compress(cv, p, blen, counter, flags);
+	}
+}
+
+/*
+ * Compress two concatenated chaining values into their parent's.
+ */
+static void
+blake3_parent(const blake3_key_t *bk, const uint8_t *cvs, uint8_t flags,
+    uint8_t *out)
+{
+	uint32_t cv[8];
+
+	bcopy(bk->bk_key, cv, sizeof (cv));
+	blake3_compress(cv, cvs, BLAKE3_BLOCK_LEN, 0,
+	    bk->bk_flags | BLAKE3_PARENT | flags);
+	blake3_store_cv(cv, out);
+}
+
+/*
+ * Combine count >= 2 adjacent chaining values into the chaining value of
+ * the subtree above them.  Pairing neighbours level by level, and carrying
+ * an odd one up unchanged, builds exactly the BLAKE3 tree.  flags is added
+ * to the final parent.  The cvs array is used as scratch space.
+ */
+static void
+blake3_reduce(const blake3_ops_t *ops, const blake3_key_t *bk, uint8_t *cvs,
+    size_t count, uint8_t flags, uint8_t *out)
+{
+	const uint8_t *ptrs[BLAKE3_MAX_PIECES / 2];
+	uint8_t next[BLAKE3_MAX_PIECES / 2 * BLAKE3_OUT_LEN];
+
+	CTASSERT(BLAKE3_LEAF_CHUNKS <= BLAKE3_MAX_PIECES);
+	ASSERT3U(count, >=, 2);
+	ASSERT3U(count, <=, BLAKE3_MAX_PIECES);
+
+	while (count > 2) {
+		size_t npairs = count / 2;
+
+		for (size_t i = 0; i < npairs; i++)
+			ptrs[i] = cvs + 2 * i * BLAKE3_OUT_LEN;
+		ops->bo_hash_many(ptrs, npairs, 1, bk->bk_key, 0, B_FALSE,
+		    bk->bk_flags | BLAKE3_PARENT, 0, 0, next);
+		bcopy(next, cvs, npairs * BLAKE3_OUT_LEN);
+		if (count & 1) {
+			bcopy(cvs + (count - 1) * BLAKE3_OUT_LEN,
+			    cvs + npairs * BLAKE3_OUT_LEN, BLAKE3_OUT_LEN);
+		}
+		count = npairs + (count & 1);
+	}
+
+	blake3_parent(bk, cvs, flags, out);
+}
+
+/*
+ * The number of bytes in the left subtree of a node covering len > 1KB
+ * bytes: the largest power of two chunks that leaves at least one byte
+ * for the right subtree.
+ */
+static size_t
+blake3_left_len(size_t len)
+{
+	uint64_t full = (len - 1) / BLAKE3_CHUNK_LEN;
+
+	return ((1ULL << (highbit64(full) - 1)) * BLAKE3_CHUNK_LEN);
+}
+
+/*
+ * Hash the subtree of len > 0 bytes whose first chunk is number counter.
+ * flags is added to its topmost parent, so a subtree of a single chunk
+ * may not be the root.
+ */
+static void
+blake3_subtree(const blake3_ops_t *ops, const blake3_key_t *bk,
+    const uint8_t *data, size_t len, uint64_t counter, uint8_t flags,
+    uint8_t *out)
+{
+	const uint8_t *ptrs[BLAKE3_LEAF_CHUNKS];
+	uint8_t cvs[BLAKE3_LEAF_CHUNKS * BLAKE3_OUT_LEN];
+	size_t full, count;
+
+	if (len > BLAKE3_LEAF_CHUNKS * BLAKE3_CHUNK_LEN) {
+		size_t left = blake3_left_len(len);
+
+		blake3_subtree(ops, bk, data, left, counter, 0, cvs);
+		blake3_subtree(ops, bk, data + left, len - left,
+		    counter + left / BLAKE3_CHUNK_LEN, 0,
+		    cvs + BLAKE3_OUT_LEN);
+		blake3_parent(bk, cvs, flags, out);
+		return;
+	}
+
+	full = len / BLAKE3_CHUNK_LEN;
+	if (full != 0) {
+		for (size_t i = 0; i < full; i++)
+			ptrs[i] = data + i * BLAKE3_CHUNK_LEN;
+		ops->bo_hash_many(ptrs, full,
+		    BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN, bk->bk_key, counter,
+		    B_TRUE, bk->bk_flags, BLAKE3_CHUNK_START,
+		    BLAKE3_CHUNK_END, cvs);
+	}
+
+	count = full;
+	if (len > full * BLAKE3_CHUNK_LEN) {
+		uint32_t cv[8];
+
+		blake3_chunk(bk, data + full * BLAKE3_CHUNK_LEN,
+		    len - full * BLAKE3_CHUNK_LEN, counter + full, 0, cv);
+		blake3_store_cv(cv, cvs + full * BLAKE3_OUT_LEN);
+		count++;
+	}
+
+	if (count == 1) {
+		ASSERT0(flags);
+		bcopy(cvs, out, BLAKE3_OUT_LEN);
+	} else {
+		blake3_reduce(ops, bk, cvs, count, flags, out);
+	}
+}
+
+typedef struct blake3_job {
+	kmutex_t		bj_lock;
+	kcondvar_t		bj_cv;
+	int			bj_pending;
+	const blake3_ops_t	*bj_ops;
+	const blake3_key_t	*bj_key;
+	const uint8_t		*bj_data;
+	size_t			bj_len;
+	size_t			bj_piece;
+	uint8_t			*bj_cvs;
+} blake3_job_t;
+
+typedef struct blake3_task {
+	blake3_job_t		*bt_job;
+	int			bt_index;
+	taskq_ent_t		bt_tqent;
+} blake3_task_t;
+
+static void
+blake3_piece(blake3_job_t *bj, int i)
+{
+	size_t off = i * bj->bj_piece;
+
+	blake3_subtree(bj->bj_ops, bj->bj_key, bj->bj_data + off,
+	    MIN(bj->bj_piece, bj->bj_len - off), off / BLAKE3_CHUNK_LEN, 0,
+	    bj->bj_cvs + i * BLAKE3_OUT_LEN);
+}
+
+static void
+blake3_piece_task(void *arg)
+{
+	blake3_task_t *bt = arg;
+	blake3_job_t *bj = bt->bt_job;
+
+	blake3_piece(bj, bt->bt_index);
+
+	mutex_enter(&bj->bj_lock);
+	if (--bj->bj_pending == 0)
+		cv_signal(&bj->bj_cv);
+	mutex_exit(&bj->bj_lock);
+}
+
+/*
+ * Cut a large input into equal power-of-two subtrees, hash them
+ * concurrently and combine their chaining values into the root.  Every
+ * subtree boundary is also a boundary in the tree of the whole input, so
+ * the result is the same as hashing it serially.
+ */
+static void
+blake3_hash_parallel(const blake3_ops_t *ops, const blake3_key_t *bk,
+    const uint8_t *data, size_t len, uint8_t *out)
+{
+	blake3_task_t tasks[BLAKE3_MAX_PIECES];
+	uint8_t cvs[BLAKE3_MAX_PIECES * BLAKE3_OUT_LEN];
+	size_t piece = blake3_left_len(len);
+	int npieces, nthreads = MIN(zfs_blake3_threads, BLAKE3_MAX_PIECES);
+	blake3_job_t bj;
+
+	while (piece > BLAKE3_LEAF_CHUNKS * BLAKE3_CHUNK_LEN &&
+	    howmany(len, piece) < nthreads)
+		piece /= 2;
+	while (howmany(len, piece) > BLAKE3_MAX_PIECES)
+		piece *= 2;
+	npieces = howmany(len, piece);
+
+	mutex_init(&bj.bj_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&bj.bj_cv, NULL, CV_DEFAULT, NULL);
+	bj.bj_pending = npieces - 1;
+	bj.bj_ops = ops;
+	bj.bj_key = bk;
+	bj.bj_data = data;
+	bj.bj_len = len;
+	bj.bj_piece = piece;
+	bj.bj_cvs = cvs;
+
+	for (int i = 1; i < npieces; i++) {
+		blake3_task_t *bt = &tasks[i];
+
+		bzero(bt, sizeof (*bt));
+		bt->bt_job = &bj;
+		bt->bt_index = i;
+		taskq_dispatch_ent(blake3_taskq, blake3_piece_task, bt,
+		    TQ_SLEEP, &bt->bt_tqent);
+	}
+
+	blake3_piece(&bj, 0);
+
+	mutex_enter(&bj.bj_lock);
+	while (bj.bj_pending != 0)
+		cv_wait(&bj.bj_cv, &bj.bj_lock);
+	mutex_exit(&bj.bj_lock);
+
+	cv_destroy(&bj.bj_cv);
+	mutex_destroy(&bj.bj_lock);
+
+	blake3_reduce(ops, bk, cvs, npieces, BLAKE3_ROOT, out);
+}
+
+static void
+blake3_hash(const blake3_ops_t *ops, const blake3_key_t *bk, const void *buf,
+    uint64_t size, boolean_t parallel, uint8_t *out)
+{
+	uint64_t min = zfs_blake3_parallel_min;
+
+	if (size <= BLAKE3_CHUNK_LEN) {
+		uint32_t cv[8];
+
+		blake3_chunk(bk, buf, size, 0, BLAKE3_ROOT, cv);
+		blake3_store_cv(cv, out);
+	} else if (parallel && blake3_taskq != NULL && min != 0 &&
+	    size >= min && size > BLAKE3_LEAF_CHUNKS * BLAKE3_CHUNK_LEN) {
+		blake3_hash_parallel(ops, bk, buf, size, out);
+	} else {
+		blake3_subtree(ops, bk, buf, size, 0, BLAKE3_ROOT, out);
+	}
+}
+
+/*
+ * Native zio_checksum interface for BLAKE3, keyed with the checksum salt.
+ */
+void
+zio_checksum_blake3_native(const void *buf, uint64_t size,
+    const void *ctx_template, zio_cksum_t *zcp)
+{
+	ASSERT(ctx_template != NULL);
+	CTASSERT(sizeof (zcp->zc_word) == BLAKE3_OUT_LEN);
+
+	blake3_hash(blake3_impl, ctx_template, buf, size, B_TRUE,
+	    (uint8_t *)zcp->zc_word);
+}
+
+/*
+ * Byteswapped zio_checksum interface for BLAKE3.
+ */
+void
+zio_checksum_blake3_byteswap(const void *buf, uint64_t size,
+    const void *ctx_template, zio_cksum_t *zcp)
+{
+	zio_cksum_t	tmp;
+
+	zio_checksum_blake3_native(buf, size, ctx_template, &tmp);
+	zcp->zc_word[0] = BSWAP_64(tmp.zc_word[0]);
+	zcp->zc_word[1] = BSWAP_64(tmp.zc_word[1]);
+	zcp->zc_word[2] = BSWAP_64(tmp.zc_word[2]);
+	zcp->zc_word[3] = BSWAP_64(tmp.zc_word[3]);
+}
+
+void *
+zio_checksum_blake3_tmpl_init(const zio_cksum_salt_t *salt)
+{
+	blake3_key_t	*bk;
+
+	CTASSERT(sizeof (salt->zcs_bytes) == BLAKE3_KEY_LEN);
+
+	bk = kmem_zalloc(sizeof (*bk), KM_SLEEP);
+	for (int i = 0; i < 8; i++)
+		bk->bk_key[i] = blake3_load_le32(salt->zcs_bytes + 4 * i);
+	bk->bk_flags = BLAKE3_KEYED_HASH;
+	return (bk);
+}
+
+void
+zio_checksum_blake3_tmpl_free(void *ctx_template)
+{
+	blake3_key_t	*bk = ctx_template;
+
+	bzero(bk, sizeof (*bk));
+	kmem_free(bk, sizeof (*bk));
+}
+
+#if defined(__zfsd__)
+int
+blake3_impl_set(const char *name)
+{
+	for (int i = 0; i < BLAKE3_NALGOS; i++) {
+		const blake3_ops_t *ops = blake3_algos[i];
+
+		if (strcmp(ops->bo_name, name) == 0 && ops->bo_valid()) {
+			blake3_impl = ops;
+			return (0);
+		}
+	}
+
+	return (SET_ERROR(ENOTSUP));
+}
+
+const char *
+blake3_impl_get(void)
+{
+	return (blake3_impl->bo_name);
+}
+
+#define	BLAKE3_BENCH_SIZE	(128 * 1024)
+
+static kstat_t *blake3_bench_ksp;
+
+typedef struct blake3_bench {
+	const blake3_key_t	*bb_key;
+	const uint8_t		*bb_buf;
+} blake3_bench_t;
+
+static const char *
+blake3_bench_name(int i, void *arg)
+{
+	return (blake3_algos[i]->bo_name);
+}
+
+static boolean_t
+blake3_bench_valid(int i, void *arg)
+{
+	return (blake3_algos[i]->bo_valid());
+}
+
+static boolean_t
+blake3_bench_verify(int i, void *arg)
+{
+	blake3_bench_t *bb = arg;
+
+	for (uint64_t size = 0; size <= 20 * BLAKE3_CHUNK_LEN;
+	    size += (size < 2 * BLAKE3_CHUNK_LEN) ? 1 : 509) {
+		uint8_t ref[BLAKE3_OUT_LEN], out[BLAKE3_OUT_LEN];
+
+		blake3_hash(&blake3_generic_ops, bb->bb_key, bb->bb_buf, size,
+		    B_FALSE, ref);
+		blake3_hash(blake3_algos[i], bb->bb_key, bb->bb_buf, size,
+		    B_FALSE, out);
+		if (bcmp(ref, out, sizeof (ref)) != 0)
+			return (B_FALSE);
+	}
+
+	return (B_TRUE);
+}
+
+/*
+ * Hash the buffer single threaded.
+ */
+static uint64_t
+blake3_bench_run(int i, void *arg)
+{
+	blake3_bench_t *bb = arg;
+	uint8_t out[BLAKE3_OUT_LEN];
+
+	blake3_hash(blake3_algos[i], bb->bb_key, bb->bb_buf, BLAKE3_BENCH_SIZE,
+	    B_FALSE, out);
+	return (BLAKE3_BENCH_SIZE);
+}
+
+static const zfs_bench_ops_t blake3_bench_ops = {
+	.zbo_nimpls = BLAKE3_NALGOS,
+	.zbo_name = blake3_bench_name,
+	.zbo_valid = blake3_bench_valid,
+	.zbo_verify = blake3_bench_verify,
+	.zbo_run = blake3_bench_run,
+};
+
+/*
+ * Verify the vector kernels against the portable code, use the fastest
+ * implementation, and start the threads for hashing large records.
+ */
+void
+blake3_init(void)
+{
+	zio_cksum_salt_t salt;
+	blake3_bench_t bb;
+	blake3_key_t *bk;
+	uint8_t *buf;
+
+	buf = kmem_alloc(BLAKE3_BENCH_SIZE, KM_SLEEP);
+	zfs_bench_fill(buf, BLAKE3_BENCH_SIZE);
+	for (int i = 0; i < sizeof (salt.zcs_bytes); i++)
+		salt.zcs_bytes[i] = (uint8_t)(i * 7);
+	bk = zio_checksum_blake3_tmpl_init(&salt);
+
+	bb.bb_key = bk;
+	bb.bb_buf = buf;
+	blake3_impl = blake3_algos[zfs_bench_select("blake3_bench",
+	    &blake3_bench_ops, &bb, NULL, &blake3_bench_ksp)];
+
+	zio_checksum_blake3_tmpl_free(bk);
+	kmem_free(buf, BLAKE3_BENCH_SIZE);
+
+	if (zfs_blake3_threads > 1) {
+		blake3_taskq = taskq_create("blake3_taskq", zfs_blake3_threads,
+		    minclsyspri, BLAKE3_MAX_PIECES, INT_MAX, TASKQ_PREPOPULATE);
+	}
+}
+
+void
+blake3_fini(void)
+{
+	if (blake3_taskq != NULL) {
+		taskq_destroy(blake3_taskq);
+		blake3_taskq = NULL;
+	}
+
+	kstat_delete(blake3_bench_ksp);
+	blake3_bench_ksp = NULL;
+}
+#endif /* defined(__zfsd__) */
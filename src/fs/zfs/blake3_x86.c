@@ -0,0 +1,352 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * x86 BLAKE3 kernels
+ *
+ * These hash several independent inputs at once, one per 32-bit vector
+ * lane: the chunks of a subtree, or the pairs of chaining values of one
+ * level of the tree.  The same source is built for 128-bit SSE4.1 vectors
+ * (four lanes), 256-bit AVX2 vectors (eight lanes) and 512-bit AVX-512
+ * vectors (sixteen lanes).  A final group with fewer inputs than lanes
+ * repeats the first input and discards the extra results.
+ */
+
+#if defined(__zfsd__) && defined(__x86_64__) && defined(__GNUC__)
+
+#include <sys/types.h>
+#include <sys/byteorder.h>
+#include <sys/sysmacros.h>
+#include <sys/zfs_blake3.h>
+
+#define	BLAKE3_SSE41	__attribute__((target("sse4.1")))
+#define	BLAKE3_AVX2	__attribute__((target("avx2")))
+#define	BLAKE3_AVX512	__attribute__((target("avx2,avx512f,avx512vl")))
+
+typedef uint32_t blake3_v4_t __attribute__((vector_size(16)));
+typedef uint32_t blake3_v8_t __attribute__((vector_size(32)));
+typedef uint32_t blake3_v16_t __attribute__((vector_size(64)));
+
+typedef int32_t blake3_i4_t __attribute__((vector_size(16)));
+typedef int32_t blake3_i8_t __attribute__((vector_size(32)));
+typedef int32_t blake3_i16_t __attribute__((vector_size(64)));
+typedef uint8_t blake3_b16_t __attribute__((vector_size(16)));
+typedef uint8_t blake3_b32_t __attribute__((vector_size(32)));
+
+#define	BLAKE3_MAX_LANES	16
+
+#define	BLAKE3_ROTR(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+
+/*
+ * Rotations by whole bytes are a single byte shuffle without AVX-512's
+ * native rotate.
+ */
+#define	BLAKE3_ROT16_MASK(o)						\
+	(o) + 2, (o) + 3, (o) + 0, (o) + 1, (o) + 6, (o) + 7, (o) + 4,	\
+	(o) + 5, (o) + 10, (o) + 11, (o) + 8, (o) + 9, (o) + 14,	\
+	(o) + 15, (o) + 12, (o) + 13
+#define	BLAKE3_ROT8_MASK(o)						\
+	(o) + 1, (o) + 2, (o) + 3, (o) + 0, (o) + 5, (o) + 6, (o) + 7,	\
+	(o) + 4, (o) + 9, (o) + 10, (o) + 11, (o) + 8, (o) + 13,	\
+	(o) + 14, (o) + 15, (o) + 12
+
+static inline BLAKE3_SSE41 blake3_v4_t
+blake3_rot16_v4(blake3_v4_t x)
+{
+	return ((blake3_v4_t)__builtin_shuffle((blake3_b16_t)x,
+	    (blake3_b16_t){ BLAKE3_ROT16_MASK(0) }));
+}
+
+static inline BLAKE3_SSE41 blake3_v4_t
+blake3_rot8_v4(blake3_v4_t x)
+{
+	return ((blake3_v4_t)__builtin_shuffle((blake3_b16_t)x,
+	    (blake3_b16_t){ BLAKE3_ROT8_MASK(0) }));
+}
+
+static inline BLAKE3_AVX2 blake3_v8_t
+blake3_rot16_v8(blake3_v8_t x)
+{
+	return ((blake3_v8_t)__builtin_shuffle((blake3_b32_t)x,
+	    (blake3_b32_t){ BLAKE3_ROT16_MASK(0),
+	    BLAKE3_ROT16_MASK(16) }));
+}
+
+static inline BLAKE3_AVX2 blake3_v8_t
+blake3_rot8_v8(blake3_v8_t x)
+{
+	return ((blake3_v8_t)__builtin_shuffle((blake3_b32_t)x,
+	    (blake3_b32_t){ BLAKE3_ROT8_MASK(0),
+	    BLAKE3_ROT8_MASK(16) }));
+}
+
+static inline BLAKE3_AVX512 blake3_v16_t
+blake3_rot16_v16(blake3_v16_t x)
+{
+	return (BLAKE3_ROTR(x, 16));
+}
+
+static inline BLAKE3_AVX512 blake3_v16_t
+blake3_rot8_v16(blake3_v16_t x)
+{
+	return (BLAKE3_ROTR(x, 8));
+}
+
+/*
+ * One step of a square transpose: rows i and i + b, for every i without
+ * bit b set, swap the off-diagonal b-wide blocks of their elements.
+ */
+#define	BLAKE3_TRANSPOSE_STEP(r, n, b, lo, hi)				\
+{									\
+	_Pragma("GCC unroll 16")					\
+	for (int i = 0; i < (n); i++) {					\
+		if (i & (b))						\
+			continue;					\
+		__typeof__(r[0]) a = r[i], c = r[i + (b)];		\
+		r[i] = __builtin_shuffle(a, c, lo);			\
+		r[i + (b)] = __builtin_shuffle(a, c, hi);		\
+	}								\
+}
+
+static inline BLAKE3_SSE41 void
+blake3_transpose_v4(blake3_v4_t r[4])
+{
+	BLAKE3_TRANSPOSE_STEP(r, 4, 2, ((blake3_i4_t){ 0, 1, 4, 5 }),
+	    ((blake3_i4_t){ 2, 3, 6, 7 }));
+	BLAKE3_TRANSPOSE_STEP(r, 4, 1, ((blake3_i4_t){ 0, 4, 2, 6 }),
+	    ((blake3_i4_t){ 1, 5, 3, 7 }));
+}
+
+static inline BLAKE3_AVX2 void
+blake3_transpose_v8(blake3_v8_t r[8])
+{
+	BLAKE3_TRANSPOSE_STEP(r, 8, 4,
+	    ((blake3_i8_t){ 0, 1, 2, 3, 8, 9, 10, 11 }),
+	    ((blake3_i8_t){ 4, 5, 6, 7, 12, 13, 14, 15 }));
+	BLAKE3_TRANSPOSE_STEP(r, 8, 2,
+	    ((blake3_i8_t){ 0, 1, 8, 9, 4, 5, 12, 13 }),
+	    ((blake3_i8_t){ 2, 3, 10, 11, 6, 7, 14, 15 }));
+	BLAKE3_TRANSPOSE_STEP(r, 8, 1,
+	    ((blake3_i8_t){ 0, 8, 2, 10, 4, 12, 6, 14 }),
+	    ((blake3_i8_t){ 1, 9, 3, 11, 5, 13, 7, 15 }));
+}
+
+static inline BLAKE3_AVX512 void
+blake3_transpose_v16(blake3_v16_t r[16])
+{
+	BLAKE3_TRANSPOSE_STEP(r, 16, 8,
+	    ((blake3_i16_t){ 0, 1, 2, 3, 4, 5, 6, 7,
+	    16, 17, 18, 19, 20, 21, 22, 23 }),
+	    ((blake3_i16_t){ 8, 9, 10, 11, 12, 13, 14, 15,
+	    24, 25, 26, 27, 28, 29, 30, 31 }));
+	BLAKE3_TRANSPOSE_STEP(r, 16, 4,
+	    ((blake3_i16_t){ 0, 1, 2, 3, 16, 17, 18, 19,
+	    8, 9, 10, 11, 24, 25, 26, 27 }),
+	    ((blake3_i16_t){ 4, 5, 6, 7, 20, 21, 22, 23,
+	    12, 13, 14, 15, 28, 29, 30, 31 }));
+	BLAKE3_TRANSPOSE_STEP(r, 16, 2,
+	    ((blake3_i16_t){ 0, 1, 16, 17, 4, 5, 20, 21,
+	    8, 9, 24, 25, 12, 13, 28, 29 }),
+	    ((blake3_i16_t){ 2, 3, 18, 19, 6, 7, 22, 23,
+	    10, 11, 26, 27, 14, 15, 30, 31 }));
+	BLAKE3_TRANSPOSE_STEP(r, 16, 1,
+	    ((blake3_i16_t){ 0, 16, 2, 18, 4, 20, 6, 22,
+	    8, 24, 10, 26, 12, 28, 14, 30 }),
+	    ((blake3_i16_t){ 1, 17, 3, 19, 5, 21, 7, 23,
+	    9, 25, 11, 27, 13, 29, 15, 31 }));
+}
+
+#define	BLAKE3_G(rot16, rot8, a, b, c, d, x, y)				\
+{									\
+	v[a] += v[b] + m[x];						\
+	v[d] = rot16(v[d] ^ v[a]);					\
+	v[c] += v[d];							\
+	v[b] = BLAKE3_ROTR(v[b] ^ v[c], 12);				\
+	v[a] += v[b] + m[y];						\
+	v[d] = rot8(v[d] ^ v[a]);					\
+	v[c] += v[d];							\
+	v[b] = BLAKE3_ROTR(v[b] ^ v[c], 7);				\
+}
+
+/* One round, with the message words in the order of its schedule. */
+#define	BLAKE3_ROUND(r16, r8, s0, s1, s2, s3, s4, s5, s6, s7,		\
+    s8, s9, s10, s11, s12, s13, s14, s15)				\
+{									\
+	BLAKE3_G(r16, r8, 0, 4, 8, 12, s0, s1);				\
+	BLAKE3_G(r16, r8, 1, 5, 9, 13, s2, s3);				\
+	BLAKE3_G(r16, r8, 2, 6, 10, 14, s4, s5);			\
+	BLAKE3_G(r16, r8, 3, 7, 11, 15, s6, s7);			\
+	BLAKE3_G(r16, r8, 0, 5, 10, 15, s8, s9);			\
+	BLAKE3_G(r16, r8, 1, 6, 11, 12, s10, s11);			\
+	BLAKE3_G(r16, r8, 2, 7, 8, 13, s12, s13);			\
+	BLAKE3_G(r16, r8, 3, 4, 9, 14, s14, s15);			\
+}
+
+/*
+ * The message words are loaded a square of lanes by words at a time and
+ * transposed, so that m[i] holds word i of every lane.  A final group that
+ * would leave at least half of the lanes idle is handed to the kernel for
+ * the next narrower vectors, if there is one.
+ */
+#define	BLAKE3_HASH_MANY(name, attr, vec_t, r16, r8, transpose, narrow)	\
+static attr void							\
+name(const uint8_t *const *inputs, size_t ninputs, size_t nblocks,	\
+    const uint32_t key[8], uint64_t counter, boolean_t increment,	\
+    uint8_t flags, uint8_t flags_start, uint8_t flags_end, uint8_t *out) \
+{									\
+	typedef vec_t blake3_v_t;					\
+	const int width = sizeof (blake3_v_t) / sizeof (uint32_t);	\
+									\
+	for (size_t base = 0; base < ninputs; base += width) {		\
+		const uint8_t *in[BLAKE3_MAX_LANES];			\
+		blake3_v_t h[8], v[16], m[16], clo, chi;		\
+		int n = MIN(width, ninputs - base);			\
+									\
+		if ((narrow) != (name) && n <= width / 2) {		\
+			narrow(inputs + base, n, nblocks, key,		\
+			    counter + (increment ? base : 0), increment, \
+			    flags, flags_start, flags_end,		\
+			    out + base * BLAKE3_OUT_LEN);		\
+			break;						\
+		}							\
+									\
+		for (int l = 0; l < width; l++) {			\
+			uint64_t c = counter +				\
+			    (increment ? base + l : 0);			\
+									\
+			in[l] = inputs[base + (l < n ? l : 0)];		\
+			clo[l] = (uint32_t)c;				\
+			chi[l] = (uint32_t)(c >> 32);			\
+		}							\
+		for (int i = 0; i < 8; i++)				\
+			h[i] = (blake3_v_t){ 0 } + key[i];		\
+									\
+		for (size_t b = 0; b < nblocks; b++) {			\
+			uint32_t bflags = flags;			\
+									\
+			if (b == 0)					\
+				bflags |= flags_start;			\
+			if (b == nblocks - 1)				\
+				bflags |= flags_end;			\
+									\
+			_Pragma("GCC unroll 4")				\
+			for (int g = 0; g < 16; g += width) {		\
+				_Pragma("GCC unroll 16")		\
+				for (int l = 0; l < width; l++) {	\
+					__builtin_memcpy(&m[g + l],	\
+					    in[l] + b * BLAKE3_BLOCK_LEN + \
+					    g * sizeof (uint32_t),	\
+					    sizeof (blake3_v_t));	\
+				}					\
+				transpose(&m[g]);			\
+			}						\
+									\
+			for (int i = 0; i < 8; i++) {			\
+				v[i] = h[i];				\
+				v[8 + i] = (blake3_v_t){ 0 } +		\
+				    blake3_iv[i];			\
+			}						\
+			v[12] = clo;					\
+			v[13] = chi;					\
+			v[14] = (blake3_v_t){ 0 } + BLAKE3_BLOCK_LEN;	\
+			v[15] = (blake3_v_t){ 0 } + bflags;		\
+									\
+			BLAKE3_ROUND(r16, r8, 0, 1, 2, 3, 4, 5, 6, 7,	\
+			    8, 9, 10, 11, 12, 13, 14, 15);		\
+			BLAKE3_ROUND(r16, r8, 2, 6, 3, 10, 7, 0, 4, 13,	\
+			    1, 11, 12, 5, 9, 14, 15, 8);		\
+			BLAKE3_ROUND(r16, r8, 3, 4, 10, 12, 13, 2, 7,	\
+			    14, 6, 5, 9, 0, 11, 15, 8, 1);		\
+			BLAKE3_ROUND(r16, r8, 10, 7, 12, 9, 14, 3, 13,	\
+			    15, 4, 0, 11, 2, 5, 8, 1, 6);		\
+			BLAKE3_ROUND(r16, r8, 12, 13, 9, 11, 15, 10,	\
+			    14, 8, 7, 2, 5, 3, 0, 1, 6, 4);		\
+			BLAKE3_ROUND(r16, r8, 9, 14, 11, 5, 8, 12, 15,	\
+			    1, 13, 3, 0, 10, 2, 6, 4, 7);		\
+			BLAKE3_ROUND(r16, r8, 11, 15, 5, 0, 1, 9, 8, 6,	\
+			    14, 10, 2, 12, 3, 4, 7, 13);		\
+									\
+			for (int i = 0; i < 8; i++)			\
+				h[i] = v[i] ^ v[i + 8];			\
+		}							\
+									\
+		for (int l = 0; l < n; l++) {				\
+			uint32_t *o = (uint32_t *)			\
+			    (out + (base + l) * BLAKE3_OUT_LEN);	\
+									\
+			for (int i = 0; i < 8; i++)			\
+				o[i] = LE_32(h[i][l]);			\
+		}							\
+	}								\
+}
+
+BLAKE3_HASH_MANY(blake3_hash_many_sse41, BLAKE3_SSE41, blake3_v4_t,
+    blake3_rot16_v4, blake3_rot8_v4, blake3_transpose_v4,
+    blake3_hash_many_sse41)
+BLAKE3_HASH_MANY(blake3_hash_many_avx2, BLAKE3_AVX2, blake3_v8_t,
+    blake3_rot16_v8, blake3_rot8_v8, blake3_transpose_v8,
+    blake3_hash_many_sse41)
+BLAKE3_HASH_MANY(blake3_hash_many_avx512, BLAKE3_AVX512, blake3_v16_t,
+    blake3_rot16_v16, blake3_rot8_v16, blake3_transpose_v16,
+    blake3_hash_many_avx2)
+
+static boolean_t
+blake3_sse41_valid(void)
+{
+	__builtin_cpu_init();
+	return (__builtin_cpu_supports("sse4.1") ? B_TRUE : B_FALSE);
+}
+
+static boolean_t
+blake3_avx2_valid(void)
+{
+	__builtin_cpu_init();
+	return (__builtin_cpu_supports("avx2") ? B_TRUE : B_FALSE);
+}
+
+static boolean_t
+blake3_avx512_valid(void)
+{
+	__builtin_cpu_init();
+	return (__builtin_cpu_supports("avx2") &&
+	    __builtin_cpu_supports("avx512f") &&
+	    __builtin_cpu_supports("avx512vl") ? B_TRUE : B_FALSE);
+}
+
+const blake3_ops_t blake3_sse41_ops = {
+	.bo_name = "sse41",
+	.bo_valid = blake3_sse41_valid,
+	.bo_hash_many = blake3_hash_many_sse41,
+};
+
+const blake3_ops_t blake3_avx2_ops = {
+	.bo_name = "avx2",
+	.bo_valid = blake3_avx2_valid,
+	.bo_hash_many = blake3_hash_many_avx2,
+};
+
+const blake3_ops_t blake3_avx512_ops = {
+	.bo_name = "avx512",
+	.bo_valid = blake3_avx512_valid,
+	.bo_hash_many = blake3_hash_many_avx512,
+};
+
+#endif	/* __zfsd__ && __x86_64__ && __GNUC__ */
@@ -3315,6 +3315,8 @@ dbuf_write_ready(zio_t *zio, arc_buf_t *buf, void *vdb)
 	rw_enter(&dn->dn_struct_rwlock, RW_WRITER);
 	*db->db_blkptr = *bp;
 	rw_exit(&dn->dn_struct_rwlock);
+
+	dmu_objset_kstat_write(db->db_objset, zio);
 }
 
 /* ARGSUSED */
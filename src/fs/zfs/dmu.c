@@ -1505,6 +1505,8 @@ dmu_sync_ready(zio_t *zio, arc_buf_t *buf, void *varg)
 			ASSERT(BP_GET_LEVEL(bp) == 0);
 			bp->blk_fill = 1;
 		}
+		dmu_objset_kstat_write(((dmu_buf_impl_t *)db)->db_objset,
+		    zio);
 	}
 }
 
@@ -303,6 +303,36 @@ dmu_objset_byteswap(void *buf, size_t size)
 	}
 }
 
+static void
+dmu_objset_kstat_init(objset_t *os)
+{
+	objset_kstats_t *osk = &os->os_kstats;
+	char module[KSTAT_STRLEN];
+	char name[KSTAT_STRLEN];
+	kstat_t *ksp;
+
+	kstat_named_init(&osk->osk_compress_aborts,
+	    "compress_aborts", KSTAT_DATA_UINT64);
+	kstat_named_init(&osk->osk_compress_abort_bytes,
+	    "compress_abort_bytes", KSTAT_DATA_UINT64);
+	kstat_named_init(&osk->osk_compress_abort_saved_ns,
+	    "compress_abort_saved_ns", KSTAT_DATA_UINT64);
+
+	(void) snprintf(module, sizeof (module), "zfs/%s",
+	    spa_name(os->os_spa));
+	(void) snprintf(name, sizeof (name), "objset-0x%llx",
+	    (u_longlong_t)dmu_objset_id(os));
+
+	ksp = kstat_create(module, 0, name, "misc", KSTAT_TYPE_NAMED,
+	    sizeof (*osk) / sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
+	if (ksp != NULL) {
+		ksp->ks_data = osk;
+		kstat_install(ksp);
+	}
+
+	os->os_kstat = ksp;
+}
+
 int
 dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
     objset_t **osp)
@@ -477,10 +507,30 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 		    DMU_GROUPUSED_OBJECT, &os->os_groupused_dnode);
 	}
 
+	dmu_objset_kstat_init(os);
+
 	*osp = os;
 	return (0);
 }
 
+/*
+ * Account for a write of one of this objset's blocks.  Called from the
+ * write's ready callback.
+ */
+void
+dmu_objset_kstat_write(objset_t *os, const zio_t *zio)
+{
+	objset_kstats_t *osk = &os->os_kstats;
+
+	if (zio->io_compress_aborted) {
+		atomic_inc_64(&osk->osk_compress_aborts.value.ui64);
+		atomic_add_64(&osk->osk_compress_abort_bytes.value.ui64,
+		    zio->io_lsize);
+		atomic_add_64(&osk->osk_compress_abort_saved_ns.value.ui64,
+		    zio->io_compress_saved);
+	}
+}
+
 int
 dmu_objset_from_ds(dsl_dataset_t *ds, objset_t **osp)
 {
@@ -747,6 +797,7 @@ dmu_objset_evict_done(objset_t *os)
 	rw_enter(&os_lock, RW_READER);
 	rw_exit(&os_lock);
 
+	kstat_delete(os->os_kstat);
 	mutex_destroy(&os->os_lock);
 	mutex_destroy(&os->os_obj_lock);
 	mutex_destroy(&os->os_user_ptr_lock);
@@ -513,6 +513,13 @@ backup_do_embed(dmu_sendarg_t *dsp, const blkptr_t *bp)
 	    !(dsp->dsa_featureflags & DMU_BACKUP_FEATURE_LZ4)))
 		return (B_FALSE);
 
+	/*
+	 * Nor can the stream ask for compression functions that need a
+	 * pool feature; send such blocks as ordinary writes instead.
+	 */
+	if (zio_compress_to_feature(BP_GET_COMPRESS(bp)) != SPA_FEATURE_NONE)
+		return (B_FALSE);
+
 	/*
 	 * Embed type must be explicitly enabled.
 	 */
@@ -690,11 +697,16 @@ do_dump(dmu_sendarg_t *dsa, struct send_block_record *data)
 		 *  - this isn't an embedded block
 		 *  - this isn't metadata (if receiving on a different endian
 		 *    system it can be byteswapped more easily)
+		 *  - the compression function doesn't need a pool feature,
+		 *    which the stream has no way to ask the receiver for
 		 */
 		boolean_t request_compressed =
 		    (dsa->dsa_featureflags & DMU_BACKUP_FEATURE_COMPRESSED) &&
 		    !split_large_blocks && !BP_SHOULD_BYTESWAP(bp) &&
-		    !BP_IS_EMBEDDED(bp) && !DMU_OT_IS_METADATA(BP_GET_TYPE(bp));
+		    !BP_IS_EMBEDDED(bp) &&
+		    !DMU_OT_IS_METADATA(BP_GET_TYPE(bp)) &&
+		    zio_compress_to_feature(BP_GET_COMPRESS(bp)) ==
+		    SPA_FEATURE_NONE;
 
 		ASSERT0(zb->zb_level);
 		ASSERT(zb->zb_object > dsa->dsa_resume_object ||
@@ -0,0 +1,229 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * x86 multi-buffer Edon-R 512 kernels
+ *
+ * The Edon-R compression function is built entirely from 64-bit adds,
+ * rotates and xors on the words of the double pipe.  These kernels run
+ * the quasigroup transformations of Q512() in lib/libspl/edonr.c on
+ * several independent messages at once, one per 64-bit lane.  The same
+ * source is built for 256-bit AVX2 vectors (two passes of four lanes) and
+ * for 512-bit AVX-512 vectors.
+ */
+
+#if defined(__zfsd__) && defined(__x86_64__) && defined(__GNUC__)
+
+#include <sys/types.h>
+#include <sys/byteorder.h>
+#include <sys/zfs_edonr.h>
+
+#define	EDONR_AVX2	__attribute__((target("avx2")))
+#define	EDONR_AVX512	__attribute__((target("avx2,avx512f")))
+
+typedef uint64_t edonr_v4_t __attribute__((vector_size(32)));
+typedef uint64_t edonr_v8_t __attribute__((vector_size(64)));
+
+#define	EDONR_ROTL(x, n)	(((x) << (n)) | ((x) >> (64 - (n))))
+
+/*
+ * The Latin square and quasigroup macros of edonr.c, on vectors of type
+ * edonr_v_t.
+ */
+#define	EDONR_LS1(c, x0, x1, x2, x3, x4, x5, x6, x7)			\
+{									\
+	edonr_v_t x04, x17, x23, x56, x07, x26;				\
+	x04 = x0 + x4, x17 = x1 + x7, x07 = x04 + x17;			\
+	s0 = c + x07 + x2;						\
+	s1 = EDONR_ROTL(x07 + x3, 5);					\
+	s2 = EDONR_ROTL(x07 + x6, 15);					\
+	x23 = x2 + x3;							\
+	s5 = EDONR_ROTL(x04 + x23 + x5, 40);				\
+	x56 = x5 + x6;							\
+	s6 = EDONR_ROTL(x17 + x56 + x0, 50);				\
+	x26 = x23 + x56;						\
+	s3 = EDONR_ROTL(x26 + x7, 22);					\
+	s4 = EDONR_ROTL(x26 + x1, 31);					\
+	s7 = EDONR_ROTL(x26 + x4, 59);					\
+}
+
+#define	EDONR_LS2(c, y0, y1, y2, y3, y4, y5, y6, y7)			\
+{									\
+	edonr_v_t y01, y25, y34, y67, y04, y05, y27, y37;		\
+	y01 = y0 + y1, y25 = y2 + y5, y05 = y01 + y25;			\
+	t0 = ~c + y05 + y7;						\
+	t2 = EDONR_ROTL(y05 + y3, 19);					\
+	y34 = y3 + y4, y04 = y01 + y34;					\
+	t1 = EDONR_ROTL(y04 + y6, 10);					\
+	t4 = EDONR_ROTL(y04 + y5, 36);					\
+	y67 = y6 + y7, y37 = y34 + y67;					\
+	t3 = EDONR_ROTL(y37 + y2, 29);					\
+	t7 = EDONR_ROTL(y37 + y0, 55);					\
+	y27 = y25 + y67;						\
+	t5 = EDONR_ROTL(y27 + y4, 44);					\
+	t6 = EDONR_ROTL(y27 + y1, 48);					\
+}
+
+#define	EDONR_EXFORM(r0, r1, r2, r3, r4, r5, r6, r7)			\
+{									\
+	edonr_v_t s04, s17, s23, s56, t01, t25, t34, t67;		\
+	s04 = s0 ^ s4, t01 = t0 ^ t1;					\
+	r0 = (s04 ^ s1) + (t01 ^ t5);					\
+	t67 = t6 ^ t7;							\
+	r1 = (s04 ^ s7) + (t2 ^ t67);					\
+	s23 = s2 ^ s3;							\
+	r7 = (s23 ^ s5) + (t4 ^ t67);					\
+	t34 = t3 ^ t4;							\
+	r3 = (s23 ^ s4) + (t0 ^ t34);					\
+	s56 = s5 ^ s6;							\
+	r5 = (s3 ^ s56) + (t34 ^ t6);					\
+	t25 = t2 ^ t5;							\
+	r6 = (s2 ^ s56) + (t25 ^ t7);					\
+	s17 = s1 ^ s7;							\
+	r4 = (s0 ^ s17) + (t1 ^ t25);					\
+	r2 = (s17 ^ s6) + (t01 ^ t3);					\
+}
+
+#define	EDONR_MB_KERNEL(name, attr, vec_t)				\
+static attr void							\
+name(uint64_t p[16][EDONR_LANES], const uint8_t *const data[EDONR_LANES], \
+    size_t nblocks)							\
+{									\
+	typedef vec_t edonr_v_t;					\
+	const int width = sizeof (edonr_v_t) / sizeof (uint64_t);	\
+	const edonr_v_t defix = (edonr_v_t){ 0 } + 0xaaaaaaaaaaaaaaaaULL; \
+									\
+	for (int base = 0; base < EDONR_LANES; base += width) {		\
+		edonr_v_t P[16], d[16];					\
+									\
+		for (int i = 0; i < 16; i++) {				\
+			for (int l = 0; l < width; l++)			\
+				P[i][l] = p[i][base + l];		\
+		}							\
+									\
+		for (size_t b = 0; b < nblocks; b++) {			\
+			edonr_v_t s0, s1, s2, s3, s4, s5, s6, s7;	\
+			edonr_v_t t0, t1, t2, t3, t4, t5, t6, t7;	\
+			edonr_v_t p0, p1, p2, p3, p4, p5, p6, p7;	\
+			edonr_v_t q0, q1, q2, q3, q4, q5, q6, q7;	\
+									\
+			for (int l = 0; l < width; l++) {		\
+				const uint64_t *w = (const uint64_t *)	\
+				    (data[base + l] + b * 128);		\
+									\
+				for (int i = 0; i < 16; i++)		\
+					d[i][l] = LE_64(w[i]);		\
+			}						\
+									\
+			EDONR_LS1(defix, d[15], d[14], d[13], d[12],	\
+			    d[11], d[10], d[9], d[8]);			\
+			EDONR_LS2(defix, d[0], d[1], d[2], d[3], d[4],	\
+			    d[5], d[6], d[7]);				\
+			EDONR_EXFORM(p0, p1, p2, p3, p4, p5, p6, p7);	\
+									\
+			EDONR_LS1(defix, p0, p1, p2, p3, p4, p5, p6, p7); \
+			EDONR_LS2(defix, d[8], d[9], d[10], d[11],	\
+			    d[12], d[13], d[14], d[15]);		\
+			EDONR_EXFORM(q0, q1, q2, q3, q4, q5, q6, q7);	\
+									\
+			EDONR_LS1(defix, P[8], P[9], P[10], P[11],	\
+			    P[12], P[13], P[14], P[15]);		\
+			EDONR_LS2(defix, p0, p1, p2, p3, p4, p5, p6, p7); \
+			EDONR_EXFORM(p0, p1, p2, p3, p4, p5, p6, p7);	\
+									\
+			EDONR_LS1(defix, p0, p1, p2, p3, p4, p5, p6, p7); \
+			EDONR_LS2(defix, q0, q1, q2, q3, q4, q5, q6, q7); \
+			EDONR_EXFORM(q0, q1, q2, q3, q4, q5, q6, q7);	\
+									\
+			EDONR_LS1(defix, p0, p1, p2, p3, p4, p5, p6, p7); \
+			EDONR_LS2(defix, P[0], P[1], P[2], P[3], P[4],	\
+			    P[5], P[6], P[7]);				\
+			EDONR_EXFORM(p0, p1, p2, p3, p4, p5, p6, p7);	\
+									\
+			EDONR_LS1(defix, q0, q1, q2, q3, q4, q5, q6, q7); \
+			EDONR_LS2(defix, p0, p1, p2, p3, p4, p5, p6, p7); \
+			EDONR_EXFORM(q0, q1, q2, q3, q4, q5, q6, q7);	\
+									\
+			EDONR_LS1(defix, d[7], d[6], d[5], d[4], d[3],	\
+			    d[2], d[1], d[0]);				\
+			EDONR_LS2(defix, p0, p1, p2, p3, p4, p5, p6, p7); \
+			EDONR_EXFORM(p0, p1, p2, p3, p4, p5, p6, p7);	\
+									\
+			EDONR_LS1(defix, p0, p1, p2, p3, p4, p5, p6, p7); \
+			EDONR_LS2(defix, q0, q1, q2, q3, q4, q5, q6, q7); \
+			EDONR_EXFORM(q0, q1, q2, q3, q4, q5, q6, q7);	\
+									\
+			P[0] ^= d[8] ^ p0;				\
+			P[1] ^= d[9] ^ p1;				\
+			P[2] ^= d[10] ^ p2;				\
+			P[3] ^= d[11] ^ p3;				\
+			P[4] ^= d[12] ^ p4;				\
+			P[5] ^= d[13] ^ p5;				\
+			P[6] ^= d[14] ^ p6;				\
+			P[7] ^= d[15] ^ p7;				\
+			P[8] ^= d[0] ^ q0;				\
+			P[9] ^= d[1] ^ q1;				\
+			P[10] ^= d[2] ^ q2;				\
+			P[11] ^= d[3] ^ q3;				\
+			P[12] ^= d[4] ^ q4;				\
+			P[13] ^= d[5] ^ q5;				\
+			P[14] ^= d[6] ^ q6;				\
+			P[15] ^= d[7] ^ q7;				\
+		}							\
+									\
+		for (int i = 0; i < 16; i++) {				\
+			for (int l = 0; l < width; l++)			\
+				p[i][base + l] = P[i][l];		\
+		}							\
+	}								\
+}
+
+EDONR_MB_KERNEL(edonr_compress_mb_avx2, EDONR_AVX2, edonr_v4_t)
+EDONR_MB_KERNEL(edonr_compress_mb_avx512, EDONR_AVX512, edonr_v8_t)
+
+static boolean_t
+edonr_avx2_valid(void)
+{
+	__builtin_cpu_init();
+	return (__builtin_cpu_supports("avx2") ? B_TRUE : B_FALSE);
+}
+
+static boolean_t
+edonr_avx512_valid(void)
+{
+	__builtin_cpu_init();
+	return (__builtin_cpu_supports("avx2") &&
+	    __builtin_cpu_supports("avx512f") ? B_TRUE : B_FALSE);
+}
+
+const edonr_ops_t edonr_avx2_ops = {
+	.eo_name = "avx2",
+	.eo_valid = edonr_avx2_valid,
+	.eo_compress_mb = edonr_compress_mb_avx2,
+};
+
+const edonr_ops_t edonr_avx512_ops = {
+	.eo_name = "avx512",
+	.eo_valid = edonr_avx512_valid,
+	.eo_compress_mb = edonr_compress_mb_avx512,
+};
+
+#endif	/* __zfsd__ && __x86_64__ && __GNUC__ */
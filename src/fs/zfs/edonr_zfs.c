@@ -25,6 +25,11 @@
 #include <sys/zfs_context.h>
 #include <sys/zio.h>
 #include <sys/edonr.h>
+#if defined(__zfsd__)
+#include <sys/zio_checksum.h>
+#include <sys/zfs_bench.h>
+#include <sys/zfs_edonr.h>
+#endif /* defined(__zfsd__) */
 
 #define	EDONR_MODE		512
 #define	EDONR_BLOCK_SIZE	EdonR512_BLOCK_SIZE
@@ -47,6 +52,134 @@ zio_checksum_edonr_native(const void *buf, uint64_t size,
 	bcopy(digest, zcp->zc_word, sizeof (zcp->zc_word));
 }
 
+#if defined(__zfsd__)
+/*
+ * Batches of equally sized blocks can be hashed by the multi-buffer
+ * kernels in edonr_x86.c, when edonr_init() found them faster than the
+ * reference code.  The measured bandwidths are exported as the named kstat
+ * "zfs:0:edonr_bench".
+ */
+static boolean_t
+edonr_generic_valid(void)
+{
+	return (B_TRUE);
+}
+
+/* The reference code, one buffer at a time. */
+static const edonr_ops_t edonr_generic_ops = {
+	.eo_name = "generic",
+	.eo_valid = edonr_generic_valid,
+};
+
+static const edonr_ops_t *edonr_algos[] = {
+	&edonr_generic_ops,
+#if defined(__x86_64__) && defined(__GNUC__)
+	&edonr_avx2_ops,
+	&edonr_avx512_ops,
+#endif
+};
+
+#define	EDONR_NALGOS	(sizeof (edonr_algos) / sizeof (edonr_algos[0]))
+
+static const edonr_ops_t *volatile edonr_multi = NULL;
+
+/*
+ * Hash up to EDONR_LANES messages of the same size, continuing from the
+ * salt block already absorbed by the template.  The padding is that of
+ * EdonRFinal(): a one bit, zeroes and the total message length in bits,
+ * spilling into a second block when fewer than 64 bits are left.  Unused
+ * lanes repeat the first message and their results are discarded.
+ */
+static void
+edonr_hash_mb(const edonr_ops_t *ops, const EdonRState *tmpl,
+    const void **data, uint64_t size, int count, zio_cksum_t *zcp)
+{
+	uint8_t pad[EDONR_LANES][2 * EDONR_BLOCK_SIZE];
+	const uint8_t *ptr[EDONR_LANES];
+	uint64_t p[16][EDONR_LANES];
+	uint64_t nblocks = size / EDONR_BLOCK_SIZE;
+	size_t rem = size % EDONR_BLOCK_SIZE;
+	size_t len = (rem < EDONR_BLOCK_SIZE - 8) ?
+	    EDONR_BLOCK_SIZE : 2 * EDONR_BLOCK_SIZE;
+	uint64_t bits = tmpl->bits_processed + size * 8;
+
+	ASSERT3S(count, >, 0);
+	ASSERT3S(count, <=, EDONR_LANES);
+	ASSERT0(tmpl->unprocessed_bits);
+
+	for (int w = 0; w < 16; w++) {
+		for (int l = 0; l < EDONR_LANES; l++)
+			p[w][l] = tmpl->pipe->p512->DoublePipe[w];
+	}
+
+	for (int l = 0; l < EDONR_LANES; l++)
+		ptr[l] = data[l < count ? l : 0];
+	if (nblocks != 0)
+		ops->eo_compress_mb(p, ptr, nblocks);
+
+	for (int l = 0; l < EDONR_LANES; l++) {
+		bcopy(ptr[l] + nblocks * EDONR_BLOCK_SIZE, pad[l], rem);
+		pad[l][rem] = 0x80;
+		bzero(pad[l] + rem + 1, len - rem - 1);
+		for (int i = 0; i < 8; i++)
+			pad[l][len - 8 + i] = (uint8_t)(bits >> (8 * i));
+		ptr[l] = pad[l];
+	}
+	ops->eo_compress_mb(p, ptr, len / EDONR_BLOCK_SIZE);
+
+	for (int l = 0; l < count; l++) {
+		for (int i = 0; i < 4; i++)
+			zcp[l].zc_word[i] = LE_64(p[8 + i][l]);
+	}
+}
+#endif /* defined(__zfsd__) */
+
+/*
+ * Checksum a batch of buffers.  Runs of equally sized buffers go through
+ * the multi-buffer kernel if one was selected.
+ */
+void
+zio_checksum_edonr_batch(const void **data, const uint64_t *size, int count,
+    const void *ctx_template, zio_cksum_t *zcp)
+{
+	int i, n;
+
+	ASSERT(ctx_template != NULL);
+
+	for (i = 0; i < count; i += n) {
+#if defined(__zfsd__)
+		const edonr_ops_t *multi = edonr_multi;
+
+		for (n = 1; i + n < count && n < EDONR_LANES &&
+		    size[i + n] == size[i]; n++)
+			continue;
+
+		if (multi != NULL && n > 1) {
+			edonr_hash_mb(multi, ctx_template, &data[i], size[i],
+			    n, &zcp[i]);
+			continue;
+		}
+#endif /* defined(__zfsd__) */
+
+		n = 1;
+		zio_checksum_edonr_native(data[i], size[i], ctx_template,
+		    &zcp[i]);
+	}
+}
+
+/*
+ * Batches are worth forming only if a multi-buffer kernel was selected.
+ */
+int
+zio_checksum_edonr_batch_width(void)
+{
+#if defined(__zfsd__)
+	if (edonr_multi != NULL)
+		return (EDONR_LANES);
+#endif /* defined(__zfsd__) */
+	return (0);
+}
+
 /*
  * Byteswapped zio_checksum interface for the Edon-R hash function.
  */
@@ -57,10 +190,10 @@ zio_checksum_edonr_byteswap(const void *buf, uint64_t size,
 	zio_cksum_t	tmp;
 
 	zio_checksum_edonr_native(buf, size, ctx_template, &tmp);
-	zcp->zc_word[0] = BSWAP_64(zcp->zc_word[0]);
-	zcp->zc_word[1] = BSWAP_64(zcp->zc_word[1]);
-	zcp->zc_word[2] = BSWAP_64(zcp->zc_word[2]);
-	zcp->zc_word[3] = BSWAP_64(zcp->zc_word[3]);
+	zcp->zc_word[0] = BSWAP_64(tmp.zc_word[0]);
+	zcp->zc_word[1] = BSWAP_64(tmp.zc_word[1]);
+	zcp->zc_word[2] = BSWAP_64(tmp.zc_word[2]);
+	zcp->zc_word[3] = BSWAP_64(tmp.zc_word[3]);
 }
 
 void *
@@ -100,3 +233,138 @@ zio_checksum_edonr_tmpl_free(void *ctx_template)
 	bzero(ctx, sizeof (*ctx));
 	kmem_free(ctx, sizeof (*ctx));
 }
+
+#if defined(__zfsd__)
+int
+edonr_impl_set(const char *name)
+{
+	for (int i = 0; i < EDONR_NALGOS; i++) {
+		const edonr_ops_t *ops = edonr_algos[i];
+
+		if (strcmp(ops->eo_name, name) == 0 && ops->eo_valid()) {
+			edonr_multi = (ops->eo_compress_mb != NULL) ?
+			    ops : NULL;
+			return (0);
+		}
+	}
+
+	return (SET_ERROR(ENOTSUP));
+}
+
+const char *
+edonr_impl_get(void)
+{
+	const edonr_ops_t *multi = edonr_multi;
+
+	return (multi != NULL ? multi->eo_name : "generic");
+}
+
+#define	EDONR_BENCH_SIZE	(16 * 1024)
+
+static kstat_t *edonr_bench_ksp;
+
+typedef struct edonr_bench {
+	void		*eb_tmpl;
+	const void	*eb_bufs[EDONR_LANES];
+} edonr_bench_t;
+
+static const char *
+edonr_bench_name(int i, void *arg)
+{
+	return (edonr_algos[i]->eo_name);
+}
+
+static boolean_t
+edonr_bench_valid(int i, void *arg)
+{
+	return (edonr_algos[i]->eo_valid());
+}
+
+/*
+ * Hash EDONR_LANES buffers, either through a multi-buffer kernel or one at
+ * a time.
+ */
+static void
+edonr_bench_hash(const edonr_ops_t *ops, edonr_bench_t *eb, uint64_t size,
+    zio_cksum_t *zc)
+{
+	if (ops->eo_compress_mb != NULL) {
+		edonr_hash_mb(ops, eb->eb_tmpl, eb->eb_bufs, size, EDONR_LANES,
+		    zc);
+	} else {
+		for (int l = 0; l < EDONR_LANES; l++) {
+			zio_checksum_edonr_native(eb->eb_bufs[l], size,
+			    eb->eb_tmpl, &zc[l]);
+		}
+	}
+}
+
+static boolean_t
+edonr_bench_verify(int i, void *arg)
+{
+	for (uint64_t size = 0; size <= 300; size++) {
+		zio_cksum_t ref[EDONR_LANES], zc[EDONR_LANES];
+
+		edonr_bench_hash(&edonr_generic_ops, arg, size, ref);
+		edonr_bench_hash(edonr_algos[i], arg, size, zc);
+		for (int l = 0; l < EDONR_LANES; l++) {
+			if (!ZIO_CHECKSUM_EQUAL(ref[l], zc[l]))
+				return (B_FALSE);
+		}
+	}
+
+	return (B_TRUE);
+}
+
+static uint64_t
+edonr_bench_run(int i, void *arg)
+{
+	zio_cksum_t zc[EDONR_LANES];
+
+	edonr_bench_hash(edonr_algos[i], arg, EDONR_BENCH_SIZE, zc);
+	return (EDONR_LANES * EDONR_BENCH_SIZE);
+}
+
+static const zfs_bench_ops_t edonr_bench_ops = {
+	.zbo_nimpls = EDONR_NALGOS,
+	.zbo_name = edonr_bench_name,
+	.zbo_valid = edonr_bench_valid,
+	.zbo_verify = edonr_bench_verify,
+	.zbo_run = edonr_bench_run,
+};
+
+/*
+ * Verify the multi-buffer kernels against the reference code and use the
+ * fastest of them for batches if it beats hashing one buffer at a time.
+ */
+void
+edonr_init(void)
+{
+	const edonr_ops_t *ops;
+	zio_cksum_salt_t salt;
+	edonr_bench_t eb;
+	uint8_t *buf;
+
+	buf = kmem_alloc(EDONR_LANES * EDONR_BENCH_SIZE, KM_SLEEP);
+	zfs_bench_fill(buf, EDONR_LANES * EDONR_BENCH_SIZE);
+	for (int l = 0; l < EDONR_LANES; l++)
+		eb.eb_bufs[l] = buf + l * EDONR_BENCH_SIZE;
+	for (int i = 0; i < sizeof (salt.zcs_bytes); i++)
+		salt.zcs_bytes[i] = (uint8_t)(i * 7);
+	eb.eb_tmpl = zio_checksum_edonr_tmpl_init(&salt);
+
+	ops = edonr_algos[zfs_bench_select("edonr_bench", &edonr_bench_ops,
+	    &eb, NULL, &edonr_bench_ksp)];
+	edonr_multi = (ops->eo_compress_mb != NULL) ? ops : NULL;
+
+	zio_checksum_edonr_tmpl_free(eb.eb_tmpl);
+	kmem_free(buf, EDONR_LANES * EDONR_BENCH_SIZE);
+}
+
+void
+edonr_fini(void)
+{
+	kstat_delete(edonr_bench_ksp);
+	edonr_bench_ksp = NULL;
+}
+#endif /* defined(__zfsd__) */
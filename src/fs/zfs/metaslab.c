@@ -477,7 +477,8 @@ metaslab_verify_space(metaslab_t *msp, uint64_t txg)
 	}
 
 	msp_free_space = range_tree_space(msp->ms_tree) + allocated +
-	    msp->ms_deferspace + range_tree_space(msp->ms_freedtree);
+	    msp->ms_deferspace + range_tree_space(msp->ms_freedtree) +
+	    range_tree_space(msp->ms_trimmingtree);
 
 	VERIFY3U(sm_free_space, ==, msp_free_space);
 }
@@ -1358,6 +1359,13 @@ metaslab_load(metaslab_t *msp)
 			range_tree_walk(msp->ms_defertree[t],
 			    range_tree_remove, msp->ms_tree);
 		}
+
+		/*
+		 * Space that is being trimmed must not be allocated until
+		 * the trim completes.
+		 */
+		range_tree_walk(msp->ms_trimmingtree,
+		    range_tree_remove, msp->ms_tree);
 		msp->ms_max_size = metaslab_block_maxsize(msp);
 	}
 	cv_broadcast(&msp->ms_load_cv);
@@ -1477,6 +1485,10 @@ metaslab_fini(metaslab_t *msp)
 		range_tree_destroy(msp->ms_defertree[t]);
 	}
 
+	range_tree_vacate(msp->ms_trimtree, NULL, NULL);
+	range_tree_destroy(msp->ms_trimtree);
+	range_tree_destroy(msp->ms_trimmingtree);
+
 	ASSERT0(msp->ms_deferspace);
 
 	mutex_exit(&msp->ms_lock);
@@ -1648,8 +1660,9 @@ metaslab_space_weight(metaslab_t *msp)
 	 * higher weight to lower metaslabs (multiplier ranging from 2x to 1x).
 	 * In effect, this means that we'll select the metaslab with the most
 	 * free bandwidth rather than simply the one with the most free space.
+	 * Solid state devices have no such zones.
 	 */
-	if (metaslab_lba_weighting_enabled) {
+	if (metaslab_lba_weighting_enabled && !vd->vdev_nonrot) {
 		weight = 2 * weight - (msp->ms_id * weight) / vd->vdev_ms_count;
 		ASSERT(weight >= space && weight <= 2 * space);
 	}
@@ -2120,6 +2133,11 @@ metaslab_condense(metaslab_t *msp, uint64_t txg, dmu_tx_t *tx)
 		    range_tree_remove, condense_tree);
 	}
 
+	/*
+	 * Space being trimmed is free, although it is not in the ms_tree.
+	 */
+	range_tree_walk(msp->ms_trimmingtree, range_tree_remove, condense_tree);
+
 	for (int t = 1; t < TXG_CONCURRENT_STATES; t++) {
 		range_tree_walk(msp->ms_alloctree[(txg + t) & TXG_MASK],
 		    range_tree_remove, condense_tree);
@@ -2269,6 +2287,7 @@ metaslab_sync(metaslab_t *msp, uint64_t txg)
 			space_map_histogram_add(msp->ms_sm,
 			    msp->ms_defertree[t], tx);
 		}
+		space_map_histogram_add(msp->ms_sm, msp->ms_trimmingtree, tx);
 	}
 
 	/*
@@ -2312,6 +2331,24 @@ metaslab_sync(metaslab_t *msp, uint64_t txg)
 	dmu_tx_commit(tx);
 }
 
+/*
+ * Note that the space in rt, which is about to become allocatable again,
+ * may be trimmed.
+ */
+static void
+metaslab_trim_add(metaslab_t *msp, range_tree_t *rt)
+{
+	spa_t *spa = msp->ms_group->mg_vd->vdev_spa;
+
+	ASSERT(MUTEX_HELD(&msp->ms_lock));
+
+	if (!zfs_trim_enabled || range_tree_space(rt) == 0)
+		return;
+
+	range_tree_walk(rt, range_tree_add, msp->ms_trimtree);
+	spa->spa_trim_pending = B_TRUE;
+}
+
 /*
  * Called after a transaction group has completely synced to mark
  * all of the metaslab's free space as usable.
@@ -2357,6 +2394,13 @@ metaslab_sync_done(metaslab_t *msp, uint64_t txg)
 			    &msp->ms_lock);
 		}
 
+		ASSERT3P(msp->ms_trimtree, ==, NULL);
+		msp->ms_trimtree = range_tree_create(NULL, msp, &msp->ms_lock);
+
+		ASSERT3P(msp->ms_trimmingtree, ==, NULL);
+		msp->ms_trimmingtree = range_tree_create(NULL, msp,
+		    &msp->ms_lock);
+
 		vdev_space_update(vd, 0, 0, msp->ms_size);
 	}
 
@@ -2391,11 +2435,13 @@ metaslab_sync_done(metaslab_t *msp, uint64_t txg)
 	 * defer_tree -- this is safe to do because we've just emptied out
 	 * the defer_tree.
 	 */
+	metaslab_trim_add(msp, *defer_tree);
 	range_tree_vacate(*defer_tree,
 	    msp->ms_loaded ? range_tree_add : NULL, msp->ms_tree);
 	if (defer_allowed) {
 		range_tree_swap(&msp->ms_freedtree, defer_tree);
 	} else {
+		metaslab_trim_add(msp, msp->ms_freedtree);
 		range_tree_vacate(msp->ms_freedtree,
 		    msp->ms_loaded ? range_tree_add : NULL, msp->ms_tree);
 	}
@@ -2640,6 +2686,7 @@ metaslab_block_alloc(metaslab_t *msp, uint64_t size, uint64_t txg)
 		VERIFY0(P2PHASE(size, 1ULL << vd->vdev_ashift));
 		VERIFY3U(range_tree_space(rt) - size, <=, msp->ms_size);
 		range_tree_remove(rt, start, size);
+		range_tree_clear(msp->ms_trimtree, start, size);
 
 		if (range_tree_space(msp->ms_alloctree[txg & TXG_MASK]) == 0)
 			vdev_dirty(mg->mg_vd, VDD_METASLAB, msp, txg);
@@ -3210,6 +3257,7 @@ metaslab_claim_dva(spa_t *spa, const dva_t *dva, uint64_t txg)
 	VERIFY0(P2PHASE(size, 1ULL << vd->vdev_ashift));
 	VERIFY3U(range_tree_space(msp->ms_tree) - size, <=, msp->ms_size);
 	range_tree_remove(msp->ms_tree, offset, size);
+	range_tree_clear(msp->ms_trimtree, offset, size);
 
 	if (spa_writeable(spa)) {	/* don't dirty if we're zdb(1M) */
 		if (range_tree_space(msp->ms_alloctree[txg & TXG_MASK]) == 0)
@@ -3395,6 +3443,8 @@ metaslab_check_free(spa_t *spa, const blkptr_t *bp)
 		range_tree_verify(msp->ms_freedtree, offset, size);
 		for (int j = 0; j < TXG_DEFER_SIZE; j++)
 			range_tree_verify(msp->ms_defertree[j], offset, size);
+		range_tree_verify(msp->ms_trimtree, offset, size);
+		range_tree_verify(msp->ms_trimmingtree, offset, size);
 	}
 	spa_config_exit(spa, SCL_VDEV, FTAG);
 }
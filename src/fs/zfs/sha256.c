@@ -27,26 +27,407 @@
  */
 #include <sys/zfs_context.h>
 #include <sys/zio.h>
+#include <sys/zio_checksum.h>
 #if defined(__zfsd__)
-#include <openssl/sha.h>
+#include <sys/zfs_bench.h>
+#include <sys/zfs_sha2.h>
 #else
 #include <sys/sha2.h>
 #endif /* defined(__zfsd__) */
 
+#if defined(__zfsd__)
+/*
+ * SHA-256
+ *
+ * zfsd carries its own SHA-256 so that it can use the x86 SHA extensions
+ * for single buffers and SIMD multi-buffer kernels for batches of equally
+ * sized blocks (see zio_checksum_batch()).  sha2_init() picks the fastest
+ * implementation of each kind; the measured bandwidths are exported as the
+ * named kstat "zfs:0:sha256_bench".
+ */
+
+const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t sha256_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+#define	ROTR32(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+#define	SHA256_S0(x)	(ROTR32(x, 2) ^ ROTR32(x, 13) ^ ROTR32(x, 22))
+#define	SHA256_S1(x)	(ROTR32(x, 6) ^ ROTR32(x, 11) ^ ROTR32(x, 25))
+#define	SHA256_s0(x)	(ROTR32(x, 7) ^ ROTR32(x, 18) ^ ((x) >> 3))
+#define	SHA256_s1(x)	(ROTR32(x, 17) ^ ROTR32(x, 19) ^ ((x) >> 10))
+#define	SHA256_CH(x, y, z)	(((x) & (y)) ^ (~(x) & (z)))
+#define	SHA256_MAJ(x, y, z)	(((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+
+static uint32_t
+sha256_load_be32(const uint8_t *p)
+{
+	return (((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+	    ((uint32_t)p[2] << 8) | (uint32_t)p[3]);
+}
+
+static void
+sha256_compress_generic(uint32_t *state, const uint8_t *blocks,
+    size_t nblocks)
+{
+	uint32_t W[64];
+
+	for (; nblocks != 0; nblocks--, blocks += SHA256_BLOCK_SIZE) {
+		uint32_t a = state[0], b = state[1], c = state[2];
+		uint32_t d = state[3], e = state[4], f = state[5];
+		uint32_t g = state[6], h = state[7];
+
+		for (int t = 0; t < 16; t++)
+			W[t] = sha256_load_be32(blocks + 4 * t);
+		for (int t = 16; t < 64; t++) {
+			W[t] = SHA256_s1(W[t - 2]) + W[t - 7] +
+			    SHA256_s0(W[t - 15]) + W[t - 16];
+		}
+
+		for (int t = 0; t < 64; t++) {
+			uint32_t T1 = h + SHA256_S1(e) + SHA256_CH(e, f, g) +
+			    sha256_k[t] + W[t];
+			uint32_t T2 = SHA256_S0(a) + SHA256_MAJ(a, b, c);
+
+			h = g;
+			g = f;
+			f = e;
+			e = d + T1;
+			d = c;
+			c = b;
+			b = a;
+			a = T1 + T2;
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+		state[5] += f;
+		state[6] += g;
+		state[7] += h;
+	}
+}
+
+static boolean_t
+sha256_generic_valid(void)
+{
+	return (B_TRUE);
+}
+
+static const sha256_ops_t sha256_generic_ops = {
+	.so_name = "generic",
+	.so_valid = sha256_generic_valid,
+	.so_compress = sha256_compress_generic,
+};
+
+static const sha256_ops_t *sha256_algos[] = {
+	&sha256_generic_ops,
+#if defined(__x86_64__) && defined(__GNUC__)
+	&sha256_shani_ops,
+	&sha256_avx2_ops,
+	&sha256_avx512_ops,
+#endif
+};
+
+#define	SHA256_NALGOS	(sizeof (sha256_algos) / sizeof (sha256_algos[0]))
+
+/*
+ * The single-buffer implementation, and the multi-buffer one if batches
+ * should use it at all.
+ */
+static const sha256_ops_t *volatile sha256_single = &sha256_generic_ops;
+static const sha256_ops_t *volatile sha256_multi = NULL;
+
+/*
+ * Build the final one or two blocks of a message of the given size, whose
+ * unprocessed tail starts at "tail".  Returns the number of blocks.
+ */
+static size_t
+sha256_pad(const uint8_t *tail, uint64_t size, uint8_t *pad)
+{
+	size_t rem = size % SHA256_BLOCK_SIZE;
+	size_t len = (rem < SHA256_BLOCK_SIZE - 8) ?
+	    SHA256_BLOCK_SIZE : 2 * SHA256_BLOCK_SIZE;
+	uint64_t bits = size << 3;
+
+	bcopy(tail, pad, rem);
+	pad[rem] = 0x80;
+	bzero(pad + rem + 1, len - rem - 1);
+	for (int i = 0; i < 8; i++)
+		pad[len - 1 - i] = (uint8_t)(bits >> (8 * i));
+
+	return (len / SHA256_BLOCK_SIZE);
+}
+
+/*
+ * Earlier versions of this function wrote the big-endian digest out
+ * through BE_64, so each checksum word holds two consecutive state words
+ * with the first in the upper half.  That must be preserved on disk.
+ */
+static void
+sha256_to_cksum(const uint32_t *H, zio_cksum_t *zcp)
+{
+	for (int i = 0; i < 4; i++)
+		zcp->zc_word[i] = ((uint64_t)H[2 * i] << 32) | H[2 * i + 1];
+}
+
+static void
+sha256_hash(const sha256_ops_t *ops, const void *buf, uint64_t size,
+    zio_cksum_t *zcp)
+{
+	uint8_t pad[2 * SHA256_BLOCK_SIZE];
+	uint64_t nblocks = size / SHA256_BLOCK_SIZE;
+	uint32_t H[8];
+	size_t npad;
+
+	bcopy(sha256_iv, H, sizeof (H));
+	if (nblocks != 0)
+		ops->so_compress(H, buf, nblocks);
+	npad = sha256_pad((const uint8_t *)buf + nblocks * SHA256_BLOCK_SIZE,
+	    size, pad);
+	ops->so_compress(H, pad, npad);
+	sha256_to_cksum(H, zcp);
+}
+
+/*
+ * Hash up to SHA256_LANES messages of the same size together.  Unused lanes
+ * repeat the first message and their results are discarded.
+ */
+static void
+sha256_hash_mb(const sha256_ops_t *ops, const void **data, uint64_t size,
+    int count, zio_cksum_t *zcp)
+{
+	uint8_t pad[SHA256_LANES][2 * SHA256_BLOCK_SIZE];
+	const uint8_t *ptr[SHA256_LANES];
+	uint32_t state[8][SHA256_LANES];
+	uint64_t nblocks = size / SHA256_BLOCK_SIZE;
+	size_t npad = 0;
+
+	ASSERT3S(count, >, 0);
+	ASSERT3S(count, <=, SHA256_LANES);
+
+	for (int w = 0; w < 8; w++) {
+		for (int l = 0; l < SHA256_LANES; l++)
+			state[w][l] = sha256_iv[w];
+	}
+
+	for (int l = 0; l < SHA256_LANES; l++)
+		ptr[l] = data[l < count ? l : 0];
+	if (nblocks != 0)
+		ops->so_compress_mb(state, ptr, nblocks);
+
+	for (int l = 0; l < SHA256_LANES; l++) {
+		npad = sha256_pad(ptr[l] + nblocks * SHA256_BLOCK_SIZE, size,
+		    pad[l]);
+		ptr[l] = pad[l];
+	}
+	ops->so_compress_mb(state, ptr, npad);
+
+	for (int l = 0; l < count; l++) {
+		uint32_t H[8];
+
+		for (int w = 0; w < 8; w++)
+			H[w] = state[w][l];
+		sha256_to_cksum(H, &zcp[l]);
+	}
+}
+
+/*
+ * SHA-512/256
+ *
+ * The sha512 checksum is SHA-512/256 as specified by FIPS 180-4: the
+ * SHA-512 compression function started from a distinct IV, with the digest
+ * truncated to its first 256 bits.  On x86-64 the message schedule can be
+ * expanded with AVX2 (see sha512_x86.c); sha2_init() exports the measured
+ * bandwidths as the named kstat "zfs:0:sha512_bench".
+ */
+
+const uint64_t sha512_k[80] = {
+	0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL,
+	0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+	0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL,
+	0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+	0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+	0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+	0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL, 0x2de92c6f592b0275ULL,
+	0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+	0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL,
+	0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+	0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL,
+	0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+	0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL,
+	0x92722c851482353bULL, 0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+	0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+	0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+	0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL,
+	0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+	0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL,
+	0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+	0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL,
+	0xc67178f2e372532bULL, 0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+	0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL,
+	0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+	0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+	0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+	0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+static const uint64_t sha512_256_iv[8] = {
+	0x22312194fc2bf72cULL, 0x9f555fa3c84c64c2ULL, 0x2393b86b6f53b151ULL,
+	0x963877195940eabdULL, 0x96283ee2a88effe3ULL, 0xbe5e1e2553863992ULL,
+	0x2b0199fc2c85b8aaULL, 0x0eb72ddc81c52ca2ULL
+};
+
+#define	ROTR64(x, n)	(((x) >> (n)) | ((x) << (64 - (n))))
+#define	SHA512_S0(x)	(ROTR64(x, 28) ^ ROTR64(x, 34) ^ ROTR64(x, 39))
+#define	SHA512_S1(x)	(ROTR64(x, 14) ^ ROTR64(x, 18) ^ ROTR64(x, 41))
+#define	SHA512_s0(x)	(ROTR64(x, 1) ^ ROTR64(x, 8) ^ ((x) >> 7))
+#define	SHA512_s1(x)	(ROTR64(x, 19) ^ ROTR64(x, 61) ^ ((x) >> 6))
+
+static uint64_t
+sha512_load_be64(const uint8_t *p)
+{
+	return (((uint64_t)sha256_load_be32(p) << 32) |
+	    sha256_load_be32(p + 4));
+}
+
+static void
+sha512_compress_generic(uint64_t *state, const uint8_t *blocks,
+    size_t nblocks)
+{
+	uint64_t W[80];
+
+	for (; nblocks != 0; nblocks--, blocks += SHA512_BLOCK_SIZE) {
+		uint64_t a = state[0], b = state[1], c = state[2];
+		uint64_t d = state[3], e = state[4], f = state[5];
+		uint64_t g = state[6], h = state[7];
+
+		for (int t = 0; t < 16; t++)
+			W[t] = sha512_load_be64(blocks + 8 * t);
+		for (int t = 16; t < 80; t++) {
+			W[t] = SHA512_s1(W[t - 2]) + W[t - 7] +
+			    SHA512_s0(W[t - 15]) + W[t - 16];
+		}
+
+		for (int t = 0; t < 80; t++) {
+			uint64_t T1 = h + SHA512_S1(e) + SHA256_CH(e, f, g) +
+			    sha512_k[t] + W[t];
+			uint64_t T2 = SHA512_S0(a) + SHA256_MAJ(a, b, c);
+
+			h = g;
+			g = f;
+			f = e;
+			e = d + T1;
+			d = c;
+			c = b;
+			b = a;
+			a = T1 + T2;
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+		state[5] += f;
+		state[6] += g;
+		state[7] += h;
+	}
+}
+
+static boolean_t
+sha512_generic_valid(void)
+{
+	return (B_TRUE);
+}
+
+static const sha512_ops_t sha512_generic_ops = {
+	.so_name = "generic",
+	.so_valid = sha512_generic_valid,
+	.so_compress = sha512_compress_generic,
+};
+
+static const sha512_ops_t *sha512_algos[] = {
+	&sha512_generic_ops,
+#if defined(__x86_64__) && defined(__GNUC__)
+	&sha512_avx2_ops,
+#endif
+};
+
+#define	SHA512_NALGOS	(sizeof (sha512_algos) / sizeof (sha512_algos[0]))
+
+static const sha512_ops_t *volatile sha512_impl = &sha512_generic_ops;
+
+static size_t
+sha512_pad(const uint8_t *tail, uint64_t size, uint8_t *pad)
+{
+	size_t rem = size % SHA512_BLOCK_SIZE;
+	size_t len = (rem < SHA512_BLOCK_SIZE - 16) ?
+	    SHA512_BLOCK_SIZE : 2 * SHA512_BLOCK_SIZE;
+	uint64_t bits = size << 3;
+
+	bcopy(tail, pad, rem);
+	pad[rem] = 0x80;
+	bzero(pad + rem + 1, len - rem - 1);
+	for (int i = 0; i < 8; i++)
+		pad[len - 1 - i] = (uint8_t)(bits >> (8 * i));
+
+	return (len / SHA512_BLOCK_SIZE);
+}
+
+/*
+ * The checksum holds the first 32 bytes of the big-endian digest, exactly
+ * as SHA2Final() writes them.
+ */
+static void
+sha512_256_hash(const sha512_ops_t *ops, const void *buf, uint64_t size,
+    zio_cksum_t *zcp)
+{
+	uint8_t pad[2 * SHA512_BLOCK_SIZE];
+	uint64_t nblocks = size / SHA512_BLOCK_SIZE;
+	uint64_t H[8];
+	size_t npad;
+
+	bcopy(sha512_256_iv, H, sizeof (H));
+	if (nblocks != 0)
+		ops->so_compress(H, buf, nblocks);
+	npad = sha512_pad((const uint8_t *)buf + nblocks * SHA512_BLOCK_SIZE,
+	    size, pad);
+	ops->so_compress(H, pad, npad);
+
+	for (int i = 0; i < 4; i++)
+		zcp->zc_word[i] = BE_64(H[i]);
+}
+#endif /* defined(__zfsd__) */
+
 /*ARGSUSED*/
 void
 zio_checksum_SHA256(const void *buf, uint64_t size,
     const void *ctx_template, zio_cksum_t *zcp)
 {
 #if defined(__zfsd__)
-	SHA256_CTX ctx;
-	zio_cksum_t tmp;
-
-	SHA256_Init(&ctx);
-	SHA256_Update(&ctx, buf, size);
-	SHA256_Final((uint8_t *)&tmp, &ctx);
-
-	CTASSERT(sizeof(zio_cksum_t) == SHA256_DIGEST_LENGTH);
+	sha256_hash(sha256_single, buf, size, zcp);
 #else
 	SHA2_CTX ctx;
 	zio_cksum_t tmp;
@@ -54,7 +435,6 @@ zio_checksum_SHA256(const void *buf, uint64_t size,
 	SHA2Init(SHA256, &ctx);
 	SHA2Update(&ctx, buf, size);
 	SHA2Final(&tmp, &ctx);
-#endif /* defined(__zfsd__) */
 
 	/*
 	 * A prior implementation of this function had a
@@ -67,35 +447,306 @@ zio_checksum_SHA256(const void *buf, uint64_t size,
 	zcp->zc_word[1] = BE_64(tmp.zc_word[1]);
 	zcp->zc_word[2] = BE_64(tmp.zc_word[2]);
 	zcp->zc_word[3] = BE_64(tmp.zc_word[3]);
+#endif /* defined(__zfsd__) */
 }
 
+/*
+ * Checksum a batch of buffers.  Runs of equally sized buffers are hashed
+ * together by the multi-buffer kernel when sha2_init() found it faster than
+ * hashing them one at a time.
+ */
+/*ARGSUSED*/
+void
+zio_checksum_SHA256_batch(const void **data, const uint64_t *size, int count,
+    const void *ctx_template, zio_cksum_t *zcp)
+{
+	int i, n;
+
+	for (i = 0; i < count; i += n) {
+#if defined(__zfsd__)
+		const sha256_ops_t *multi = sha256_multi;
+
+		for (n = 1; i + n < count && n < SHA256_LANES &&
+		    size[i + n] == size[i]; n++)
+			continue;
+
+		if (multi != NULL && n > 1) {
+			sha256_hash_mb(multi, &data[i], size[i], n, &zcp[i]);
+			continue;
+		}
+#endif /* defined(__zfsd__) */
+
+		n = 1;
+		zio_checksum_SHA256(data[i], size[i], ctx_template, &zcp[i]);
+	}
+}
+
+/*
+ * Batches are worth forming only if a multi-buffer kernel was selected.
+ */
+int
+zio_checksum_SHA256_batch_width(void)
+{
+#if defined(__zfsd__)
+	if (sha256_multi != NULL)
+		return (SHA256_LANES);
+#endif /* defined(__zfsd__) */
+	return (0);
+}
+
+#if defined(__zfsd__)
+int
+sha256_impl_set(const char *name)
+{
+	for (int i = 0; i < SHA256_NALGOS; i++) {
+		const sha256_ops_t *ops = sha256_algos[i];
+
+		if (strcmp(ops->so_name, name) != 0 || !ops->so_valid())
+			continue;
+
+		if (ops->so_compress != NULL) {
+			sha256_single = ops;
+			sha256_multi = NULL;
+		} else {
+			sha256_multi = ops;
+		}
+		return (0);
+	}
+
+	return (SET_ERROR(ENOTSUP));
+}
+
+const char *
+sha256_impl_get(void)
+{
+	const sha256_ops_t *multi = sha256_multi;
+
+	return (multi != NULL ? multi->so_name : sha256_single->so_name);
+}
+
+#define	SHA256_BENCH_SIZE	(16 * 1024)
+
+static kstat_t *sha256_bench_ksp;
+
+static const char *
+sha256_bench_name(int i, void *arg)
+{
+	return (sha256_algos[i]->so_name);
+}
+
+static boolean_t
+sha256_bench_valid(int i, void *arg)
+{
+	return (sha256_algos[i]->so_valid());
+}
+
+/*
+ * Hash SHA256_LANES buffers, either one at a time or through the
+ * multi-buffer kernel.
+ */
+static void
+sha256_bench_hash(const sha256_ops_t *ops, const void **bufs, uint64_t size,
+    zio_cksum_t *zc)
+{
+	if (ops->so_compress_mb != NULL) {
+		sha256_hash_mb(ops, bufs, size, SHA256_LANES, zc);
+	} else {
+		for (int l = 0; l < SHA256_LANES; l++)
+			sha256_hash(ops, bufs[l], size, &zc[l]);
+	}
+}
+
+static boolean_t
+sha256_bench_verify(int i, void *arg)
+{
+	const void **bufs = arg;
+
+	for (uint64_t size = 0; size <= 300; size++) {
+		zio_cksum_t ref[SHA256_LANES], zc[SHA256_LANES];
+
+		sha256_bench_hash(&sha256_generic_ops, bufs, size, ref);
+		sha256_bench_hash(sha256_algos[i], bufs, size, zc);
+		for (int l = 0; l < SHA256_LANES; l++) {
+			if (!ZIO_CHECKSUM_EQUAL(ref[l], zc[l]))
+				return (B_FALSE);
+		}
+	}
+
+	return (B_TRUE);
+}
+
+static uint64_t
+sha256_bench_run(int i, void *arg)
+{
+	zio_cksum_t zc[SHA256_LANES];
+
+	sha256_bench_hash(sha256_algos[i], arg, SHA256_BENCH_SIZE, zc);
+	return (SHA256_LANES * SHA256_BENCH_SIZE);
+}
+
+static const zfs_bench_ops_t sha256_bench_ops = {
+	.zbo_nimpls = SHA256_NALGOS,
+	.zbo_name = sha256_bench_name,
+	.zbo_valid = sha256_bench_valid,
+	.zbo_verify = sha256_bench_verify,
+	.zbo_run = sha256_bench_run,
+};
+
+/*
+ * Verify the accelerated implementations against the generic code, then
+ * pick the fastest single-buffer implementation and, if one beats it, the
+ * fastest multi-buffer implementation.
+ */
+static void
+sha256_init(void)
+{
+	const void *bufs[SHA256_LANES];
+	uint64_t bw[SHA256_NALGOS];
+	uint64_t best_single = 0, best_multi = 0;
+	const sha256_ops_t *multi = NULL;
+	uint8_t *buf;
+
+	buf = kmem_alloc(SHA256_LANES * SHA256_BENCH_SIZE, KM_SLEEP);
+	zfs_bench_fill(buf, SHA256_LANES * SHA256_BENCH_SIZE);
+	for (int l = 0; l < SHA256_LANES; l++)
+		bufs[l] = buf + l * SHA256_BENCH_SIZE;
+
+	(void) zfs_bench_select("sha256_bench", &sha256_bench_ops, bufs, bw,
+	    &sha256_bench_ksp);
+
+	for (int i = 0; i < SHA256_NALGOS; i++) {
+		const sha256_ops_t *ops = sha256_algos[i];
+
+		if (ops->so_compress != NULL && bw[i] > best_single) {
+			sha256_single = ops;
+			best_single = bw[i];
+		}
+		if (ops->so_compress_mb != NULL && bw[i] > best_multi) {
+			multi = ops;
+			best_multi = bw[i];
+		}
+	}
+
+	sha256_multi = (best_multi > best_single) ? multi : NULL;
+
+	kmem_free(buf, SHA256_LANES * SHA256_BENCH_SIZE);
+}
+
+int
+sha512_impl_set(const char *name)
+{
+	for (int i = 0; i < SHA512_NALGOS; i++) {
+		const sha512_ops_t *ops = sha512_algos[i];
+
+		if (strcmp(ops->so_name, name) == 0 && ops->so_valid()) {
+			sha512_impl = ops;
+			return (0);
+		}
+	}
+
+	return (SET_ERROR(ENOTSUP));
+}
+
+const char *
+sha512_impl_get(void)
+{
+	return (sha512_impl->so_name);
+}
+
+#define	SHA512_BENCH_SIZE	(128 * 1024)
+
+static kstat_t *sha512_bench_ksp;
+
+static const char *
+sha512_bench_name(int i, void *arg)
+{
+	return (sha512_algos[i]->so_name);
+}
+
+static boolean_t
+sha512_bench_valid(int i, void *arg)
+{
+	return (sha512_algos[i]->so_valid());
+}
+
+/*
+ * Messages of up to 1200 bytes cover every tail length and the partial
+ * four-block groups of the AVX2 kernel.
+ */
+static boolean_t
+sha512_bench_verify(int i, void *arg)
+{
+	for (uint64_t size = 0; size <= 1200; size++) {
+		zio_cksum_t ref, zc;
+
+		sha512_256_hash(&sha512_generic_ops, arg, size, &ref);
+		sha512_256_hash(sha512_algos[i], arg, size, &zc);
+		if (!ZIO_CHECKSUM_EQUAL(ref, zc))
+			return (B_FALSE);
+	}
+
+	return (B_TRUE);
+}
+
+static uint64_t
+sha512_bench_run(int i, void *arg)
+{
+	zio_cksum_t zc;
+
+	sha512_256_hash(sha512_algos[i], arg, SHA512_BENCH_SIZE, &zc);
+	return (SHA512_BENCH_SIZE);
+}
+
+static const zfs_bench_ops_t sha512_bench_ops = {
+	.zbo_nimpls = SHA512_NALGOS,
+	.zbo_name = sha512_bench_name,
+	.zbo_valid = sha512_bench_valid,
+	.zbo_verify = sha512_bench_verify,
+	.zbo_run = sha512_bench_run,
+};
+
+/*
+ * Verify the accelerated SHA-512 implementations against the generic code
+ * and pick the fastest.
+ */
+static void
+sha512_init(void)
+{
+	uint8_t *buf;
+
+	buf = kmem_alloc(SHA512_BENCH_SIZE, KM_SLEEP);
+	zfs_bench_fill(buf, SHA512_BENCH_SIZE);
+
+	sha512_impl = sha512_algos[zfs_bench_select("sha512_bench",
+	    &sha512_bench_ops, buf, NULL, &sha512_bench_ksp)];
+
+	kmem_free(buf, SHA512_BENCH_SIZE);
+}
+
+void
+sha2_init(void)
+{
+	sha256_init();
+	sha512_init();
+}
+
+void
+sha2_fini(void)
+{
+	kstat_delete(sha512_bench_ksp);
+	sha512_bench_ksp = NULL;
+	kstat_delete(sha256_bench_ksp);
+	sha256_bench_ksp = NULL;
+}
+#endif /* defined(__zfsd__) */
+
 /*ARGSUSED*/
 void
 zio_checksum_SHA512_native(const void *buf, uint64_t size,
     const void *ctx_template, zio_cksum_t *zcp)
 {
 #if defined(__zfsd__)
-	SHA512_CTX ctx;
-	union {
-		struct {
-			zio_cksum_t first;
-			zio_cksum_t second;
-		} digest;
-		uint8_t bytes[SHA512_DIGEST_LENGTH];
-	} digest;
-
-	SHA512_Init(&ctx);
-	SHA512_Update(&ctx, buf, size);
-	SHA512_Final(digest.bytes, &ctx);
-
-	CTASSERT(sizeof(digest) == SHA512_DIGEST_LENGTH);
-
-	/* XXX True SHA 512/256 changes the initialization vector as
-	 * well as truncating the result. AFAICT OpenSSL does not support
-	 * this, so until then this would result in an incompatible on-disk
-	 * checksum.
-	 */
-	*zcp = digest.digest.second;
+	sha512_256_hash(sha512_impl, buf, size, zcp);
 #else
 	SHA2_CTX	ctx;
 
@@ -0,0 +1,273 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * x86 SHA-256 kernels
+ *
+ * sha256_compress_shani() uses the SHA extensions (SHA-NI) and is the
+ * fastest way to hash a single buffer on CPUs that have them.  The
+ * multi-buffer kernels instead run the portable round function on eight
+ * independent messages at once, one per 32-bit lane of a 256-bit vector;
+ * the AVX-512 variant is the same kernel using the AVX-512VL rotate and
+ * ternary-logic instructions.  All of them are compiled with per-function
+ * target attributes and are only selected by sha2_init() when the CPU
+ * supports them.
+ */
+
+#if defined(__zfsd__) && defined(__x86_64__) && defined(__GNUC__)
+
+#include <sys/types.h>
+#include <sys/zfs_sha2.h>
+#include <immintrin.h>
+
+#define	SHA256_SHANI	__attribute__((target("sha,sse4.1")))
+#define	SHA256_AVX2	__attribute__((target("avx2")))
+#define	SHA256_AVX512	__attribute__((target("avx2,avx512f,avx512vl")))
+#define	SHA256_INLINE	inline __attribute__((always_inline))
+
+static boolean_t
+sha256_shani_valid(void)
+{
+	__builtin_cpu_init();
+	return (__builtin_cpu_supports("sha") &&
+	    __builtin_cpu_supports("sse4.1") ? B_TRUE : B_FALSE);
+}
+
+/*
+ * The SHA-NI round instructions keep the state as the ABEF and CDGH word
+ * pairs, and consume the message schedule four words at a time.
+ */
+static SHA256_SHANI void
+sha256_compress_shani(uint32_t *state, const uint8_t *blocks, size_t nblocks)
+{
+	const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+	    0x0405060700010203ULL);
+	__m128i state0, state1, tmp;
+
+	tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]),
+	    0xb1);					/* CDAB */
+	state1 = _mm_shuffle_epi32(_mm_loadu_si128(
+	    (const __m128i *)&state[4]), 0x1b);		/* EFGH */
+	state0 = _mm_alignr_epi8(tmp, state1, 8);	/* ABEF */
+	state1 = _mm_blend_epi16(state1, tmp, 0xf0);	/* CDGH */
+
+	for (; nblocks != 0; nblocks--, blocks += SHA256_BLOCK_SIZE) {
+		__m128i abef = state0, cdgh = state1;
+		__m128i m[4];
+
+		for (int g = 0; g < 16; g++) {
+			__m128i w, msg;
+
+			if (g < 4) {
+				w = _mm_shuffle_epi8(_mm_loadu_si128(
+				    (const __m128i *)(blocks + 16 * g)), bswap);
+			} else {
+				w = _mm_sha256msg1_epu32(m[g & 3],
+				    m[(g + 1) & 3]);
+				w = _mm_add_epi32(w, _mm_alignr_epi8(
+				    m[(g + 3) & 3], m[(g + 2) & 3], 4));
+				w = _mm_sha256msg2_epu32(w, m[(g + 3) & 3]);
+			}
+			m[g & 3] = w;
+
+			msg = _mm_add_epi32(w, _mm_loadu_si128(
+			    (const __m128i *)&sha256_k[4 * g]));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+			msg = _mm_shuffle_epi32(msg, 0x0e);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+		}
+
+		state0 = _mm_add_epi32(state0, abef);
+		state1 = _mm_add_epi32(state1, cdgh);
+	}
+
+	tmp = _mm_shuffle_epi32(state0, 0x1b);		/* FEBA */
+	state1 = _mm_shuffle_epi32(state1, 0xb1);	/* DCHG */
+	state0 = _mm_blend_epi16(tmp, state1, 0xf0);	/* DCBA */
+	state1 = _mm_alignr_epi8(state1, tmp, 8);	/* HGFE */
+
+	_mm_storeu_si128((__m128i *)&state[0], state0);
+	_mm_storeu_si128((__m128i *)&state[4], state1);
+}
+
+const sha256_ops_t sha256_shani_ops = {
+	.so_name = "shani",
+	.so_valid = sha256_shani_valid,
+	.so_compress = sha256_compress_shani,
+};
+
+/*
+ * Load 32 bytes at "off" from each lane's message, convert them from big
+ * endian and transpose them so that w[i] holds word i of every lane.
+ */
+static SHA256_AVX2 SHA256_INLINE void
+sha256_mb_load(__m256i *w, const uint8_t *const data[SHA256_LANES],
+    size_t off)
+{
+	const __m256i bswap = _mm256_setr_epi8(
+	    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+	    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	__m256i r[8], t[8], u[8];
+
+	for (int l = 0; l < SHA256_LANES; l++) {
+		r[l] = _mm256_shuffle_epi8(_mm256_loadu_si256(
+		    (const __m256i *)(data[l] + off)), bswap);
+	}
+
+	for (int i = 0; i < 8; i += 2) {
+		t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+		t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+	}
+
+	for (int i = 0; i < 8; i += 4) {
+		u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+		u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+		u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+		u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+	}
+
+	for (int i = 0; i < 4; i++) {
+		w[i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+		w[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+	}
+}
+
+#define	MB_ADD(x, y)	_mm256_add_epi32(x, y)
+#define	MB_XOR(x, y)	_mm256_xor_si256(x, y)
+
+#define	MB_AVX2_ROTR(x, n)	\
+	_mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define	MB_AVX2_CH(x, y, z)	\
+	_mm256_xor_si256(_mm256_and_si256(x, y), _mm256_andnot_si256(x, z))
+#define	MB_AVX2_MAJ(x, y, z)	_mm256_or_si256(_mm256_and_si256(x, y), \
+	_mm256_and_si256(z, _mm256_or_si256(x, y)))
+
+#define	MB_AVX512_ROTR(x, n)	_mm256_ror_epi32(x, n)
+#define	MB_AVX512_CH(x, y, z)	_mm256_ternarylogic_epi32(x, y, z, 0xca)
+#define	MB_AVX512_MAJ(x, y, z)	_mm256_ternarylogic_epi32(x, y, z, 0xe8)
+
+/*
+ * The multi-buffer compression function, instantiated once per instruction
+ * set since only the rotate and boolean primitives differ.
+ */
+#define	SHA256_MB_KERNEL(name, attr, ROTR, CH, MAJ)			\
+static attr void							\
+name(uint32_t state[8][SHA256_LANES],					\
+    const uint8_t *const data[SHA256_LANES], size_t nblocks)		\
+{									\
+	__m256i s[8], W[16];						\
+									\
+	for (int i = 0; i < 8; i++)					\
+		s[i] = _mm256_loadu_si256((const __m256i *)state[i]);	\
+									\
+	for (size_t blk = 0; blk < nblocks; blk++) {			\
+		__m256i a = s[0], b = s[1], c = s[2], d = s[3];		\
+		__m256i e = s[4], f = s[5], g = s[6], h = s[7];		\
+		size_t off = blk * SHA256_BLOCK_SIZE;			\
+									\
+		sha256_mb_load(&W[0], data, off);			\
+		sha256_mb_load(&W[8], data, off + 32);			\
+									\
+		for (int t = 0; t < 64; t++) {				\
+			__m256i w, T1, T2;				\
+									\
+			if (t < 16) {					\
+				w = W[t];				\
+			} else {					\
+				__m256i w2 = W[(t - 2) & 15];		\
+				__m256i w15 = W[(t - 15) & 15];		\
+									\
+				w = MB_ADD(MB_ADD(W[t & 15],		\
+				    W[(t - 7) & 15]), MB_ADD(		\
+				    MB_XOR(MB_XOR(ROTR(w15, 7),		\
+				    ROTR(w15, 18)),			\
+				    _mm256_srli_epi32(w15, 3)),		\
+				    MB_XOR(MB_XOR(ROTR(w2, 17),		\
+				    ROTR(w2, 19)),			\
+				    _mm256_srli_epi32(w2, 10))));	\
+				W[t & 15] = w;				\
+			}						\
+									\
+			T1 = MB_ADD(MB_ADD(h, MB_XOR(MB_XOR(		\
+			    ROTR(e, 6), ROTR(e, 11)), ROTR(e, 25))),	\
+			    MB_ADD(CH(e, f, g), MB_ADD(w,		\
+			    _mm256_set1_epi32(sha256_k[t]))));		\
+			T2 = MB_ADD(MB_XOR(MB_XOR(ROTR(a, 2),		\
+			    ROTR(a, 13)), ROTR(a, 22)), MAJ(a, b, c));	\
+			h = g;						\
+			g = f;						\
+			f = e;						\
+			e = MB_ADD(d, T1);				\
+			d = c;						\
+			c = b;						\
+			b = a;						\
+			a = MB_ADD(T1, T2);				\
+		}							\
+									\
+		s[0] = MB_ADD(s[0], a);					\
+		s[1] = MB_ADD(s[1], b);					\
+		s[2] = MB_ADD(s[2], c);					\
+		s[3] = MB_ADD(s[3], d);					\
+		s[4] = MB_ADD(s[4], e);					\
+		s[5] = MB_ADD(s[5], f);					\
+		s[6] = MB_ADD(s[6], g);					\
+		s[7] = MB_ADD(s[7], h);					\
+	}								\
+									\
+	for (int i = 0; i < 8; i++)					\
+		_mm256_storeu_si256((__m256i *)state[i], s[i]);		\
+}
+
+SHA256_MB_KERNEL(sha256_compress_mb_avx2, SHA256_AVX2,
+    MB_AVX2_ROTR, MB_AVX2_CH, MB_AVX2_MAJ)
+
+SHA256_MB_KERNEL(sha256_compress_mb_avx512, SHA256_AVX512,
+    MB_AVX512_ROTR, MB_AVX512_CH, MB_AVX512_MAJ)
+
+static boolean_t
+sha256_avx2_valid(void)
+{
+	__builtin_cpu_init();
+	return (__builtin_cpu_supports("avx2") ? B_TRUE : B_FALSE);
+}
+
+static boolean_t
+sha256_avx512_valid(void)
+{
+	__builtin_cpu_init();
+	return (__builtin_cpu_supports("avx2") &&
+	    __builtin_cpu_supports("avx512f") &&
+	    __builtin_cpu_supports("avx512vl") ? B_TRUE : B_FALSE);
+}
+
+const sha256_ops_t sha256_avx2_ops = {
+	.so_name = "avx2",
+	.so_valid = sha256_avx2_valid,
+	.so_compress_mb = sha256_compress_mb_avx2,
+};
+
+const sha256_ops_t sha256_avx512_ops = {
+	.so_name = "avx512",
+	.so_valid = sha256_avx512_valid,
+	.so_compress_mb = sha256_compress_mb_avx512,
+};
+
+#endif	/* __zfsd__ && __x86_64__ && __GNUC__ */
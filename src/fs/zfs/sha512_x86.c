@@ -0,0 +1,173 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * x86 SHA-512 kernel
+ *
+ * The SHA-512 rounds are inherently serial, but the message schedule of a
+ * block depends only on that block's data.  sha512_compress_avx2() expands
+ * the schedules of four consecutive blocks at once, one per 64-bit lane of
+ * a 256-bit vector, adds the round constants and then runs the scalar
+ * rounds over each block in turn.  The rounds are compiled with BMI2 so
+ * that the rotates become RORX and do not clobber the flags.
+ */
+
+#if defined(__zfsd__) && defined(__x86_64__) && defined(__GNUC__)
+
+#include <sys/types.h>
+#include <sys/sysmacros.h>
+#include <sys/zfs_sha2.h>
+#include <immintrin.h>
+
+#define	SHA512_AVX2	__attribute__((target("avx2,bmi2")))
+#define	SHA512_INLINE	inline __attribute__((always_inline))
+
+#define	SHA512_AVX2_LANES	4
+
+#define	ROTR64(x, n)	(((x) >> (n)) | ((x) << (64 - (n))))
+#define	SHA512_S0(x)	(ROTR64(x, 28) ^ ROTR64(x, 34) ^ ROTR64(x, 39))
+#define	SHA512_S1(x)	(ROTR64(x, 14) ^ ROTR64(x, 18) ^ ROTR64(x, 41))
+#define	SHA512_CH(x, y, z)	(((x) & (y)) ^ (~(x) & (z)))
+#define	SHA512_MAJ(x, y, z)	(((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+
+#define	V_ROTR64(x, n)	\
+	_mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - (n)))
+#define	V_SHA512_s0(x)	_mm256_xor_si256(_mm256_xor_si256(V_ROTR64(x, 1), \
+	V_ROTR64(x, 8)), _mm256_srli_epi64(x, 7))
+#define	V_SHA512_s1(x)	_mm256_xor_si256(_mm256_xor_si256(V_ROTR64(x, 19), \
+	V_ROTR64(x, 61)), _mm256_srli_epi64(x, 6))
+
+static boolean_t
+sha512_avx2_valid(void)
+{
+	__builtin_cpu_init();
+	return (__builtin_cpu_supports("avx2") &&
+	    __builtin_cpu_supports("bmi2") ? B_TRUE : B_FALSE);
+}
+
+/*
+ * Expand the message schedules of n <= 4 consecutive blocks, storing
+ * W[t] + K[t] of block l in wk[t][l].  Lanes past n repeat the first block.
+ */
+static SHA512_AVX2 SHA512_INLINE void
+sha512_schedule_avx2(const uint8_t *blocks, size_t n,
+    uint64_t wk[80][SHA512_AVX2_LANES])
+{
+	const __m256i bswap = _mm256_set_epi64x(0x08090a0b0c0d0e0fULL,
+	    0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL,
+	    0x0001020304050607ULL);
+	__m256i W[80];
+
+	for (int q = 0; q < 4; q++) {
+		__m256i r[SHA512_AVX2_LANES], lo01, hi01, lo23, hi23;
+
+		for (int l = 0; l < SHA512_AVX2_LANES; l++) {
+			const uint8_t *p = blocks +
+			    (l < n ? l : 0) * SHA512_BLOCK_SIZE + q * 32;
+
+			r[l] = _mm256_shuffle_epi8(_mm256_loadu_si256(
+			    (const __m256i *)p), bswap);
+		}
+
+		/* Transpose 4x4 so that W[4q + i] holds word i of each row. */
+		lo01 = _mm256_unpacklo_epi64(r[0], r[1]);
+		hi01 = _mm256_unpackhi_epi64(r[0], r[1]);
+		lo23 = _mm256_unpacklo_epi64(r[2], r[3]);
+		hi23 = _mm256_unpackhi_epi64(r[2], r[3]);
+		W[4 * q + 0] = _mm256_permute2x128_si256(lo01, lo23, 0x20);
+		W[4 * q + 1] = _mm256_permute2x128_si256(hi01, hi23, 0x20);
+		W[4 * q + 2] = _mm256_permute2x128_si256(lo01, lo23, 0x31);
+		W[4 * q + 3] = _mm256_permute2x128_si256(hi01, hi23, 0x31);
+	}
+
+	for (int t = 16; t < 80; t++) {
+		W[t] = _mm256_add_epi64(_mm256_add_epi64(V_SHA512_s1(W[t - 2]),
+		    W[t - 7]), _mm256_add_epi64(V_SHA512_s0(W[t - 15]),
+		    W[t - 16]));
+	}
+
+	for (int t = 0; t < 80; t++) {
+		_mm256_store_si256((__m256i *)wk[t], _mm256_add_epi64(W[t],
+		    _mm256_set1_epi64x(sha512_k[t])));
+	}
+}
+
+/*
+ * One round, with the working variables renamed rather than moved.
+ */
+#define	SHA512_ROUND(a, b, c, d, e, f, g, h, t) do {			\
+	uint64_t T1 = h + SHA512_S1(e) + SHA512_CH(e, f, g) + wk[t][lane]; \
+	d += T1;							\
+	h = T1 + SHA512_S0(a) + SHA512_MAJ(a, b, c);			\
+} while (0)
+
+static SHA512_AVX2 SHA512_INLINE void
+sha512_rounds_avx2(uint64_t *state, uint64_t wk[80][SHA512_AVX2_LANES],
+    int lane)
+{
+	uint64_t a = state[0], b = state[1], c = state[2], d = state[3];
+	uint64_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+	for (int t = 0; t < 80; t += 8) {
+		SHA512_ROUND(a, b, c, d, e, f, g, h, t + 0);
+		SHA512_ROUND(h, a, b, c, d, e, f, g, t + 1);
+		SHA512_ROUND(g, h, a, b, c, d, e, f, t + 2);
+		SHA512_ROUND(f, g, h, a, b, c, d, e, t + 3);
+		SHA512_ROUND(e, f, g, h, a, b, c, d, t + 4);
+		SHA512_ROUND(d, e, f, g, h, a, b, c, t + 5);
+		SHA512_ROUND(c, d, e, f, g, h, a, b, t + 6);
+		SHA512_ROUND(b, c, d, e, f, g, h, a, t + 7);
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+	state[5] += f;
+	state[6] += g;
+	state[7] += h;
+}
+
+static SHA512_AVX2 void
+sha512_compress_avx2(uint64_t *state, const uint8_t *blocks, size_t nblocks)
+{
+	uint64_t wk[80][SHA512_AVX2_LANES] __attribute__((aligned(32)));
+
+	while (nblocks != 0) {
+		size_t n = MIN(nblocks, SHA512_AVX2_LANES);
+
+		sha512_schedule_avx2(blocks, n, wk);
+		for (int l = 0; l < n; l++)
+			sha512_rounds_avx2(state, wk, l);
+
+		blocks += n * SHA512_BLOCK_SIZE;
+		nblocks -= n;
+	}
+}
+
+const sha512_ops_t sha512_avx2_ops = {
+	.so_name = "avx2",
+	.so_valid = sha512_avx2_valid,
+	.so_compress = sha512_compress_avx2,
+};
+
+#endif	/* __zfsd__ && __x86_64__ && __GNUC__ */
@@ -0,0 +1,195 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * x86 multi-buffer Skein-512 kernels
+ *
+ * Threefish-512 is a long serial chain of 64-bit adds, rotates and xors,
+ * so a single message keeps only a few ALUs busy.  These kernels instead
+ * hash several messages under the same key at once, one per 64-bit lane,
+ * with the 72 rounds fully unrolled.  The same source is built for 256-bit
+ * AVX2 vectors (two passes of four lanes) and for 512-bit AVX-512 vectors,
+ * where the rotates become single VPROLQ instructions.
+ */
+
+#if defined(__zfsd__) && defined(__x86_64__) && defined(__GNUC__)
+
+#include <sys/types.h>
+#include <sys/byteorder.h>
+#include <sys/debug.h>
+#include <sys/zfs_skein.h>
+#include <skein_impl.h>
+
+#define	SKEIN_AVX2	__attribute__((target("avx2")))
+#define	SKEIN_AVX512	__attribute__((target("avx2,avx512f")))
+
+typedef uint64_t skein_v4_t __attribute__((vector_size(32)));
+typedef uint64_t skein_v8_t __attribute__((vector_size(64)));
+
+#define	SKEIN_ROTL(x, n)	(((x) << (n)) | ((x) >> (64 - (n))))
+
+#define	SKEIN_MB_ROUND(p0, p1, p2, p3, p4, p5, p6, p7, ROT)		\
+	x##p0 += x##p1; x##p1 = SKEIN_ROTL(x##p1, ROT##_0) ^ x##p0;	\
+	x##p2 += x##p3; x##p3 = SKEIN_ROTL(x##p3, ROT##_1) ^ x##p2;	\
+	x##p4 += x##p5; x##p5 = SKEIN_ROTL(x##p5, ROT##_2) ^ x##p4;	\
+	x##p6 += x##p7; x##p7 = SKEIN_ROTL(x##p7, ROT##_3) ^ x##p6;
+
+#define	SKEIN_MB_INJECT(R)						\
+	x0 += ks[((R) + 1) % 9];					\
+	x1 += ks[((R) + 2) % 9];					\
+	x2 += ks[((R) + 3) % 9];					\
+	x3 += ks[((R) + 4) % 9];					\
+	x4 += ks[((R) + 5) % 9];					\
+	x5 += ks[((R) + 6) % 9] + ts[((R) + 1) % 3];			\
+	x6 += ks[((R) + 7) % 9] + ts[((R) + 2) % 3];			\
+	x7 += ks[((R) + 8) % 9] + (uint64_t)((R) + 1);
+
+#define	SKEIN_MB_8_ROUNDS(R)						\
+	SKEIN_MB_ROUND(0, 1, 2, 3, 4, 5, 6, 7, R_512_0)			\
+	SKEIN_MB_ROUND(2, 1, 4, 7, 6, 5, 0, 3, R_512_1)			\
+	SKEIN_MB_ROUND(4, 1, 6, 3, 0, 5, 2, 7, R_512_2)			\
+	SKEIN_MB_ROUND(6, 1, 0, 7, 2, 5, 4, 3, R_512_3)			\
+	SKEIN_MB_INJECT(2 * (R))					\
+	SKEIN_MB_ROUND(0, 1, 2, 3, 4, 5, 6, 7, R_512_4)			\
+	SKEIN_MB_ROUND(2, 1, 4, 7, 6, 5, 0, 3, R_512_5)			\
+	SKEIN_MB_ROUND(4, 1, 6, 3, 0, 5, 2, 7, R_512_6)			\
+	SKEIN_MB_ROUND(6, 1, 0, 7, 2, 5, 4, 3, R_512_7)			\
+	SKEIN_MB_INJECT(2 * (R) + 1)
+
+/*
+ * Process nblocks blocks of the lanes [base, base + width) of a batch.
+ * The tweak is the same for every lane, so it is kept in scalars.
+ */
+#define	SKEIN_MB_KERNEL(name, attr, vec_t)				\
+static attr void							\
+name(uint64_t X[8][SKEIN_LANES], const uint8_t *const data[SKEIN_LANES], \
+    size_t nblocks, uint64_t *T, size_t byte_add)			\
+{									\
+	const int width = sizeof (vec_t) / sizeof (uint64_t);		\
+	uint64_t t0 = T[0], t1 = T[1];					\
+									\
+	for (int base = 0; base < SKEIN_LANES; base += width) {		\
+		vec_t c[8], w[8], ks[9], ts[3];				\
+		vec_t x0, x1, x2, x3, x4, x5, x6, x7;			\
+									\
+		t0 = T[0];						\
+		t1 = T[1];						\
+		for (int i = 0; i < 8; i++) {				\
+			for (int l = 0; l < width; l++)			\
+				c[i][l] = X[i][base + l];		\
+		}							\
+									\
+		for (size_t b = 0; b < nblocks; b++) {			\
+			const size_t off = b * SKEIN_512_BLOCK_BYTES;	\
+									\
+			t0 += byte_add;					\
+			ts[0] = (vec_t){ 0 } + t0;			\
+			ts[1] = (vec_t){ 0 } + t1;			\
+			ts[2] = (vec_t){ 0 } + (t0 ^ t1);		\
+									\
+			ks[8] = (vec_t){ 0 } + SKEIN_KS_PARITY;		\
+			for (int i = 0; i < 8; i++) {			\
+				ks[i] = c[i];				\
+				ks[8] ^= c[i];				\
+			}						\
+									\
+			for (int l = 0; l < width; l++) {		\
+				const uint64_t *p = (const uint64_t *)	\
+				    (data[base + l] + off);		\
+									\
+				for (int i = 0; i < 8; i++)		\
+					w[i][l] = LE_64(p[i]);		\
+			}						\
+									\
+			x0 = w[0] + ks[0];				\
+			x1 = w[1] + ks[1];				\
+			x2 = w[2] + ks[2];				\
+			x3 = w[3] + ks[3];				\
+			x4 = w[4] + ks[4];				\
+			x5 = w[5] + ks[5] + ts[0];			\
+			x6 = w[6] + ks[6] + ts[1];			\
+			x7 = w[7] + ks[7];				\
+									\
+			SKEIN_MB_8_ROUNDS(0)				\
+			SKEIN_MB_8_ROUNDS(1)				\
+			SKEIN_MB_8_ROUNDS(2)				\
+			SKEIN_MB_8_ROUNDS(3)				\
+			SKEIN_MB_8_ROUNDS(4)				\
+			SKEIN_MB_8_ROUNDS(5)				\
+			SKEIN_MB_8_ROUNDS(6)				\
+			SKEIN_MB_8_ROUNDS(7)				\
+			SKEIN_MB_8_ROUNDS(8)				\
+									\
+			c[0] = x0 ^ w[0];				\
+			c[1] = x1 ^ w[1];				\
+			c[2] = x2 ^ w[2];				\
+			c[3] = x3 ^ w[3];				\
+			c[4] = x4 ^ w[4];				\
+			c[5] = x5 ^ w[5];				\
+			c[6] = x6 ^ w[6];				\
+			c[7] = x7 ^ w[7];				\
+									\
+			t1 &= ~SKEIN_T1_FLAG_FIRST;			\
+		}							\
+									\
+		for (int i = 0; i < 8; i++) {				\
+			for (int l = 0; l < width; l++)			\
+				X[i][base + l] = c[i][l];		\
+		}							\
+	}								\
+									\
+	T[0] = t0;							\
+	T[1] = t1;							\
+}
+
+CTASSERT(SKEIN_512_ROUNDS_TOTAL == 72);
+
+SKEIN_MB_KERNEL(skein_compress_mb_avx2, SKEIN_AVX2, skein_v4_t)
+SKEIN_MB_KERNEL(skein_compress_mb_avx512, SKEIN_AVX512, skein_v8_t)
+
+static boolean_t
+skein_avx2_valid(void)
+{
+	__builtin_cpu_init();
+	return (__builtin_cpu_supports("avx2") ? B_TRUE : B_FALSE);
+}
+
+static boolean_t
+skein_avx512_valid(void)
+{
+	__builtin_cpu_init();
+	return (__builtin_cpu_supports("avx2") &&
+	    __builtin_cpu_supports("avx512f") ? B_TRUE : B_FALSE);
+}
+
+const skein_ops_t skein_avx2_ops = {
+	.so_name = "avx2",
+	.so_valid = skein_avx2_valid,
+	.so_compress_mb = skein_compress_mb_avx2,
+};
+
+const skein_ops_t skein_avx512_ops = {
+	.so_name = "avx512",
+	.so_valid = skein_avx512_valid,
+	.so_compress_mb = skein_compress_mb_avx512,
+};
+
+#endif	/* __zfsd__ && __x86_64__ && __GNUC__ */
@@ -24,6 +24,12 @@
 #include <sys/zfs_context.h>
 #include <sys/zio.h>
 #include <sys/skein.h>
+#if defined(__zfsd__)
+#include <sys/zio_checksum.h>
+#include <sys/zfs_bench.h>
+#include <sys/zfs_skein.h>
+#include <skein_impl.h>
+#endif /* defined(__zfsd__) */
 
 /*
  * Computes a native 256-bit skein MAC checksum. Please note that this
@@ -44,6 +50,138 @@ zio_checksum_skein_native(const void *buf, uint64_t size,
 	bzero(&ctx, sizeof (ctx));
 }
 
+#if defined(__zfsd__)
+/*
+ * Batches of equally sized blocks can be hashed by the multi-buffer
+ * kernels in skein_x86.c, when skein_init() found them faster than the
+ * reference code.  The measured bandwidths are exported as the named kstat
+ * "zfs:0:skein_bench".
+ */
+static boolean_t
+skein_generic_valid(void)
+{
+	return (B_TRUE);
+}
+
+/* The reference code, one buffer at a time. */
+static const skein_ops_t skein_generic_ops = {
+	.so_name = "generic",
+	.so_valid = skein_generic_valid,
+};
+
+static const skein_ops_t *skein_algos[] = {
+	&skein_generic_ops,
+#if defined(__x86_64__) && defined(__GNUC__)
+	&skein_avx2_ops,
+	&skein_avx512_ops,
+#endif
+};
+
+#define	SKEIN_NALGOS	(sizeof (skein_algos) / sizeof (skein_algos[0]))
+
+static const skein_ops_t *volatile skein_multi = NULL;
+
+/*
+ * Hash up to SKEIN_LANES messages of the same size under the key of the
+ * template.  This follows Skein_512_Update() and Skein_512_Final(): the last
+ * block, zero padded and possibly empty, carries the FINAL flag, and a
+ * single output block with counter zero follows.  Unused lanes repeat the
+ * first message and their results are discarded.
+ */
+static void
+skein_hash_mb(const skein_ops_t *ops, const Skein_512_Ctxt_t *tmpl,
+    const void **data, uint64_t size, int count, zio_cksum_t *zcp)
+{
+	uint8_t last[SKEIN_LANES][SKEIN_512_BLOCK_BYTES];
+	const uint8_t *ptr[SKEIN_LANES];
+	uint64_t X[8][SKEIN_LANES], T[2];
+	uint64_t nblocks = (size == 0) ? 0 : (size - 1) / SKEIN_512_BLOCK_BYTES;
+	size_t rem = size - nblocks * SKEIN_512_BLOCK_BYTES;
+
+	ASSERT3S(count, >, 0);
+	ASSERT3S(count, <=, SKEIN_LANES);
+	ASSERT0(tmpl->h.bCnt);
+
+	for (int w = 0; w < 8; w++) {
+		for (int l = 0; l < SKEIN_LANES; l++)
+			X[w][l] = tmpl->X[w];
+	}
+	T[0] = tmpl->h.T[0];
+	T[1] = tmpl->h.T[1];
+
+	for (int l = 0; l < SKEIN_LANES; l++)
+		ptr[l] = data[l < count ? l : 0];
+	if (nblocks != 0)
+		ops->so_compress_mb(X, ptr, nblocks, T, SKEIN_512_BLOCK_BYTES);
+
+	for (int l = 0; l < SKEIN_LANES; l++) {
+		bcopy(ptr[l] + nblocks * SKEIN_512_BLOCK_BYTES, last[l], rem);
+		bzero(last[l] + rem, SKEIN_512_BLOCK_BYTES - rem);
+		ptr[l] = last[l];
+	}
+	T[1] |= SKEIN_T1_FLAG_FINAL;
+	ops->so_compress_mb(X, ptr, 1, T, rem);
+
+	bzero(last[0], sizeof (last[0]));
+	for (int l = 0; l < SKEIN_LANES; l++)
+		ptr[l] = last[0];
+	T[0] = 0;
+	T[1] = SKEIN_T1_FLAG_FIRST | SKEIN_T1_BLK_TYPE_OUT_FINAL;
+	ops->so_compress_mb(X, ptr, 1, T, sizeof (uint64_t));
+
+	for (int l = 0; l < count; l++) {
+		for (int i = 0; i < 4; i++)
+			zcp[l].zc_word[i] = LE_64(X[i][l]);
+	}
+}
+#endif /* defined(__zfsd__) */
+
+/*
+ * Checksum a batch of buffers.  Runs of equally sized buffers go through
+ * the multi-buffer kernel if one was selected.
+ */
+void
+zio_checksum_skein_batch(const void **data, const uint64_t *size, int count,
+    const void *ctx_template, zio_cksum_t *zcp)
+{
+	int i, n;
+
+	ASSERT(ctx_template != NULL);
+
+	for (i = 0; i < count; i += n) {
+#if defined(__zfsd__)
+		const skein_ops_t *multi = skein_multi;
+
+		for (n = 1; i + n < count && n < SKEIN_LANES &&
+		    size[i + n] == size[i]; n++)
+			continue;
+
+		if (multi != NULL && n > 1) {
+			skein_hash_mb(multi, ctx_template, &data[i], size[i],
+			    n, &zcp[i]);
+			continue;
+		}
+#endif /* defined(__zfsd__) */
+
+		n = 1;
+		zio_checksum_skein_native(data[i], size[i], ctx_template,
+		    &zcp[i]);
+	}
+}
+
+/*
+ * Batches are worth forming only if a multi-buffer kernel was selected.
+ */
+int
+zio_checksum_skein_batch_width(void)
+{
+#if defined(__zfsd__)
+	if (skein_multi != NULL)
+		return (SKEIN_LANES);
+#endif /* defined(__zfsd__) */
+	return (0);
+}
+
 /*
  * Byteswapped version of zio_checksum_skein_native. This just invokes
  * the native checksum function and byteswaps the resulting checksum (since
@@ -89,3 +227,138 @@ zio_checksum_skein_tmpl_free(void *ctx_template)
 	bzero(ctx, sizeof (*ctx));
 	kmem_free(ctx, sizeof (*ctx));
 }
+
+#if defined(__zfsd__)
+int
+skein_impl_set(const char *name)
+{
+	for (int i = 0; i < SKEIN_NALGOS; i++) {
+		const skein_ops_t *ops = skein_algos[i];
+
+		if (strcmp(ops->so_name, name) == 0 && ops->so_valid()) {
+			skein_multi = (ops->so_compress_mb != NULL) ?
+			    ops : NULL;
+			return (0);
+		}
+	}
+
+	return (SET_ERROR(ENOTSUP));
+}
+
+const char *
+skein_impl_get(void)
+{
+	const skein_ops_t *multi = skein_multi;
+
+	return (multi != NULL ? multi->so_name : "generic");
+}
+
+#define	SKEIN_BENCH_SIZE	(16 * 1024)
+
+static kstat_t *skein_bench_ksp;
+
+typedef struct skein_bench {
+	void		*sb_tmpl;
+	const void	*sb_bufs[SKEIN_LANES];
+} skein_bench_t;
+
+static const char *
+skein_bench_name(int i, void *arg)
+{
+	return (skein_algos[i]->so_name);
+}
+
+static boolean_t
+skein_bench_valid(int i, void *arg)
+{
+	return (skein_algos[i]->so_valid());
+}
+
+/*
+ * Hash SKEIN_LANES buffers, either through a multi-buffer kernel or one at
+ * a time.
+ */
+static void
+skein_bench_hash(const skein_ops_t *ops, skein_bench_t *sb, uint64_t size,
+    zio_cksum_t *zc)
+{
+	if (ops->so_compress_mb != NULL) {
+		skein_hash_mb(ops, sb->sb_tmpl, sb->sb_bufs, size, SKEIN_LANES,
+		    zc);
+	} else {
+		for (int l = 0; l < SKEIN_LANES; l++) {
+			zio_checksum_skein_native(sb->sb_bufs[l], size,
+			    sb->sb_tmpl, &zc[l]);
+		}
+	}
+}
+
+static boolean_t
+skein_bench_verify(int i, void *arg)
+{
+	for (uint64_t size = 0; size <= 300; size++) {
+		zio_cksum_t ref[SKEIN_LANES], zc[SKEIN_LANES];
+
+		skein_bench_hash(&skein_generic_ops, arg, size, ref);
+		skein_bench_hash(skein_algos[i], arg, size, zc);
+		for (int l = 0; l < SKEIN_LANES; l++) {
+			if (!ZIO_CHECKSUM_EQUAL(ref[l], zc[l]))
+				return (B_FALSE);
+		}
+	}
+
+	return (B_TRUE);
+}
+
+static uint64_t
+skein_bench_run(int i, void *arg)
+{
+	zio_cksum_t zc[SKEIN_LANES];
+
+	skein_bench_hash(skein_algos[i], arg, SKEIN_BENCH_SIZE, zc);
+	return (SKEIN_LANES * SKEIN_BENCH_SIZE);
+}
+
+static const zfs_bench_ops_t skein_bench_ops = {
+	.zbo_nimpls = SKEIN_NALGOS,
+	.zbo_name = skein_bench_name,
+	.zbo_valid = skein_bench_valid,
+	.zbo_verify = skein_bench_verify,
+	.zbo_run = skein_bench_run,
+};
+
+/*
+ * Verify the multi-buffer kernels against the reference code and use the
+ * fastest of them for batches if it beats hashing one buffer at a time.
+ */
+void
+skein_init(void)
+{
+	const skein_ops_t *ops;
+	zio_cksum_salt_t salt;
+	skein_bench_t sb;
+	uint8_t *buf;
+
+	buf = kmem_alloc(SKEIN_LANES * SKEIN_BENCH_SIZE, KM_SLEEP);
+	zfs_bench_fill(buf, SKEIN_LANES * SKEIN_BENCH_SIZE);
+	for (int l = 0; l < SKEIN_LANES; l++)
+		sb.sb_bufs[l] = buf + l * SKEIN_BENCH_SIZE;
+	for (int i = 0; i < sizeof (salt.zcs_bytes); i++)
+		salt.zcs_bytes[i] = (uint8_t)(i * 7);
+	sb.sb_tmpl = zio_checksum_skein_tmpl_init(&salt);
+
+	ops = skein_algos[zfs_bench_select("skein_bench", &skein_bench_ops,
+	    &sb, NULL, &skein_bench_ksp)];
+	skein_multi = (ops->so_compress_mb != NULL) ? ops : NULL;
+
+	zio_checksum_skein_tmpl_free(sb.sb_tmpl);
+	kmem_free(buf, SKEIN_LANES * SKEIN_BENCH_SIZE);
+}
+
+void
+skein_fini(void)
+{
+	kstat_delete(skein_bench_ksp);
+	skein_bench_ksp = NULL;
+}
+#endif /* defined(__zfsd__) */
@@ -5964,7 +5964,9 @@ spa_async_suspend(spa_t *spa)
 {
 	mutex_enter(&spa->spa_async_lock);
 	spa->spa_async_suspended++;
-	while (spa->spa_async_thread != NULL)
+	cv_broadcast(&spa->spa_async_cv);
+	while (spa->spa_async_thread != NULL ||
+	    spa->spa_trim_thread != NULL)
 		cv_wait(&spa->spa_async_cv, &spa->spa_async_lock);
 	mutex_exit(&spa->spa_async_lock);
 }
@@ -6802,6 +6804,7 @@ spa_sync(spa_t *spa, uint64_t txg)
 	ASSERT(txg_list_empty(&dp->dp_dirty_dirs, txg));
 	ASSERT(txg_list_empty(&spa->spa_vdev_txg_list, txg));
 
+	spa_txg_history_set_passes(spa, txg, spa->spa_sync_pass);
 	spa->spa_sync_pass = 0;
 
 	/*
@@ -6819,6 +6822,7 @@ spa_sync(spa_t *spa, uint64_t txg)
 	 * If any async tasks have been requested, kick them off.
 	 */
 	spa_async_dispatch(spa);
+	spa_trim_dispatch(spa);
 }
 
 /*
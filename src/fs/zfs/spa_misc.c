@@ -566,6 +566,10 @@ spa_add(const char *name, nvlist_t *config, const char *altroot)
 	mutex_init(&spa->spa_proc_lock, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&spa->spa_props_lock, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&spa->spa_cksum_tmpls_lock, NULL, MUTEX_DEFAULT, NULL);
+	for (int c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++) {
+		mutex_init(&spa->spa_cksum_batch[c].scb_lock, NULL,
+		    MUTEX_DEFAULT, NULL);
+	}
 	mutex_init(&spa->spa_scrub_lock, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&spa->spa_suspend_lock, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&spa->spa_vdev_top_lock, NULL, MUTEX_DEFAULT, NULL);
@@ -660,6 +664,8 @@ spa_add(const char *name, nvlist_t *config, const char *altroot)
 		kstat_install(spa->spa_iokstat);
 	}
 
+	spa_stats_init(spa);
+
 	spa->spa_debug = ((zfs_flags & ZFS_DEBUG_SPA) != 0);
 
 	spa->spa_min_ashift = INT_MAX;
@@ -728,6 +734,8 @@ spa_remove(spa_t *spa)
 	kstat_delete(spa->spa_iokstat);
 	spa->spa_iokstat = NULL;
 
+	spa_stats_destroy(spa);
+
 	for (int t = 0; t < TXG_SIZE; t++)
 		bplist_destroy(&spa->spa_free_bplist[t]);
 
@@ -748,6 +756,10 @@ spa_remove(spa_t *spa)
 	mutex_destroy(&spa->spa_proc_lock);
 	mutex_destroy(&spa->spa_props_lock);
 	mutex_destroy(&spa->spa_cksum_tmpls_lock);
+	for (int c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++) {
+		ASSERT0(spa->spa_cksum_batch[c].scb_count);
+		mutex_destroy(&spa->spa_cksum_batch[c].scb_lock);
+	}
 	mutex_destroy(&spa->spa_scrub_lock);
 	mutex_destroy(&spa->spa_suspend_lock);
 	mutex_destroy(&spa->spa_vdev_top_lock);
@@ -1878,7 +1890,10 @@ spa_init(int mode)
 	unique_init();
 	range_tree_init();
 	metaslab_alloc_trace_init();
+	zio_checksum_init();
+	zio_compress_init();
 	zio_init();
+	vdev_queue_agg_init();
 	dmu_init();
 	zil_init();
 	vdev_cache_stat_init();
@@ -1899,7 +1914,10 @@ spa_fini(void)
 	vdev_cache_stat_fini();
 	zil_fini();
 	dmu_fini();
+	vdev_queue_agg_fini();
 	zio_fini();
+	zio_compress_fini();
+	zio_checksum_fini();
 	metaslab_alloc_trace_fini();
 	range_tree_fini();
 	unique_fini();
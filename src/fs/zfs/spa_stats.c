@@ -0,0 +1,282 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Per-pool statistics.
+ *
+ * Each pool keeps a bounded history of its most recent transaction groups.
+ * The txg threads record how long every txg spent open, quiescing, waiting
+ * for the sync thread and syncing, along with the amount of dirty data and
+ * the I/O that syncing it generated.  The history is exported as the raw
+ * kstat "zfs/<pool>:0:txgs", whose data is an array of spa_txg_history_t
+ * indexed by txg modulo the history size.
+ *
+ * Each pool also accumulates the thread CPU time spent in every zio
+ * pipeline stage, broken down by zio type and by the zio taskq the stage
+ * ran on (see zio_execute()).  The table is exported as the raw kstat
+ * "zfs/<pool>:0:zio_cpu", an array of spa_zio_cpu_t laid out as
+ * [ZIO_TYPES][ZIO_TASKQ_TYPES + 1][ZIO_STAGES].  Its counters are updated
+ * atomically and are never reset.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/spa_impl.h>
+
+/*
+ * Number of txgs to keep per pool.  Zero disables the txg history.  The
+ * value is sampled when a pool is added to the namespace.
+ */
+int zfs_txg_history = 100;
+
+static void
+spa_txg_history_init(spa_t *spa)
+{
+	char module[KSTAT_STRLEN];
+	size_t size;
+	kstat_t *ksp;
+
+	mutex_init(&spa->spa_txg_history_lock, NULL, MUTEX_DEFAULT, NULL);
+
+	if (zfs_txg_history <= 0)
+		return;
+
+	spa->spa_txg_history_size = zfs_txg_history;
+	size = spa->spa_txg_history_size * sizeof (spa_txg_history_t);
+	spa->spa_txg_history = kmem_zalloc(size, KM_SLEEP);
+
+	(void) snprintf(module, sizeof (module), "zfs/%s", spa_name(spa));
+
+	ksp = kstat_create(module, 0, "txgs", "misc", KSTAT_TYPE_RAW,
+	    size, KSTAT_FLAG_VIRTUAL);
+	if (ksp != NULL) {
+		ksp->ks_data = spa->spa_txg_history;
+		ksp->ks_lock = &spa->spa_txg_history_lock;
+		ksp->ks_private = spa;
+		kstat_install(ksp);
+	}
+
+	spa->spa_txg_kstat = ksp;
+}
+
+static void
+spa_txg_history_destroy(spa_t *spa)
+{
+	kstat_delete(spa->spa_txg_kstat);
+	spa->spa_txg_kstat = NULL;
+
+	if (spa->spa_txg_history != NULL) {
+		kmem_free(spa->spa_txg_history,
+		    spa->spa_txg_history_size * sizeof (spa_txg_history_t));
+		spa->spa_txg_history = NULL;
+		spa->spa_txg_history_size = 0;
+	}
+
+	mutex_destroy(&spa->spa_txg_history_lock);
+}
+
+/*
+ * Find the history entry for a txg.  Returns NULL if history is disabled
+ * or if the entry has already been recycled for a later txg.
+ */
+static spa_txg_history_t *
+spa_txg_history_find(spa_t *spa, uint64_t txg)
+{
+	spa_txg_history_t *sth;
+
+	ASSERT(MUTEX_HELD(&spa->spa_txg_history_lock));
+
+	if (spa->spa_txg_history == NULL)
+		return (NULL);
+
+	sth = &spa->spa_txg_history[txg % spa->spa_txg_history_size];
+	return (sth->sth_txg == txg ? sth : NULL);
+}
+
+/*
+ * Start tracking a newly opened txg, recycling the oldest entry.
+ */
+void
+spa_txg_history_add(spa_t *spa, uint64_t txg, hrtime_t birth)
+{
+	spa_txg_history_t *sth;
+
+	if (spa->spa_txg_history == NULL)
+		return;
+
+	mutex_enter(&spa->spa_txg_history_lock);
+	sth = &spa->spa_txg_history[txg % spa->spa_txg_history_size];
+	bzero(sth, sizeof (*sth));
+	sth->sth_txg = txg;
+	sth->sth_birth = birth;
+	sth->sth_mark = birth;
+	mutex_exit(&spa->spa_txg_history_lock);
+}
+
+/*
+ * Record that a txg entered the given state at time "now", charging the
+ * time since its previous state change to the state it just left.
+ */
+void
+spa_txg_history_set(spa_t *spa, uint64_t txg, spa_txg_state_t state,
+    hrtime_t now)
+{
+	spa_txg_history_t *sth;
+	hrtime_t delta;
+
+	if (spa->spa_txg_history == NULL)
+		return;
+
+	mutex_enter(&spa->spa_txg_history_lock);
+	if ((sth = spa_txg_history_find(spa, txg)) != NULL) {
+		delta = now - sth->sth_mark;
+		sth->sth_mark = now;
+
+		switch (state) {
+		case SPA_TXG_STATE_QUIESCING:
+			sth->sth_open = delta;
+			break;
+		case SPA_TXG_STATE_QUIESCED:
+			sth->sth_quiesce = delta;
+			break;
+		case SPA_TXG_STATE_SYNCING:
+			sth->sth_wait = delta;
+			break;
+		case SPA_TXG_STATE_SYNCED:
+			sth->sth_sync = delta;
+			break;
+		}
+	}
+	mutex_exit(&spa->spa_txg_history_lock);
+}
+
+void
+spa_txg_history_set_io(spa_t *spa, uint64_t txg, uint64_t nread,
+    uint64_t nwritten, uint64_t reads, uint64_t writes, uint64_t ndirty)
+{
+	spa_txg_history_t *sth;
+
+	if (spa->spa_txg_history == NULL)
+		return;
+
+	mutex_enter(&spa->spa_txg_history_lock);
+	if ((sth = spa_txg_history_find(spa, txg)) != NULL) {
+		sth->sth_nread = nread;
+		sth->sth_nwritten = nwritten;
+		sth->sth_reads = reads;
+		sth->sth_writes = writes;
+		sth->sth_ndirty = ndirty;
+	}
+	mutex_exit(&spa->spa_txg_history_lock);
+}
+
+void
+spa_txg_history_set_passes(spa_t *spa, uint64_t txg, uint64_t passes)
+{
+	spa_txg_history_t *sth;
+
+	if (spa->spa_txg_history == NULL)
+		return;
+
+	mutex_enter(&spa->spa_txg_history_lock);
+	if ((sth = spa_txg_history_find(spa, txg)) != NULL)
+		sth->sth_passes = passes;
+	mutex_exit(&spa->spa_txg_history_lock);
+}
+
+static void
+spa_zio_cpu_init(spa_t *spa)
+{
+	char module[KSTAT_STRLEN];
+	kstat_t *ksp;
+
+	(void) snprintf(module, sizeof (module), "zfs/%s", spa_name(spa));
+
+	ksp = kstat_create(module, 0, "zio_cpu", "misc", KSTAT_TYPE_RAW,
+	    sizeof (spa->spa_zio_cpu), KSTAT_FLAG_VIRTUAL);
+	if (ksp != NULL) {
+		ksp->ks_data = spa->spa_zio_cpu;
+		ksp->ks_private = spa;
+		kstat_install(ksp);
+	}
+
+	spa->spa_zio_cpu_kstat = ksp;
+}
+
+static void
+spa_zio_cpu_destroy(spa_t *spa)
+{
+	kstat_delete(spa->spa_zio_cpu_kstat);
+	spa->spa_zio_cpu_kstat = NULL;
+}
+
+static void
+spa_trim_kstat_init(spa_t *spa)
+{
+	spa_trim_kstats_t *stk = &spa->spa_trim_kstats;
+	char module[KSTAT_STRLEN];
+	kstat_t *ksp;
+
+	kstat_named_init(&stk->stk_extents, "extents", KSTAT_DATA_UINT64);
+	kstat_named_init(&stk->stk_bytes, "bytes", KSTAT_DATA_UINT64);
+	kstat_named_init(&stk->stk_skipped_bytes, "skipped_bytes",
+	    KSTAT_DATA_UINT64);
+	kstat_named_init(&stk->stk_errors, "errors", KSTAT_DATA_UINT64);
+	kstat_named_init(&stk->stk_throttled_ns, "throttled_ns",
+	    KSTAT_DATA_UINT64);
+	kstat_named_init(&stk->stk_full_trims, "full_trims",
+	    KSTAT_DATA_UINT64);
+
+	(void) snprintf(module, sizeof (module), "zfs/%s", spa_name(spa));
+
+	ksp = kstat_create(module, 0, "trim", "misc", KSTAT_TYPE_NAMED,
+	    sizeof (*stk) / sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
+	if (ksp != NULL) {
+		ksp->ks_data = stk;
+		ksp->ks_private = spa;
+		kstat_install(ksp);
+	}
+
+	spa->spa_trim_kstat = ksp;
+}
+
+static void
+spa_trim_kstat_destroy(spa_t *spa)
+{
+	kstat_delete(spa->spa_trim_kstat);
+	spa->spa_trim_kstat = NULL;
+}
+
+void
+spa_stats_init(spa_t *spa)
+{
+	spa_txg_history_init(spa);
+	spa_zio_cpu_init(spa);
+	spa_trim_kstat_init(spa);
+}
+
+void
+spa_stats_destroy(spa_t *spa)
+{
+	spa_trim_kstat_destroy(spa);
+	spa_zio_cpu_destroy(spa);
+	spa_txg_history_destroy(spa);
+}
@@ -0,0 +1,375 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * TRIM
+ *
+ * Freed space is passed down to the leaf vdevs as DKIOCFREE ioctls so
+ * that SSDs and thinly provisioned storage can reclaim it.
+ *
+ * When a metaslab makes freed space allocatable again (after its defer
+ * txgs have passed, see metaslab_sync_done()), the space is also added to
+ * the metaslab's ms_trimtree and the pool is marked as having trims
+ * pending.  Allocating or claiming space removes it from the ms_trimtree,
+ * so the tree only ever holds free space.  At the end of spa_sync(), the
+ * per-pool trim thread is started if there is pending work.
+ *
+ * The trim thread walks the metaslabs, taking up to zfs_trim_max_active
+ * extents at a time out of each ms_trimtree.  While an extent is being
+ * trimmed it is moved to the ms_trimmingtree and removed from the
+ * ms_tree, so that it cannot be allocated and overwritten while the
+ * device is discarding it.  Extents smaller than zfs_trim_min_extent are
+ * dropped, since trimming them costs more than it gains.  After each batch
+ * the thread sleeps long enough to keep the rate of trimmed bytes below
+ * zfs_trim_rate, so trimming does not compete with the I/O that the vdev
+ * queues are scheduling.
+ *
+ * spa_trim() trims all of the free space in the pool, by first filling
+ * each ms_trimtree from the metaslab's free space.
+ *
+ * Only leaves and mirrors of leaves are trimmed; the children of a RAID-Z
+ * vdev do not store a range of it at the same offsets.  A leaf whose trims
+ * fail with ENOTSUP is marked vdev_notrim and is no longer trimmed.  The
+ * statistics are exported as the named kstat "zfs/<pool>:0:trim".
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/spa_impl.h>
+#include <sys/vdev_impl.h>
+#include <sys/metaslab_impl.h>
+#include <sys/zio.h>
+
+/*
+ * Set to zero to stop adding freed space to the trim trees.
+ */
+int zfs_trim_enabled = 1;
+
+/*
+ * Free extents smaller than this are not trimmed.
+ */
+uint64_t zfs_trim_min_extent = 32ULL << 10;
+
+/*
+ * Maximum rate of trimming, in bytes per second.  Zero means unlimited.
+ */
+uint64_t zfs_trim_rate = 1ULL << 30;
+
+/*
+ * Maximum number of extents trimmed concurrently.
+ */
+int zfs_trim_max_active = 8;
+
+#define	SPA_TRIM_MAX_ACTIVE	64
+
+static void
+spa_trim_done(zio_t *zio)
+{
+	spa_trim_kstats_t *stk = &zio->io_spa->spa_trim_kstats;
+
+	if (zio->io_error == 0) {
+		atomic_inc_64(&stk->stk_extents.value.ui64);
+		atomic_add_64(&stk->stk_bytes.value.ui64, zio->io_size);
+	} else if (zio->io_error != ENOTSUP) {
+		atomic_inc_64(&stk->stk_errors.value.ui64);
+	}
+}
+
+/*
+ * Return true if every leaf under vd stores vd's ranges at the same
+ * offsets, and every such leaf can be trimmed.
+ */
+static boolean_t
+spa_trim_vdev_supported(vdev_t *vd)
+{
+	const char *type = vd->vdev_ops->vdev_op_type;
+
+	if (!vdev_writeable(vd) || vd->vdev_notrim)
+		return (B_FALSE);
+
+	if (vd->vdev_ops->vdev_op_leaf)
+		return (B_TRUE);
+
+	if (strcmp(type, VDEV_TYPE_MIRROR) != 0 &&
+	    strcmp(type, VDEV_TYPE_REPLACING) != 0 &&
+	    strcmp(type, VDEV_TYPE_SPARE) != 0)
+		return (B_FALSE);
+
+	for (int c = 0; c < vd->vdev_children; c++) {
+		if (!spa_trim_vdev_supported(vd->vdev_child[c]))
+			return (B_FALSE);
+	}
+
+	return (B_TRUE);
+}
+
+/*
+ * Trim the next batch of extents of metaslab m of top-level vdev c.  If
+ * fill is set, first make all of the metaslab's free space eligible.  The
+ * number of bytes trimmed is returned in bytesp.  Returns EAGAIN if the
+ * metaslab has more to trim, ENOENT if there is no metaslab m, ENXIO if
+ * there is no vdev c, and EINTR if trimming has been suspended.
+ */
+static int
+spa_trim_batch(spa_t *spa, uint64_t c, uint64_t m, boolean_t fill,
+    uint64_t *bytesp)
+{
+	spa_trim_kstats_t *stk = &spa->spa_trim_kstats;
+	vdev_t *rvd = spa->spa_root_vdev;
+	uint64_t start[SPA_TRIM_MAX_ACTIVE];
+	uint64_t size[SPA_TRIM_MAX_ACTIVE];
+	uint64_t skipped = 0;
+	int max = MIN(MAX(zfs_trim_max_active, 1), SPA_TRIM_MAX_ACTIVE);
+	int n = 0;
+	metaslab_t *msp;
+	range_seg_t *rs;
+	vdev_t *vd;
+	zio_t *zio;
+	int error;
+
+	*bytesp = 0;
+
+	mutex_enter(&spa->spa_async_lock);
+	error = spa->spa_async_suspended ? SET_ERROR(EINTR) : 0;
+	mutex_exit(&spa->spa_async_lock);
+	if (error != 0)
+		return (error);
+
+	spa_config_enter(spa, SCL_STATE_ALL, FTAG, RW_READER);
+
+	if (c >= rvd->vdev_children) {
+		spa_config_exit(spa, SCL_STATE_ALL, FTAG);
+		return (SET_ERROR(ENXIO));
+	}
+
+	vd = rvd->vdev_child[c];
+	if (m >= vd->vdev_ms_count || vd->vdev_ms == NULL) {
+		spa_config_exit(spa, SCL_STATE_ALL, FTAG);
+		return (SET_ERROR(ENOENT));
+	}
+
+	msp = vd->vdev_ms[m];
+	mutex_enter(&msp->ms_lock);
+	metaslab_load_wait(msp);
+
+	/*
+	 * A metaslab that was just added has no trim tree until its first
+	 * txg syncs, and one that is condensing must keep its ms_tree.
+	 */
+	if (msp->ms_trimtree == NULL || msp->ms_condensing) {
+		mutex_exit(&msp->ms_lock);
+		spa_config_exit(spa, SCL_STATE_ALL, FTAG);
+		return (0);
+	}
+
+	if (!spa_trim_vdev_supported(vd)) {
+		skipped = range_tree_space(msp->ms_trimtree);
+		range_tree_vacate(msp->ms_trimtree, NULL, NULL);
+		mutex_exit(&msp->ms_lock);
+		spa_config_exit(spa, SCL_STATE_ALL, FTAG);
+		atomic_add_64(&stk->stk_skipped_bytes.value.ui64, skipped);
+		return (0);
+	}
+
+	if (fill) {
+		boolean_t loaded = msp->ms_loaded;
+
+		if (loaded || metaslab_load(msp) == 0) {
+			range_tree_vacate(msp->ms_trimtree, NULL, NULL);
+			range_tree_walk(msp->ms_tree, range_tree_add,
+			    msp->ms_trimtree);
+			if (!loaded && !(msp->ms_weight & METASLAB_ACTIVE_MASK))
+				metaslab_unload(msp);
+		}
+	}
+
+	/*
+	 * Hold the extents out of the allocatable space while they are
+	 * being trimmed.
+	 */
+	while (n < max &&
+	    (rs = avl_first(&msp->ms_trimtree->rt_root)) != NULL) {
+		uint64_t s = rs->rs_start;
+		uint64_t sz = MIN(rs->rs_end - s, SPA_MAXBLOCKSIZE);
+
+		range_tree_remove(msp->ms_trimtree, s, sz);
+		if (sz < zfs_trim_min_extent) {
+			skipped += sz;
+			continue;
+		}
+
+		range_tree_add(msp->ms_trimmingtree, s, sz);
+		if (msp->ms_loaded)
+			range_tree_remove(msp->ms_tree, s, sz);
+
+		start[n] = s;
+		size[n] = sz;
+		n++;
+	}
+	if (msp->ms_loaded)
+		msp->ms_max_size = metaslab_block_maxsize(msp);
+	mutex_exit(&msp->ms_lock);
+
+	atomic_add_64(&stk->stk_skipped_bytes.value.ui64, skipped);
+
+	zio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+	for (int i = 0; i < n; i++) {
+		zio_nowait(zio_trim(zio, spa, vd, start[i], size[i],
+		    spa_trim_done, NULL, ZIO_FLAG_CANFAIL |
+		    ZIO_FLAG_DONT_PROPAGATE | ZIO_FLAG_DONT_RETRY));
+		*bytesp += size[i];
+	}
+	(void) zio_wait(zio);
+
+	mutex_enter(&msp->ms_lock);
+	for (int i = 0; i < n; i++) {
+		range_tree_remove(msp->ms_trimmingtree, start[i], size[i]);
+		if (msp->ms_loaded)
+			range_tree_add(msp->ms_tree, start[i], size[i]);
+	}
+	if (msp->ms_loaded)
+		msp->ms_max_size = metaslab_block_maxsize(msp);
+	error = range_tree_space(msp->ms_trimtree) != 0 ? EAGAIN : 0;
+	mutex_exit(&msp->ms_lock);
+
+	spa_config_exit(spa, SCL_STATE_ALL, FTAG);
+
+	return (error);
+}
+
+/*
+ * Sleep long enough that trimming bytes stays within zfs_trim_rate.
+ */
+static void
+spa_trim_pace(spa_t *spa, uint64_t bytes)
+{
+	spa_trim_kstats_t *stk = &spa->spa_trim_kstats;
+	hrtime_t start = gethrtime();
+	clock_t deadline;
+
+	if (zfs_trim_rate == 0 || bytes == 0)
+		return;
+
+	mutex_enter(&spa->spa_async_lock);
+	deadline = ddi_get_lbolt() + MAX(bytes * hz / zfs_trim_rate, 1);
+	while (!spa->spa_async_suspended && ddi_get_lbolt() < deadline) {
+		(void) cv_timedwait(&spa->spa_async_cv, &spa->spa_async_lock,
+		    deadline);
+	}
+	mutex_exit(&spa->spa_async_lock);
+
+	atomic_add_64(&stk->stk_throttled_ns.value.ui64, gethrtime() - start);
+}
+
+/*
+ * Trim every metaslab of the pool once.
+ */
+static int
+spa_trim_pass(spa_t *spa, boolean_t full)
+{
+	for (uint64_t c = 0; ; c++) {
+		for (uint64_t m = 0; ; m++) {
+			boolean_t fill = full;
+			uint64_t bytes;
+			int error;
+
+			do {
+				error = spa_trim_batch(spa, c, m, fill, &bytes);
+				spa_trim_pace(spa, bytes);
+				fill = B_FALSE;
+			} while (error == EAGAIN);
+
+			if (error == ENOENT)
+				break;
+			if (error == ENXIO)
+				return (0);
+			if (error != 0)
+				return (error);
+		}
+	}
+}
+
+static void
+spa_trim_thread(void *arg)
+{
+	spa_t *spa = arg;
+	spa_trim_kstats_t *stk = &spa->spa_trim_kstats;
+
+	mutex_enter(&spa->spa_async_lock);
+	while (!spa->spa_async_suspended &&
+	    (spa->spa_trim_full || spa->spa_trim_pending)) {
+		boolean_t full = spa->spa_trim_full;
+		int error;
+
+		spa->spa_trim_full = B_FALSE;
+		spa->spa_trim_pending = B_FALSE;
+		mutex_exit(&spa->spa_async_lock);
+
+		error = spa_trim_pass(spa, full);
+
+		if (full && error == 0)
+			atomic_inc_64(&stk->stk_full_trims.value.ui64);
+
+		mutex_enter(&spa->spa_async_lock);
+		if (full && error != 0)
+			spa->spa_trim_full = B_TRUE;
+	}
+
+	spa->spa_trim_thread = NULL;
+	cv_broadcast(&spa->spa_async_cv);
+	mutex_exit(&spa->spa_async_lock);
+	thread_exit();
+}
+
+/*
+ * Start the trim thread if there is anything to trim.
+ */
+void
+spa_trim_dispatch(spa_t *spa)
+{
+	mutex_enter(&spa->spa_async_lock);
+	if ((spa->spa_trim_pending || spa->spa_trim_full) &&
+	    !spa->spa_async_suspended &&
+	    spa->spa_trim_thread == NULL &&
+	    spa_writeable(spa))
+		spa->spa_trim_thread = thread_create(NULL, 0,
+		    (kthread_proc_t)spa_trim_thread, spa, 0, &p0, TS_RUN,
+		    minclsyspri);
+	mutex_exit(&spa->spa_async_lock);
+}
+
+/*
+ * Trim all of the free space in the pool.  The trim runs asynchronously;
+ * the "full_trims" kstat counts the passes that have completed.
+ */
+int
+spa_trim(spa_t *spa)
+{
+	if (!spa_writeable(spa))
+		return (SET_ERROR(EROFS));
+
+	mutex_enter(&spa->spa_async_lock);
+	spa->spa_trim_full = B_TRUE;
+	mutex_exit(&spa->spa_async_lock);
+
+	spa_trim_dispatch(spa);
+
+	return (0);
+}
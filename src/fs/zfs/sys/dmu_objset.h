@@ -69,6 +69,16 @@ typedef struct objset_phys {
 	dnode_phys_t os_groupused_dnode;
 } objset_phys_t;
 
+/*
+ * Per-objset statistics, exported as the named kstat
+ * "zfs/<pool>:0:objset-0x<objset id>".
+ */
+typedef struct objset_kstats {
+	kstat_named_t	osk_compress_aborts;
+	kstat_named_t	osk_compress_abort_bytes;
+	kstat_named_t	osk_compress_abort_saved_ns;
+} objset_kstats_t;
+
 struct objset {
 	/* Immutable: */
 	struct dsl_dataset *os_dsl_dataset;
@@ -130,6 +140,10 @@ struct objset {
 	kmutex_t os_user_ptr_lock;
 	void *os_user_ptr;
 	sa_os_t *os_sa;
+
+	/* Updated atomically */
+	objset_kstats_t os_kstats;
+	kstat_t *os_kstat;
 };
 
 #define	DMU_META_OBJSET		0
@@ -145,6 +159,8 @@ struct objset {
 
 #define	DMU_OS_IS_L2COMPRESSIBLE(os)	(zfs_mdcomp_disable == B_FALSE)
 
+void dmu_objset_kstat_write(objset_t *os, const zio_t *zio);
+
 /* called from zpl */
 int dmu_objset_hold(const char *name, void *tag, objset_t **osp);
 int dmu_objset_own(const char *name, dmu_objset_type_t type,
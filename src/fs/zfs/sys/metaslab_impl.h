@@ -329,6 +329,13 @@ struct metaslab {
 	range_tree_t	*ms_freedtree; /* already freed this syncing txg */
 	range_tree_t	*ms_defertree[TXG_DEFER_SIZE];
 
+	/*
+	 * Free space that may be trimmed, and space being trimmed, which is
+	 * kept out of ms_tree until the trim completes (see spa_trim.c).
+	 */
+	range_tree_t	*ms_trimtree;
+	range_tree_t	*ms_trimmingtree;
+
 	boolean_t	ms_condensing;	/* condensing? */
 	boolean_t	ms_condense_wanted;
 
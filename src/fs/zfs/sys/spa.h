@@ -675,6 +675,11 @@ extern void spa_l2cache_drop(spa_t *spa);
 extern int spa_scan(spa_t *spa, pool_scan_func_t func);
 extern int spa_scan_stop(spa_t *spa);
 
+/* trimming, in spa_trim.c */
+extern int zfs_trim_enabled;
+extern int spa_trim(spa_t *spa);
+extern void spa_trim_dispatch(spa_t *spa);
+
 /* spa syncing */
 extern void spa_sync(spa_t *spa, uint64_t txg); /* only for DMU use */
 extern void spa_sync_allpools(void);
@@ -843,6 +848,47 @@ extern void spa_history_log_internal_ds(struct dsl_dataset *ds, const char *op,
 extern void spa_history_log_internal_dd(dsl_dir_t *dd, const char *operation,
     dmu_tx_t *tx, const char *fmt, ...);
 
+/* per-txg statistics, in spa_stats.c */
+typedef enum spa_txg_state {
+	SPA_TXG_STATE_QUIESCING,	/* closed to new transactions */
+	SPA_TXG_STATE_QUIESCED,		/* all transactions committed */
+	SPA_TXG_STATE_SYNCING,		/* handed off to spa_sync() */
+	SPA_TXG_STATE_SYNCED		/* spa_sync() returned */
+} spa_txg_state_t;
+
+/*
+ * One entry of the per-pool txg history.  The durations are nanoseconds
+ * spent in each state; the I/O counts cover the leaf I/O issued by the
+ * pool while the txg was syncing.
+ */
+typedef struct spa_txg_history {
+	uint64_t	sth_txg;	/* txg number, 0 if unused */
+	hrtime_t	sth_birth;	/* when the txg was opened */
+	hrtime_t	sth_open;	/* time spent open */
+	hrtime_t	sth_quiesce;	/* time spent quiescing */
+	hrtime_t	sth_wait;	/* time quiesced, waiting to sync */
+	hrtime_t	sth_sync;	/* time spent in spa_sync() */
+	uint64_t	sth_ndirty;	/* dirty bytes at start of sync */
+	uint64_t	sth_nread;	/* bytes read while syncing */
+	uint64_t	sth_nwritten;	/* bytes written while syncing */
+	uint64_t	sth_reads;	/* read operations while syncing */
+	uint64_t	sth_writes;	/* write operations while syncing */
+	uint64_t	sth_passes;	/* spa_sync() passes */
+	hrtime_t	sth_mark;	/* time of the last state change */
+} spa_txg_history_t;
+
+extern int zfs_txg_history;
+
+extern void spa_stats_init(spa_t *spa);
+extern void spa_stats_destroy(spa_t *spa);
+extern void spa_txg_history_add(spa_t *spa, uint64_t txg, hrtime_t birth);
+extern void spa_txg_history_set(spa_t *spa, uint64_t txg,
+    spa_txg_state_t state, hrtime_t now);
+extern void spa_txg_history_set_io(spa_t *spa, uint64_t txg, uint64_t nread,
+    uint64_t nwritten, uint64_t reads, uint64_t writes, uint64_t ndirty);
+extern void spa_txg_history_set_passes(spa_t *spa, uint64_t txg,
+    uint64_t passes);
+
 /* error handling */
 struct zbookmark_phys;
 extern void spa_log_error(spa_t *spa, zio_t *zio);
@@ -92,6 +92,47 @@ typedef enum zio_taskq_type {
 	ZIO_TASKQ_TYPES
 } zio_taskq_type_t;
 
+/*
+ * Thread CPU time spent in one zio pipeline stage.  Each pool keeps these
+ * per zio type and per zio taskq type, with an extra taskq slot for stages
+ * executed outside the zio taskqs (e.g. by the thread that issued the zio).
+ */
+typedef struct spa_zio_cpu {
+	uint64_t	szc_time;	/* thread CPU nanoseconds */
+	uint64_t	szc_count;	/* stage executions */
+} spa_zio_cpu_t;
+
+#define	ZIO_TASKQ_NONE	ZIO_TASKQ_TYPES	/* not on a zio taskq */
+
+/*
+ * Write zios parked in the CHECKSUM_GENERATE stage so that their checksums
+ * can be computed together (see zio_checksum_generate()).  Each pool keeps
+ * one batch per checksum function.
+ */
+#define	SPA_CKSUM_BATCH_MAX	8	/* widest multi-buffer kernel */
+
+typedef struct spa_cksum_batch {
+	kmutex_t	scb_lock;
+	int		scb_count;
+	hrtime_t	scb_start;	/* when the first zio was parked */
+	boolean_t	scb_flush;	/* flush task is queued */
+	taskq_ent_t	scb_tqent;	/* for the flush task */
+	zio_t		*scb_zio[SPA_CKSUM_BATCH_MAX];
+} spa_cksum_batch_t;
+
+/*
+ * TRIM statistics, exported as the named kstat "zfs/<pool>:0:trim".
+ * Extents and bytes are counted once per leaf vdev they were trimmed on.
+ */
+typedef struct spa_trim_kstats {
+	kstat_named_t	stk_extents;	/* extents trimmed */
+	kstat_named_t	stk_bytes;	/* bytes trimmed */
+	kstat_named_t	stk_skipped_bytes; /* freed, but too small to trim */
+	kstat_named_t	stk_errors;	/* failed trims */
+	kstat_named_t	stk_throttled_ns; /* time waiting for zfs_trim_rate */
+	kstat_named_t	stk_full_trims;	/* completed spa_trim() passes */
+} spa_trim_kstats_t;
+
 /*
  * State machine for the zpool-poolname process.  The states transitions
  * are done as follows:
@@ -179,6 +220,7 @@ struct spa {
 	/* checksum context templates */
 	kmutex_t	spa_cksum_tmpls_lock;
 	void		*spa_cksum_tmpls[ZIO_CHECKSUM_FUNCTIONS];
+	spa_cksum_batch_t spa_cksum_batch[ZIO_CHECKSUM_FUNCTIONS];
 	uberblock_t	spa_ubsync;		/* last synced uberblock */
 	uberblock_t	spa_uberblock;		/* current uberblock */
 	boolean_t	spa_extreme_rewind;	/* rewind past deferred frees */
@@ -198,6 +240,9 @@ struct spa {
 	int		spa_async_suspended;	/* async tasks suspended */
 	kcondvar_t	spa_async_cv;		/* wait for thread_exit() */
 	uint16_t	spa_async_tasks;	/* async task mask */
+	kthread_t	*spa_trim_thread;	/* thread trimming free space */
+	boolean_t	spa_trim_pending;	/* freed space awaits trim */
+	boolean_t	spa_trim_full;		/* spa_trim() requested */
 	char		*spa_root;		/* alternate root directory */
 	uint64_t	spa_ena;		/* spa-wide ereport ENA */
 	int		spa_last_open_failed;	/* error if last open failed */
@@ -278,6 +323,22 @@ struct spa {
 
 	hrtime_t	spa_ccw_fail_time;	/* Conf cache write fail time */
 
+	/*
+	 * spa_txg_history_lock protects the ring of recent txg statistics,
+	 * which is indexed by txg modulo spa_txg_history_size.
+	 */
+	kmutex_t	spa_txg_history_lock;
+	spa_txg_history_t *spa_txg_history;	/* recent txg statistics */
+	uint_t		spa_txg_history_size;	/* entries in the ring */
+	struct kstat	*spa_txg_kstat;		/* exports spa_txg_history */
+
+	/* CPU time per zio stage, updated atomically by zio_execute() */
+	spa_zio_cpu_t	spa_zio_cpu[ZIO_TYPES][ZIO_TASKQ_TYPES + 1][ZIO_STAGES];
+	struct kstat	*spa_zio_cpu_kstat;	/* exports spa_zio_cpu */
+
+	spa_trim_kstats_t spa_trim_kstats;	/* TRIM statistics */
+	struct kstat	*spa_trim_kstat;	/* exports spa_trim_kstats */
+
 	/*
 	 * spa_refcount & spa_config_lock must be the last elements
 	 * because refcount_t changes size based on compilation options.
@@ -121,6 +121,9 @@ extern void vdev_cache_purge(vdev_t *vd);
 
 extern void vdev_queue_init(vdev_t *vd);
 extern void vdev_queue_fini(vdev_t *vd);
+extern void vdev_queue_agg_init(void);
+extern void vdev_queue_agg_fini(void);
+extern void vdev_queue_set_max_active(vdev_t *vd, uint32_t max_active);
 extern zio_t *vdev_queue_io(zio_t *zio);
 extern void vdev_queue_io_done(zio_t *zio);
 
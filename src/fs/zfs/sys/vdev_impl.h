@@ -68,6 +68,7 @@ typedef void	vdev_io_done_func_t(zio_t *zio);
 typedef void	vdev_state_change_func_t(vdev_t *vd, int, int);
 typedef void	vdev_hold_func_t(vdev_t *vd);
 typedef void	vdev_rele_func_t(vdev_t *vd);
+typedef void	vdev_io_plug_func_t(vdev_t *vd);
 
 typedef struct vdev_ops {
 	vdev_open_func_t		*vdev_op_open;
@@ -78,6 +79,8 @@ typedef struct vdev_ops {
 	vdev_state_change_func_t	*vdev_op_state_change;
 	vdev_hold_func_t		*vdev_op_hold;
 	vdev_rele_func_t		*vdev_op_rele;
+	vdev_io_plug_func_t		*vdev_op_io_plug;
+	vdev_io_plug_func_t		*vdev_op_io_unplug;
 	char				vdev_op_type[16];
 	boolean_t			vdev_op_leaf;
 } vdev_ops_t;
@@ -112,6 +115,19 @@ typedef struct vdev_queue_class {
 	avl_tree_t	vqc_queued_tree;
 } vdev_queue_class_t;
 
+/*
+ * Per-leaf queue statistics, exported as the named kstat
+ * "zfs/<pool>:0:vdev-0x<vdev guid>".
+ */
+typedef struct vdev_queue_kstats {
+	kstat_named_t	vqk_max_active;	/* i/os the leaf accepts at once */
+	kstat_named_t	vqk_active;	/* i/os issued to the leaf */
+	kstat_named_t	vqk_peak_active;
+	kstat_named_t	vqk_queued;	/* i/os waiting to be issued */
+	kstat_named_t	vqk_saturated;	/* issues deferred at max_active */
+	kstat_named_t	vqk_saturated_ns; /* time spent at max_active */
+} vdev_queue_kstats_t;
+
 struct vdev_queue {
 	vdev_t		*vq_vdev;
 	vdev_queue_class_t vq_class[ZIO_PRIORITY_NUM_QUEUEABLE];
@@ -120,6 +136,10 @@ struct vdev_queue {
 	avl_tree_t	vq_write_offset_tree;
 	uint64_t	vq_last_offset;
 	hrtime_t	vq_io_complete_ts; /* time last i/o completed */
+	uint32_t	vq_max_active;	/* leaf's in-flight limit, or 0 */
+	hrtime_t	vq_saturated_ts; /* time max_active was reached */
+	vdev_queue_kstats_t vq_kstats;
+	kstat_t		*vq_kstat;
 	kmutex_t	vq_lock;
 };
 
@@ -210,6 +230,7 @@ struct vdev {
 	uint64_t	vdev_not_present; /* not present during import	*/
 	uint64_t	vdev_unspare;	/* unspare when resilvering done */
 	boolean_t	vdev_nowritecache; /* true if flushwritecache failed */
+	boolean_t	vdev_notrim;	/* true if DKIOCFREE failed	*/
 	boolean_t	vdev_checkremove; /* temporary online test	*/
 	boolean_t	vdev_forcefault; /* force online fault		*/
 	boolean_t	vdev_splitting;	/* split or repair in progress  */
@@ -220,6 +241,8 @@ struct vdev {
 	boolean_t	vdev_cant_write; /* vdev is failing all writes	*/
 	boolean_t	vdev_isspare;	/* was a hot spare		*/
 	boolean_t	vdev_isl2cache;	/* was a l2cache device		*/
+	boolean_t	vdev_iovec;	/* leaf can issue io_iov zios	*/
+	boolean_t	vdev_nonrot;	/* true if solid state		*/
 	vdev_queue_t	vdev_queue;	/* I/O deadline schedule queue	*/
 	vdev_cache_t	vdev_cache;	/* physical block cache		*/
 	spa_aux_vdev_t	*vdev_aux;	/* for l2cache and spares vdevs	*/
@@ -339,6 +362,7 @@ extern vdev_ops_t vdev_replacing_ops;
 extern vdev_ops_t vdev_raidz_ops;
 extern vdev_ops_t vdev_disk_ops;
 extern vdev_ops_t vdev_file_ops;
+extern vdev_ops_t vdev_memory_ops;
 extern vdev_ops_t vdev_missing_ops;
 extern vdev_ops_t vdev_hole_ops;
 extern vdev_ops_t vdev_spare_ops;
@@ -0,0 +1,60 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef	_SYS_ZFS_BENCH_H
+#define	_SYS_ZFS_BENCH_H
+
+#include <sys/types.h>
+#include <sys/kstat.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * How long zfs_bench_select() times each implementation.
+ */
+#define	ZFS_BENCH_NS	MSEC2NSEC(2)
+
+/*
+ * An algorithm's implementations, as seen by zfs_bench_select().  Every
+ * callback gets the index of an implementation and the caller's argument.
+ */
+typedef struct zfs_bench_ops {
+	int		zbo_nimpls;
+	const char	*(*zbo_name)(int i, void *arg);
+	/* Whether this CPU can run the implementation. */
+	boolean_t	(*zbo_valid)(int i, void *arg);
+	/* Whether the implementation agrees with the generic code. */
+	boolean_t	(*zbo_verify)(int i, void *arg);
+	/* Run the implementation once, returning the bytes processed. */
+	uint64_t	(*zbo_run)(int i, void *arg);
+} zfs_bench_ops_t;
+
+extern int zfs_bench_select(const char *name, const zfs_bench_ops_t *zbo,
+    void *arg, uint64_t *bw, kstat_t **kspp);
+extern void zfs_bench_fill(void *buf, size_t size);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_ZFS_BENCH_H */
@@ -0,0 +1,79 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef	_SYS_ZFS_BLAKE3_H
+#define	_SYS_ZFS_BLAKE3_H
+
+#include <sys/types.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define	BLAKE3_KEY_LEN		32
+#define	BLAKE3_OUT_LEN		32
+#define	BLAKE3_BLOCK_LEN	64
+#define	BLAKE3_CHUNK_LEN	1024
+
+/* Domain separation flags. */
+#define	BLAKE3_CHUNK_START	(1 << 0)
+#define	BLAKE3_CHUNK_END	(1 << 1)
+#define	BLAKE3_PARENT		(1 << 2)
+#define	BLAKE3_ROOT		(1 << 3)
+#define	BLAKE3_KEYED_HASH	(1 << 4)
+
+/*
+ * Hash ninputs independent inputs of nblocks 64-byte blocks each, starting
+ * every one from the chaining value key.  Input i uses the block counter
+ * counter + i if increment is set, or counter otherwise.  Every block gets
+ * flags; the first also gets flags_start and the last flags_end.  The
+ * resulting chaining values are written to out, BLAKE3_OUT_LEN bytes per
+ * input.  This is used both for runs of whole chunks and for parent nodes.
+ */
+typedef void blake3_hash_many_f(const uint8_t *const *inputs, size_t ninputs,
+    size_t nblocks, const uint32_t key[8], uint64_t counter,
+    boolean_t increment, uint8_t flags, uint8_t flags_start,
+    uint8_t flags_end, uint8_t *out);
+
+typedef struct blake3_ops {
+	const char		*bo_name;
+	boolean_t		(*bo_valid)(void);
+	blake3_hash_many_f	*bo_hash_many;
+} blake3_ops_t;
+
+extern const uint32_t blake3_iv[8];
+
+#if defined(__x86_64__) && defined(__GNUC__)
+extern const blake3_ops_t blake3_sse41_ops;
+extern const blake3_ops_t blake3_avx2_ops;
+extern const blake3_ops_t blake3_avx512_ops;
+#endif
+
+extern void blake3_init(void);
+extern void blake3_fini(void);
+extern int blake3_impl_set(const char *);
+extern const char *blake3_impl_get(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_ZFS_BLAKE3_H */
@@ -59,13 +59,29 @@ extern boolean_t zfs_free_leak_on_eio;
 #define	ZFS_DEBUG_ZIO_FREE		(1 << 6)
 #define	ZFS_DEBUG_HISTOGRAM_VERIFY	(1 << 7)
 #define	ZFS_DEBUG_METASLAB_VERIFY	(1 << 8)
+#define	ZFS_DEBUG_IO_ALIGN		(1 << 9)
 
 #ifdef ZFS_DEBUG
 extern void __dprintf(const char *file, const char *func,
     int line, const char *fmt, ...) printflike(4, 5);
-#define	dprintf(...) \
-	if (zfs_flags & ZFS_DEBUG_DPRINTF) \
-		__dprintf(__FILE__, __func__, __LINE__, __VA_ARGS__)
+extern int __dprintf_site_init(const char *file, const char *func);
+
+/*
+ * Each dprintf() call site caches whether ZFS_DEBUG selects it, so the
+ * debug string is matched against its file and function only once. A
+ * site is 0 until it is first reached, then 1 (enabled) or -1 (disabled).
+ */
+#define	dprintf(...) do { \
+	static int __dprintf_site; \
+	if (zfs_flags & ZFS_DEBUG_DPRINTF) { \
+		if (__dprintf_site == 0) \
+			__dprintf_site = \
+			    __dprintf_site_init(__FILE__, __func__); \
+		if (__dprintf_site > 0) \
+			__dprintf(__FILE__, __func__, __LINE__, \
+			    __VA_ARGS__); \
+	} \
+_NOTE(CONSTCOND) } while (0)
 #else
 #define	dprintf(...) ((void)0)
 #endif /* ZFS_DEBUG */
@@ -0,0 +1,61 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef	_SYS_ZFS_EDONR_H
+#define	_SYS_ZFS_EDONR_H
+
+#include <sys/types.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * Multi-buffer Edon-R 512.  A compress function runs nblocks consecutive
+ * 128-byte blocks of EDONR_LANES independent messages through their double
+ * pipes, laid out as p[word][lane].
+ */
+#define	EDONR_LANES		8
+
+typedef void edonr_compress_mb_f(uint64_t p[16][EDONR_LANES],
+    const uint8_t *const data[EDONR_LANES], size_t nblocks);
+
+typedef struct edonr_ops {
+	const char		*eo_name;
+	boolean_t		(*eo_valid)(void);
+	edonr_compress_mb_f	*eo_compress_mb;
+} edonr_ops_t;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+extern const edonr_ops_t edonr_avx2_ops;
+extern const edonr_ops_t edonr_avx512_ops;
+#endif
+
+extern void edonr_init(void);
+extern void edonr_fini(void);
+extern int edonr_impl_set(const char *);
+extern const char *edonr_impl_get(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_ZFS_EDONR_H */
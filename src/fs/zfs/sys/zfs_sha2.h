@@ -0,0 +1,89 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef	_SYS_ZFS_SHA2_H
+#define	_SYS_ZFS_SHA2_H
+
+#include <sys/types.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * SHA-2 block functions.  A compress function runs nblocks consecutive
+ * 64-byte blocks through the SHA-256 state; a multi-buffer function does
+ * the same for eight independent messages at once, with the state laid
+ * out as state[word][lane].
+ */
+#define	SHA256_BLOCK_SIZE	64
+#define	SHA256_LANES		8
+
+typedef void sha256_compress_f(uint32_t *state, const uint8_t *blocks,
+    size_t nblocks);
+typedef void sha256_compress_mb_f(uint32_t state[8][SHA256_LANES],
+    const uint8_t *const data[SHA256_LANES], size_t nblocks);
+
+typedef struct sha256_ops {
+	const char		*so_name;
+	boolean_t		(*so_valid)(void);
+	sha256_compress_f	*so_compress;		/* single buffer */
+	sha256_compress_mb_f	*so_compress_mb;	/* multi-buffer */
+} sha256_ops_t;
+
+/*
+ * SHA-512 compress functions run nblocks consecutive 128-byte blocks
+ * through the eight 64-bit state words.  They back the sha512 checksum,
+ * which is SHA-512/256: SHA-512 with its own IV, truncated to 256 bits.
+ */
+#define	SHA512_BLOCK_SIZE	128
+
+typedef void sha512_compress_f(uint64_t *state, const uint8_t *blocks,
+    size_t nblocks);
+
+typedef struct sha512_ops {
+	const char		*so_name;
+	boolean_t		(*so_valid)(void);
+	sha512_compress_f	*so_compress;
+} sha512_ops_t;
+
+extern const uint32_t sha256_k[64];
+extern const uint64_t sha512_k[80];
+
+#if defined(__x86_64__) && defined(__GNUC__)
+extern const sha256_ops_t sha256_shani_ops;
+extern const sha256_ops_t sha256_avx2_ops;
+extern const sha256_ops_t sha256_avx512_ops;
+extern const sha512_ops_t sha512_avx2_ops;
+#endif
+
+extern void sha2_init(void);
+extern void sha2_fini(void);
+extern int sha256_impl_set(const char *);
+extern const char *sha256_impl_get(void);
+extern int sha512_impl_set(const char *);
+extern const char *sha512_impl_get(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_ZFS_SHA2_H */
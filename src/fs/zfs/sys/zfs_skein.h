@@ -0,0 +1,64 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef	_SYS_ZFS_SKEIN_H
+#define	_SYS_ZFS_SKEIN_H
+
+#include <sys/types.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * Multi-buffer Skein-512.  A compress function runs nblocks consecutive
+ * 64-byte blocks of SKEIN_LANES independent messages through their
+ * chaining values, laid out as X[word][lane].  All lanes share the tweak
+ * T, which is advanced by byte_add per block exactly as
+ * Skein_512_Process_Block() does.
+ */
+#define	SKEIN_LANES		8
+
+typedef void skein_compress_mb_f(uint64_t X[8][SKEIN_LANES],
+    const uint8_t *const data[SKEIN_LANES], size_t nblocks, uint64_t *T,
+    size_t byte_add);
+
+typedef struct skein_ops {
+	const char		*so_name;
+	boolean_t		(*so_valid)(void);
+	skein_compress_mb_f	*so_compress_mb;
+} skein_ops_t;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+extern const skein_ops_t skein_avx2_ops;
+extern const skein_ops_t skein_avx512_ops;
+#endif
+
+extern void skein_init(void);
+extern void skein_fini(void);
+extern int skein_impl_set(const char *);
+extern const char *skein_impl_get(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_ZFS_SKEIN_H */
@@ -0,0 +1,65 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef	_SYS_ZFS_ZERO_H
+#define	_SYS_ZFS_ZERO_H
+
+#include <sys/types.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * The vector kernels work on ZFS_ZERO_CHUNK bytes at a time, which is also
+ * the width of the masks returned by zfs_zero_mask().
+ */
+#define	ZFS_ZERO_CHUNK	64
+
+typedef struct zfs_zero_ops {
+	const char	*zo_name;
+	boolean_t	(*zo_valid)(void);
+	/* Length of the leading run of zero bytes; size is chunk aligned. */
+	size_t		(*zo_run)(const void *buf, size_t size);
+	/* Bit i is set if byte i of the chunk at buf is zero. */
+	uint64_t	(*zo_mask)(const void *buf);
+} zfs_zero_ops_t;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+extern const zfs_zero_ops_t zfs_zero_sse2_ops;
+extern const zfs_zero_ops_t zfs_zero_avx2_ops;
+extern const zfs_zero_ops_t zfs_zero_avx512_ops;
+#endif
+
+extern size_t zfs_zero_run(const void *buf, size_t size);
+extern boolean_t zfs_is_zero(const void *buf, size_t size);
+extern uint64_t zfs_zero_mask(const void *buf);
+
+extern void zfs_zero_init(void);
+extern void zfs_zero_fini(void);
+extern int zfs_zero_impl_set(const char *);
+extern const char *zfs_zero_impl_get(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_ZFS_ZERO_H */
@@ -86,6 +86,7 @@ enum zio_checksum {
 	ZIO_CHECKSUM_SHA512,
 	ZIO_CHECKSUM_SKEIN,
 	ZIO_CHECKSUM_EDONR,
+	ZIO_CHECKSUM_BLAKE3,
 	ZIO_CHECKSUM_FUNCTIONS
 };
 
@@ -401,11 +402,15 @@ struct zio {
 	zio_done_func_t	*io_done;
 	void		*io_private;
 	int64_t		io_prev_space_delta;	/* DMU private */
+	boolean_t	io_compress_aborted;	/* see zio_compress_abort_t */
+	hrtime_t	io_compress_saved;
 	blkptr_t	io_bp_orig;
 
 	/* Data represented by this I/O */
 	void		*io_data;
 	void		*io_orig_data;
+	iovec_t		*io_iov;	/* io_data as a scatter list */
+	uint_t		io_iovcnt;
 	uint64_t	io_size;
 	uint64_t	io_orig_size;
 	/* io_lsize != io_orig_size iff this is a raw write */
@@ -453,29 +458,33 @@ struct zio {
 
 	/* Taskq dispatching state */
 	taskq_ent_t	io_tqent;
+	uint_t		io_tqstat;	/* CPU accounting slot of last taskq */
+
+	/* Slow I/O flight recorder state, NULL unless enabled */
+	struct zio_trace *io_trace;
 };
 
 extern int zio_timestamp_compare(const void *, const void *);
 
 extern zio_t *zio_null(zio_t *pio, spa_t *spa, vdev_t *vd,
-    zio_done_func_t *done, void *private, enum zio_flag flags);
+    zio_done_func_t *done, void *priv, enum zio_flag flags);
 
 extern zio_t *zio_root(spa_t *spa,
-    zio_done_func_t *done, void *private, enum zio_flag flags);
+    zio_done_func_t *done, void *priv, enum zio_flag flags);
 
 extern zio_t *zio_read(zio_t *pio, spa_t *spa, const blkptr_t *bp, void *data,
-    uint64_t lsize, zio_done_func_t *done, void *private,
+    uint64_t lsize, zio_done_func_t *done, void *priv,
     zio_priority_t priority, enum zio_flag flags, const zbookmark_phys_t *zb);
 
 extern zio_t *zio_write(zio_t *pio, spa_t *spa, uint64_t txg, blkptr_t *bp,
     void *data, uint64_t size, uint64_t psize, const zio_prop_t *zp,
     zio_done_func_t *ready, zio_done_func_t *children_ready,
     zio_done_func_t *physdone, zio_done_func_t *done,
-    void *private, zio_priority_t priority, enum zio_flag flags,
+    void *priv, zio_priority_t priority, enum zio_flag flags,
     const zbookmark_phys_t *zb);
 
 extern zio_t *zio_rewrite(zio_t *pio, spa_t *spa, uint64_t txg, blkptr_t *bp,
-    void *data, uint64_t size, zio_done_func_t *done, void *private,
+    void *data, uint64_t size, zio_done_func_t *done, void *priv,
     zio_priority_t priority, enum zio_flag flags, zbookmark_phys_t *zb);
 
 extern void zio_write_override(zio_t *zio, blkptr_t *bp, int copies,
@@ -485,19 +494,22 @@ extern void zio_free(spa_t *spa, uint64_t txg, const blkptr_t *bp);
 
 extern zio_t *zio_claim(zio_t *pio, spa_t *spa, uint64_t txg,
     const blkptr_t *bp,
-    zio_done_func_t *done, void *private, enum zio_flag flags);
+    zio_done_func_t *done, void *priv, enum zio_flag flags);
 
 extern zio_t *zio_ioctl(zio_t *pio, spa_t *spa, vdev_t *vd, int cmd,
-    zio_done_func_t *done, void *private, enum zio_flag flags);
+    zio_done_func_t *done, void *priv, enum zio_flag flags);
+
+extern zio_t *zio_trim(zio_t *pio, spa_t *spa, vdev_t *vd, uint64_t offset,
+    uint64_t size, zio_done_func_t *done, void *priv, enum zio_flag flags);
 
 extern zio_t *zio_read_phys(zio_t *pio, vdev_t *vd, uint64_t offset,
     uint64_t size, void *data, int checksum,
-    zio_done_func_t *done, void *private, zio_priority_t priority,
+    zio_done_func_t *done, void *priv, zio_priority_t priority,
     enum zio_flag flags, boolean_t labels);
 
 extern zio_t *zio_write_phys(zio_t *pio, vdev_t *vd, uint64_t offset,
     uint64_t size, void *data, int checksum,
-    zio_done_func_t *done, void *private, zio_priority_t priority,
+    zio_done_func_t *done, void *priv, zio_priority_t priority,
     enum zio_flag flags, boolean_t labels);
 
 extern zio_t *zio_free_sync(zio_t *pio, spa_t *spa, uint64_t txg,
@@ -535,11 +547,11 @@ extern void zio_resubmit_stage_async(void *);
 extern zio_t *zio_vdev_child_io(zio_t *zio, blkptr_t *bp, vdev_t *vd,
     uint64_t offset, void *data, uint64_t size, int type,
     zio_priority_t priority, enum zio_flag flags,
-    zio_done_func_t *done, void *private);
+    zio_done_func_t *done, void *priv);
 
 extern zio_t *zio_vdev_delegated_io(vdev_t *vd, uint64_t offset,
     void *data, uint64_t size, int type, zio_priority_t priority,
-    enum zio_flag flags, zio_done_func_t *done, void *private);
+    enum zio_flag flags, zio_done_func_t *done, void *priv);
 
 extern void zio_vdev_io_bypass(zio_t *zio);
 extern void zio_vdev_io_reissue(zio_t *zio);
@@ -582,6 +594,63 @@ extern int zio_handle_label_injection(zio_t *zio, int error);
 extern void zio_handle_ignored_writes(zio_t *zio);
 extern hrtime_t zio_handle_io_delay(zio_t *zio);
 
+/*
+ * Slow I/O flight recorder
+ *
+ * When zio_slow_io_ms is non-zero, every zio timestamps its pipeline stage
+ * transitions, taskq hops and vdev queue residency.  Any zio that takes
+ * longer than zio_slow_io_ms from being queued to completing is copied into
+ * a bounded ring, exported as the raw kstat "zfs:0:slow_ios".
+ */
+typedef struct zio_trace {
+	hrtime_t	zt_stage[ZIO_STAGES];	/* last entry into each stage */
+	hrtime_t	zt_dispatch;	/* pending taskq dispatch, or 0 */
+	hrtime_t	zt_taskq_wait;	/* total dispatch-to-execute time */
+	uint32_t	zt_taskq_hops;	/* number of taskq dispatches */
+	hrtime_t	zt_vdev_dequeue; /* left the vdev queue */
+	hrtime_t	zt_interrupt;	/* last I/O completion interrupt */
+} zio_trace_t;
+
+/*
+ * A slow I/O record.  Times are nanoseconds relative to zsi_queued, with
+ * zero meaning that the zio never reached that point.
+ */
+typedef struct zio_slow_io {
+	uint64_t	zsi_seq;	/* record sequence number */
+	uint64_t	zsi_spa_guid;	/* pool */
+	uint64_t	zsi_vdev_guid;	/* vdev, or 0 for logical I/O */
+	uint64_t	zsi_txg;
+	uint64_t	zsi_offset;
+	uint64_t	zsi_size;
+	zio_type_t	zsi_type;
+	zio_priority_t	zsi_priority;
+	enum zio_flag	zsi_flags;
+	enum zio_stage	zsi_pipeline_trace; /* stages executed */
+	int		zsi_error;
+	hrtime_t	zsi_queued;	/* absolute time the zio was queued */
+	hrtime_t	zsi_latency;	/* queued until done */
+	hrtime_t	zsi_stage[ZIO_STAGES]; /* entry into each stage */
+	hrtime_t	zsi_taskq_wait;	/* total time waiting on taskqs */
+	uint32_t	zsi_taskq_hops;
+	hrtime_t	zsi_vdev_queue;	/* time spent in the vdev queue */
+	hrtime_t	zsi_vdev_device; /* dequeued until interrupt */
+	blkptr_t	zsi_bp;		/* copy of io_bp, if any */
+} zio_slow_io_t;
+
+extern int zio_slow_io_ms;
+extern int zio_slow_io_history;
+
+extern void zio_trace_init(void);
+extern void zio_trace_fini(void);
+extern void zio_trace_create(zio_t *zio);
+extern void zio_trace_destroy(zio_t *zio);
+extern void zio_trace_done(zio_t *zio);
+
+#define	ZIO_TRACE_STAMP(zio, field) do {				\
+	if ((zio)->io_trace != NULL)					\
+		(zio)->io_trace->field = gethrtime();			\
+_NOTE(CONSTCOND) } while (0)
+
 /*
  * Checksum ereport functions
  */
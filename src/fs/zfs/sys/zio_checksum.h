@@ -39,6 +39,9 @@ extern "C" {
  */
 typedef void zio_checksum_t(const void *data, uint64_t size,
     const void *ctx_template, zio_cksum_t *zcp);
+typedef void zio_checksum_batch_t(const void **data, const uint64_t *size,
+    int count, const void *ctx_template, zio_cksum_t *zcp);
+typedef int zio_checksum_batch_width_t(void);
 typedef void *zio_checksum_tmpl_init_t(const zio_cksum_salt_t *salt);
 typedef void zio_checksum_tmpl_free_t(void *ctx_template);
 
@@ -65,6 +68,8 @@ typedef struct zio_checksum_info {
 	zio_checksum_tmpl_free_t	*ci_tmpl_free;
 	zio_checksum_flags_t		ci_flags;
 	char				*ci_name;	/* descriptive name */
+	zio_checksum_batch_t		*ci_batch;	/* native, optional */
+	zio_checksum_batch_width_t	*ci_batch_width; /* optional */
 } zio_checksum_info_t;
 
 typedef struct zio_bad_cksum {
@@ -82,31 +87,50 @@ extern zio_checksum_info_t zio_checksum_table[ZIO_CHECKSUM_FUNCTIONS];
  * Checksum routines.
  */
 extern zio_checksum_t zio_checksum_SHA256;
+extern zio_checksum_batch_t zio_checksum_SHA256_batch;
+extern zio_checksum_batch_width_t zio_checksum_SHA256_batch_width;
 extern zio_checksum_t zio_checksum_SHA512_native;
 extern zio_checksum_t zio_checksum_SHA512_byteswap;
 
 /* Skein */
 extern zio_checksum_t zio_checksum_skein_native;
 extern zio_checksum_t zio_checksum_skein_byteswap;
+extern zio_checksum_batch_t zio_checksum_skein_batch;
+extern zio_checksum_batch_width_t zio_checksum_skein_batch_width;
 extern zio_checksum_tmpl_init_t zio_checksum_skein_tmpl_init;
 extern zio_checksum_tmpl_free_t zio_checksum_skein_tmpl_free;
 
 /* Edon-R */
 extern zio_checksum_t zio_checksum_edonr_native;
 extern zio_checksum_t zio_checksum_edonr_byteswap;
+extern zio_checksum_batch_t zio_checksum_edonr_batch;
+extern zio_checksum_batch_width_t zio_checksum_edonr_batch_width;
 extern zio_checksum_tmpl_init_t zio_checksum_edonr_tmpl_init;
 extern zio_checksum_tmpl_free_t zio_checksum_edonr_tmpl_free;
 
+/* BLAKE3 */
+extern zio_checksum_t zio_checksum_blake3_native;
+extern zio_checksum_t zio_checksum_blake3_byteswap;
+extern zio_checksum_tmpl_init_t zio_checksum_blake3_tmpl_init;
+extern zio_checksum_tmpl_free_t zio_checksum_blake3_tmpl_free;
+
 extern int zio_checksum_equal(spa_t *, blkptr_t *, enum zio_checksum,
     void *, uint64_t, uint64_t, zio_bad_cksum_t *);
 extern void zio_checksum_compute(zio_t *zio, enum zio_checksum checksum,
     void *data, uint64_t size);
+extern void zio_checksum_batch(spa_t *spa, enum zio_checksum checksum,
+    const void **data, const uint64_t *size, int count, zio_cksum_t *zcp);
+extern int zio_checksum_batch_width(enum zio_checksum checksum);
+extern void zio_checksum_compute_batch(zio_t **zios, int count,
+    enum zio_checksum checksum);
 extern int zio_checksum_error_impl(spa_t *, blkptr_t *, enum zio_checksum,
     void *, uint64_t, uint64_t, zio_bad_cksum_t *);
 extern int zio_checksum_error(zio_t *zio, zio_bad_cksum_t *out);
 extern enum zio_checksum spa_dedup_checksum(spa_t *spa);
 extern void zio_checksum_templates_free(spa_t *spa);
 extern spa_feature_t zio_checksum_to_feature(enum zio_checksum cksum);
+extern void zio_checksum_init(void);
+extern void zio_checksum_fini(void);
 
 #ifdef	__cplusplus
 }
@@ -31,6 +31,8 @@
 #ifndef _SYS_ZIO_COMPRESS_H
 #define	_SYS_ZIO_COMPRESS_H
 
+#include <zfeature_common.h>
+
 #ifdef	__cplusplus
 extern "C" {
 #endif
@@ -52,6 +54,31 @@ enum zio_compress {
 	ZIO_COMPRESS_GZIP_9,
 	ZIO_COMPRESS_ZLE,
 	ZIO_COMPRESS_LZ4,
+	ZIO_COMPRESS_ZSTD_1,
+	ZIO_COMPRESS_ZSTD_2,
+	ZIO_COMPRESS_ZSTD_3,
+	ZIO_COMPRESS_ZSTD_4,
+	ZIO_COMPRESS_ZSTD_5,
+	ZIO_COMPRESS_ZSTD_6,
+	ZIO_COMPRESS_ZSTD_7,
+	ZIO_COMPRESS_ZSTD_8,
+	ZIO_COMPRESS_ZSTD_9,
+	ZIO_COMPRESS_ZSTD_10,
+	ZIO_COMPRESS_ZSTD_11,
+	ZIO_COMPRESS_ZSTD_12,
+	ZIO_COMPRESS_ZSTD_13,
+	ZIO_COMPRESS_ZSTD_14,
+	ZIO_COMPRESS_ZSTD_15,
+	ZIO_COMPRESS_ZSTD_16,
+	ZIO_COMPRESS_ZSTD_17,
+	ZIO_COMPRESS_ZSTD_18,
+	ZIO_COMPRESS_ZSTD_19,
+	ZIO_COMPRESS_LZ4_FAST_2,
+	ZIO_COMPRESS_LZ4_FAST_4,
+	ZIO_COMPRESS_LZ4_FAST_8,
+	ZIO_COMPRESS_LZ4_FAST_16,
+	ZIO_COMPRESS_LZ4_FAST_32,
+	ZIO_COMPRESS_LZ4_FAST_64,
 	ZIO_COMPRESS_FUNCTIONS
 };
 
@@ -74,6 +101,16 @@ typedef struct zio_compress_info {
 
 extern zio_compress_info_t zio_compress_table[ZIO_COMPRESS_FUNCTIONS];
 
+/*
+ * Whether zio_compress_data_impl() skipped the compressor because the
+ * early abort probe predicted the block would not compress, and the
+ * compressor time that is estimated to have saved.
+ */
+typedef struct zio_compress_abort {
+	boolean_t	zca_aborted;
+	hrtime_t	zca_saved;
+} zio_compress_abort_t;
+
 /*
  * Compression routines.
  */
@@ -93,14 +130,28 @@ extern size_t lz4_compress(void *src, void *dst, size_t s_len, size_t d_len,
     int level);
 extern int lz4_decompress(void *src, void *dst, size_t s_len, size_t d_len,
     int level);
+extern size_t zstd_compress(void *src, void *dst, size_t s_len, size_t d_len,
+    int level);
+extern int zstd_decompress(void *src, void *dst, size_t s_len, size_t d_len,
+    int level);
+extern void lz4_init(void);
+extern void lz4_fini(void);
+extern void zstd_init(void);
+extern void zstd_fini(void);
 
 /*
  * Compress and decompress data if necessary.
  */
 extern size_t zio_compress_data(enum zio_compress c, void *src, void *dst,
     size_t s_len);
+extern size_t zio_compress_data_impl(enum zio_compress c, void *src,
+    void *dst, size_t s_len, zio_compress_abort_t *zca);
 extern int zio_decompress_data(enum zio_compress c, void *src, void *dst,
     size_t s_len, size_t d_len);
+extern spa_feature_t zio_compress_to_feature(enum zio_compress c);
+extern enum zio_compress zio_compress_ondisk(enum zio_compress c);
+extern void zio_compress_init(void);
+extern void zio_compress_fini(void);
 
 #ifdef	__cplusplus
 }
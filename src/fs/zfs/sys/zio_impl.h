@@ -141,6 +141,8 @@ enum zio_stage {
 	ZIO_STAGE_DONE			= 1 << 23	/* RWFCI */
 };
 
+#define	ZIO_STAGES	24	/* highbit64(ZIO_STAGE_DONE) */
+
 #define	ZIO_INTERLOCK_STAGES			\
 	(ZIO_STAGE_READY |			\
 	ZIO_STAGE_DONE)
@@ -30,6 +30,7 @@
 #include <sys/dmu_tx.h>
 #include <sys/dsl_pool.h>
 #include <sys/dsl_scan.h>
+#include <sys/spa_impl.h>
 #include <sys/callb.h>
 
 /*
@@ -202,6 +203,9 @@ txg_sync_start(dsl_pool_t *dp)
 
 	tx->tx_threads = 2;
 
+	tx->tx_open_time = gethrtime();
+	spa_txg_history_add(dp->dp_spa, tx->tx_open_txg, tx->tx_open_time);
+
 	tx->tx_quiesce_thread = thread_create(NULL, 0, txg_quiesce_thread,
 	    dp, 0, &p0, TS_RUN, minclsyspri);
 
@@ -352,6 +356,7 @@ txg_rele_to_sync(txg_handle_t *th)
 static void
 txg_quiesce(dsl_pool_t *dp, uint64_t txg)
 {
+	spa_t *spa = dp->dp_spa;
 	tx_state_t *tx = &dp->dp_tx;
 	int g = txg & TXG_MASK;
 	int c;
@@ -376,6 +381,10 @@ txg_quiesce(dsl_pool_t *dp, uint64_t txg)
 	for (c = 0; c < max_ncpus; c++)
 		mutex_exit(&tx->tx_cpu[c].tc_open_lock);
 
+	spa_txg_history_set(spa, txg, SPA_TXG_STATE_QUIESCING,
+	    tx->tx_open_time);
+	spa_txg_history_add(spa, tx->tx_open_txg, tx->tx_open_time);
+
 	/*
 	 * Quiesce the transaction group by waiting for everyone to txg_exit().
 	 */
@@ -386,6 +395,8 @@ txg_quiesce(dsl_pool_t *dp, uint64_t txg)
 			cv_wait(&tc->tc_cv[g], &tc->tc_lock);
 		mutex_exit(&tc->tc_lock);
 	}
+
+	spa_txg_history_set(spa, txg, SPA_TXG_STATE_QUIESCED, gethrtime());
 }
 
 static void
@@ -449,8 +460,12 @@ txg_sync_thread(dsl_pool_t *dp)
 	spa_t *spa = dp->dp_spa;
 	tx_state_t *tx = &dp->dp_tx;
 	callb_cpr_t cpr;
+	vdev_stat_t *vs1, *vs2;
 	uint64_t start, delta;
 
+	vs1 = kmem_alloc(sizeof (vdev_stat_t), KM_SLEEP);
+	vs2 = kmem_alloc(sizeof (vdev_stat_t), KM_SLEEP);
+
 	txg_thread_enter(tx, &cpr);
 
 	start = delta = 0;
@@ -458,6 +473,7 @@ txg_sync_thread(dsl_pool_t *dp)
 		uint64_t timeout = zfs_txg_timeout * hz;
 		uint64_t timer;
 		uint64_t txg;
+		uint64_t ndirty;
 
 		/*
 		 * We sync when we're scanning, there's someone waiting
@@ -488,8 +504,11 @@ txg_sync_thread(dsl_pool_t *dp)
 			txg_thread_wait(tx, &cpr, &tx->tx_quiesce_done_cv, 0);
 		}
 
-		if (tx->tx_exiting)
+		if (tx->tx_exiting) {
+			kmem_free(vs2, sizeof (vdev_stat_t));
+			kmem_free(vs1, sizeof (vdev_stat_t));
 			txg_thread_exit(tx, &cpr, &tx->tx_sync_thread);
+		}
 
 		/*
 		 * Consume the quiesced txg which has been handed off to
@@ -506,10 +525,30 @@ txg_sync_thread(dsl_pool_t *dp)
 		    txg, tx->tx_quiesce_txg_waiting, tx->tx_sync_txg_waiting);
 		mutex_exit(&tx->tx_sync_lock);
 
+		ndirty = dp->dp_dirty_pertxg[txg & TXG_MASK];
+		spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
+		vdev_get_stats(spa->spa_root_vdev, vs1);
+		spa_config_exit(spa, SCL_CONFIG, FTAG);
+		spa_txg_history_set(spa, txg, SPA_TXG_STATE_SYNCING,
+		    gethrtime());
+
 		start = ddi_get_lbolt();
 		spa_sync(spa, txg);
 		delta = ddi_get_lbolt() - start;
 
+		spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
+		vdev_get_stats(spa->spa_root_vdev, vs2);
+		spa_config_exit(spa, SCL_CONFIG, FTAG);
+		spa_txg_history_set(spa, txg, SPA_TXG_STATE_SYNCED,
+		    gethrtime());
+		spa_txg_history_set_io(spa, txg,
+		    vs2->vs_bytes[ZIO_TYPE_READ] - vs1->vs_bytes[ZIO_TYPE_READ],
+		    vs2->vs_bytes[ZIO_TYPE_WRITE] -
+		    vs1->vs_bytes[ZIO_TYPE_WRITE],
+		    vs2->vs_ops[ZIO_TYPE_READ] - vs1->vs_ops[ZIO_TYPE_READ],
+		    vs2->vs_ops[ZIO_TYPE_WRITE] - vs1->vs_ops[ZIO_TYPE_WRITE],
+		    ndirty);
+
 		mutex_enter(&tx->tx_sync_lock);
 		tx->tx_synced_txg = txg;
 		tx->tx_syncing_txg = 0;
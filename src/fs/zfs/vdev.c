@@ -58,6 +58,7 @@ static vdev_ops_t *vdev_ops_table[] = {
 	&vdev_spare_ops,
 	&vdev_disk_ops,
 	&vdev_file_ops,
+	&vdev_memory_ops,
 	&vdev_missing_ops,
 	&vdev_hole_ops,
 	NULL
@@ -1135,16 +1136,23 @@ vdev_open_children(vdev_t *vd)
 		for (int c = 0; c < children; c++)
 			vd->vdev_child[c]->vdev_open_error =
 			    vdev_open(vd->vdev_child[c]);
-		return;
+	} else {
+		tq = taskq_create("vdev_open", children, minclsyspri,
+		    children, children, TASKQ_PREPOPULATE);
+
+		for (int c = 0; c < children; c++)
+			VERIFY(taskq_dispatch(tq, vdev_open_child,
+			    vd->vdev_child[c], TQ_SLEEP) != NULL);
+
+		taskq_destroy(tq);
 	}
-	tq = taskq_create("vdev_open", children, minclsyspri,
-	    children, children, TASKQ_PREPOPULATE);
 
+	/*
+	 * An interior vdev is non-rotational only if all its children are.
+	 */
+	vd->vdev_nonrot = B_TRUE;
 	for (int c = 0; c < children; c++)
-		VERIFY(taskq_dispatch(tq, vdev_open_child, vd->vdev_child[c],
-		    TQ_SLEEP) != NULL);
-
-	taskq_destroy(tq);
+		vd->vdev_nonrot &= vd->vdev_child[c]->vdev_nonrot;
 }
 
 /*
@@ -325,6 +325,35 @@ vdev_cache_read(zio_t *zio)
 	return (B_TRUE);
 }
 
+/*
+ * Copy len bytes starting at offset off within the zio's data, which may
+ * be a scatter list (see vdev_queue_aggregate()).
+ */
+static void
+vdev_cache_copy_from_zio(zio_t *zio, uint64_t off, void *buf, uint64_t len)
+{
+	iovec_t *iov = zio->io_iov;
+
+	if (iov == NULL) {
+		bcopy((char *)zio->io_data + off, buf, len);
+		return;
+	}
+
+	for (; off >= iov->iov_len; iov++)
+		off -= iov->iov_len;
+
+	while (len > 0) {
+		uint64_t n = MIN(len, iov->iov_len - off);
+
+		ASSERT3P(iov, <, zio->io_iov + zio->io_iovcnt);
+		bcopy((char *)iov->iov_base + off, buf, n);
+		buf = (char *)buf + n;
+		len -= n;
+		off = 0;
+		iov++;
+	}
+}
+
 /*
  * Update cache contents upon write completion.
  */
@@ -356,7 +385,7 @@ vdev_cache_write(zio_t *zio)
 		if (ve->ve_fill_io != NULL) {
 			ve->ve_missed_update = 1;
 		} else {
-			bcopy((char *)zio->io_data + start - io_start,
+			vdev_cache_copy_from_zio(zio, start - io_start,
 			    ve->ve_data + start - ve->ve_offset, end - start);
 		}
 		ve = AVL_NEXT(&vc->vc_offset_tree, ve);
@@ -123,6 +123,21 @@ vdev_mirror_map_alloc(zio_t *zio)
 			mc->mc_vd = vd->vdev_child[c];
 			mc->mc_offset = zio->io_offset;
 		}
+
+		/*
+		 * If the mirror mixes solid state and rotational children,
+		 * read from the solid state ones, still spreading reads
+		 * across them by offset.
+		 */
+		if (!mm->mm_replacing && !vd->vdev_nonrot) {
+			for (d = 0; d < mm->mm_children; d++) {
+				c = (mm->mm_preferred + d) % mm->mm_children;
+				if (mm->mm_child[c].mc_vd->vdev_nonrot) {
+					mm->mm_preferred = c;
+					break;
+				}
+			}
+		}
 	}
 
 	zio->io_vsd = mm;
@@ -462,6 +477,8 @@ vdev_ops_t vdev_mirror_ops = {
 	vdev_mirror_state_change,
 	NULL,
 	NULL,
+	NULL,
+	NULL,
 	VDEV_TYPE_MIRROR,	/* name of this vdev type */
 	B_FALSE			/* not a leaf vdev */
 };
@@ -475,6 +492,8 @@ vdev_ops_t vdev_replacing_ops = {
 	vdev_mirror_state_change,
 	NULL,
 	NULL,
+	NULL,
+	NULL,
 	VDEV_TYPE_REPLACING,	/* name of this vdev type */
 	B_FALSE			/* not a leaf vdev */
 };
@@ -488,6 +507,8 @@ vdev_ops_t vdev_spare_ops = {
 	vdev_mirror_state_change,
 	NULL,
 	NULL,
+	NULL,
+	NULL,
 	VDEV_TYPE_SPARE,	/* name of this vdev type */
 	B_FALSE			/* not a leaf vdev */
 };
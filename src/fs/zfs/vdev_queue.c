@@ -168,6 +168,21 @@ int zfs_vdev_aggregation_limit = SPA_OLD_MAXBLOCKSIZE;
 int zfs_vdev_read_gap_limit = 32 << 10;
 int zfs_vdev_write_gap_limit = 4 << 10;
 
+/*
+ * If the leaf vdev supports it (vdev_iovec), an aggregate I/O is described
+ * by a scatter list of its children's buffers rather than copied through a
+ * bounce buffer.  Read gaps are filled from a shared scratch buffer whose
+ * contents are discarded, and unwritten regions from a shared zero buffer.
+ * Aggregates of overlapping I/Os, or that would need more than IOV_MAX
+ * segments, are still copied.
+ */
+int zfs_vdev_aggregation_vectored = 1;
+
+#define	VDEV_QUEUE_PAD_SIZE	SPA_OLD_MAXBLOCKSIZE
+
+static void *vdev_queue_zero_buf;
+static void *vdev_queue_scratch_buf;
+
 /*
  * Define the queue depth percentage for each top-level. This percentage is
  * used in conjunction with zfs_vdev_async_max_active to determine how many
@@ -239,6 +254,45 @@ vdev_queue_timestamp_compare(const void *x1, const void *x2)
 	return (0);
 }
 
+static void
+vdev_queue_kstat_init(vdev_queue_t *vq)
+{
+	vdev_queue_kstats_t *vqk = &vq->vq_kstats;
+	vdev_t *vd = vq->vq_vdev;
+	char module[KSTAT_STRLEN];
+	char name[KSTAT_STRLEN];
+	kstat_t *ksp;
+
+	kstat_named_init(&vqk->vqk_max_active,
+	    "max_active", KSTAT_DATA_UINT32);
+	kstat_named_init(&vqk->vqk_active,
+	    "active", KSTAT_DATA_UINT32);
+	kstat_named_init(&vqk->vqk_peak_active,
+	    "peak_active", KSTAT_DATA_UINT32);
+	kstat_named_init(&vqk->vqk_queued,
+	    "queued", KSTAT_DATA_UINT32);
+	kstat_named_init(&vqk->vqk_saturated,
+	    "saturated", KSTAT_DATA_UINT64);
+	kstat_named_init(&vqk->vqk_saturated_ns,
+	    "saturated_ns", KSTAT_DATA_UINT64);
+	vqk->vqk_max_active.value.ui32 = zfs_vdev_max_active;
+
+	(void) snprintf(module, sizeof (module), "zfs/%s",
+	    spa_name(vd->vdev_spa));
+	(void) snprintf(name, sizeof (name), "vdev-0x%llx",
+	    (u_longlong_t)vd->vdev_guid);
+
+	ksp = kstat_create(module, 0, name, "misc", KSTAT_TYPE_NAMED,
+	    sizeof (*vqk) / sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
+	if (ksp != NULL) {
+		ksp->ks_data = vqk;
+		ksp->ks_lock = &vq->vq_lock;
+		kstat_install(ksp);
+	}
+
+	vq->vq_kstat = ksp;
+}
+
 void
 vdev_queue_init(vdev_t *vd)
 {
@@ -272,6 +326,9 @@ vdev_queue_init(vdev_t *vd)
 		avl_create(vdev_queue_class_tree(vq, p), compfn,
 		    sizeof (zio_t), offsetof(struct zio, io_queue_node));
 	}
+
+	if (vd->vdev_ops->vdev_op_leaf)
+		vdev_queue_kstat_init(vq);
 }
 
 void
@@ -279,6 +336,9 @@ vdev_queue_fini(vdev_t *vd)
 {
 	vdev_queue_t *vq = &vd->vdev_queue;
 
+	kstat_delete(vq->vq_kstat);
+	vq->vq_kstat = NULL;
+
 	for (zio_priority_t p = 0; p < ZIO_PRIORITY_NUM_QUEUEABLE; p++)
 		avl_destroy(vdev_queue_class_tree(vq, p));
 	avl_destroy(&vq->vq_active_tree);
@@ -288,6 +348,39 @@ vdev_queue_fini(vdev_t *vd)
 	mutex_destroy(&vq->vq_lock);
 }
 
+/*
+ * The number of i/os that may be active to the vdev at once.
+ */
+static uint32_t
+vdev_queue_max_active(vdev_queue_t *vq)
+{
+	if (vq->vq_max_active != 0)
+		return (MIN(vq->vq_max_active, zfs_vdev_max_active));
+	return (zfs_vdev_max_active);
+}
+
+/*
+ * Called by a leaf vdev, typically when it is opened, to limit the number
+ * of i/os issued to it at once to what it can accept without blocking, for
+ * example the number of requests its io_uring or worker threads can take.
+ * I/Os beyond the limit wait in the queue, where they can still be sorted,
+ * aggregated and prioritized, rather than blocking the zio pipeline in the
+ * leaf.  How often and for how long the leaf is held at its limit is
+ * exported in its queue kstat.  Zero removes the limit.
+ */
+void
+vdev_queue_set_max_active(vdev_t *vd, uint32_t max_active)
+{
+	vdev_queue_t *vq = &vd->vdev_queue;
+
+	ASSERT(vd->vdev_ops->vdev_op_leaf);
+
+	mutex_enter(&vq->vq_lock);
+	vq->vq_max_active = max_active;
+	vq->vq_kstats.vqk_max_active.value.ui32 = vdev_queue_max_active(vq);
+	mutex_exit(&vq->vq_lock);
+}
+
 static void
 vdev_queue_io_add(vdev_queue_t *vq, zio_t *zio)
 {
@@ -296,6 +389,7 @@ vdev_queue_io_add(vdev_queue_t *vq, zio_t *zio)
 	ASSERT3U(zio->io_priority, <, ZIO_PRIORITY_NUM_QUEUEABLE);
 	avl_add(vdev_queue_class_tree(vq, zio->io_priority), zio);
 	avl_add(vdev_queue_type_tree(vq, zio->io_type), zio);
+	vq->vq_kstats.vqk_queued.value.ui32++;
 
 	mutex_enter(&spa->spa_iokstat_lock);
 	spa->spa_queue_stats[zio->io_priority].spa_queued++;
@@ -312,6 +406,8 @@ vdev_queue_io_remove(vdev_queue_t *vq, zio_t *zio)
 	ASSERT3U(zio->io_priority, <, ZIO_PRIORITY_NUM_QUEUEABLE);
 	avl_remove(vdev_queue_class_tree(vq, zio->io_priority), zio);
 	avl_remove(vdev_queue_type_tree(vq, zio->io_type), zio);
+	vq->vq_kstats.vqk_queued.value.ui32--;
+	ZIO_TRACE_STAMP(zio, zt_vdev_dequeue);
 
 	mutex_enter(&spa->spa_iokstat_lock);
 	ASSERT3U(spa->spa_queue_stats[zio->io_priority].spa_queued, >, 0);
@@ -325,11 +421,21 @@ static void
 vdev_queue_pending_add(vdev_queue_t *vq, zio_t *zio)
 {
 	spa_t *spa = zio->io_spa;
+	vdev_queue_kstats_t *vqk = &vq->vq_kstats;
+	uint32_t active;
+
 	ASSERT(MUTEX_HELD(&vq->vq_lock));
 	ASSERT3U(zio->io_priority, <, ZIO_PRIORITY_NUM_QUEUEABLE);
 	vq->vq_class[zio->io_priority].vqc_active++;
 	avl_add(&vq->vq_active_tree, zio);
 
+	active = avl_numnodes(&vq->vq_active_tree);
+	vqk->vqk_active.value.ui32 = active;
+	if (active > vqk->vqk_peak_active.value.ui32)
+		vqk->vqk_peak_active.value.ui32 = active;
+	if (active >= vdev_queue_max_active(vq) && vq->vq_saturated_ts == 0)
+		vq->vq_saturated_ts = gethrtime();
+
 	mutex_enter(&spa->spa_iokstat_lock);
 	spa->spa_queue_stats[zio->io_priority].spa_active++;
 	if (spa->spa_iokstat != NULL)
@@ -341,11 +447,22 @@ static void
 vdev_queue_pending_remove(vdev_queue_t *vq, zio_t *zio)
 {
 	spa_t *spa = zio->io_spa;
+	vdev_queue_kstats_t *vqk = &vq->vq_kstats;
+	uint32_t active;
+
 	ASSERT(MUTEX_HELD(&vq->vq_lock));
 	ASSERT3U(zio->io_priority, <, ZIO_PRIORITY_NUM_QUEUEABLE);
 	vq->vq_class[zio->io_priority].vqc_active--;
 	avl_remove(&vq->vq_active_tree, zio);
 
+	active = avl_numnodes(&vq->vq_active_tree);
+	vqk->vqk_active.value.ui32 = active;
+	if (active < vdev_queue_max_active(vq) && vq->vq_saturated_ts != 0) {
+		vqk->vqk_saturated_ns.value.ui64 +=
+		    gethrtime() - vq->vq_saturated_ts;
+		vq->vq_saturated_ts = 0;
+	}
+
 	mutex_enter(&spa->spa_iokstat_lock);
 	ASSERT3U(spa->spa_queue_stats[zio->io_priority].spa_active, >, 0);
 	spa->spa_queue_stats[zio->io_priority].spa_active--;
@@ -364,9 +481,31 @@ vdev_queue_pending_remove(vdev_queue_t *vq, zio_t *zio)
 	mutex_exit(&spa->spa_iokstat_lock);
 }
 
+void
+vdev_queue_agg_init(void)
+{
+	vdev_queue_zero_buf = zio_buf_alloc(VDEV_QUEUE_PAD_SIZE);
+	bzero(vdev_queue_zero_buf, VDEV_QUEUE_PAD_SIZE);
+	vdev_queue_scratch_buf = zio_buf_alloc(VDEV_QUEUE_PAD_SIZE);
+}
+
+void
+vdev_queue_agg_fini(void)
+{
+	zio_buf_free(vdev_queue_scratch_buf, VDEV_QUEUE_PAD_SIZE);
+	zio_buf_free(vdev_queue_zero_buf, VDEV_QUEUE_PAD_SIZE);
+}
+
 static void
 vdev_queue_agg_io_done(zio_t *aio)
 {
+	if (aio->io_iov != NULL) {
+		/* The children's buffers were read or written in place. */
+		kmem_free(aio->io_iov, aio->io_iovcnt * sizeof (iovec_t));
+		aio->io_iov = NULL;
+		return;
+	}
+
 	if (aio->io_type == ZIO_TYPE_READ) {
 		zio_t *pio;
 		zio_link_t *zl = NULL;
@@ -468,8 +607,11 @@ vdev_queue_class_to_issue(vdev_queue_t *vq)
 	spa_t *spa = vq->vq_vdev->vdev_spa;
 	zio_priority_t p;
 
-	if (avl_numnodes(&vq->vq_active_tree) >= zfs_vdev_max_active)
+	if (avl_numnodes(&vq->vq_active_tree) >= vdev_queue_max_active(vq)) {
+		if (vq->vq_kstats.vqk_queued.value.ui32 > 0)
+			vq->vq_kstats.vqk_saturated.value.ui64++;
 		return (ZIO_PRIORITY_NUM_QUEUEABLE);
+	}
 
 	/* find a queue that has not reached its minimum # outstanding i/os */
 	for (p = 0; p < ZIO_PRIORITY_NUM_QUEUEABLE; p++) {
@@ -503,12 +645,56 @@ vdev_queue_class_to_issue(vdev_queue_t *vq)
 #define	IO_SPAN(fio, lio) ((lio)->io_offset + (lio)->io_size - (fio)->io_offset)
 #define	IO_GAP(fio, lio) (-IO_SPAN(lio, fio))
 
+/*
+ * Count the segments needed to describe the I/Os from first to last as a
+ * scatter list.  Returns zero if the range can't be vectored.
+ */
+static uint_t
+vdev_queue_agg_iovcnt(avl_tree_t *t, zio_t *first, zio_t *last)
+{
+	zio_t *dio, *pio = NULL;
+	uint_t iovcnt = 0;
+
+	for (dio = first; pio != last; pio = dio, dio = AVL_NEXT(t, dio)) {
+		if (pio != NULL) {
+			if (IO_GAP(pio, dio) < 0)
+				return (0);
+			iovcnt += howmany(IO_GAP(pio, dio),
+			    VDEV_QUEUE_PAD_SIZE);
+		}
+
+		if (dio->io_flags & ZIO_FLAG_NODATA)
+			iovcnt += howmany(dio->io_size, VDEV_QUEUE_PAD_SIZE);
+		else
+			iovcnt++;
+	}
+
+	return (iovcnt <= IOV_MAX ? iovcnt : 0);
+}
+
+/*
+ * Append len bytes of padding from buf to the scatter list.
+ */
+static void
+vdev_queue_agg_pad(zio_t *aio, void *buf, uint64_t len)
+{
+	while (len > 0) {
+		uint64_t n = MIN(len, VDEV_QUEUE_PAD_SIZE);
+
+		aio->io_iov[aio->io_iovcnt].iov_base = buf;
+		aio->io_iov[aio->io_iovcnt].iov_len = n;
+		aio->io_iovcnt++;
+		len -= n;
+	}
+}
+
 static zio_t *
 vdev_queue_aggregate(vdev_queue_t *vq, zio_t *zio)
 {
 	zio_t *first, *last, *aio, *dio, *mandatory, *nio;
 	uint64_t maxgap = 0;
-	uint64_t size;
+	uint64_t size, end;
+	uint_t iovcnt = 0;
 	boolean_t stretch = B_FALSE;
 	avl_tree_t *t = vdev_queue_type_tree(vq, zio->io_type);
 	enum zio_flag flags = zio->io_flags & ZIO_FLAG_AGG_INHERIT;
@@ -610,19 +796,42 @@ vdev_queue_aggregate(vdev_queue_t *vq, zio_t *zio)
 	size = IO_SPAN(first, last);
 	ASSERT3U(size, <=, zfs_vdev_aggregation_limit);
 
+	if (zfs_vdev_aggregation_vectored && first->io_vd->vdev_iovec)
+		iovcnt = vdev_queue_agg_iovcnt(t, first, last);
+
 	aio = zio_vdev_delegated_io(first->io_vd, first->io_offset,
-	    zio_buf_alloc(size), size, first->io_type, zio->io_priority,
-	    flags | ZIO_FLAG_DONT_CACHE | ZIO_FLAG_DONT_QUEUE,
+	    iovcnt == 0 ? zio_buf_alloc(size) : NULL, size, first->io_type,
+	    zio->io_priority, flags | ZIO_FLAG_DONT_CACHE | ZIO_FLAG_DONT_QUEUE,
 	    vdev_queue_agg_io_done, NULL);
 	aio->io_timestamp = first->io_timestamp;
 
+	if (iovcnt != 0)
+		aio->io_iov = kmem_alloc(iovcnt * sizeof (iovec_t), KM_SLEEP);
+
+	end = first->io_offset;
 	nio = first;
 	do {
 		dio = nio;
 		nio = AVL_NEXT(t, dio);
 		ASSERT3U(dio->io_type, ==, aio->io_type);
 
-		if (dio->io_flags & ZIO_FLAG_NODATA) {
+		if (aio->io_iov != NULL) {
+			vdev_queue_agg_pad(aio, dio->io_type == ZIO_TYPE_READ ?
+			    vdev_queue_scratch_buf : vdev_queue_zero_buf,
+			    dio->io_offset - end);
+			end = dio->io_offset + dio->io_size;
+
+			if (dio->io_flags & ZIO_FLAG_NODATA) {
+				vdev_queue_agg_pad(aio, vdev_queue_zero_buf,
+				    dio->io_size);
+			} else {
+				aio->io_iov[aio->io_iovcnt].iov_base =
+				    dio->io_data;
+				aio->io_iov[aio->io_iovcnt].iov_len =
+				    dio->io_size;
+				aio->io_iovcnt++;
+			}
+		} else if (dio->io_flags & ZIO_FLAG_NODATA) {
 			ASSERT3U(dio->io_type, ==, ZIO_TYPE_WRITE);
 			bzero((char *)aio->io_data + (dio->io_offset -
 			    aio->io_offset), dio->io_size);
@@ -638,6 +847,8 @@ vdev_queue_aggregate(vdev_queue_t *vq, zio_t *zio)
 		zio_execute(dio);
 	} while (dio != last);
 
+	ASSERT3U(aio->io_iovcnt, ==, iovcnt);
+
 	return (aio);
 }
 
@@ -748,9 +959,16 @@ vdev_queue_io(zio_t *zio)
 void
 vdev_queue_io_done(zio_t *zio)
 {
-	vdev_queue_t *vq = &zio->io_vd->vdev_queue;
+	vdev_t *vd = zio->io_vd;
+	vdev_queue_t *vq = &vd->vdev_queue;
 	zio_t *nio;
 
+	/*
+	 * Let the leaf batch everything we issue below into one submission.
+	 */
+	if (vd->vdev_ops->vdev_op_io_plug != NULL)
+		vd->vdev_ops->vdev_op_io_plug(vd);
+
 	mutex_enter(&vq->vq_lock);
 
 	vdev_queue_pending_remove(vq, zio);
@@ -769,4 +987,7 @@ vdev_queue_io_done(zio_t *zio)
 	}
 
 	mutex_exit(&vq->vq_lock);
+
+	if (vd->vdev_ops->vdev_op_io_unplug != NULL)
+		vd->vdev_ops->vdev_op_io_unplug(vd);
 }
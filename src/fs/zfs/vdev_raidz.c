@@ -2370,6 +2370,8 @@ vdev_ops_t vdev_raidz_ops = {
 	vdev_raidz_state_change,
 	NULL,
 	NULL,
+	NULL,
+	NULL,
 	VDEV_TYPE_RAIDZ,	/* name of this vdev type */
 	B_FALSE			/* not a leaf vdev */
 };
@@ -0,0 +1,113 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Implementation selection
+ *
+ * Checksum and zero detection code with vector kernels picks the fastest
+ * of them that this CPU supports when the module loads.  The algorithm
+ * describes its implementations with a zfs_bench_ops_t, the generic one
+ * first, and zfs_bench_select() checks each against the generic code,
+ * times it and exports the bandwidths as the named kstat "zfs:0:<name>".
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/zfs_bench.h>
+
+/*
+ * Return the index of the fastest usable implementation, which is 0 if
+ * none beats the generic code.  The bandwidth of each, in bytes per
+ * second or 0 if it is unusable, is stored in bw if that is not NULL,
+ * and the installed kstat in *kspp.
+ */
+int
+zfs_bench_select(const char *name, const zfs_bench_ops_t *zbo, void *arg,
+    uint64_t *bw, kstat_t **kspp)
+{
+	kstat_named_t *knp = NULL;
+	uint64_t best_bw = 0;
+	int best = 0;
+	kstat_t *ksp;
+
+	ksp = kstat_create("zfs", 0, name, "misc", KSTAT_TYPE_NAMED,
+	    zbo->zbo_nimpls, 0);
+	if (ksp != NULL)
+		knp = ksp->ks_data;
+
+	for (int i = 0; i < zbo->zbo_nimpls; i++) {
+		hrtime_t start, elapsed;
+		uint64_t bytes = 0, ibw;
+
+		if (bw != NULL)
+			bw[i] = 0;
+		if (knp != NULL) {
+			kstat_named_init(&knp[i], zbo->zbo_name(i, arg),
+			    KSTAT_DATA_UINT64);
+		}
+
+		if (!zbo->zbo_valid(i, arg))
+			continue;
+
+		if (!zbo->zbo_verify(i, arg)) {
+			cmn_err(CE_WARN, "%s: %s implementation disagrees "
+			    "with generic code", name, zbo->zbo_name(i, arg));
+			continue;
+		}
+
+		/* Warm up the caches and the vector units first. */
+		(void) zbo->zbo_run(i, arg);
+
+		start = gethrtime();
+		do {
+			bytes += zbo->zbo_run(i, arg);
+			elapsed = gethrtime() - start;
+		} while (elapsed < ZFS_BENCH_NS);
+
+		ibw = bytes * NANOSEC / MAX(elapsed, 1);
+		if (bw != NULL)
+			bw[i] = ibw;
+		if (knp != NULL)
+			knp[i].value.ui64 = ibw;
+
+		if (ibw > best_bw) {
+			best = i;
+			best_bw = ibw;
+		}
+	}
+
+	if (ksp != NULL)
+		kstat_install(ksp);
+	*kspp = ksp;
+
+	return (best);
+}
+
+/*
+ * Fill a benchmark buffer with a pattern that no kernel can shortcut.
+ */
+void
+zfs_bench_fill(void *buf, size_t size)
+{
+	uint8_t *p = buf;
+
+	for (size_t i = 0; i < size; i++)
+		p[i] = (uint8_t)(i * 131 + (i >> 9));
+}
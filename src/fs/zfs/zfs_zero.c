@@ -0,0 +1,253 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Zero detection
+ *
+ * Finding runs of zero bytes is on the write path of every block:
+ * zio_compress_data() and zio_write_compress() turn all-zero blocks into
+ * holes, and ZLE encodes runs of zeroes.  zfs_zero_run() returns the
+ * length of the leading run of zeroes in a buffer, and zfs_zero_mask()
+ * returns a bitmap of the zero bytes of a 64-byte chunk.
+ *
+ * The x86 kernels in zfs_zero_x86.c OR together several vectors per
+ * iteration and only look for the first nonzero byte once a chunk turns
+ * out to be nonzero.  zfs_zero_init() verifies them against the generic
+ * code below and picks the fastest; the measured bandwidths are exported
+ * as the named kstat "zfs:0:zero_bench".
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/zfs_bench.h>
+#include <sys/zfs_zero.h>
+
+static boolean_t
+zfs_zero_generic_valid(void)
+{
+	return (B_TRUE);
+}
+
+static size_t
+zfs_zero_run_generic(const void *buf, size_t size)
+{
+	const uint8_t *p = buf;
+	size_t off = 0;
+
+	if (IS_P2ALIGNED(p, sizeof (uint64_t))) {
+		const uint64_t *word = buf;
+
+		while (off < size && word[off / sizeof (uint64_t)] == 0)
+			off += sizeof (uint64_t);
+	}
+
+	while (off < size && p[off] == 0)
+		off++;
+
+	return (off);
+}
+
+static uint64_t
+zfs_zero_mask_generic(const void *buf)
+{
+	const uint8_t *p = buf;
+	uint64_t mask = 0;
+
+	for (int i = 0; i < ZFS_ZERO_CHUNK; i++) {
+		if (p[i] == 0)
+			mask |= 1ULL << i;
+	}
+
+	return (mask);
+}
+
+static const zfs_zero_ops_t zfs_zero_generic_ops = {
+	.zo_name = "generic",
+	.zo_valid = zfs_zero_generic_valid,
+	.zo_run = zfs_zero_run_generic,
+	.zo_mask = zfs_zero_mask_generic,
+};
+
+static const zfs_zero_ops_t *zfs_zero_algos[] = {
+	&zfs_zero_generic_ops,
+#if defined(__x86_64__) && defined(__GNUC__)
+	&zfs_zero_sse2_ops,
+	&zfs_zero_avx2_ops,
+	&zfs_zero_avx512_ops,
+#endif
+};
+
+#define	ZFS_ZERO_NALGOS	(sizeof (zfs_zero_algos) / sizeof (zfs_zero_algos[0]))
+
+static const zfs_zero_ops_t *volatile zfs_zero_impl = &zfs_zero_generic_ops;
+
+/*
+ * Return the number of leading zero bytes in buf, at most size.
+ */
+size_t
+zfs_zero_run(const void *buf, size_t size)
+{
+	const uint8_t *p = buf;
+	size_t bulk = P2ALIGN(size, (size_t)ZFS_ZERO_CHUNK);
+	size_t off;
+
+	off = zfs_zero_impl->zo_run(buf, bulk);
+	if (off < bulk)
+		return (off);
+
+	while (off < size && p[off] == 0)
+		off++;
+
+	return (off);
+}
+
+boolean_t
+zfs_is_zero(const void *buf, size_t size)
+{
+	return (zfs_zero_run(buf, size) == size);
+}
+
+/*
+ * Return a mask of the zero bytes among the ZFS_ZERO_CHUNK bytes at buf,
+ * with byte i in bit i.
+ */
+uint64_t
+zfs_zero_mask(const void *buf)
+{
+	return (zfs_zero_impl->zo_mask(buf));
+}
+
+int
+zfs_zero_impl_set(const char *name)
+{
+	for (int i = 0; i < ZFS_ZERO_NALGOS; i++) {
+		const zfs_zero_ops_t *ops = zfs_zero_algos[i];
+
+		if (strcmp(ops->zo_name, name) == 0 && ops->zo_valid()) {
+			zfs_zero_impl = ops;
+			return (0);
+		}
+	}
+
+	return (SET_ERROR(ENOTSUP));
+}
+
+const char *
+zfs_zero_impl_get(void)
+{
+	return (zfs_zero_impl->zo_name);
+}
+
+#define	ZFS_ZERO_BENCH_SIZE	(128 * 1024)
+
+static kstat_t *zfs_zero_bench_ksp;
+
+/*
+ * Check an implementation against the generic code with a single nonzero
+ * byte at every position of the first few chunks, and at the very end.
+ */
+static boolean_t
+zfs_zero_verify(const zfs_zero_ops_t *ops, uint8_t *buf)
+{
+	size_t size = ZFS_ZERO_BENCH_SIZE;
+	boolean_t ok = B_TRUE;
+
+	for (size_t pos = 0; pos <= 8 * ZFS_ZERO_CHUNK && ok; pos++) {
+		size_t where = MIN(pos, size - 1);
+
+		buf[where] = 0x80 >> (pos & 7);
+		if (ops->zo_run(buf, size) !=
+		    zfs_zero_run_generic(buf, size) ||
+		    ops->zo_run(buf, P2ALIGN(where, ZFS_ZERO_CHUNK)) !=
+		    P2ALIGN(where, ZFS_ZERO_CHUNK))
+			ok = B_FALSE;
+		for (size_t c = 0; c < where + ZFS_ZERO_CHUNK && c < size;
+		    c += ZFS_ZERO_CHUNK) {
+			if (ops->zo_mask(buf + c) !=
+			    zfs_zero_mask_generic(buf + c))
+				ok = B_FALSE;
+		}
+		buf[where] = 0;
+	}
+
+	buf[size - 1] = 1;
+	if (ops->zo_run(buf, size) != size - 1)
+		ok = B_FALSE;
+	buf[size - 1] = 0;
+	if (ops->zo_run(buf, size) != size)
+		ok = B_FALSE;
+
+	return (ok);
+}
+
+static const char *
+zfs_zero_bench_name(int i, void *arg)
+{
+	return (zfs_zero_algos[i]->zo_name);
+}
+
+static boolean_t
+zfs_zero_bench_valid(int i, void *arg)
+{
+	return (zfs_zero_algos[i]->zo_valid());
+}
+
+static boolean_t
+zfs_zero_bench_verify(int i, void *arg)
+{
+	return (zfs_zero_verify(zfs_zero_algos[i], arg));
+}
+
+static uint64_t
+zfs_zero_bench_run(int i, void *arg)
+{
+	return (zfs_zero_algos[i]->zo_run(arg, ZFS_ZERO_BENCH_SIZE));
+}
+
+static const zfs_bench_ops_t zfs_zero_bench_ops = {
+	.zbo_nimpls = ZFS_ZERO_NALGOS,
+	.zbo_name = zfs_zero_bench_name,
+	.zbo_valid = zfs_zero_bench_valid,
+	.zbo_verify = zfs_zero_bench_verify,
+	.zbo_run = zfs_zero_bench_run,
+};
+
+/*
+ * Verify the vector kernels and use the fastest implementation.  The
+ * bandwidth is measured scanning an all-zero buffer, which is the case
+ * that has to read all of it.
+ */
+void
+zfs_zero_init(void)
+{
+	uint8_t *buf = kmem_zalloc(ZFS_ZERO_BENCH_SIZE, KM_SLEEP);
+
+	zfs_zero_impl = zfs_zero_algos[zfs_bench_select("zero_bench",
+	    &zfs_zero_bench_ops, buf, NULL, &zfs_zero_bench_ksp)];
+
+	kmem_free(buf, ZFS_ZERO_BENCH_SIZE);
+}
+
+void
+zfs_zero_fini(void)
+{
+	kstat_delete(zfs_zero_bench_ksp);
+	zfs_zero_bench_ksp = NULL;
+}
@@ -0,0 +1,213 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * SSE2, AVX2 and AVX-512 zero detection kernels.
+ *
+ * The run kernels OR together four chunks, 256 bytes, per iteration and
+ * test the result once, so an all-zero buffer is scanned at close to load
+ * bandwidth.  The first nonzero chunk is then located with the mask
+ * kernel, and the first nonzero byte within it from the mask.
+ */
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+#include <sys/types.h>
+#include <sys/zfs_zero.h>
+#include <immintrin.h>
+
+#define	ZFS_ZERO_AVX2	__attribute__((target("avx2")))
+#define	ZFS_ZERO_AVX512	__attribute__((target("avx2,avx512f,avx512bw")))
+#define	ZFS_ZERO_INLINE	inline __attribute__((always_inline))
+
+#define	ZFS_ZERO_STRIDE	(4 * ZFS_ZERO_CHUNK)
+
+/*
+ * Finish a run in the chunk-by-chunk tail, given the kernel's mask.
+ */
+#define	ZFS_ZERO_RUN_TAIL(p, off, size, mask)				\
+	for (; (off) < (size); (off) += ZFS_ZERO_CHUNK) {		\
+		uint64_t m = mask((p) + (off));				\
+		if (m != ~0ULL)						\
+			return ((off) + __builtin_ctzll(~m));		\
+	}								\
+	return (off)
+
+static boolean_t
+zfs_zero_sse2_valid(void)
+{
+	return (B_TRUE);	/* part of the x86-64 baseline */
+}
+
+static ZFS_ZERO_INLINE __m128i
+zfs_zero_or_sse2(const uint8_t *p)
+{
+	return (_mm_or_si128(
+	    _mm_or_si128(_mm_loadu_si128((const __m128i *)p),
+	    _mm_loadu_si128((const __m128i *)(p + 16))),
+	    _mm_or_si128(_mm_loadu_si128((const __m128i *)(p + 32)),
+	    _mm_loadu_si128((const __m128i *)(p + 48)))));
+}
+
+static uint64_t
+zfs_zero_mask_sse2(const void *buf)
+{
+	const uint8_t *p = buf;
+	__m128i zero = _mm_setzero_si128();
+	uint64_t mask = 0;
+
+	for (int i = 0; i < ZFS_ZERO_CHUNK; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+
+		mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+		    _mm_cmpeq_epi8(v, zero)) << i;
+	}
+
+	return (mask);
+}
+
+static size_t
+zfs_zero_run_sse2(const void *buf, size_t size)
+{
+	const uint8_t *p = buf;
+	__m128i zero = _mm_setzero_si128();
+	size_t off = 0;
+
+	for (; off + ZFS_ZERO_STRIDE <= size; off += ZFS_ZERO_STRIDE) {
+		__m128i v = _mm_or_si128(
+		    _mm_or_si128(zfs_zero_or_sse2(p + off),
+		    zfs_zero_or_sse2(p + off + 64)),
+		    _mm_or_si128(zfs_zero_or_sse2(p + off + 128),
+		    zfs_zero_or_sse2(p + off + 192)));
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) != 0xffff)
+			break;
+	}
+
+	ZFS_ZERO_RUN_TAIL(p, off, size, zfs_zero_mask_sse2);
+}
+
+const zfs_zero_ops_t zfs_zero_sse2_ops = {
+	.zo_name = "sse2",
+	.zo_valid = zfs_zero_sse2_valid,
+	.zo_run = zfs_zero_run_sse2,
+	.zo_mask = zfs_zero_mask_sse2,
+};
+
+static boolean_t
+zfs_zero_avx2_valid(void)
+{
+	__builtin_cpu_init();
+	return (__builtin_cpu_supports("avx2") ? B_TRUE : B_FALSE);
+}
+
+static ZFS_ZERO_AVX2 ZFS_ZERO_INLINE __m256i
+zfs_zero_or_avx2(const uint8_t *p)
+{
+	return (_mm256_or_si256(_mm256_loadu_si256((const __m256i *)p),
+	    _mm256_loadu_si256((const __m256i *)(p + 32))));
+}
+
+static ZFS_ZERO_AVX2 uint64_t
+zfs_zero_mask_avx2(const void *buf)
+{
+	const uint8_t *p = buf;
+	__m256i zero = _mm256_setzero_si256();
+	__m256i lo = _mm256_loadu_si256((const __m256i *)p);
+	__m256i hi = _mm256_loadu_si256((const __m256i *)(p + 32));
+
+	return ((uint64_t)(uint32_t)_mm256_movemask_epi8(
+	    _mm256_cmpeq_epi8(lo, zero)) |
+	    (uint64_t)(uint32_t)_mm256_movemask_epi8(
+	    _mm256_cmpeq_epi8(hi, zero)) << 32);
+}
+
+static ZFS_ZERO_AVX2 size_t
+zfs_zero_run_avx2(const void *buf, size_t size)
+{
+	const uint8_t *p = buf;
+	size_t off = 0;
+
+	for (; off + ZFS_ZERO_STRIDE <= size; off += ZFS_ZERO_STRIDE) {
+		__m256i v = _mm256_or_si256(
+		    _mm256_or_si256(zfs_zero_or_avx2(p + off),
+		    zfs_zero_or_avx2(p + off + 64)),
+		    _mm256_or_si256(zfs_zero_or_avx2(p + off + 128),
+		    zfs_zero_or_avx2(p + off + 192)));
+
+		if (!_mm256_testz_si256(v, v))
+			break;
+	}
+
+	ZFS_ZERO_RUN_TAIL(p, off, size, zfs_zero_mask_avx2);
+}
+
+const zfs_zero_ops_t zfs_zero_avx2_ops = {
+	.zo_name = "avx2",
+	.zo_valid = zfs_zero_avx2_valid,
+	.zo_run = zfs_zero_run_avx2,
+	.zo_mask = zfs_zero_mask_avx2,
+};
+
+static boolean_t
+zfs_zero_avx512_valid(void)
+{
+	__builtin_cpu_init();
+	return (__builtin_cpu_supports("avx512f") &&
+	    __builtin_cpu_supports("avx512bw") &&
+	    __builtin_cpu_supports("avx2") ? B_TRUE : B_FALSE);
+}
+
+static ZFS_ZERO_AVX512 uint64_t
+zfs_zero_mask_avx512(const void *buf)
+{
+	return (_mm512_cmpeq_epi8_mask(_mm512_loadu_si512(buf),
+	    _mm512_setzero_si512()));
+}
+
+static ZFS_ZERO_AVX512 size_t
+zfs_zero_run_avx512(const void *buf, size_t size)
+{
+	const uint8_t *p = buf;
+	size_t off = 0;
+
+	for (; off + ZFS_ZERO_STRIDE <= size; off += ZFS_ZERO_STRIDE) {
+		__m512i v = _mm512_or_si512(
+		    _mm512_or_si512(_mm512_loadu_si512(p + off),
+		    _mm512_loadu_si512(p + off + 64)),
+		    _mm512_or_si512(_mm512_loadu_si512(p + off + 128),
+		    _mm512_loadu_si512(p + off + 192)));
+
+		if (_mm512_test_epi64_mask(v, v) != 0)
+			break;
+	}
+
+	ZFS_ZERO_RUN_TAIL(p, off, size, zfs_zero_mask_avx512);
+}
+
+const zfs_zero_ops_t zfs_zero_avx512_ops = {
+	.zo_name = "avx512",
+	.zo_valid = zfs_zero_avx512_valid,
+	.zo_run = zfs_zero_run_avx512,
+	.zo_mask = zfs_zero_mask_avx512,
+};
+
+#endif	/* __x86_64__ && __GNUC__ */
@@ -0,0 +1,161 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Zstandard compression
+ *
+ * zstd-N compresses at zstd level N.  Like lz4, the compressed stream is
+ * preceded by its length as a big-endian 32-bit word, because the buffer
+ * handed back to zstd_decompress() may have been padded out to a sector
+ * boundary and zstd refuses trailing garbage after a frame.  The level
+ * lives only in the block pointer's compress value, which makes this
+ * layout incompatible with OpenZFS zstd blocks; the pool feature has a
+ * GUID of its own for that reason.
+ *
+ * Setting up a compression context costs far more than compressing a small
+ * record, so each thread lazily creates one compression and one
+ * decompression context and keeps them in thread-specific data until it
+ * exits.  A compression context adapts itself to whatever level it is asked
+ * for, so one per thread serves every zstd-N.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/zio_compress.h>
+
+#include <zstd.h>
+
+static uint_t zstd_cctx_key;
+static uint_t zstd_dctx_key;
+
+static void
+zstd_cctx_free(void *cctx)
+{
+	(void) ZSTD_freeCCtx(cctx);
+}
+
+static void
+zstd_dctx_free(void *dctx)
+{
+	(void) ZSTD_freeDCtx(dctx);
+}
+
+static ZSTD_CCtx *
+zstd_cctx(void)
+{
+	ZSTD_CCtx *cctx = tsd_get(zstd_cctx_key);
+
+	if (cctx == NULL) {
+		VERIFY((cctx = ZSTD_createCCtx()) != NULL);
+		VERIFY0(tsd_set(zstd_cctx_key, cctx));
+	}
+
+	return (cctx);
+}
+
+static ZSTD_DCtx *
+zstd_dctx(void)
+{
+	ZSTD_DCtx *dctx = tsd_get(zstd_dctx_key);
+
+	if (dctx == NULL) {
+		VERIFY((dctx = ZSTD_createDCtx()) != NULL);
+		VERIFY0(tsd_set(zstd_dctx_key, dctx));
+	}
+
+	return (dctx);
+}
+
+size_t
+zstd_compress(void *s_start, void *d_start, size_t s_len, size_t d_len, int n)
+{
+	uint32_t bufsiz;
+	char *dest = d_start;
+	size_t c_len;
+
+	ASSERT(d_len >= sizeof (bufsiz));
+
+	c_len = ZSTD_compressCCtx(zstd_cctx(), &dest[sizeof (bufsiz)],
+	    d_len - sizeof (bufsiz), s_start, s_len, n);
+
+	/*
+	 * An error, most likely dstSize_tooSmall, means the data did not
+	 * compress well enough to be worth storing compressed.
+	 */
+	if (ZSTD_isError(c_len))
+		return (s_len);
+
+	bufsiz = c_len;
+	*(uint32_t *)dest = BE_32(bufsiz);
+
+	return (bufsiz + sizeof (bufsiz));
+}
+
+/*ARGSUSED*/
+int
+zstd_decompress(void *s_start, void *d_start, size_t s_len, size_t d_len,
+    int n)
+{
+	const char *src = s_start;
+	uint32_t bufsiz = BE_IN32(src);
+	size_t len;
+
+	/* invalid compressed buffer size encoded at start */
+	if (bufsiz + sizeof (bufsiz) > s_len)
+		return (1);
+
+	len = ZSTD_decompressDCtx(zstd_dctx(), d_start, d_len,
+	    &src[sizeof (bufsiz)], bufsiz);
+
+	return (ZSTD_isError(len) || len != d_len);
+}
+
+/*
+ * The keys are created once and never deleted: deleting a key keeps its
+ * destructor from running when the threads holding contexts exit, which
+ * would leak them.  zstd_fini() only frees the calling thread's.
+ */
+void
+zstd_init(void)
+{
+	static boolean_t created = B_FALSE;
+
+	if (!created) {
+		tsd_create(&zstd_cctx_key, zstd_cctx_free);
+		tsd_create(&zstd_dctx_key, zstd_dctx_free);
+		created = B_TRUE;
+	}
+}
+
+void
+zstd_fini(void)
+{
+	ZSTD_CCtx *cctx = tsd_get(zstd_cctx_key);
+	ZSTD_DCtx *dctx = tsd_get(zstd_dctx_key);
+
+	if (cctx != NULL) {
+		VERIFY0(tsd_set(zstd_cctx_key, NULL));
+		zstd_cctx_free(cctx);
+	}
+	if (dctx != NULL) {
+		VERIFY0(tsd_set(zstd_dctx_key, NULL));
+		zstd_dctx_free(dctx);
+	}
+}
@@ -35,6 +35,7 @@
 #include <sys/zio_impl.h>
 #include <sys/zio_compress.h>
 #include <sys/zio_checksum.h>
+#include <sys/zfs_zero.h>
 #include <sys/dmu_objset.h>
 #include <sys/arc.h>
 #include <sys/ddt.h>
@@ -90,6 +91,13 @@ int zfs_sync_pass_deferred_free = 2; /* defer frees starting in this pass */
 int zfs_sync_pass_dont_compress = 5; /* don't compress starting in this pass */
 int zfs_sync_pass_rewrite = 2; /* rewrite new bps starting in this pass */
 
+/*
+ * Store all-zero level 0 data blocks as holes when compression is off, as
+ * compression already does, so that zeroed regions of sparse files such as
+ * VM images do not take up space.
+ */
+boolean_t zio_write_zero_holes = B_TRUE;
+
 /*
  * An allocating zio is one that either currently has the DVA allocate
  * stage set or will have it later in its lifetime.
@@ -104,6 +112,54 @@ int zio_buf_debug_limit = 16384;
 int zio_buf_debug_limit = 0;
 #endif
 
+/*
+ * Charge the thread CPU time of every pipeline stage to the pool's
+ * spa_zio_cpu table, exported as the kstat "zfs/<pool>:0:zio_cpu".  This
+ * reads the thread CPU clock around every stage, so it is off by default.
+ */
+int zio_stage_cpu_stats = 0;
+
+/*
+ * Let write zios that reach CHECKSUM_GENERATE while their issue taskq has
+ * more work queued wait there, so that checksum functions with a
+ * multi-buffer kernel can hash several blocks at once (see
+ * zio_checksum_generate_batch()).  A batch is computed as soon as a zio
+ * joins it more than zio_checksum_batch_wait_ns after its first zio was
+ * parked.
+ */
+int zio_checksum_batching = 1;
+int zio_checksum_batch_wait_ns = 100 * 1000; /* 100 microseconds */
+
+/*
+ * Checksum batches computed, and the zios in them, exported as the named
+ * kstat "zfs:0:zio_cksum_batch".
+ */
+typedef struct zio_cksum_batch_stats {
+	kstat_named_t	zcbs_batches;
+	kstat_named_t	zcbs_zios;
+} zio_cksum_batch_stats_t;
+
+static zio_cksum_batch_stats_t zio_cksum_batch_stats = {
+	{ "batches",	KSTAT_DATA_UINT64 },
+	{ "zios",	KSTAT_DATA_UINT64 },
+};
+
+static kstat_t *zio_cksum_batch_ksp;
+
+/*
+ * Holds the spa_zio_cpu slot (plus one) of the zio taskq that the current
+ * thread is working for, or NULL outside of zio taskq dispatches.
+ */
+static uint_t zio_taskq_tsd_key;
+
+/*
+ * Holds the thread CPU time that zio_execute() has charged to pipeline
+ * stages on the current thread.  A stage may run other zios inline, e.g.
+ * zio_nowait() of a child or zio_notify_parent() resuming the parent, and
+ * charges itself only the part of its time that those did not charge.
+ */
+static uint_t zio_cpu_tsd_key;
+
 static void zio_taskq_dispatch(zio_t *, zio_taskq_type_t, boolean_t);
 
 void
@@ -144,10 +200,16 @@ zio_init(void)
 		if (arc_watch && !IS_P2ALIGNED(size, PAGESIZE))
 			continue;
 #endif
-		if (size <= 4 * SPA_MINBLOCKSIZE) {
-			align = SPA_MINBLOCKSIZE;
-		} else if (IS_P2ALIGNED(size, p2 >> 2)) {
-			align = MIN(p2 >> 2, PAGESIZE);
+		/*
+		 * Leaf vdevs do direct I/O straight from these buffers, which
+		 * must then be aligned to the device's sector size.  Align each
+		 * buffer to the largest power of two dividing its size, up to
+		 * a page, so that it suits any device whose sector size
+		 * divides the I/O size.
+		 */
+		if (size <= 4 * SPA_MINBLOCKSIZE ||
+		    IS_P2ALIGNED(size, p2 >> 2)) {
+			align = MIN(size & -size, PAGESIZE);
 		}
 
 		if (align != 0) {
@@ -178,7 +240,19 @@ zio_init(void)
 			zio_data_buf_cache[c - 1] = zio_data_buf_cache[c];
 	}
 
+	tsd_create(&zio_taskq_tsd_key, NULL);
+	tsd_create(&zio_cpu_tsd_key, NULL);
+
+	zio_cksum_batch_ksp = kstat_create("zfs", 0, "zio_cksum_batch", "misc",
+	    KSTAT_TYPE_NAMED, sizeof (zio_cksum_batch_stats) /
+	    sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
+	if (zio_cksum_batch_ksp != NULL) {
+		zio_cksum_batch_ksp->ks_data = &zio_cksum_batch_stats;
+		kstat_install(zio_cksum_batch_ksp);
+	}
+
 	zio_inject_init();
+	zio_trace_init();
 }
 
 void
@@ -205,7 +279,16 @@ zio_fini(void)
 	kmem_cache_destroy(zio_link_cache);
 	kmem_cache_destroy(zio_cache);
 
+	zio_trace_fini();
 	zio_inject_fini();
+
+	if (zio_cksum_batch_ksp != NULL) {
+		kstat_delete(zio_cksum_batch_ksp);
+		zio_cksum_batch_ksp = NULL;
+	}
+
+	tsd_destroy(&zio_cpu_tsd_key);
+	tsd_destroy(&zio_taskq_tsd_key);
 }
 
 /*
@@ -546,6 +629,7 @@ zio_create(zio_t *pio, spa_t *spa, uint64_t txg, const blkptr_t *bp,
 	list_create(&zio->io_child_list, sizeof (zio_link_t),
 	    offsetof(zio_link_t, zl_child_node));
 	metaslab_trace_init(&zio->io_alloc_list);
+	zio_trace_create(zio);
 
 	if (vd != NULL)
 		zio->io_child_type = ZIO_CHILD_VDEV;
@@ -606,6 +690,7 @@ static void
 zio_destroy(zio_t *zio)
 {
 	metaslab_trace_fini(&zio->io_alloc_list);
+	zio_trace_destroy(zio);
 	list_destroy(&zio->io_parent_list);
 	list_destroy(&zio->io_child_list);
 	mutex_destroy(&zio->io_lock);
@@ -926,6 +1011,35 @@ zio_ioctl(zio_t *pio, spa_t *spa, vdev_t *vd, int cmd,
 	return (zio);
 }
 
+/*
+ * Tell the leaves of vd that a free range of it no longer holds data
+ * (DKIOCFREE).  Every child of an interior vdev must store the range at
+ * the same offset, so this is only valid for leaves and mirrors.
+ */
+zio_t *
+zio_trim(zio_t *pio, spa_t *spa, vdev_t *vd, uint64_t offset, uint64_t size,
+    zio_done_func_t *done, void *private, enum zio_flag flags)
+{
+	zio_t *zio;
+
+	if (vd->vdev_children == 0) {
+		zio = zio_create(pio, spa, 0, NULL, NULL, size, size, done,
+		    private, ZIO_TYPE_IOCTL, ZIO_PRIORITY_NOW, flags, vd,
+		    offset + VDEV_LABEL_START_SIZE, NULL, ZIO_STAGE_OPEN,
+		    ZIO_IOCTL_PIPELINE);
+
+		zio->io_cmd = DKIOCFREE;
+	} else {
+		zio = zio_null(pio, spa, NULL, NULL, NULL, flags);
+
+		for (int c = 0; c < vd->vdev_children; c++)
+			zio_nowait(zio_trim(zio, spa, vd->vdev_child[c],
+			    offset, size, done, private, flags));
+	}
+
+	return (zio);
+}
+
 zio_t *
 zio_read_phys(zio_t *pio, vdev_t *vd, uint64_t offset, uint64_t size,
     void *data, int checksum, zio_done_func_t *done, void *private,
@@ -1258,7 +1372,14 @@ zio_write_compress(zio_t *zio)
 	/* If it's a compressed write that is not raw, compress the buffer. */
 	if (compress != ZIO_COMPRESS_OFF && psize == lsize) {
 		void *cbuf = zio_buf_alloc(lsize);
-		psize = zio_compress_data(compress, zio->io_data, cbuf, lsize);
+		zio_compress_abort_t zca;
+
+		psize = zio_compress_data_impl(compress, zio->io_data, cbuf,
+		    lsize, &zca);
+		zio->io_compress_aborted = zca.zca_aborted;
+		zio->io_compress_saved = zca.zca_saved;
+		/* From here on, compress is what the block pointer records. */
+		compress = zio_compress_ondisk(compress);
 		if (psize == 0 || psize == lsize) {
 			compress = ZIO_COMPRESS_OFF;
 			zio_buf_free(cbuf, lsize);
@@ -1307,6 +1428,12 @@ zio_write_compress(zio_t *zio)
 		zio->io_bp_override = NULL;
 		*bp = zio->io_bp_orig;
 		zio->io_pipeline = zio->io_orig_pipeline;
+	} else if (zio_write_zero_holes &&
+	    zp->zp_compress == ZIO_COMPRESS_OFF && psize == lsize &&
+	    pass < zfs_sync_pass_dont_compress &&
+	    zp->zp_level == 0 && !DMU_OT_IS_METADATA(zp->zp_type) &&
+	    zfs_is_zero(zio->io_data, lsize)) {
+		psize = 0;
 	} else {
 		ASSERT3U(psize, !=, 0);
 	}
@@ -1383,6 +1510,21 @@ zio_free_bp_init(zio_t *zio)
  * ==========================================================================
  */
 
+/*
+ * Taskq entry point for zio_execute().  Publishes the taskq the zio was
+ * dispatched to so that the stages it runs, including those of any parent
+ * zio it executes inline, are charged to that taskq.
+ */
+static void
+zio_taskq_execute(zio_t *zio)
+{
+	void *prev = tsd_get(zio_taskq_tsd_key);
+
+	(void) tsd_set(zio_taskq_tsd_key, (void *)(uintptr_t)zio->io_tqstat);
+	zio_execute(zio);
+	(void) tsd_set(zio_taskq_tsd_key, prev);
+}
+
 static void
 zio_taskq_dispatch(zio_t *zio, zio_taskq_type_t q, boolean_t cutinline)
 {
@@ -1420,7 +1562,9 @@ zio_taskq_dispatch(zio_t *zio, zio_taskq_type_t q, boolean_t cutinline)
 	 * to dispatch the zio to another taskq at the same time.
 	 */
 	ASSERT(zio->io_tqent.tqent_next == NULL);
-	spa_taskq_dispatch_ent(spa, t, q, (task_func_t *)zio_execute, zio,
+	ZIO_TRACE_STAMP(zio, zt_dispatch);
+	zio->io_tqstat = t * ZIO_TASKQ_TYPES + q + 1;
+	spa_taskq_dispatch_ent(spa, t, q, (task_func_t *)zio_taskq_execute, zio,
 	    flags, &zio->io_tqent);
 }
 
@@ -1453,6 +1597,7 @@ zio_issue_async(zio_t *zio)
 void
 zio_interrupt(zio_t *zio)
 {
+	ZIO_TRACE_STAMP(zio, zt_interrupt);
 	zio_taskq_dispatch(zio, ZIO_TASKQ_INTERRUPT, B_FALSE);
 }
 
@@ -1526,13 +1671,57 @@ zio_delay_interrupt(zio_t *zio)
  */
 static zio_pipe_stage_t *zio_pipeline[];
 
+/*
+ * Charge the stage that started at vtime, when the thread's charged total
+ * was *charged, and move both on to the start of the next stage.
+ */
+static void
+zio_stage_cpu_charge(spa_zio_cpu_t *sc, hrtime_t *vtime, hrtime_t *charged)
+{
+	hrtime_t now = gethrvtime();
+	hrtime_t nested = (hrtime_t)(uintptr_t)tsd_get(zio_cpu_tsd_key) -
+	    *charged;
+
+	atomic_add_64(&sc->szc_time, now - *vtime - nested);
+	atomic_inc_64(&sc->szc_count);
+
+	*charged += now - *vtime;
+	*vtime = now;
+	(void) tsd_set(zio_cpu_tsd_key, (void *)(uintptr_t)*charged);
+}
+
 void
 zio_execute(zio_t *zio)
 {
+	zio_trace_t *zt = zio->io_trace;
+	spa_zio_cpu_t *szc = NULL;
+	hrtime_t vtime = 0;
+	hrtime_t charged = 0;
+
 	zio->io_executor = curthread;
 
+	if (zio_stage_cpu_stats) {
+		uintptr_t tq = (uintptr_t)tsd_get(zio_taskq_tsd_key);
+
+		if (tq != 0) {
+			szc = zio->io_spa->spa_zio_cpu[(tq - 1) /
+			    ZIO_TASKQ_TYPES][(tq - 1) % ZIO_TASKQ_TYPES];
+		} else {
+			szc = zio->io_spa->spa_zio_cpu[zio->io_type]
+			    [ZIO_TASKQ_NONE];
+		}
+		vtime = gethrvtime();
+		charged = (hrtime_t)(uintptr_t)tsd_get(zio_cpu_tsd_key);
+	}
+
 	ASSERT3U(zio->io_queued_timestamp, >, 0);
 
+	if (zt != NULL && zt->zt_dispatch != 0) {
+		zt->zt_taskq_wait += gethrtime() - zt->zt_dispatch;
+		zt->zt_taskq_hops++;
+		zt->zt_dispatch = 0;
+	}
+
 	while (zio->io_stage < ZIO_STAGE_DONE) {
 		enum zio_stage pipeline = zio->io_pipeline;
 		enum zio_stage stage = zio->io_stage;
@@ -1567,8 +1756,19 @@ zio_execute(zio_t *zio)
 
 		zio->io_stage = stage;
 		zio->io_pipeline_trace |= zio->io_stage;
+		if (zt != NULL)
+			zt->zt_stage[highbit64(stage) - 1] = gethrtime();
 		rv = zio_pipeline[highbit64(stage) - 1](zio);
 
+		/*
+		 * The zio may have been freed by the stage, so only the
+		 * stage and the spa_zio_cpu slot captured above are used.
+		 */
+		if (szc != NULL) {
+			zio_stage_cpu_charge(&szc[highbit64(stage) - 1],
+			    &vtime, &charged);
+		}
+
 		if (rv == ZIO_PIPELINE_STOP)
 			return;
 
@@ -3171,6 +3371,14 @@ zio_vdev_io_assess(zio_t *zio)
 	    zio->io_cmd == DKIOCFLUSHWRITECACHE && vd != NULL)
 		vd->vdev_nowritecache = B_TRUE;
 
+	/*
+	 * Likewise, stop trimming a device that cannot discard.
+	 */
+	if ((zio->io_error == ENOTSUP || zio->io_error == ENOTTY) &&
+	    zio->io_type == ZIO_TYPE_IOCTL &&
+	    zio->io_cmd == DKIOCFREE && vd != NULL)
+		vd->vdev_notrim = B_TRUE;
+
 	if (zio->io_error)
 		zio->io_pipeline = ZIO_INTERLOCK_PIPELINE;
 
@@ -3216,6 +3424,132 @@ zio_vdev_io_bypass(zio_t *zio)
  * Generate and verify checksums
  * ==========================================================================
  */
+
+/*
+ * Compute the checksums of a batch of parked zios and send them back to the
+ * issue taskq to carry on from CHECKSUM_GENERATE.
+ */
+static void
+zio_checksum_batch_done(zio_t **zios, int count, enum zio_checksum checksum)
+{
+	zio_checksum_compute_batch(zios, count, checksum);
+
+	atomic_inc_64(&zio_cksum_batch_stats.zcbs_batches.value.ui64);
+	atomic_add_64(&zio_cksum_batch_stats.zcbs_zios.value.ui64, count);
+
+	for (int i = 0; i < count; i++)
+		zio_taskq_dispatch(zios[i], ZIO_TASKQ_ISSUE, B_TRUE);
+}
+
+/*
+ * Runs on the issue taskq behind the work that was queued when the first
+ * zio of a batch was parked, and computes whatever has been parked since.
+ */
+static void
+zio_checksum_batch_flush(void *arg)
+{
+	spa_cksum_batch_t *scb = arg;
+	zio_t *zios[SPA_CKSUM_BATCH_MAX];
+	spa_t *spa;
+	int count;
+
+	mutex_enter(&scb->scb_lock);
+	count = scb->scb_count;
+	bcopy(scb->scb_zio, zios, count * sizeof (zio_t *));
+	scb->scb_count = 0;
+	scb->scb_flush = B_FALSE;
+	mutex_exit(&scb->scb_lock);
+
+	if (count == 0)
+		return;
+
+	spa = zios[0]->io_spa;
+	if (zio_stage_cpu_stats) {
+		int s = highbit64(ZIO_STAGE_CHECKSUM_GENERATE) - 1;
+		spa_zio_cpu_t *sc =
+		    &spa->spa_zio_cpu[ZIO_TYPE_WRITE][ZIO_TASKQ_ISSUE][s];
+		hrtime_t vtime = gethrvtime();
+
+		zio_checksum_batch_done(zios, count,
+		    BP_GET_CHECKSUM(zios[0]->io_bp));
+		atomic_add_64(&sc->szc_time, gethrvtime() - vtime);
+	} else {
+		zio_checksum_batch_done(zios, count,
+		    BP_GET_CHECKSUM(zios[0]->io_bp));
+	}
+}
+
+/*
+ * Park a write zio on its pool's checksum batch instead of computing its
+ * checksum right away.  This is only done on an issue taskq that has more
+ * work queued, so an idle pool never waits for a batch to form.  The first
+ * zio parked queues a flush task behind that work; the zios the work brings
+ * to CHECKSUM_GENERATE meanwhile join the batch, and whichever fills it, or
+ * joins it after zio_checksum_batch_wait_ns, computes the whole batch.  The
+ * latter keeps a deep backlog from holding the first zio until the flush
+ * task comes up.  Returns B_FALSE if the caller should compute the checksum
+ * itself.
+ */
+static boolean_t
+zio_checksum_generate_batch(zio_t *zio, enum zio_checksum checksum)
+{
+	spa_t *spa = zio->io_spa;
+	spa_cksum_batch_t *scb = &spa->spa_cksum_batch[checksum];
+	spa_taskqs_t *tqs;
+	int width = zio_checksum_batch_width(checksum);
+	zio_t *zios[SPA_CKSUM_BATCH_MAX];
+	taskq_t *tq = NULL;
+	boolean_t flush = B_FALSE;
+	hrtime_t now;
+	int count = 0;
+
+	if (!zio_checksum_batching || width < 2)
+		return (B_FALSE);
+
+	tqs = &spa->spa_zio_taskq[ZIO_TYPE_WRITE][ZIO_TASKQ_ISSUE];
+	for (uint_t i = 0; i < tqs->stqs_count; i++) {
+		if (taskq_member(tqs->stqs_taskq[i], curthread)) {
+			tq = tqs->stqs_taskq[i];
+			break;
+		}
+	}
+
+	if (tq == NULL)
+		return (B_FALSE);
+
+	mutex_enter(&scb->scb_lock);
+	if (scb->scb_count == 0 && taskq_empty(tq)) {
+		mutex_exit(&scb->scb_lock);
+		return (B_FALSE);
+	}
+
+	now = gethrtime();
+	if (scb->scb_count == 0)
+		scb->scb_start = now;
+
+	scb->scb_zio[scb->scb_count++] = zio;
+	if (scb->scb_count >= width ||
+	    now - scb->scb_start >= zio_checksum_batch_wait_ns) {
+		count = scb->scb_count;
+		bcopy(scb->scb_zio, zios, count * sizeof (zio_t *));
+		scb->scb_count = 0;
+	} else if (!scb->scb_flush) {
+		scb->scb_flush = B_TRUE;
+		flush = B_TRUE;
+	}
+	mutex_exit(&scb->scb_lock);
+
+	if (flush) {
+		taskq_dispatch_ent(tq, zio_checksum_batch_flush, scb, 0,
+		    &scb->scb_tqent);
+	}
+
+	if (count != 0)
+		zio_checksum_batch_done(zios, count, checksum);
+
+	return (B_TRUE);
+}
+
 static int
 zio_checksum_generate(zio_t *zio)
 {
@@ -3240,6 +3574,11 @@ zio_checksum_generate(zio_t *zio)
 		} else {
 			checksum = BP_GET_CHECKSUM(bp);
 		}
+
+		if (!(zio_checksum_table[checksum].ci_flags &
+		    ZCHECKSUM_FLAG_EMBEDDED) &&
+		    zio_checksum_generate_batch(zio, checksum))
+			return (ZIO_PIPELINE_STOP);
 	}
 
 	zio_checksum_compute(zio, checksum, zio->io_data, zio->io_size);
@@ -3724,6 +4063,8 @@ zio_done(zio_t *zio)
 		zfs_ereport_free_checksum(zcr);
 	}
 
+	zio_trace_done(zio);
+
 	/*
 	 * It is the responsibility of the done callback to ensure that this
 	 * particular zio is no longer discoverable for adoption, and as
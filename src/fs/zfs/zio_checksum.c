@@ -32,6 +32,12 @@
 #include <sys/zio_checksum.h>
 #include <sys/zil.h>
 #include <zfs_fletcher.h>
+#if defined(__zfsd__)
+#include <sys/zfs_sha2.h>
+#include <sys/zfs_skein.h>
+#include <sys/zfs_edonr.h>
+#include <sys/zfs_blake3.h>
+#endif
 
 /*
  * Checksum vectors.
@@ -118,7 +124,8 @@ zio_checksum_info_t zio_checksum_table[ZIO_CHECKSUM_FUNCTIONS] = {
 	    NULL, NULL, ZCHECKSUM_FLAG_METADATA, "fletcher4"},
 	{{zio_checksum_SHA256,		zio_checksum_SHA256},
 	    NULL, NULL, ZCHECKSUM_FLAG_METADATA | ZCHECKSUM_FLAG_DEDUP |
-	    ZCHECKSUM_FLAG_NOPWRITE, "sha256"},
+	    ZCHECKSUM_FLAG_NOPWRITE, "sha256", zio_checksum_SHA256_batch,
+	    zio_checksum_SHA256_batch_width},
 	{{fletcher_4_native,		fletcher_4_byteswap},
 	    NULL, NULL, ZCHECKSUM_FLAG_EMBEDDED, "zilog2"},
 	{{zio_checksum_off,		zio_checksum_off},
@@ -129,11 +136,17 @@ zio_checksum_info_t zio_checksum_table[ZIO_CHECKSUM_FUNCTIONS] = {
 	{{zio_checksum_skein_native,	zio_checksum_skein_byteswap},
 	    zio_checksum_skein_tmpl_init, zio_checksum_skein_tmpl_free,
 	    ZCHECKSUM_FLAG_METADATA | ZCHECKSUM_FLAG_DEDUP |
-	    ZCHECKSUM_FLAG_SALTED | ZCHECKSUM_FLAG_NOPWRITE, "skein"},
+	    ZCHECKSUM_FLAG_SALTED | ZCHECKSUM_FLAG_NOPWRITE, "skein",
+	    zio_checksum_skein_batch, zio_checksum_skein_batch_width},
 	{{zio_checksum_edonr_native,	zio_checksum_edonr_byteswap},
 	    zio_checksum_edonr_tmpl_init, zio_checksum_edonr_tmpl_free,
 	    ZCHECKSUM_FLAG_METADATA | ZCHECKSUM_FLAG_SALTED |
-	    ZCHECKSUM_FLAG_NOPWRITE, "edonr"},
+	    ZCHECKSUM_FLAG_NOPWRITE, "edonr", zio_checksum_edonr_batch,
+	    zio_checksum_edonr_batch_width},
+	{{zio_checksum_blake3_native,	zio_checksum_blake3_byteswap},
+	    zio_checksum_blake3_tmpl_init, zio_checksum_blake3_tmpl_free,
+	    ZCHECKSUM_FLAG_METADATA | ZCHECKSUM_FLAG_DEDUP |
+	    ZCHECKSUM_FLAG_SALTED | ZCHECKSUM_FLAG_NOPWRITE, "blake3"},
 };
 
 /*
@@ -152,6 +165,8 @@ zio_checksum_to_feature(enum zio_checksum cksum)
 		return (SPA_FEATURE_SKEIN);
 	case ZIO_CHECKSUM_EDONR:
 		return (SPA_FEATURE_EDONR);
+	case ZIO_CHECKSUM_BLAKE3:
+		return (SPA_FEATURE_BLAKE3);
 	}
 	return (SPA_FEATURE_NONE);
 }
@@ -292,6 +307,83 @@ zio_checksum_compute(zio_t *zio, enum zio_checksum checksum,
 	}
 }
 
+/*
+ * Compute the native checksums of several buffers at once, using the
+ * algorithm's batch entry point when it has one.  The spa may be NULL for
+ * unsalted checksums.
+ */
+void
+zio_checksum_batch(spa_t *spa, enum zio_checksum checksum, const void **data,
+    const uint64_t *size, int count, zio_cksum_t *zcp)
+{
+	zio_checksum_info_t *ci = &zio_checksum_table[checksum];
+	void *tmpl = NULL;
+
+	ASSERT((uint_t)checksum < ZIO_CHECKSUM_FUNCTIONS);
+	ASSERT(ci->ci_func[0] != NULL);
+	ASSERT(spa != NULL || !(ci->ci_flags & ZCHECKSUM_FLAG_SALTED));
+
+	if (spa != NULL) {
+		zio_checksum_template_init(checksum, spa);
+		tmpl = spa->spa_cksum_tmpls[checksum];
+	}
+
+	if (ci->ci_batch != NULL) {
+		ci->ci_batch(data, size, count, tmpl, zcp);
+		return;
+	}
+
+	for (int i = 0; i < count; i++)
+		ci->ci_func[0](data[i], size[i], tmpl, &zcp[i]);
+}
+
+/*
+ * Returns how many buffers the checksum function can usefully hash at once,
+ * or zero if batches are no faster than hashing one buffer at a time.
+ */
+int
+zio_checksum_batch_width(enum zio_checksum checksum)
+{
+	zio_checksum_info_t *ci = &zio_checksum_table[checksum];
+
+	ASSERT((uint_t)checksum < ZIO_CHECKSUM_FUNCTIONS);
+
+	if (ci->ci_batch == NULL || ci->ci_batch_width == NULL)
+		return (0);
+
+	return (MIN(ci->ci_batch_width(), SPA_CKSUM_BATCH_MAX));
+}
+
+/*
+ * Generate the checksums of several write zios of one pool, which all use
+ * the same non-embedded checksum function.
+ */
+void
+zio_checksum_compute_batch(zio_t **zios, int count,
+    enum zio_checksum checksum)
+{
+	const void *data[SPA_CKSUM_BATCH_MAX];
+	uint64_t size[SPA_CKSUM_BATCH_MAX] = { 0 };
+	zio_cksum_t cksum[SPA_CKSUM_BATCH_MAX];
+
+	ASSERT3S(count, <=, SPA_CKSUM_BATCH_MAX);
+	ASSERT(!(zio_checksum_table[checksum].ci_flags &
+	    ZCHECKSUM_FLAG_EMBEDDED));
+
+	for (int i = 0; i < count; i++) {
+		ASSERT3P(zios[i]->io_spa, ==, zios[0]->io_spa);
+		ASSERT3U(BP_GET_CHECKSUM(zios[i]->io_bp), ==, checksum);
+		data[i] = zios[i]->io_data;
+		size[i] = zios[i]->io_size;
+	}
+
+	zio_checksum_batch(zios[0]->io_spa, checksum, data, size, count,
+	    cksum);
+
+	for (int i = 0; i < count; i++)
+		zios[i]->io_bp->blk_cksum = cksum[i];
+}
+
 int
 zio_checksum_error_impl(spa_t *spa, blkptr_t *bp, enum zio_checksum checksum,
     void *data, uint64_t size, uint64_t offset, zio_bad_cksum_t *info)
@@ -417,3 +509,30 @@ zio_checksum_templates_free(spa_t *spa)
 		}
 	}
 }
+
+/*
+ * Select the checksum implementations for this CPU.
+ */
+void
+zio_checksum_init(void)
+{
+	fletcher_init();
+#if defined(__zfsd__)
+	sha2_init();
+	skein_init();
+	edonr_init();
+	blake3_init();
+#endif
+}
+
+void
+zio_checksum_fini(void)
+{
+#if defined(__zfsd__)
+	blake3_fini();
+	edonr_fini();
+	skein_fini();
+	sha2_fini();
+#endif
+	fletcher_fini();
+}
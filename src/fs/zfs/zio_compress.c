@@ -37,6 +37,31 @@
 #include <sys/zfeature.h>
 #include <sys/zio.h>
 #include <sys/zio_compress.h>
+#include <sys/zfs_zero.h>
+#include <sys/zmod.h>
+
+/*
+ * Early abort.  The expensive compressors (gzip, and zstd above level 4)
+ * can spend a long time on a block only to find that it did not shrink by
+ * the required 12.5%.  Before running one of them, zio_compress_data()
+ * tries lz4, and if that fails zstd-1, on the same block; both are cheap
+ * and give up quickly on incompressible data.  Only when both fail to
+ * reach the threshold is the block declared incompressible without
+ * running the real compressor.
+ *
+ * To report the time saved, the cost of every real compression is
+ * accumulated per algorithm, and an abort is credited with what its bytes
+ * would have cost at the average rate, less the time spent probing.
+ */
+int zio_compress_early_abort = 1;
+
+/*
+ * Blocks smaller than this are compressed without probing.
+ */
+uint64_t zio_compress_early_abort_size = 16 * 1024;
+
+static uint64_t zio_compress_cost_ns[ZIO_COMPRESS_FUNCTIONS];
+static uint64_t zio_compress_cost_bytes[ZIO_COMPRESS_FUNCTIONS];
 
 /*
  * Compression vectors.
@@ -59,8 +84,54 @@ zio_compress_info_t zio_compress_table[ZIO_COMPRESS_FUNCTIONS] = {
 	{gzip_compress,		gzip_decompress,	9,	"gzip-9"},
 	{zle_compress,		zle_decompress,		64,	"zle"},
 	{lz4_compress,		lz4_decompress,		0,	"lz4"},
+	{zstd_compress,		zstd_decompress,	1,	"zstd-1"},
+	{zstd_compress,		zstd_decompress,	2,	"zstd-2"},
+	{zstd_compress,		zstd_decompress,	3,	"zstd-3"},
+	{zstd_compress,		zstd_decompress,	4,	"zstd-4"},
+	{zstd_compress,		zstd_decompress,	5,	"zstd-5"},
+	{zstd_compress,		zstd_decompress,	6,	"zstd-6"},
+	{zstd_compress,		zstd_decompress,	7,	"zstd-7"},
+	{zstd_compress,		zstd_decompress,	8,	"zstd-8"},
+	{zstd_compress,		zstd_decompress,	9,	"zstd-9"},
+	{zstd_compress,		zstd_decompress,	10,	"zstd-10"},
+	{zstd_compress,		zstd_decompress,	11,	"zstd-11"},
+	{zstd_compress,		zstd_decompress,	12,	"zstd-12"},
+	{zstd_compress,		zstd_decompress,	13,	"zstd-13"},
+	{zstd_compress,		zstd_decompress,	14,	"zstd-14"},
+	{zstd_compress,		zstd_decompress,	15,	"zstd-15"},
+	{zstd_compress,		zstd_decompress,	16,	"zstd-16"},
+	{zstd_compress,		zstd_decompress,	17,	"zstd-17"},
+	{zstd_compress,		zstd_decompress,	18,	"zstd-18"},
+	{zstd_compress,		zstd_decompress,	19,	"zstd-19"},
+	{lz4_compress,		lz4_decompress,		2,	"lz4-fast-2"},
+	{lz4_compress,		lz4_decompress,		4,	"lz4-fast-4"},
+	{lz4_compress,		lz4_decompress,		8,	"lz4-fast-8"},
+	{lz4_compress,		lz4_decompress,		16,	"lz4-fast-16"},
+	{lz4_compress,		lz4_decompress,		32,	"lz4-fast-32"},
+	{lz4_compress,		lz4_decompress,		64,	"lz4-fast-64"},
 };
 
+spa_feature_t
+zio_compress_to_feature(enum zio_compress c)
+{
+	if (c >= ZIO_COMPRESS_ZSTD_1 && c <= ZIO_COMPRESS_ZSTD_19)
+		return (SPA_FEATURE_ZSTD_COMPRESS);
+	return (SPA_FEATURE_NONE);
+}
+
+/*
+ * The compression function recorded in the block pointer of a block
+ * compressed with c.  The lz4-fast levels only change how hard the
+ * compressor searches for matches; their output is ordinary lz4.
+ */
+enum zio_compress
+zio_compress_ondisk(enum zio_compress c)
+{
+	if (c >= ZIO_COMPRESS_LZ4_FAST_2 && c <= ZIO_COMPRESS_LZ4_FAST_64)
+		return (ZIO_COMPRESS_LZ4);
+	return (c);
+}
+
 enum zio_compress
 zio_compress_select(spa_t *spa, enum zio_compress child,
     enum zio_compress parent)
@@ -85,13 +156,78 @@ zio_compress_select(spa_t *spa, enum zio_compress child,
 	return (result);
 }
 
+static boolean_t
+zio_compress_early_abort_eligible(enum zio_compress c, size_t s_len)
+{
+	if (!zio_compress_early_abort || s_len < zio_compress_early_abort_size)
+		return (B_FALSE);
+
+	return ((c >= ZIO_COMPRESS_GZIP_1 && c <= ZIO_COMPRESS_GZIP_9) ||
+	    (c >= ZIO_COMPRESS_ZSTD_5 && c <= ZIO_COMPRESS_ZSTD_19));
+}
+
+/*
+ * Returns B_TRUE if a cheap compressor could shrink the block to d_len,
+ * suggesting that the real one is worth running.  dst is scratch space.
+ */
+static boolean_t
+zio_compress_probe(void *src, void *dst, size_t s_len, size_t d_len)
+{
+	if (lz4_compress(src, dst, s_len, d_len, 0) <= d_len)
+		return (B_TRUE);
+
+	return (zstd_compress(src, dst, s_len, d_len, 1) <= d_len);
+}
+
+/*
+ * Estimated time for compressor c to compress s_len bytes, from the
+ * average rate so far, in nanoseconds per kilobyte.
+ */
+static hrtime_t
+zio_compress_cost(enum zio_compress c, size_t s_len)
+{
+	uint64_t kb = zio_compress_cost_bytes[c] >> 10;
+
+	if (kb == 0)
+		return (0);
+
+	return (zio_compress_cost_ns[c] / kb * (s_len >> 10));
+}
+
+static size_t
+zio_compress_finish(zio_compress_info_t *ci, void *src, void *dst,
+    size_t s_len, size_t d_len)
+{
+	size_t c_len = ci->ci_compress(src, dst, s_len, d_len, ci->ci_level);
+
+	if (c_len > d_len)
+		return (s_len);
+
+	ASSERT3U(c_len, <=, d_len);
+	return (c_len);
+}
+
 size_t
 zio_compress_data(enum zio_compress c, void *src, void *dst, size_t s_len)
 {
-	uint64_t *word, *word_end;
+	return (zio_compress_data_impl(c, src, dst, s_len, NULL));
+}
+
+/*
+ * As zio_compress_data(), also reporting through zca, if it is not NULL,
+ * whether the compressor was skipped by the early abort probe.
+ */
+size_t
+zio_compress_data_impl(enum zio_compress c, void *src, void *dst,
+    size_t s_len, zio_compress_abort_t *zca)
+{
 	size_t c_len, d_len;
+	hrtime_t start, probe;
 	zio_compress_info_t *ci = &zio_compress_table[c];
 
+	if (zca != NULL)
+		bzero(zca, sizeof (*zca));
+
 	ASSERT((uint_t)c < ZIO_COMPRESS_FUNCTIONS);
 	ASSERT((uint_t)c == ZIO_COMPRESS_EMPTY || ci->ci_compress != NULL);
 
@@ -99,12 +235,7 @@ zio_compress_data(enum zio_compress c, void *src, void *dst, size_t s_len)
 	 * If the data is all zeroes, we don't even need to allocate
 	 * a block for it.  We indicate this by returning zero size.
 	 */
-	word_end = (uint64_t *)((char *)src + s_len);
-	for (word = src; word < word_end; word++)
-		if (*word != 0)
-			break;
-
-	if (word == word_end)
+	if (zfs_is_zero(src, s_len))
 		return (0);
 
 	if (c == ZIO_COMPRESS_EMPTY)
@@ -112,12 +243,27 @@ zio_compress_data(enum zio_compress c, void *src, void *dst, size_t s_len)
 
 	/* Compress at least 12.5% */
 	d_len = s_len - (s_len >> 3);
-	c_len = ci->ci_compress(src, dst, s_len, d_len, ci->ci_level);
 
-	if (c_len > d_len)
+	if (!zio_compress_early_abort_eligible(c, s_len))
+		return (zio_compress_finish(ci, src, dst, s_len, d_len));
+
+	start = gethrtime();
+	if (!zio_compress_probe(src, dst, s_len, d_len)) {
+		probe = gethrtime() - start;
+		if (zca != NULL) {
+			hrtime_t cost = zio_compress_cost(c, s_len);
+
+			zca->zca_aborted = B_TRUE;
+			zca->zca_saved = cost > probe ? cost - probe : 0;
+		}
 		return (s_len);
+	}
+
+	start = gethrtime();
+	c_len = zio_compress_finish(ci, src, dst, s_len, d_len);
+	atomic_add_64(&zio_compress_cost_ns[c], gethrtime() - start);
+	atomic_add_64(&zio_compress_cost_bytes[c], s_len);
 
-	ASSERT3U(c_len, <=, d_len);
 	return (c_len);
 }
 
@@ -132,3 +278,21 @@ zio_decompress_data(enum zio_compress c, void *src, void *dst,
 
 	return (ci->ci_decompress(src, dst, s_len, d_len, ci->ci_level));
 }
+
+void
+zio_compress_init(void)
+{
+	zfs_zero_init();
+	zmod_init();
+	lz4_init();
+	zstd_init();
+}
+
+void
+zio_compress_fini(void)
+{
+	zstd_fini();
+	lz4_fini();
+	zmod_fini();
+	zfs_zero_fini();
+}
@@ -0,0 +1,183 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * ZFS slow I/O flight recorder
+ *
+ * Setting zio_slow_io_ms to a non-zero value makes every subsequently
+ * created zio carry a zio_trace_t.  zio_execute() stamps the entry into
+ * each pipeline stage and the time each taskq dispatch spent waiting for a
+ * thread, the vdev queue stamps when the zio was handed to the device, and
+ * zio_interrupt() stamps the device completion.
+ *
+ * When a traced zio completes more than zio_slow_io_ms after it was queued,
+ * zio_done() copies the trace, together with the block pointer, vdev and
+ * priority, into a global ring of zio_slow_io_history records.  The ring is
+ * exported as the raw kstat "zfs:0:slow_ios"; records are ordered by their
+ * zsi_seq field.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/vdev_impl.h>
+#include <sys/zio_impl.h>
+
+/*
+ * Latency threshold, in milliseconds, above which a zio is recorded.
+ * Zero disables tracing entirely.
+ */
+int zio_slow_io_ms = 0;
+
+/*
+ * Number of slow I/O records to keep.  Sampled by zio_init().
+ */
+int zio_slow_io_history = 256;
+
+static kmem_cache_t *zio_trace_cache;
+
+static kmutex_t zio_slow_io_lock;
+static zio_slow_io_t *zio_slow_ios;
+static uint_t zio_slow_io_size;
+static uint64_t zio_slow_io_seq;
+static kstat_t *zio_slow_io_ksp;
+
+void
+zio_trace_init(void)
+{
+	zio_trace_cache = kmem_cache_create("zio_trace_cache",
+	    sizeof (zio_trace_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
+
+	mutex_init(&zio_slow_io_lock, NULL, MUTEX_DEFAULT, NULL);
+
+	if (zio_slow_io_history <= 0)
+		return;
+
+	zio_slow_io_size = zio_slow_io_history;
+	zio_slow_ios = kmem_zalloc(zio_slow_io_size * sizeof (zio_slow_io_t),
+	    KM_SLEEP);
+
+	zio_slow_io_ksp = kstat_create("zfs", 0, "slow_ios", "misc",
+	    KSTAT_TYPE_RAW, zio_slow_io_size * sizeof (zio_slow_io_t),
+	    KSTAT_FLAG_VIRTUAL);
+	if (zio_slow_io_ksp != NULL) {
+		zio_slow_io_ksp->ks_data = zio_slow_ios;
+		zio_slow_io_ksp->ks_lock = &zio_slow_io_lock;
+		kstat_install(zio_slow_io_ksp);
+	}
+}
+
+void
+zio_trace_fini(void)
+{
+	kstat_delete(zio_slow_io_ksp);
+	zio_slow_io_ksp = NULL;
+
+	if (zio_slow_ios != NULL) {
+		kmem_free(zio_slow_ios,
+		    zio_slow_io_size * sizeof (zio_slow_io_t));
+		zio_slow_ios = NULL;
+		zio_slow_io_size = 0;
+	}
+
+	mutex_destroy(&zio_slow_io_lock);
+	kmem_cache_destroy(zio_trace_cache);
+}
+
+void
+zio_trace_create(zio_t *zio)
+{
+	if (zio_slow_io_ms == 0 || zio_slow_ios == NULL)
+		return;
+
+	zio->io_trace = kmem_cache_alloc(zio_trace_cache, KM_SLEEP);
+	bzero(zio->io_trace, sizeof (zio_trace_t));
+}
+
+void
+zio_trace_destroy(zio_t *zio)
+{
+	if (zio->io_trace != NULL) {
+		kmem_cache_free(zio_trace_cache, zio->io_trace);
+		zio->io_trace = NULL;
+	}
+}
+
+static hrtime_t
+zio_trace_delta(hrtime_t from, hrtime_t to)
+{
+	return ((from == 0 || to < from) ? 0 : to - from);
+}
+
+/*
+ * Called from zio_done() before the done callback runs, so that io_bp is
+ * still valid.
+ */
+void
+zio_trace_done(zio_t *zio)
+{
+	zio_trace_t *zt = zio->io_trace;
+	hrtime_t queued = zio->io_queued_timestamp;
+	hrtime_t latency;
+	zio_slow_io_t *zsi;
+
+	if (zt == NULL || queued == 0 || zio_slow_io_ms == 0)
+		return;
+
+	latency = gethrtime() - queued;
+	if (latency < MSEC2NSEC((hrtime_t)zio_slow_io_ms))
+		return;
+
+	mutex_enter(&zio_slow_io_lock);
+
+	zsi = &zio_slow_ios[zio_slow_io_seq % zio_slow_io_size];
+	bzero(zsi, sizeof (*zsi));
+
+	zsi->zsi_seq = zio_slow_io_seq++;
+	zsi->zsi_spa_guid = spa_guid(zio->io_spa);
+	zsi->zsi_vdev_guid = zio->io_vd ? zio->io_vd->vdev_guid : 0;
+	zsi->zsi_txg = zio->io_txg;
+	zsi->zsi_offset = zio->io_offset;
+	zsi->zsi_size = zio->io_size;
+	zsi->zsi_type = zio->io_type;
+	zsi->zsi_priority = zio->io_priority;
+	zsi->zsi_flags = zio->io_flags;
+	zsi->zsi_pipeline_trace = zio->io_pipeline_trace;
+	zsi->zsi_error = zio->io_error;
+	zsi->zsi_queued = queued;
+	zsi->zsi_latency = latency;
+
+	for (int s = 0; s < ZIO_STAGES; s++)
+		zsi->zsi_stage[s] = zio_trace_delta(queued, zt->zt_stage[s]);
+
+	zsi->zsi_taskq_wait = zt->zt_taskq_wait;
+	zsi->zsi_taskq_hops = zt->zt_taskq_hops;
+	if (zio->io_vd != NULL && zt->zt_vdev_dequeue != 0) {
+		zsi->zsi_vdev_queue = zio_trace_delta(zio->io_timestamp,
+		    zt->zt_vdev_dequeue);
+		zsi->zsi_vdev_device = zio_trace_delta(zt->zt_vdev_dequeue,
+		    zt->zt_interrupt);
+	}
+
+	if (zio->io_bp != NULL)
+		zsi->zsi_bp = *zio->io_bp;
+
+	mutex_exit(&zio_slow_io_lock);
+}
@@ -29,10 +29,55 @@
  * runs of zeroes.  Each chunk of compressed data begins with a length byte, b.
  * If b < n (where n is the compression parameter) then the next b + 1 bytes
  * are literal values.  If b >= n then the next (256 - b + 1) bytes are zero.
+ *
+ * Runs are found with the vector zero detection in zfs_zero.c: zero runs
+ * with zfs_zero_run(), and the end of a literal run, the first pair of
+ * zero bytes, from the mask of zero bytes of the next 64 bytes.
+ */
+#include <sys/zfs_context.h>
+#include <sys/zfs_zero.h>
+
+/*
+ * Length of the zero run at src, at most max bytes.
  */
-#include <sys/types.h>
-#include <sys/sysmacros.h>
+static size_t
+zle_zero_run(const uchar_t *src, size_t max)
+{
+	uint64_t nonzero;
+
+	if (max < ZFS_ZERO_CHUNK)
+		return (zfs_zero_run(src, max));
+
+	nonzero = ~zfs_zero_mask(src);
+	if (nonzero != 0)
+		return (MIN(__builtin_ctzll(nonzero), max));
+
+	return (ZFS_ZERO_CHUNK +
+	    zfs_zero_run(src + ZFS_ZERO_CHUNK, max - ZFS_ZERO_CHUNK));
+}
+
+/*
+ * Length of a literal run, given the mask of zero bytes starting at its
+ * first, nonzero, byte and valid for at least n bytes: up to the first pair
+ * of zero bytes, but no more than n bytes, and not ending with a zero.
+ */
+static int
+zle_literal_run(uint64_t zero, int n)
+{
+	uint64_t pairs = zero & (zero >> 1) & ((1ULL << (n - 1)) - 1);
 
+	if (pairs != 0)
+		return (__builtin_ctzll(pairs));
+
+	return (n - 1 + ((zero >> (n - 1)) & 1 ? 0 : 1));
+}
+
+/*
+ * Runs in real data are mostly short, so the mask of zero bytes of one
+ * chunk, starting at base, is kept and shifted to the current position
+ * until the position leaves the chunk or a run needs to see past it.
+ * Bytes past the end of the chunk read as nonzero in the shifted mask.
+ */
 size_t
 zle_compress(void *s_start, void *d_start, size_t s_len, size_t d_len, int n)
 {
@@ -40,24 +85,83 @@ zle_compress(void *s_start, void *d_start, size_t s_len, size_t d_len, int n)
 	uchar_t *dst = d_start;
 	uchar_t *s_end = src + s_len;
 	uchar_t *d_end = dst + d_len;
+	uchar_t *base = src;
+	uint64_t zero = 0;
+	boolean_t vector = (n > 0 && n <= ZFS_ZERO_CHUNK);
+
+	if (vector && s_len >= ZFS_ZERO_CHUNK)
+		zero = zfs_zero_mask(src);
 
 	while (src < s_end && dst < d_end - 1) {
 		uchar_t *first = src;
 		uchar_t *len = dst++;
+		size_t off, run;
+		uint64_t m;
+
+		if (!vector || s_end - src < ZFS_ZERO_CHUNK) {
+			if (src[0] == 0) {
+				uchar_t *last = src + (256 - n);
+				while (src < MIN(last, s_end) && src[0] == 0)
+					src++;
+				*len = src - first - 1 + n;
+			} else {
+				uchar_t *last = src + n;
+				if (d_end - dst < n)
+					break;
+				while (src < MIN(last, s_end) - 1 &&
+				    (src[0] | src[1]))
+					*dst++ = *src++;
+				if (src[0])
+					*dst++ = *src++;
+				*len = src - first - 1;
+			}
+			continue;
+		}
+
+		if (src - base >= ZFS_ZERO_CHUNK) {
+			base = src;
+			zero = zfs_zero_mask(src);
+		}
+		off = src - base;
+		m = zero >> off;
+
 		if (src[0] == 0) {
-			uchar_t *last = src + (256 - n);
-			while (src < MIN(last, s_end) && src[0] == 0)
-				src++;
-			*len = src - first - 1 + n;
+			size_t max = MIN(256 - n, s_end - src);
+			uint64_t nonzero = ~m & (~0ULL >> off);
+
+			if (nonzero != 0) {
+				run = MIN(__builtin_ctzll(nonzero), max);
+			} else {
+				run = ZFS_ZERO_CHUNK - off;
+				if (run < max)
+					run += zle_zero_run(src + run,
+					    max - run);
+				run = MIN(run, max);
+			}
+			src += run;
+			*len = run - 1 + n;
 		} else {
-			uchar_t *last = src + n;
 			if (d_end - dst < n)
 				break;
-			while (src < MIN(last, s_end) - 1 && (src[0] | src[1]))
-				*dst++ = *src++;
-			if (src[0])
-				*dst++ = *src++;
-			*len = src - first - 1;
+			/*
+			 * Look past the chunk only if the part of it that
+			 * is left does not already end the run.
+			 */
+			if (ZFS_ZERO_CHUNK - off < n &&
+			    (m & (m >> 1) &
+			    ((1ULL << (ZFS_ZERO_CHUNK - off - 1)) - 1)) == 0) {
+				base = src;
+				zero = m = zfs_zero_mask(src);
+			}
+			run = zle_literal_run(m, n);
+			/* A fixed size copy is cheaper, if there is room. */
+			if (d_end - dst >= ZFS_ZERO_CHUNK)
+				bcopy(src, dst, ZFS_ZERO_CHUNK);
+			else
+				bcopy(src, dst, run);
+			src += run;
+			dst += run;
+			*len = run - 1;
 		}
 	}
 	return (src == s_end ? dst - (uchar_t *)d_start : s_len);
@@ -74,12 +178,23 @@ zle_decompress(void *s_start, void *d_start, size_t s_len, size_t d_len, int n)
 	while (src < s_end && dst < d_end) {
 		int len = 1 + *src++;
 		if (len <= n) {
-			while (len-- != 0)
-				*dst++ = *src++;
+			if (len > s_end - src || len > d_end - dst)
+				return (-1);
+			/* As in zle_compress(), copy a whole chunk if we can */
+			if (len <= ZFS_ZERO_CHUNK &&
+			    s_end - src >= ZFS_ZERO_CHUNK &&
+			    d_end - dst >= ZFS_ZERO_CHUNK)
+				bcopy(src, dst, ZFS_ZERO_CHUNK);
+			else
+				bcopy(src, dst, len);
+			src += len;
+			dst += len;
 		} else {
 			len -= n;
-			while (len-- != 0)
-				*dst++ = 0;
+			if (len > d_end - dst)
+				return (-1);
+			bzero(dst, len);
+			dst += len;
 		}
 	}
 	return (dst == d_end ? 0 : -1);
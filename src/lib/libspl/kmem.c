@@ -24,6 +24,7 @@
 #include <sys/kmem.h>
 #include <spl/atomic.h>
 #include <spl/debug.h>
+#include <spl/mutex.h>
 #include <string.h>
 
 /* POINTER_IS_VALID depends on scribbling on uninitialized memory. */
@@ -43,6 +44,11 @@ struct kmem_cache
     void *              km_arg;
     unsigned            km_count;
     unsigned            km_align;
+
+    // Freed objects are kept for reuse until the cache is reaped. They are
+    // linked through their first word.
+    kmutex_t            km_lock;
+    void *              km_free;
 };
 
 vmem_t * zio_arena;
@@ -82,6 +88,7 @@ kmem_cache_create(const char *name, size_t bufsize, size_t align,
     cache->km_fini = destructor;
     cache->km_arg = arg;
     cache->km_align = align;
+    mutex_init(&cache->km_lock, NULL, MUTEX_DEFAULT, NULL);
 
     return cache;
 }
@@ -92,6 +99,8 @@ kmem_cache_destroy(kmem_cache_t *cp)
     // Clients are required to destroy outstanding objects before
     // destroying the pool.
     ASSERT(cp->km_count == 0);
+    kmem_cache_reap_now(cp);
+    mutex_destroy(&cp->km_lock);
     kmem_free(cp, sizeof(*cp));
 }
 
@@ -100,9 +109,16 @@ kmem_cache_alloc(kmem_cache_t *cp, unsigned kmflags)
 {
     void * ptr;
 
-    if (cp->km_align) {
+    mutex_enter(&cp->km_lock);
+    ptr = cp->km_free;
+    if (ptr) {
+        cp->km_free = *(void **)ptr;
+    }
+    mutex_exit(&cp->km_lock);
+
+    if (ptr == NULL && cp->km_align) {
         ptr = kmem_aligned_alloc(cp->km_align, cp->km_objsize, kmflags);
-    } else {
+    } else if (ptr == NULL) {
         ptr = kmem_alloc(cp->km_objsize, kmflags);
     }
 
@@ -121,6 +137,16 @@ kmem_cache_free(kmem_cache_t *cp, void *ptr)
     if (ptr) {
         kmem_cache_object_fini(cp, ptr);
         atomic_dec_32(&cp->km_count);
+
+        if (cp->km_objsize < sizeof(void *)) {
+            kmem_free(ptr, cp->km_objsize);
+            return;
+        }
+
+        mutex_enter(&cp->km_lock);
+        *(void **)ptr = cp->km_free;
+        cp->km_free = ptr;
+        mutex_exit(&cp->km_lock);
     }
 }
 
@@ -134,12 +160,22 @@ kmem_cache_set_move(kmem_cache_t *cp, kmem_move_t mv)
     // compaction, which we don't do ...
 }
 
+// Release the objects the cache is holding for reuse.
 void
 kmem_cache_reap_now(kmem_cache_t *cp)
 {
-    (void)cp;
+    void * ptr;
 
-    // Do nothing for now, since kmem_cache is just a malloc wrapper.
+    mutex_enter(&cp->km_lock);
+    ptr = cp->km_free;
+    cp->km_free = NULL;
+    mutex_exit(&cp->km_lock);
+
+    while (ptr) {
+        void * next = *(void **)ptr;
+        kmem_free(ptr, cp->km_objsize);
+        ptr = next;
+    }
 }
 
 size_t vmem_size(vmem_t *vmp, int typemask)
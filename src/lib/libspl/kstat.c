@@ -23,52 +23,270 @@
 
 #include <spl/types.h>
 #include <spl/kstat.h>
+#include <spl/kmem.h>
 #include <spl/debug.h>
+#include <spl/string.h>
+#include <spl/time.h>
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+
+// The kstat chain. Providers create and install kstats on the chain, and
+// consumers look them up by name with kstat_hold_byname(). A held kstat is
+// not freed by kstat_delete() until the last hold is released.
+
+typedef struct ekstat
+{
+    kstat_t     e_ks;       // Must be first.
+    size_t      e_size;     // Total allocation size, including data.
+    uint_t      e_holds;    // Consumer holds.
+} ekstat_t;
+
+kid_t kstat_chain_id;
+
+static kstat_t * kstat_chain;
+static kid_t kstat_next_kid;
+static pthread_mutex_t kstat_chain_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t kstat_chain_cv = PTHREAD_COND_INITIALIZER;
+
+static size_t
+kstat_data_size(uchar_t ks_type, uint_t ks_ndata)
+{
+    switch (ks_type) {
+    case KSTAT_TYPE_NAMED:
+        return ks_ndata * sizeof(kstat_named_t);
+    case KSTAT_TYPE_INTR:
+        return ks_ndata * sizeof(kstat_intr_t);
+    case KSTAT_TYPE_IO:
+        return ks_ndata * sizeof(kstat_io_t);
+    case KSTAT_TYPE_TIMER:
+        return ks_ndata * sizeof(kstat_timer_t);
+    case KSTAT_TYPE_RAW:
+    default:
+        // Raw kstats are sized in bytes.
+        return ks_ndata;
+    }
+}
+
+static int
+kstat_default_update(kstat_t * ksp, int rw)
+{
+    return rw == KSTAT_WRITE ? EACCES : 0;
+}
 
 kstat_t *
 kstat_create(const char * ks_module, int ks_instance, const char * ks_name,
         const char * ks_class, uchar_t ks_type, uint_t ks_ndata, uchar_t ks_flags)
 {
+    ekstat_t * e;
+    kstat_t * ksp;
+    size_t size;
+
     VERIFY3(ks_type, <, KSTAT_NUM_TYPES);
 
-    return NULL;
+    size = sizeof(ekstat_t);
+    if (!(ks_flags & KSTAT_FLAG_VIRTUAL)) {
+        size += kstat_data_size(ks_type, ks_ndata);
+    }
+
+    e = kmem_zalloc(size, KM_SLEEP);
+    e->e_size = size;
+
+    ksp = &e->e_ks;
+    ksp->ks_crtime = gethrtime();
+    ksp->ks_instance = ks_instance;
+    ksp->ks_type = ks_type;
+    ksp->ks_flags = ks_flags | KSTAT_FLAG_INVALID;
+    ksp->ks_ndata = ks_ndata;
+    ksp->ks_data_size = kstat_data_size(ks_type, ks_ndata);
+    ksp->ks_update = kstat_default_update;
+    ksp->ks_private = NULL;
+
+    strlcpy(ksp->ks_module, ks_module, sizeof(ksp->ks_module));
+    strlcpy(ksp->ks_name, ks_name, sizeof(ksp->ks_name));
+    strlcpy(ksp->ks_class, ks_class, sizeof(ksp->ks_class));
+
+    if (!(ks_flags & KSTAT_FLAG_VIRTUAL)) {
+        ksp->ks_data = e + 1;
+    }
+
+    pthread_mutex_lock(&kstat_chain_lock);
+    ksp->ks_kid = kstat_next_kid++;
+    ksp->ks_next = kstat_chain;
+    kstat_chain = ksp;
+    kstat_chain_id++;
+    pthread_mutex_unlock(&kstat_chain_lock);
+
+    return ksp;
 }
 
 void
 kstat_named_init(kstat_named_t * knp, const char * name, uchar_t data_type)
 {
+    strlcpy(knp->name, name, sizeof(knp->name));
+    knp->data_type = data_type;
 }
 
 void
-kstat_install(kstat_t * ks)
+kstat_install(kstat_t * ksp)
 {
-    VERIFY3(ks, ==, NULL);
+    VERIFY(ksp != NULL);
+
+    pthread_mutex_lock(&kstat_chain_lock);
+    ksp->ks_flags &= ~KSTAT_FLAG_INVALID;
+    kstat_chain_id++;
+    pthread_mutex_unlock(&kstat_chain_lock);
 }
 
 void
-kstat_delete(kstat_t * ks)
+kstat_delete(kstat_t * ksp)
 {
-    VERIFY3(ks, ==, NULL);
+    ekstat_t * e = (ekstat_t *)ksp;
+    kstat_t ** kpp;
+
+    if (ksp == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&kstat_chain_lock);
+
+    for (kpp = &kstat_chain; *kpp != ksp; kpp = &(*kpp)->ks_next) {
+        VERIFY(*kpp != NULL);
+    }
+
+    *kpp = ksp->ks_next;
+    kstat_chain_id++;
+
+    // Wait for consumers to let go before freeing.
+    while (e->e_holds > 0) {
+        pthread_cond_wait(&kstat_chain_cv, &kstat_chain_lock);
+    }
+
+    pthread_mutex_unlock(&kstat_chain_lock);
+
+    kmem_free(e, e->e_size);
+}
+
+kstat_t *
+kstat_hold_byname(const char * ks_module, int ks_instance,
+        const char * ks_name, zoneid_t ks_zoneid)
+{
+    kstat_t * ksp;
+
+    (void)ks_zoneid;
+
+    pthread_mutex_lock(&kstat_chain_lock);
+
+    for (ksp = kstat_chain; ksp != NULL; ksp = ksp->ks_next) {
+        if (ksp->ks_flags & KSTAT_FLAG_INVALID) {
+            continue;
+        }
+
+        if (ksp->ks_instance == ks_instance &&
+            strcmp(ksp->ks_module, ks_module) == 0 &&
+            strcmp(ksp->ks_name, ks_name) == 0) {
+            ((ekstat_t *)ksp)->e_holds++;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&kstat_chain_lock);
+    return ksp;
+}
+
+kstat_t *
+kstat_hold_bykid(kid_t kid, zoneid_t ks_zoneid)
+{
+    kstat_t * ksp;
+
+    (void)ks_zoneid;
+
+    pthread_mutex_lock(&kstat_chain_lock);
+
+    for (ksp = kstat_chain; ksp != NULL; ksp = ksp->ks_next) {
+        if (ksp->ks_kid == kid && !(ksp->ks_flags & KSTAT_FLAG_INVALID)) {
+            ((ekstat_t *)ksp)->e_holds++;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&kstat_chain_lock);
+    return ksp;
 }
 
+void
+kstat_rele(kstat_t * ksp)
+{
+    ekstat_t * e = (ekstat_t *)ksp;
+
+    pthread_mutex_lock(&kstat_chain_lock);
+    VERIFY3U(e->e_holds, >, 0);
+    if (--e->e_holds == 0) {
+        pthread_cond_broadcast(&kstat_chain_cv);
+    }
+    pthread_mutex_unlock(&kstat_chain_lock);
+}
+
+// The kstat_io_t accounting below follows the illumos implementation; see
+// the description of the Riemann sums in <spl/kstat.h>. Callers serialize
+// updates with the provider's ks_lock.
+
 void
 kstat_waitq_enter(kstat_io_t *kiop)
 {
+    hrtime_t now = gethrtime();
+    hrtime_t delta = now - kiop->wlastupdate;
+    uint_t wcnt;
+
+    kiop->wlastupdate = now;
+    wcnt = kiop->wcnt++;
+    if (wcnt != 0) {
+        kiop->wlentime += delta * wcnt;
+        kiop->wtime += delta;
+    }
 }
 
 void
 kstat_waitq_exit(kstat_io_t *kiop)
 {
+    hrtime_t now = gethrtime();
+    hrtime_t delta = now - kiop->wlastupdate;
+    uint_t wcnt;
+
+    kiop->wlastupdate = now;
+    wcnt = kiop->wcnt--;
+    ASSERT((int)wcnt > 0);
+    kiop->wlentime += delta * wcnt;
+    kiop->wtime += delta;
 }
 
 void
 kstat_runq_enter(kstat_io_t *kiop)
 {
+    hrtime_t now = gethrtime();
+    hrtime_t delta = now - kiop->rlastupdate;
+    uint_t rcnt;
+
+    kiop->rlastupdate = now;
+    rcnt = kiop->rcnt++;
+    if (rcnt != 0) {
+        kiop->rlentime += delta * rcnt;
+        kiop->rtime += delta;
+    }
 }
 
 void
 kstat_runq_exit(kstat_io_t *kiop)
 {
+    hrtime_t now = gethrtime();
+    hrtime_t delta = now - kiop->rlastupdate;
+    uint_t rcnt;
+
+    kiop->rlastupdate = now;
+    rcnt = kiop->rcnt--;
+    ASSERT((int)rcnt > 0);
+    kiop->rlentime += delta * rcnt;
+    kiop->rtime += delta;
 }
 
 /* vim: set sts=4 sw=4 ts=4 tw=79 et: */
@@ -87,6 +87,7 @@ extern void	taskq_suspend(taskq_t *);
 extern int	taskq_suspended(taskq_t *);
 extern void	taskq_resume(taskq_t *);
 extern int	taskq_member(taskq_t *, kthread_t *);
+extern int	taskq_empty(taskq_t *);
 
 #endif	/* _KERNEL */
 
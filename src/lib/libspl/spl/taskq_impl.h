@@ -45,13 +45,42 @@ typedef struct taskq_ent {
 	task_func_t		*tqent_func;
 	void			*tqent_arg;
 	uintptr_t		tqent_flags;
+	hrtime_t		tqent_queued;	/* time of dispatch */
 } taskq_ent_t;
 
 #define	TQENT_FLAG_PREALLOC	0x1	/* taskq_dispatch_ent used */
 
+#define	TASKQ_HIST_BUCKETS	32
+
+/*
+ * Per-taskq statistics, exported as the raw kstat
+ * "taskq:<instance>:<taskq name>".  Histogram bucket n counts intervals of
+ * [2^(n-1), 2^n) nanoseconds; the last bucket also counts anything longer.
+ * Utilization is tqs_busy_time / (tqs_nthreads * time since ks_crtime).
+ */
+typedef struct taskq_stats {
+	uint64_t	tqs_nthreads;
+	uint64_t	tqs_busy;		/* threads running a task */
+	uint64_t	tqs_busy_max;
+	uint64_t	tqs_depth;		/* tasks waiting to start */
+	uint64_t	tqs_depth_max;
+	uint64_t	tqs_dispatched;
+	uint64_t	tqs_executed;
+	uint64_t	tqs_nomem;		/* TQ_NOSLEEP failures */
+	uint64_t	tqs_maxalloc_waits;	/* throttled by tq_maxalloc */
+	hrtime_t	tqs_maxalloc_time;	/* time spent throttled */
+	hrtime_t	tqs_busy_time;		/* time spent running tasks */
+	/* Dispatch to start, and task run time. */
+	uint64_t	tqs_wait_hist[TASKQ_HIST_BUCKETS];
+	uint64_t	tqs_run_hist[TASKQ_HIST_BUCKETS];
+} taskq_stats_t;
+
 /* Special form of taskq dispatch that uses preallocated entries. */
 void taskq_dispatch_ent(taskq_t *, task_func_t, void *, uint_t, taskq_ent_t *);
 
+/* The taskq's stats kstat, or NULL if it could not be created. */
+kstat_t *taskq_kstat(taskq_t *);
+
 #ifdef	__cplusplus
 }
 #endif
@@ -80,11 +80,21 @@ ddi_get_lbolt(void) {
 
 // The gethrtime() function returns the current high-resolution real
 // time.  Time is expressed as nanoseconds since some arbitrary time
-// in the past.
+// in the past. This deliberately avoids CLOCK_MONOTONIC_COARSE, whose
+// scheduler-tick resolution is too low for I/O latency accounting.
 static inline hrtime_t
 gethrtime() {
     struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return SEC_TO_NSEC(ts.tv_sec) + ts.tv_nsec;
+}
+
+// The gethrvtime() function returns the CPU time consumed by the calling
+// thread, in nanoseconds.
+static inline hrtime_t
+gethrvtime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
     return SEC_TO_NSEC(ts.tv_sec) + ts.tv_nsec;
 }
 
@@ -67,6 +67,11 @@ extern int z_compress(void *, size_t *, const void *, size_t);
 extern int z_compress_level(void *, size_t *, const void *, size_t, int);
 extern const char *z_strerror(int);
 
+#if defined(__zfsd__)
+extern void zmod_init(void);
+extern void zmod_fini(void);
+#endif /* defined(__zfsd__) */
+
 #ifdef	__cplusplus
 }
 #endif
@@ -38,6 +38,9 @@
 #include <spl/time.h>
 #include <spl/rwlock.h>
 #include <spl/kmem.h>
+#include <spl/kstat.h>
+#include <spl/bitmap.h>
+#include <spl/atomic.h>
 #include <string.h>
 
 /* From usr/src/head/thread.h */
@@ -70,6 +73,8 @@ thr_join(thread_t tid, thread_t *departed, void **status)
 int taskq_now;
 taskq_t *system_taskq;
 
+static uint32_t taskq_instance;
+
 #define	TASKQ_ACTIVE	0x00010000
 #define	TASKQ_NAMELEN	31
 
@@ -90,19 +95,46 @@ struct taskq {
 	int		tq_maxalloc_wait;
 	taskq_ent_t	*tq_freelist;
 	taskq_ent_t	tq_task;
+	taskq_stats_t	tq_stats;	/* protected by tq_lock */
+	kstat_t		*tq_kstat;
 };
 
+static void
+taskq_hist_add(uint64_t *hist, hrtime_t delta)
+{
+	int bucket = delta > 0 ? highbit64(delta) : 0;
+
+	hist[MIN(bucket, TASKQ_HIST_BUCKETS - 1)]++;
+}
+
+/*
+ * Account for a task that has just been linked onto the queue.
+ */
+static void
+taskq_stat_enqueue(taskq_t *tq, taskq_ent_t *t)
+{
+	taskq_stats_t *tqs = &tq->tq_stats;
+
+	ASSERT(MUTEX_HELD(&tq->tq_lock));
+
+	t->tqent_queued = gethrtime();
+	tqs->tqs_dispatched++;
+	if (++tqs->tqs_depth > tqs->tqs_depth_max)
+		tqs->tqs_depth_max = tqs->tqs_depth;
+}
+
 static taskq_ent_t *
 task_alloc(taskq_t *tq, int tqflags)
 {
 	taskq_ent_t *t;
+	hrtime_t start;
 	int rv;
 
 again:	if ((t = tq->tq_freelist) != NULL && tq->tq_nalloc >= tq->tq_minalloc) {
 		tq->tq_freelist = t->tqent_next;
 	} else {
 		if (tq->tq_nalloc >= tq->tq_maxalloc) {
-			if (!(tqflags & KM_SLEEP))
+			if (tqflags & KM_NOSLEEP)
 				return (NULL);
 
 			/*
@@ -116,8 +148,11 @@ again:	if ((t = tq->tq_freelist) != NULL && tq->tq_nalloc >= tq->tq_minalloc) {
 			 * immediately retry the allocation.
 			 */
 			tq->tq_maxalloc_wait++;
+			tq->tq_stats.tqs_maxalloc_waits++;
+			start = gethrtime();
 			rv = cv_timedwait(&tq->tq_maxalloc_cv,
 			    &tq->tq_lock, ddi_get_lbolt() + hz);
+			tq->tq_stats.tqs_maxalloc_time += gethrtime() - start;
 			tq->tq_maxalloc_wait--;
 			if (rv > 0)
 				goto again;		/* signaled */
@@ -163,6 +198,7 @@ taskq_dispatch(taskq_t *tq, task_func_t func, void *arg, uint_t tqflags)
 	mutex_enter(&tq->tq_lock);
 	ASSERT(tq->tq_flags & TASKQ_ACTIVE);
 	if ((t = task_alloc(tq, tqflags)) == NULL) {
+		tq->tq_stats.tqs_nomem++;
 		mutex_exit(&tq->tq_lock);
 		return (0);
 	}
@@ -178,6 +214,7 @@ taskq_dispatch(taskq_t *tq, task_func_t func, void *arg, uint_t tqflags)
 	t->tqent_func = func;
 	t->tqent_arg = arg;
 	t->tqent_flags = 0;
+	taskq_stat_enqueue(tq, t);
 	cv_signal(&tq->tq_dispatch_cv);
 	mutex_exit(&tq->tq_lock);
 	return (1);
@@ -211,6 +248,7 @@ taskq_dispatch_ent(taskq_t *tq, task_func_t func, void *arg, uint_t flags,
 	t->tqent_prev->tqent_next = t;
 	t->tqent_func = func;
 	t->tqent_arg = arg;
+	taskq_stat_enqueue(tq, t);
 	cv_signal(&tq->tq_dispatch_cv);
 	mutex_exit(&tq->tq_lock);
 }
@@ -228,8 +266,10 @@ static void *
 taskq_thread(void *arg)
 {
 	taskq_t *tq = arg;
+	taskq_stats_t *tqs = &tq->tq_stats;
 	taskq_ent_t *t;
 	boolean_t prealloc;
+	hrtime_t start, run;
 
 	mutex_enter(&tq->tq_lock);
 	while (tq->tq_flags & TASKQ_ACTIVE) {
@@ -245,13 +285,25 @@ taskq_thread(void *arg)
 		t->tqent_next = NULL;
 		t->tqent_prev = NULL;
 		prealloc = t->tqent_flags & TQENT_FLAG_PREALLOC;
+
+		start = gethrtime();
+		tqs->tqs_depth--;
+		if (++tqs->tqs_busy > tqs->tqs_busy_max)
+			tqs->tqs_busy_max = tqs->tqs_busy;
+		taskq_hist_add(tqs->tqs_wait_hist, start - t->tqent_queued);
 		mutex_exit(&tq->tq_lock);
 
 		rw_enter(&tq->tq_threadlock, RW_READER);
 		t->tqent_func(t->tqent_arg);
 		rw_exit(&tq->tq_threadlock);
 
+		run = gethrtime() - start;
+
 		mutex_enter(&tq->tq_lock);
+		tqs->tqs_busy--;
+		tqs->tqs_executed++;
+		tqs->tqs_busy_time += run;
+		taskq_hist_add(tqs->tqs_run_hist, run);
 		if (!prealloc)
 			task_free(tq, t);
 	}
@@ -319,6 +371,17 @@ taskq_create(const char *name, int nthreads, pri_t pri,
 	tq->tq_task.tqent_next = &tq->tq_task;
 	tq->tq_task.tqent_prev = &tq->tq_task;
 	tq->tq_threadlist = kmem_alloc(nthreads * sizeof (thread_t), KM_SLEEP);
+	tq->tq_stats.tqs_nthreads = nthreads;
+
+	tq->tq_kstat = kstat_create("taskq", atomic_inc_32_nv(&taskq_instance),
+	    tq->tq_name, "taskq", KSTAT_TYPE_RAW, sizeof (taskq_stats_t),
+	    KSTAT_FLAG_VIRTUAL);
+	if (tq->tq_kstat != NULL) {
+		tq->tq_kstat->ks_data = &tq->tq_stats;
+		tq->tq_kstat->ks_lock = &tq->tq_lock;
+		tq->tq_kstat->ks_private = tq;
+		kstat_install(tq->tq_kstat);
+	}
 
 	if (flags & TASKQ_PREPOPULATE) {
 		mutex_enter(&tq->tq_lock);
@@ -342,6 +405,9 @@ taskq_destroy(taskq_t *tq)
 
 	taskq_wait(tq);
 
+	kstat_delete(tq->tq_kstat);
+	tq->tq_kstat = NULL;
+
 	mutex_enter(&tq->tq_lock);
 
 	tq->tq_flags &= ~TASKQ_ACTIVE;
@@ -387,6 +453,27 @@ taskq_member(taskq_t *tq, kthread_t *t)
 	return (0);
 }
 
+/*
+ * Returns whether no tasks are waiting to start on tq.
+ */
+int
+taskq_empty(taskq_t *tq)
+{
+	int empty;
+
+	mutex_enter(&tq->tq_lock);
+	empty = (tq->tq_task.tqent_next == &tq->tq_task);
+	mutex_exit(&tq->tq_lock);
+
+	return (empty);
+}
+
+kstat_t *
+taskq_kstat(taskq_t *tq)
+{
+	return (tq->tq_kstat);
+}
+
 void
 system_taskq_init(void)
 {
@@ -27,7 +27,11 @@
 #if !defined(__zfsd__)
 #include <sys/modctl.h>
 #else
+#include <stdlib.h>
 #include <strings.h>
+#include <sys/debug.h>
+#include <sys/types.h>
+#include <sys/thread.h>
 #endif /* !defined(__zfsd__) */
 #include <sys/zmod.h>
 
@@ -38,6 +42,213 @@
 #define DEF_WBITS MAX_WBITS
 #endif /* !defined(__zfsd__) */
 
+#if defined(__zfsd__)
+/*
+ * Setting up a zlib stream allocates roughly 256KB of window and hash
+ * state and clears the hash table, which can cost more than compressing
+ * a small block.  Each thread therefore keeps one deflate and one inflate
+ * stream for its lifetime and rewinds them with deflateReset() and
+ * inflateReset() between blocks.  The deflate stream is set up for the
+ * last level the thread used and is set up again only when the level
+ * changes, so a thread never holds more than one.  Streams are freed when
+ * the thread exits.
+ */
+typedef struct z_tsd {
+	z_stream	zt_deflate;
+	z_stream	zt_inflate;
+	int		zt_level;	/* level of zt_deflate */
+	boolean_t	zt_deflate_valid;
+	boolean_t	zt_inflate_valid;
+} z_tsd_t;
+
+static uint_t z_tsd_key;
+
+static void
+z_tsd_free(void *arg)
+{
+	z_tsd_t *zt = arg;
+
+	if (zt->zt_deflate_valid)
+		(void) deflateEnd(&zt->zt_deflate);
+	if (zt->zt_inflate_valid)
+		(void) inflateEnd(&zt->zt_inflate);
+	free(zt);
+}
+
+static z_tsd_t *
+z_tsd_get(void)
+{
+	z_tsd_t *zt;
+
+	if ((zt = tsd_get(z_tsd_key)) == NULL) {
+		if ((zt = calloc(1, sizeof (*zt))) == NULL)
+			return (NULL);
+		VERIFY0(tsd_set(z_tsd_key, zt));
+	}
+
+	return (zt);
+}
+
+/*
+ * The key is created once and never deleted: deleting a key keeps its
+ * destructor from running when the threads holding streams exit, which
+ * would leak them.  zmod_fini() only frees the calling thread's.
+ */
+void
+zmod_init(void)
+{
+	static boolean_t created = B_FALSE;
+
+	if (!created) {
+		tsd_create(&z_tsd_key, z_tsd_free);
+		created = B_TRUE;
+	}
+}
+
+void
+zmod_fini(void)
+{
+	z_tsd_t *zt = tsd_get(z_tsd_key);
+
+	if (zt != NULL) {
+		VERIFY0(tsd_set(z_tsd_key, NULL));
+		z_tsd_free(zt);
+	}
+}
+
+/*
+ * Return this thread's rewound deflate stream for the given level, or NULL
+ * with *errp set if one could not be set up.
+ */
+static z_stream *
+z_deflate_stream(int level, int *errp)
+{
+	z_tsd_t *zt;
+	z_stream *zs;
+	int err;
+
+	if (level == Z_DEFAULT_COMPRESSION)
+		level = 6;
+	if (level < 0 || level > Z_BEST_COMPRESSION) {
+		*errp = Z_STREAM_ERROR;
+		return (NULL);
+	}
+
+	if ((zt = z_tsd_get()) == NULL) {
+		*errp = Z_MEM_ERROR;
+		return (NULL);
+	}
+	zs = &zt->zt_deflate;
+
+	if (zt->zt_deflate_valid && zt->zt_level == level) {
+		if ((err = deflateReset(zs)) == Z_OK)
+			return (zs);
+		*errp = err;
+		(void) deflateEnd(zs);
+		zt->zt_deflate_valid = B_FALSE;
+		return (NULL);
+	}
+
+	if (zt->zt_deflate_valid) {
+		(void) deflateEnd(zs);
+		zt->zt_deflate_valid = B_FALSE;
+	}
+
+	if ((err = deflateInit(zs, level)) != Z_OK) {
+		*errp = err;
+		return (NULL);
+	}
+	zt->zt_deflate_valid = B_TRUE;
+	zt->zt_level = level;
+
+	return (zs);
+}
+
+static z_stream *
+z_inflate_stream(int *errp)
+{
+	z_tsd_t *zt;
+	int err;
+
+	if ((zt = z_tsd_get()) == NULL) {
+		*errp = Z_MEM_ERROR;
+		return (NULL);
+	}
+
+	if (!zt->zt_inflate_valid) {
+		/*
+		 * A window size of DEF_WBITS with the 6th bit set indicates
+		 * that the compression format type (zlib or gzip) should be
+		 * automatically detected.
+		 */
+		err = inflateInit2(&zt->zt_inflate, DEF_WBITS | 0x20);
+		if (err != Z_OK) {
+			*errp = err;
+			return (NULL);
+		}
+		zt->zt_inflate_valid = B_TRUE;
+		return (&zt->zt_inflate);
+	}
+
+	if ((err = inflateReset(&zt->zt_inflate)) != Z_OK) {
+		(void) inflateEnd(&zt->zt_inflate);
+		zt->zt_inflate_valid = B_FALSE;
+		*errp = err;
+		return (NULL);
+	}
+
+	return (&zt->zt_inflate);
+}
+
+/*
+ * Uncompress the buffer 'src' into the buffer 'dst'.  The caller must store
+ * the expected decompressed data size externally so it can be passed in.
+ * The resulting decompressed size is then returned through dstlen.  This
+ * function return Z_OK on success, or another error code on failure.
+ */
+int
+z_uncompress(void *dst, size_t *dstlen, const void *src, size_t srclen)
+{
+	z_stream *zs;
+	int err;
+
+	if ((zs = z_inflate_stream(&err)) == NULL)
+		return (err);
+
+	zs->next_in = (uchar_t *)src;
+	zs->avail_in = srclen;
+	zs->next_out = dst;
+	zs->avail_out = *dstlen;
+
+	if ((err = inflate(zs, Z_FINISH)) != Z_STREAM_END)
+		return (err == Z_OK ? Z_BUF_ERROR : err);
+
+	*dstlen = zs->total_out;
+	return (Z_OK);
+}
+
+int
+z_compress_level(void *dst, size_t *dstlen, const void *src, size_t srclen,
+    int level)
+{
+	z_stream *zs;
+	int err;
+
+	if ((zs = z_deflate_stream(level, &err)) == NULL)
+		return (err);
+
+	zs->next_in = (uchar_t *)src;
+	zs->avail_in = srclen;
+	zs->next_out = dst;
+	zs->avail_out = *dstlen;
+
+	if ((err = deflate(zs, Z_FINISH)) != Z_STREAM_END)
+		return (err == Z_OK ? Z_BUF_ERROR : err);
+
+	*dstlen = zs->total_out;
+	return (Z_OK);
+}
+#else	/* !defined(__zfsd__) */
 /*
  * Uncompress the buffer 'src' into the buffer 'dst'.  The caller must store
  * the expected decompressed data size externally so it can be passed in.
@@ -99,6 +310,8 @@ z_compress_level(void *dst, size_t *dstlen, const void *src, size_t srclen,
 	return (deflateEnd(&zs));
 }
 
+#endif	/* !defined(__zfsd__) */
+
 int
 z_compress(void *dst, size_t *dstlen, const void *src, size_t srclen)
 {
@@ -0,0 +1,630 @@
+/** @file
+ *
+ *  A brief file description
+ *
+ *  @section license License
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <catch.hpp>
+#include <spl/types.h>
+#include <sys/spa.h>
+#include <sys/zfs_blake3.h>
+#include <sys/zfs_edonr.h>
+#include <sys/zfs_sha2.h>
+#include <sys/zfs_skein.h>
+#include <zfs_fletcher.h>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// sys/zio_checksum.h pulls in sys/zio.h, which is not valid C++.
+extern "C" {
+void zio_checksum_SHA256(const void *, uint64_t, const void *, zio_cksum_t *);
+void zio_checksum_SHA256_batch(const void **, const uint64_t *, int,
+        const void *, zio_cksum_t *);
+void zio_checksum_SHA512_native(const void *, uint64_t, const void *,
+        zio_cksum_t *);
+void zio_checksum_skein_native(const void *, uint64_t, const void *,
+        zio_cksum_t *);
+void zio_checksum_skein_batch(const void **, const uint64_t *, int,
+        const void *, zio_cksum_t *);
+void *zio_checksum_skein_tmpl_init(const zio_cksum_salt_t *);
+void zio_checksum_skein_tmpl_free(void *);
+void zio_checksum_edonr_native(const void *, uint64_t, const void *,
+        zio_cksum_t *);
+void zio_checksum_edonr_byteswap(const void *, uint64_t, const void *,
+        zio_cksum_t *);
+void zio_checksum_edonr_batch(const void **, const uint64_t *, int,
+        const void *, zio_cksum_t *);
+void *zio_checksum_edonr_tmpl_init(const zio_cksum_salt_t *);
+void zio_checksum_edonr_tmpl_free(void *);
+void zio_checksum_blake3_native(const void *, uint64_t, const void *,
+        zio_cksum_t *);
+void *zio_checksum_blake3_tmpl_init(const zio_cksum_salt_t *);
+void zio_checksum_blake3_tmpl_free(void *);
+
+extern uint64_t zfs_blake3_parallel_min;
+}
+
+typedef void (*checksum_batch_func_t)(const void **, const uint64_t *, int,
+        const void *, zio_cksum_t *);
+
+typedef void (*checksum_func_t)(const void *, uint64_t, const void *,
+        zio_cksum_t *);
+
+static std::vector<uint8_t>
+random_buffer(size_t nbytes)
+{
+    std::vector<uint8_t> buf(nbytes);
+
+    srandom(nbytes);
+    for (auto& b : buf) {
+        b = random();
+    }
+
+    return buf;
+}
+
+// Every SIMD implementation the CPU supports has to produce the same
+// checksums as the scalar code, for any size and alignment, including the
+// incremental variants which recombine partial results.
+TEST_CASE("Fletcher implementations agree", "[checksum]")
+{
+    static const char * impls[] = { "sse2", "avx2", "avx512" };
+    static const uint64_t sizes[] = {
+        0, 4, 12, 16, 28, 64, 100, 512, 4096, 4100, 131072
+    };
+
+    std::string saved4 = fletcher_4_impl_get();
+    std::string saved2 = fletcher_2_impl_get();
+    auto buf = random_buffer(131072 + 64);
+
+    for (auto impl : impls) {
+        for (auto size : sizes) {
+            for (unsigned offset = 0; offset < 32; offset += 4) {
+                const uint8_t * p = buf.data() + offset;
+                zio_cksum_t ref, zc;
+
+                for (checksum_func_t f : { fletcher_4_native,
+                        fletcher_4_byteswap, fletcher_2_native,
+                        fletcher_2_byteswap }) {
+                    uint64_t len = size;
+
+                    // Fletcher-2 consumes 64-bit word pairs.
+                    if (f == fletcher_2_native || f == fletcher_2_byteswap) {
+                        len &= ~15ULL;
+                    }
+
+                    REQUIRE(fletcher_4_impl_set("scalar") == 0);
+                    REQUIRE(fletcher_2_impl_set("scalar") == 0);
+                    f(p, len, NULL, &ref);
+
+                    if (fletcher_4_impl_set(impl) != 0) {
+                        continue;
+                    }
+
+                    REQUIRE(fletcher_2_impl_set(impl) == 0);
+                    f(p, len, NULL, &zc);
+                    INFO(impl << " size " << len << " offset " << offset);
+                    REQUIRE(ZIO_CHECKSUM_EQUAL(ref, zc));
+                }
+
+                fletcher_4_native(p, size, NULL, &ref);
+
+                ZIO_SET_CHECKSUM(&zc, 0, 0, 0, 0);
+                uint64_t split = (size / 3) & ~3ULL;
+                fletcher_4_incremental_native(p, split, &zc);
+                fletcher_4_incremental_native(p + split, size - split, &zc);
+                INFO(impl << " incremental size " << size);
+                REQUIRE(ZIO_CHECKSUM_EQUAL(ref, zc));
+            }
+        }
+    }
+
+    REQUIRE(fletcher_4_impl_set("nonesuch") != 0);
+    REQUIRE(fletcher_4_impl_set(saved4.c_str()) == 0);
+    REQUIRE(fletcher_2_impl_set(saved2.c_str()) == 0);
+}
+
+static void
+sha256_expect(const char * msg, const uint32_t (&H)[8])
+{
+    zio_cksum_t zc;
+
+    zio_checksum_SHA256(msg, strlen(msg), NULL, &zc);
+    for (int i = 0; i < 4; i++) {
+        INFO(sha256_impl_get() << " '" << msg << "' word " << i);
+        REQUIRE(zc.zc_word[i] == (((uint64_t)H[2 * i] << 32) | H[2 * i + 1]));
+    }
+}
+
+// FIPS 180-2 test vectors, checked against every implementation, plus
+// agreement of the batch entry point (which uses the multi-buffer kernels)
+// with single-buffer hashing for mixed batches.
+TEST_CASE("SHA-256 implementations", "[checksum]")
+{
+    static const char * impls[] = { "generic", "shani", "avx2", "avx512" };
+    static const uint32_t empty[8] = {
+        0xe3b0c442, 0x98fc1c14, 0x9afbf4c8, 0x996fb924,
+        0x27ae41e4, 0x649b934c, 0xa495991b, 0x7852b855
+    };
+    static const uint32_t abc[8] = {
+        0xba7816bf, 0x8f01cfea, 0x414140de, 0x5dae2223,
+        0xb00361a3, 0x96177a9c, 0xb410ff61, 0xf20015ad
+    };
+    static const uint32_t two_block[8] = {
+        0x248d6a61, 0xd20638b8, 0xe5c02693, 0x0c3e6039,
+        0xa33ce459, 0x64ff2167, 0xf6ecedd4, 0x19db06c1
+    };
+
+    std::string saved = sha256_impl_get();
+    auto buf = random_buffer(8 * 4096 + 64);
+
+    for (auto impl : impls) {
+        if (sha256_impl_set(impl) != 0) {
+            continue;
+        }
+
+        sha256_expect("", empty);
+        sha256_expect("abc", abc);
+        sha256_expect(
+            "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+            two_block);
+
+        const void * data[12];
+        uint64_t size[12];
+        zio_cksum_t batch[12], single[12];
+
+        // Nine 4K blocks, an odd-sized one and two short ones.
+        for (int i = 0; i < 12; i++) {
+            data[i] = buf.data() + i * 1000;
+            size[i] = i < 9 ? 4096 : 55 + i;
+        }
+
+        zio_checksum_SHA256_batch(data, size, 12, NULL, batch);
+        REQUIRE(sha256_impl_set("generic") == 0);
+        for (int i = 0; i < 12; i++) {
+            zio_checksum_SHA256(data[i], size[i], NULL, &single[i]);
+            INFO(impl << " batch entry " << i);
+            REQUIRE(ZIO_CHECKSUM_EQUAL(batch[i], single[i]));
+        }
+    }
+
+    REQUIRE(sha256_impl_set(saved.c_str()) == 0);
+}
+
+// Hidden by default; run with "check-tests [bench]".  Reports the batch
+// throughput of each SHA-256 implementation for 4K to 1M blocks.
+TEST_CASE("SHA-256 throughput", "[.][bench]")
+{
+    static const char * impls[] = { "generic", "shani", "avx2", "avx512" };
+    const uint64_t total = 64ULL << 20;
+
+    std::string saved = sha256_impl_get();
+    auto buf = random_buffer(8 << 20);
+
+    for (auto impl : impls) {
+        if (sha256_impl_set(impl) != 0) {
+            continue;
+        }
+
+        for (uint64_t bs = 4096; bs <= (1 << 20); bs <<= 1) {
+            const void * data[8];
+            uint64_t size[8];
+            zio_cksum_t zc[8];
+            struct timespec start, end;
+
+            for (int i = 0; i < 8; i++) {
+                data[i] = buf.data() + i * bs;
+                size[i] = bs;
+            }
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (uint64_t done = 0; done < total; done += 8 * bs) {
+                zio_checksum_SHA256_batch(data, size, 8, NULL, zc);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+
+            double secs = (end.tv_sec - start.tv_sec) +
+                (end.tv_nsec - start.tv_nsec) / 1e9;
+            WARN("sha256 " << impl << " " << bs / 1024 << "K: " <<
+                    (total / secs) / (1 << 20) << " MB/s");
+        }
+    }
+
+    REQUIRE(sha256_impl_set(saved.c_str()) == 0);
+}
+
+static void
+sha512_expect(const char * msg, const char * hex)
+{
+    zio_cksum_t zc;
+    uint8_t digest[32];
+
+    for (int i = 0; i < 32; i++) {
+        char byte[3] = { hex[2 * i], hex[2 * i + 1], '\0' };
+        digest[i] = strtoul(byte, NULL, 16);
+    }
+
+    zio_checksum_SHA512_native(msg, strlen(msg), NULL, &zc);
+    INFO(sha512_impl_get() << " '" << msg << "'");
+    REQUIRE(memcmp(&zc, digest, sizeof(digest)) == 0);
+}
+
+// The sha512 checksum is SHA-512/256 and stores the digest bytes as they
+// are, so the FIPS 180-4 vectors can be compared directly.  Every
+// implementation must also agree with the generic code on large buffers.
+TEST_CASE("SHA-512/256 implementations", "[checksum]")
+{
+    static const char * impls[] = { "generic", "avx2" };
+
+    std::string saved = sha512_impl_get();
+    auto buf = random_buffer(128 * 1024 + 1000);
+    std::vector<zio_cksum_t> ref;
+
+    for (auto impl : impls) {
+        if (sha512_impl_set(impl) != 0) {
+            continue;
+        }
+
+        sha512_expect("",
+            "c672b8d1ef56ed28ab87c3622c5114069bdd3ad7b8f9737498d0c01ecef0967a");
+        sha512_expect("abc",
+            "53048e2681941ef99b2e29b76b4c7dabe4c2d0c634fc6d46e0e2f13107e7af23");
+        sha512_expect(
+            "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+            "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+            "3928e184fb8690f840da3988121d31be65cb9d3ef83ee6146feac861e19b563a");
+
+        // Sizes around the four-block groups of the AVX2 kernel.
+        std::vector<zio_cksum_t> zc;
+        for (uint64_t size = 0; size <= buf.size(); size += 127) {
+            zio_cksum_t c;
+
+            zio_checksum_SHA512_native(buf.data(), size, NULL, &c);
+            zc.push_back(c);
+        }
+
+        if (ref.empty()) {
+            ref = zc;
+        }
+        for (size_t i = 0; i < zc.size(); i++) {
+            INFO(impl << " size " << i * 127);
+            REQUIRE(ZIO_CHECKSUM_EQUAL(zc[i], ref[i]));
+        }
+    }
+
+    REQUIRE(sha512_impl_set("nonesuch") != 0);
+    REQUIRE(sha512_impl_set(saved.c_str()) == 0);
+}
+
+// Hidden by default.  Reports the throughput of each SHA-512/256
+// implementation for 4K to 1M blocks.
+TEST_CASE("SHA-512/256 throughput", "[.][bench]")
+{
+    static const char * impls[] = { "generic", "avx2" };
+    const uint64_t total = 64ULL << 20;
+
+    std::string saved = sha512_impl_get();
+    auto buf = random_buffer(1 << 20);
+
+    for (auto impl : impls) {
+        if (sha512_impl_set(impl) != 0) {
+            continue;
+        }
+
+        for (uint64_t bs = 4096; bs <= (1 << 20); bs <<= 1) {
+            zio_cksum_t zc;
+            struct timespec start, end;
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (uint64_t done = 0; done < total; done += bs) {
+                zio_checksum_SHA512_native(buf.data(), bs, NULL, &zc);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+
+            double secs = (end.tv_sec - start.tv_sec) +
+                (end.tv_nsec - start.tv_nsec) / 1e9;
+            WARN("sha512 " << impl << " " << bs / 1024 << "K: " <<
+                    (total / secs) / (1 << 20) << " MB/s");
+        }
+    }
+
+    REQUIRE(sha512_impl_set(saved.c_str()) == 0);
+}
+
+struct salted_checksum {
+    const char *            name;
+    checksum_func_t         native;
+    checksum_batch_func_t   batch;
+    void *                  (*tmpl_init)(const zio_cksum_salt_t *);
+    void                    (*tmpl_free)(void *);
+    int                     (*impl_set)(const char *);
+    const char *            (*impl_get)(void);
+};
+
+static const salted_checksum salted_checksums[] = {
+    { "skein", zio_checksum_skein_native, zio_checksum_skein_batch,
+      zio_checksum_skein_tmpl_init, zio_checksum_skein_tmpl_free,
+      skein_impl_set, skein_impl_get },
+    { "edonr", zio_checksum_edonr_native, zio_checksum_edonr_batch,
+      zio_checksum_edonr_tmpl_init, zio_checksum_edonr_tmpl_free,
+      edonr_impl_set, edonr_impl_get },
+};
+
+// Batches of the salted checksums, which may go through the multi-buffer
+// kernels, must agree with hashing each buffer on its own, for every size
+// class of padding and for runs shorter than a full set of lanes.
+TEST_CASE("salted checksum batches", "[checksum]")
+{
+    static const char * impls[] = { "generic", "avx2", "avx512" };
+
+    auto buf = random_buffer(64 * 1024);
+    zio_cksum_salt_t salt;
+
+    for (unsigned i = 0; i < sizeof(salt.zcs_bytes); i++) {
+        salt.zcs_bytes[i] = buf[i];
+    }
+
+    for (auto & algo : salted_checksums) {
+        std::string saved = algo.impl_get();
+        void * tmpl = algo.tmpl_init(&salt);
+
+        for (auto impl : impls) {
+            if (algo.impl_set(impl) != 0) {
+                continue;
+            }
+
+            static const uint64_t sizes[] = {
+                0, 1, 63, 64, 65, 119, 120, 127, 128, 129, 4096, 4097
+            };
+
+            for (auto sz : sizes) {
+                const void * data[11];
+                uint64_t size[11];
+                zio_cksum_t batch[11], single[11];
+
+                // A run of nine followed by a run of two.
+                for (int j = 0; j < 11; j++) {
+                    data[j] = buf.data() + j * 4099;
+                    size[j] = sz;
+                }
+
+                algo.batch(data, size, 11, tmpl, batch);
+                for (int j = 0; j < 11; j++) {
+                    algo.native(data[j], size[j], tmpl, &single[j]);
+                    INFO(algo.name << " " << impl << " size " << sz <<
+                            " entry " << j);
+                    REQUIRE(ZIO_CHECKSUM_EQUAL(batch[j], single[j]));
+                }
+            }
+        }
+
+        algo.tmpl_free(tmpl);
+        REQUIRE(algo.impl_set("nonesuch") != 0);
+        REQUIRE(algo.impl_set(saved.c_str()) == 0);
+    }
+
+    // Salting must matter, and the byteswapped Edon-R checksum is the
+    // native one with its words swapped.
+    zio_cksum_t a, b;
+    void * tmpl = zio_checksum_edonr_tmpl_init(&salt);
+
+    zio_checksum_edonr_native(buf.data(), 4096, tmpl, &a);
+    zio_checksum_edonr_byteswap(buf.data(), 4096, tmpl, &b);
+    for (int i = 0; i < 4; i++) {
+        REQUIRE(b.zc_word[i] == __builtin_bswap64(a.zc_word[i]));
+    }
+    zio_checksum_edonr_tmpl_free(tmpl);
+
+    salt.zcs_bytes[0] ^= 1;
+    tmpl = zio_checksum_edonr_tmpl_init(&salt);
+    zio_checksum_edonr_native(buf.data(), 4096, tmpl, &b);
+    REQUIRE(!ZIO_CHECKSUM_EQUAL(a, b));
+    zio_checksum_edonr_tmpl_free(tmpl);
+}
+
+// Hidden by default.  Reports the batch throughput of each Skein and Edon-R
+// implementation for 4K to 1M blocks.
+TEST_CASE("salted checksum throughput", "[.][bench]")
+{
+    static const char * impls[] = { "generic", "avx2", "avx512" };
+    const uint64_t total = 64ULL << 20;
+
+    auto buf = random_buffer(8 << 20);
+    zio_cksum_salt_t salt = { { 0 } };
+
+    for (auto & algo : salted_checksums) {
+        std::string saved = algo.impl_get();
+        void * tmpl = algo.tmpl_init(&salt);
+
+        for (auto impl : impls) {
+            if (algo.impl_set(impl) != 0) {
+                continue;
+            }
+
+            for (uint64_t bs = 4096; bs <= (1 << 20); bs <<= 2) {
+                const void * data[8];
+                uint64_t size[8];
+                zio_cksum_t zc[8];
+                struct timespec start, end;
+
+                for (int i = 0; i < 8; i++) {
+                    data[i] = buf.data() + i * bs;
+                    size[i] = bs;
+                }
+
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                for (uint64_t done = 0; done < total; done += 8 * bs) {
+                    algo.batch(data, size, 8, tmpl, zc);
+                }
+                clock_gettime(CLOCK_MONOTONIC, &end);
+
+                double secs = (end.tv_sec - start.tv_sec) +
+                    (end.tv_nsec - start.tv_nsec) / 1e9;
+                WARN(algo.name << " " << impl << " " << bs / 1024 <<
+                        "K: " << (total / secs) / (1 << 20) << " MB/s");
+            }
+        }
+
+        algo.tmpl_free(tmpl);
+        REQUIRE(algo.impl_set(saved.c_str()) == 0);
+    }
+}
+
+struct blake3_vector {
+    uint64_t        size;
+    const char *    hex;
+};
+
+// Keyed hashes from the BLAKE3 reference test vectors: the input is
+// i % 251 for every byte i, and the key is the one used there.
+static const blake3_vector blake3_vectors[] = {
+    { 0, "92b2b75604ed3c761f9d6f62392c8a9227ad0ea3f09573e783f1498a4ed60d26" },
+    { 1, "6d7878dfff2f485635d39013278ae14f1454b8c0a3a2d34bc1ab38228a80c95b" },
+    { 64, "ba8ced36f327700d213f120b1a207a3b8c04330528586f414d09f2f7d9ccb7e6" },
+    { 65, "c0a4edefa2d2accb9277c371ac12fcdbb52988a86edc54f0716e1591b4326e72" },
+    { 1023,
+      "c951ecdf03288d0fcc96ee3413563d8a6d3589547f2c2fb36d9786470f1b9d6e" },
+    { 1024,
+      "75c46f6f3d9eb4f55ecaaee480db732e6c2105546f1e675003687c31719c7ba4" },
+    { 1025,
+      "357dc55de0c7e382c900fd6e320acc04146be01db6a8ce7210b7189bd664ea69" },
+    { 2049,
+      "9f29700902f7c86e514ddc4df1e3049f258b2472b6dd5267f61bf13983b78dd5" },
+    { 3073,
+      "68dede9bef00ba89e43f31a6825f4cf433389fedae75c04ee9f0cf16a427c95a" },
+    { 5120,
+      "2c493e48e9b9bf31e0553a22b23503c0a3388f035cece68eb438d22fa1943e20" },
+    { 16384,
+      "9e9fc4eb7cf081ea7c47d1807790ed211bfec56aa25bb7037784c13c4b707b0d" },
+    { 31744,
+      "efa53b389ab67c593dba624d898d0f7353ab99e4ac9d42302ee64cbf9939a419" },
+    { 102400,
+      "1c35d1a5811083fd7119f5d5d1ba027b4d01c0c6c49fb6ff2cf75393ea5db4a7" },
+    // Large enough to be split across the blake3 taskq.
+    { 1 << 20,
+      "59b889b0821111fc4c249dc98b5435b767b44fb881542c61a85c1bebbffb2906" },
+    { (1 << 20) + 1,
+      "a0c8e093827da3e07e22fa684eb60fc1600cf44c5036c80fb0b587d0f39ef421" },
+    { (3 << 20) + 1000,
+      "fe65ba8f1cb96ee9d9bbffd9062d5ba901917c6a9347e0faf0aebc6add8db692" },
+    { 4 << 20,
+      "182b531d06d2705f68e23dc6a5580481f3342ded15cece016b58e0922e75c0e3" },
+};
+
+// The blake3 checksum is keyed with the salt and stores the digest bytes as
+// they are.  Every implementation has to reproduce the reference vectors,
+// both serially and when large inputs are hashed in parallel.
+TEST_CASE("BLAKE3 implementations", "[checksum]")
+{
+    static const char * impls[] = { "generic", "sse41", "avx2", "avx512" };
+    static const char key[] = "whats the Elvish word for friend";
+
+    blake3_init();
+
+    std::string saved = blake3_impl_get();
+    uint64_t saved_min = zfs_blake3_parallel_min;
+    std::vector<uint8_t> buf(4 << 20);
+    zio_cksum_salt_t salt;
+
+    for (size_t i = 0; i < buf.size(); i++) {
+        buf[i] = i % 251;
+    }
+    memcpy(salt.zcs_bytes, key, sizeof(salt.zcs_bytes));
+    void * tmpl = zio_checksum_blake3_tmpl_init(&salt);
+
+    for (auto impl : impls) {
+        if (blake3_impl_set(impl) != 0) {
+            continue;
+        }
+
+        for (auto parallel_min : { 0ULL, 1ULL << 20 }) {
+            zfs_blake3_parallel_min = parallel_min;
+
+            for (auto & v : blake3_vectors) {
+                zio_cksum_t zc;
+                uint8_t digest[32];
+
+                for (int i = 0; i < 32; i++) {
+                    char byte[3] = { v.hex[2 * i], v.hex[2 * i + 1], '\0' };
+                    digest[i] = strtoul(byte, NULL, 16);
+                }
+
+                zio_checksum_blake3_native(buf.data(), v.size, tmpl, &zc);
+                INFO(impl << " size " << v.size << " parallel_min " <<
+                        parallel_min);
+                REQUIRE(memcmp(&zc, digest, sizeof(digest)) == 0);
+            }
+        }
+    }
+
+    zio_checksum_blake3_tmpl_free(tmpl);
+    zfs_blake3_parallel_min = saved_min;
+    REQUIRE(blake3_impl_set("nonesuch") != 0);
+    REQUIRE(blake3_impl_set(saved.c_str()) == 0);
+
+    blake3_fini();
+}
+
+// Hidden by default.  Reports the throughput of each BLAKE3 implementation
+// for 4K to 16M blocks; blocks of 1M and up are hashed in parallel.
+TEST_CASE("BLAKE3 throughput", "[.][bench]")
+{
+    static const char * impls[] = { "generic", "sse41", "avx2", "avx512" };
+    const uint64_t total = 256ULL << 20;
+
+    blake3_init();
+
+    std::string saved = blake3_impl_get();
+    auto buf = random_buffer(16 << 20);
+    zio_cksum_salt_t salt = { { 0 } };
+    void * tmpl = zio_checksum_blake3_tmpl_init(&salt);
+
+    for (auto impl : impls) {
+        if (blake3_impl_set(impl) != 0) {
+            continue;
+        }
+
+        for (uint64_t bs = 4096; bs <= (16 << 20); bs <<= 2) {
+            zio_cksum_t zc;
+            struct timespec start, end;
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (uint64_t done = 0; done < total; done += bs) {
+                zio_checksum_blake3_native(buf.data(), bs, tmpl, &zc);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+
+            double secs = (end.tv_sec - start.tv_sec) +
+                (end.tv_nsec - start.tv_nsec) / 1e9;
+            WARN("blake3 " << impl << " " << bs / 1024 << "K: " <<
+                    (total / secs) / (1 << 20) << " MB/s");
+        }
+    }
+
+    zio_checksum_blake3_tmpl_free(tmpl);
+    REQUIRE(blake3_impl_set(saved.c_str()) == 0);
+
+    blake3_fini();
+}
+
+/* vim: set sts=4 sw=4 ts=4 tw=79 et: */
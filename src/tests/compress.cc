@@ -0,0 +1,311 @@
+/** @file
+ *
+ *  A brief file description
+ *
+ *  @section license License
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <catch.hpp>
+#include <spl/types.h>
+#include <sys/zfs_zero.h>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+
+// sys/zio_compress.h pulls in sys/zio.h, which is not valid C++.
+extern "C" {
+size_t zle_compress(void *, void *, size_t, size_t, int);
+int zle_decompress(void *, void *, size_t, size_t, int);
+size_t lz4_compress(void *, void *, size_t, size_t, int);
+int lz4_decompress(void *, void *, size_t, size_t, int);
+void lz4_init(void);
+void lz4_fini(void);
+size_t zstd_compress(void *, void *, size_t, size_t, int);
+int zstd_decompress(void *, void *, size_t, size_t, int);
+void zstd_init(void);
+void zstd_fini(void);
+size_t gzip_compress(void *, void *, size_t, size_t, int);
+int gzip_decompress(void *, void *, size_t, size_t, int);
+void zmod_init(void);
+void zmod_fini(void);
+}
+
+static const char * zero_impls[] = { "generic", "sse2", "avx2", "avx512" };
+
+// A buffer of zero and nonzero runs, with the given percentage of zero
+// runs.  Nonzero runs also contain isolated zero bytes.
+static std::vector<uint8_t>
+runs_buffer(size_t nbytes, int zero_pct, unsigned seed)
+{
+    std::vector<uint8_t> buf(nbytes);
+    size_t i = 0;
+
+    srandom(seed);
+    while (i < nbytes) {
+        size_t run = 1 + random() % ((random() % 2) ? 300 : 5);
+        bool zero = random() % 100 < zero_pct;
+
+        for (size_t k = 0; k < run && i < nbytes; k++, i++) {
+            buf[i] = zero ? 0 : ((random() % 4) ? 1 + random() % 255 : 0);
+        }
+    }
+
+    return buf;
+}
+
+// The byte at a time encoder that the vectorized zle_compress() replaced.
+// Its output is the on-disk format, so the two have to agree exactly.
+static size_t
+zle_compress_reference(const uint8_t * src, uint8_t * dst, size_t s_len,
+        size_t d_len, int n)
+{
+    const uint8_t * s_end = src + s_len;
+    uint8_t * d_start = dst;
+    uint8_t * d_end = dst + d_len;
+
+    while (src < s_end && dst < d_end - 1) {
+        const uint8_t * first = src;
+        uint8_t * len = dst++;
+
+        if (src[0] == 0) {
+            const uint8_t * last = std::min(src + (256 - n), s_end);
+            while (src < last && src[0] == 0) {
+                src++;
+            }
+            *len = src - first - 1 + n;
+        } else {
+            const uint8_t * last = std::min(src + n, s_end);
+            if (d_end - dst < n) {
+                break;
+            }
+            while (src < last - 1 && (src[0] | src[1])) {
+                *dst++ = *src++;
+            }
+            if (src[0]) {
+                *dst++ = *src++;
+            }
+            *len = src - first - 1;
+        }
+    }
+
+    return src == s_end ? dst - d_start : s_len;
+}
+
+TEST_CASE("zero detection implementations agree", "[compress]")
+{
+    std::string saved = zfs_zero_impl_get();
+    std::vector<uint8_t> buf(8192 + 64);
+
+    for (auto impl : zero_impls) {
+        if (zfs_zero_impl_set(impl) != 0) {
+            continue;
+        }
+
+        for (size_t pos = 0; pos < 1024; pos++) {
+            buf[pos] = 0x80 >> (pos % 8);
+
+            for (size_t offset = 0; offset < 64; offset += 7) {
+                const uint8_t * p = buf.data() + offset;
+                size_t size = 8192;
+                size_t expect = pos >= offset ? pos - offset : size;
+
+                INFO(impl << " pos " << pos << " offset " << offset);
+                REQUIRE(zfs_zero_run(p, size) == expect);
+                REQUIRE(zfs_is_zero(p, size) == (expect == size));
+
+                uint64_t mask = zfs_zero_mask(p);
+                for (size_t i = 0; i < 64; i++) {
+                    REQUIRE(((mask >> i) & 1) == (p[i] == 0));
+                }
+            }
+
+            buf[pos] = 0;
+        }
+    }
+
+    REQUIRE(zfs_zero_impl_set("nonesuch") != 0);
+    REQUIRE(zfs_zero_impl_set(saved.c_str()) == 0);
+}
+
+// ZLE has to produce the same stream as before for every implementation of
+// zero detection, including when the output buffer is too small, and has
+// to decode it again.
+TEST_CASE("ZLE matches the reference encoder", "[compress]")
+{
+    static const size_t sizes[] = { 1, 63, 64, 65, 511, 4096, 131072 };
+    std::string saved = zfs_zero_impl_get();
+
+    for (auto impl : zero_impls) {
+        if (zfs_zero_impl_set(impl) != 0) {
+            continue;
+        }
+
+        for (auto size : sizes) {
+            for (int zero_pct : { 0, 10, 50, 90, 100 }) {
+                auto src = runs_buffer(size, zero_pct, size + zero_pct);
+                std::vector<uint8_t> ref(size), dst(size), out(size + 1);
+
+                for (size_t d_len : { size, size - size / 8 }) {
+                    size_t ref_len = zle_compress_reference(src.data(),
+                            ref.data(), size, d_len, 64);
+                    size_t len = zle_compress(src.data(), dst.data(), size,
+                            d_len, 64);
+
+                    INFO(impl << " size " << size << " zeroes " <<
+                            zero_pct << "% d_len " << d_len);
+                    REQUIRE(len == ref_len);
+                    if (len == size) {
+                        continue;
+                    }
+
+                    REQUIRE(memcmp(dst.data(), ref.data(), len) == 0);
+                    REQUIRE(zle_decompress(dst.data(), out.data(), len,
+                                size, 64) == 0);
+                    REQUIRE(memcmp(out.data(), src.data(), size) == 0);
+
+                    // A truncated stream must not decode.
+                    REQUIRE(zle_decompress(dst.data(), out.data(), len,
+                                size + 1, 64) != 0);
+                }
+            }
+        }
+    }
+
+    REQUIRE(zfs_zero_impl_set(saved.c_str()) == 0);
+}
+
+// Every acceleration level has to produce plain LZ4 blocks that decode
+// with the same function, also after padding to a sector boundary.
+TEST_CASE("LZ4 acceleration levels round trip", "[compress]")
+{
+    static const size_t sizes[] = { 4096, 16384, 131072 };
+
+    lz4_init();
+
+    for (auto size : sizes) {
+        for (int zero_pct : { 50, 90 }) {
+            auto src = runs_buffer(size, zero_pct, size + zero_pct);
+
+            for (int accel : { 0, 2, 4, 8, 16, 32, 64 }) {
+                std::vector<uint8_t> dst(size, 0), out(size);
+                size_t len = lz4_compress(src.data(), dst.data(), size,
+                        size, accel);
+
+                INFO("size " << size << " zeroes " << zero_pct <<
+                        "% acceleration " << accel);
+                REQUIRE(len < size);
+
+                size_t padded = std::min((len + 511) & ~511UL, size);
+                REQUIRE(lz4_decompress(dst.data(), out.data(), padded, size,
+                            0) == 0);
+                REQUIRE(out == src);
+            }
+        }
+    }
+
+    lz4_fini();
+}
+
+// Every zstd level has to decode after padding to a sector boundary, and
+// data that does not fit in the destination is left uncompressed.
+TEST_CASE("zstd levels round trip", "[compress]")
+{
+    static const size_t sizes[] = { 4096, 16384, 131072 };
+
+    zstd_init();
+
+    for (auto size : sizes) {
+        for (int zero_pct : { 50, 90 }) {
+            auto src = runs_buffer(size, zero_pct, size + zero_pct);
+
+            for (int level : { 1, 3, 9, 19 }) {
+                std::vector<uint8_t> dst(size, 0), out(size);
+                size_t len = zstd_compress(src.data(), dst.data(), size,
+                        size, level);
+
+                INFO("size " << size << " zeroes " << zero_pct <<
+                        "% level " << level);
+                REQUIRE(len < size);
+
+                size_t padded = std::min((len + 511) & ~511UL, size);
+                REQUIRE(zstd_decompress(dst.data(), out.data(), padded,
+                            size, level) == 0);
+                REQUIRE(out == src);
+
+                // A truncated stream must fail rather than decode.
+                REQUIRE(zstd_decompress(dst.data(), out.data(), len - 1,
+                            size, level) != 0);
+            }
+        }
+
+        std::vector<uint8_t> noise(size), dst(size);
+        for (auto & b : noise) {
+            b = random();
+        }
+        REQUIRE(zstd_compress(noise.data(), dst.data(), size, size / 2,
+                    3) == size);
+    }
+
+    zstd_fini();
+}
+
+// gzip levels have to round trip after padding to a sector boundary, also
+// when one thread switches between levels and has to set its deflate
+// stream up again.
+TEST_CASE("gzip levels round trip", "[compress]")
+{
+    static const size_t sizes[] = { 4096, 131072 };
+
+    zmod_init();
+
+    for (auto size : sizes) {
+        for (int zero_pct : { 50, 90 }) {
+            auto src = runs_buffer(size, zero_pct, size + zero_pct);
+
+            for (int pass = 0; pass < 2; pass++) {
+                for (int level = 1; level <= 9; level++) {
+                    std::vector<uint8_t> dst(size, 0), out(size);
+                    size_t len = gzip_compress(src.data(), dst.data(), size,
+                            size, level);
+
+                    INFO("size " << size << " zeroes " << zero_pct <<
+                            "% level " << level);
+                    REQUIRE(len < size);
+
+                    size_t padded = std::min((len + 511) & ~511UL, size);
+                    REQUIRE(gzip_decompress(dst.data(), out.data(), padded,
+                                size, level) == 0);
+                    REQUIRE(out == src);
+                }
+            }
+        }
+
+        std::vector<uint8_t> noise(size), dst(size);
+        for (auto & b : noise) {
+            b = random();
+        }
+        REQUIRE(gzip_compress(noise.data(), dst.data(), size, size / 2,
+                    6) == size);
+    }
+
+    zmod_fini();
+}
+
+/* vim: set sts=4 sw=4 ts=4 tw=79 et: */
@@ -21,13 +21,147 @@
  *  limitations under the License.
  */
 
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <catch.hpp>
 #include <spl/types.h>
 #include <spl/nvpair.h>
 #include <sys/spa.h>
+#include <sys/dmu.h>
+#include <sys/txg.h>
 #include <sys/rrwlock.h>
+#include <sys/dkio.h>
+#include <sys/dsl_prop.h>
+#include <sys/spa_impl.h>
+#include <sys/vdev.h>
+#include <sys/zio.h>
+#include <sys/zio_impl.h>
+#include <sys/zfs_sha2.h>
+#include <sys/zfs_skein.h>
+#include <sys/zfs_edonr.h>
+#include <spl/kstat.h>
+#include "../fs/compat/vdev_file_impl.h"
+#include "../fs/compat/vdev_memory_impl.h"
+#include <cinttypes>
+#include <string>
+#include <vector>
 
 extern uint_t rrw_tsd_key;
+extern int vdev_file_osync;
+extern int zfs_vdev_aggregation_vectored;
+extern int zio_slow_io_ms;
+extern int zio_slow_io_history;
+extern int zio_stage_cpu_stats;
+extern int zio_checksum_batch_wait_ns;
+
+// The SPL's <sys/sysmacros.h> hides glibc's major() and minor().
+extern "C" unsigned int gnu_dev_major(dev_t);
+extern "C" unsigned int gnu_dev_minor(dev_t);
+
+// The slow I/O record indexes its stages by highbit64(stage) - 1.
+static int
+zio_stage_index(enum zio_stage stage)
+{
+    return highbit64(stage) - 1;
+}
+
+// Snapshot the zio_cpu kstat of the given pool, which exports the pool's
+// spa_zio_cpu array.
+static std::vector<spa_zio_cpu_t>
+zio_cpu_snapshot(const char * pool)
+{
+    std::string module = std::string("zfs/") + pool;
+    std::vector<spa_zio_cpu_t> szc(
+            sizeof(spa_t::spa_zio_cpu) / sizeof(spa_zio_cpu_t));
+    kstat_t * ksp;
+
+    ksp = kstat_hold_byname(module.c_str(), 0, "zio_cpu", GLOBAL_ZONEID);
+    REQUIRE(ksp != nullptr);
+    REQUIRE(ksp->ks_data_size == szc.size() * sizeof(spa_zio_cpu_t));
+
+    // The counters are updated atomically, without the kstat lock.
+    memcpy(szc.data(), ksp->ks_data, ksp->ks_data_size);
+    kstat_rele(ksp);
+    return szc;
+}
+
+// Sum the stage executions and CPU time of one zio type.
+static void
+zio_cpu_sum(const std::vector<spa_zio_cpu_t> & szc, zio_type_t type,
+        uint64_t * count, uint64_t * time)
+{
+    size_t per_type = sizeof(spa_t::spa_zio_cpu[0]) / sizeof(spa_zio_cpu_t);
+
+    *count = *time = 0;
+    for (size_t i = type * per_type; i < (type + 1) * per_type; ++i) {
+        *count += szc[i].szc_count;
+        *time += szc[i].szc_time;
+    }
+}
+
+// Read an attribute of the request queue of the block device holding a
+// file, the way vdev_file does: the device's own queue, or its parent's
+// for a partition.
+static bool
+queue_attr(const char * path, const char * attr, uint64_t * val)
+{
+    struct stat st;
+
+    if (stat(path, &st) == -1) {
+        return false;
+    }
+
+    for (auto dir : { "queue", "../queue" }) {
+        std::string sys = "/sys/dev/block/" +
+            std::to_string(gnu_dev_major(st.st_dev)) + ":" +
+            std::to_string(gnu_dev_minor(st.st_dev)) + "/" + dir + "/" + attr;
+        FILE * fp = fopen(sys.c_str(), "r");
+        int n;
+
+        if (fp == nullptr) {
+            continue;
+        }
+
+        n = fscanf(fp, "%" SCNu64, val);
+        fclose(fp);
+        if (n == 1) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Set a tunable for the rest of the scope, and restore it on the way out
+// even when a REQUIRE fails.
+template <typename T>
+struct scoped_tunable
+{
+    scoped_tunable(T & tunable, T value) : tunable(tunable), saved(tunable) {
+        tunable = value;
+    }
+
+    ~scoped_tunable() {
+        tunable = saved;
+    }
+
+    T & tunable;
+    T saved;
+};
+
+// Issue another null zio from the completion of each one, until the
+// count runs out, so that each runs inline within the DONE stage of the
+// one before it.
+static void
+zio_nest_done(zio_t * zio)
+{
+    int * remaining = (int *)zio->io_private;
+
+    if (--*remaining > 0) {
+        zio_nowait(zio_null(nullptr, zio->io_spa, nullptr, zio_nest_done,
+                    remaining, ZIO_FLAG_CANFAIL));
+    }
+}
 
 // See zfd_ioctl.c::_init() for ZFS initialization ordering.
 struct scoped_spa_fixture
@@ -88,6 +222,116 @@ struct scoped_spa_fixture
         return nv;
     }
 
+    // Allocate a nvlist containing a single memory vdev.
+    nvlist_t * memdev()
+    {
+        nvlist_t * nv = fnvlist_alloc();
+
+        fnvlist_add_string(nv, ZPOOL_CONFIG_TYPE, VDEV_TYPE_MEMORY);
+        fnvlist_add_uint64(nv, ZPOOL_CONFIG_IS_LOG, B_FALSE);
+        return nv;
+    }
+
+    // Create a pool with a single top-level vdev, and free the vdev.
+    int create_pool(const char * pool, nvlist_t * vdev,
+            nvlist_t * props = nullptr)
+    {
+        nvlist_t * nvroot = fnvlist_alloc();
+        int error;
+
+        fnvlist_add_string(nvroot, ZPOOL_CONFIG_TYPE, VDEV_TYPE_ROOT);
+        fnvlist_add_nvlist_array(nvroot, ZPOOL_CONFIG_CHILDREN, &vdev, 1);
+
+        error = spa_create(pool, nvroot, props, nullptr);
+        nvlist_free(nvroot);
+        nvlist_free(vdev);
+        return error;
+    }
+
+    // Scrub a pool and wait for the scrub to finish.
+    pool_scan_stat_t scrub(const char * pool)
+    {
+        nvlist_t * config;
+        spa_t * scanspa;
+        pool_scan_stat_t * pss;
+        pool_scan_stat_t result;
+        uint_t npss;
+
+        REQUIRE(spa_open(pool, &scanspa, FTAG) == 0);
+        REQUIRE(spa_scan(scanspa, POOL_SCAN_SCRUB) == 0);
+        spa_close(scanspa, FTAG);
+
+        for (int i = 0; i < 1000; ++i) {
+            REQUIRE(spa_get_stats(pool, &config, nullptr, 0) == 0);
+            REQUIRE(nvlist_lookup_uint64_array(
+                        fnvlist_lookup_nvlist(config,
+                            ZPOOL_CONFIG_VDEV_TREE),
+                        ZPOOL_CONFIG_SCAN_STATS,
+                        (uint64_t **)&pss, &npss) == 0);
+
+            result = *pss;
+            nvlist_free(config);
+            if (result.pss_state == DSS_FINISHED) {
+                break;
+            }
+
+            delay(hz / 100);
+        }
+
+        return result;
+    }
+
+    // Write nblocks blocks of random data to a new object in the root
+    // dataset of a pool, checksummed with the given function, and wait
+    // for them to sync.
+    void write(const char * pool, uint8_t checksum, size_t nblocks)
+    {
+        const size_t blksz = SPA_OLD_MAXBLOCKSIZE;
+        const size_t chunk = 8 * blksz;
+        std::vector<uint8_t> buf(nblocks * blksz);
+        objset_t * os;
+        dmu_tx_t * tx;
+        uint64_t object = 0;
+        int err = 0;
+
+        for (auto & b : buf) {
+            b = random();
+        }
+
+        // Only the legacy checksums can be set per object, so set the
+        // checksum of the whole dataset.
+        REQUIRE(dsl_prop_set_int(pool, "checksum", ZPROP_SRC_LOCAL,
+                    checksum) == 0);
+        REQUIRE(dmu_objset_own(pool, DMU_OST_ANY, B_FALSE, FTAG, &os) == 0);
+
+        // Keep each tx well below DMU_MAX_ACCESS.  Don't fail while the
+        // objset is owned, or the pool can't be torn down.
+        for (size_t off = 0; off < buf.size() && err == 0; off += chunk) {
+            size_t len = std::min(chunk, buf.size() - off);
+
+            tx = dmu_tx_create(os);
+            dmu_tx_hold_write(tx, object ? object : DMU_NEW_OBJECT, off,
+                    len);
+            err = dmu_tx_assign(tx, TXG_WAIT);
+            if (err != 0) {
+                dmu_tx_abort(tx);
+                break;
+            }
+
+            if (object == 0) {
+                object = dmu_object_alloc(os, DMU_OT_UINT64_OTHER, blksz,
+                        DMU_OT_NONE, 0, tx);
+            }
+
+            dmu_write(os, object, off, len, buf.data() + off, tx);
+            dmu_tx_commit(tx);
+        }
+
+        txg_wait_synced(dmu_objset_pool(os), 0);
+        dmu_objset_disown(os, FTAG);
+        REQUIRE(err == 0);
+    }
+
     std::vector<int> descriptors;
     std::vector<std::string> paths;
 };
@@ -102,19 +346,502 @@ TEST_CASE("Basic spa_create()", "[spa]")
 
     // Make a pool with one file vdev.
     SECTION("create a default pool") {
-        nvlist_t * vdev;
-
         REQUIRE(spa.makefile("spa.0", SPA_MINDEVSIZE));
-        vdev = spa.filedev("spa.0");
+        REQUIRE(spa.create_pool("test.0", spa.filedev("spa.0")) == 0);
+    }
+
+    // Same again, but issue vdev I/O from the taskq rather than io_uring.
+    SECTION("create a pool with taskq vdev I/O") {
+        scoped_tunable<int> backend(vdev_file_io_backend,
+                VDEV_FILE_BACKEND_TASKQ);
+
+        REQUIRE(spa.makefile("spa.1", SPA_MINDEVSIZE));
+        REQUIRE(spa.create_pool("test.1", spa.filedev("spa.1")) == 0);
+    }
+
+    // And with libaio, for kernels where io_uring is disabled.
+    SECTION("create a pool with libaio vdev I/O") {
+        uint64_t opens = vdev_file_backend_opens[VDEV_FILE_BACKEND_AIO];
+        int fd;
+
+        REQUIRE(spa.makefile("spa.2", SPA_MINDEVSIZE));
+
+        // Linux AIO is only asynchronous with O_DIRECT, so the vdev would
+        // fall back to the taskq backend without it.
+        fd = open("spa.2", O_RDWR | O_DIRECT);
+        if (fd == -1) {
+            WARN("no O_DIRECT support, skipping the libaio backend");
+            return;
+        }
+        close(fd);
+
+        scoped_tunable<int> backend(vdev_file_io_backend,
+                VDEV_FILE_BACKEND_AIO);
+
+        REQUIRE(spa.create_pool("test.2", spa.filedev("spa.2")) == 0);
+        REQUIRE(vdev_file_backend_opens[VDEV_FILE_BACKEND_AIO] > opens);
+    }
+
+    // Export and re-import a pool. Loading it reads back the metadata that
+    // spa_create() wrote, through both vectored and copied aggregates.
+    SECTION("export and import a pool") {
+        nvlist_t * config = nullptr;
+
+        REQUIRE(spa.makefile("spa.3", SPA_MINDEVSIZE));
+        REQUIRE(spa.create_pool("test.3", spa.filedev("spa.3")) == 0);
+
+        REQUIRE(spa_export((char *)"test.3", &config, B_FALSE, B_FALSE) == 0);
+        REQUIRE(spa_import("test.3", config, props, 0) == 0);
+
+        {
+            scoped_tunable<int> vectored(zfs_vdev_aggregation_vectored, 0);
+
+            REQUIRE(spa_export((char *)"test.3", nullptr, B_FALSE,
+                        B_FALSE) == 0);
+            REQUIRE(spa_import("test.3", config, props, 0) == 0);
+        }
+
+        nvlist_free(config);
+    }
+
+    // Give the vdev a single I/O thread, and check that its queue never
+    // issues more I/O than that.
+    SECTION("limit the I/O active to a vdev") {
+        nvlist_t * config = nullptr;
+        nvlist_t ** child;
+        uint_t nchild;
+        char name[KSTAT_STRLEN];
+        kstat_t * ksp;
+        kstat_named_t * knp;
+        scoped_tunable<int> backend(vdev_file_io_backend,
+                VDEV_FILE_BACKEND_TASKQ);
+        scoped_tunable<uint_t> threads(vdev_file_taskq_threads, 1);
+
+        REQUIRE(spa.makefile("spa.4", SPA_MINDEVSIZE));
+        REQUIRE(spa.create_pool("test.4", spa.filedev("spa.4")) == 0);
+
+        REQUIRE(spa_get_stats("test.4", &config, nullptr, 0) == 0);
+        REQUIRE(nvlist_lookup_nvlist_array(
+                    fnvlist_lookup_nvlist(config, ZPOOL_CONFIG_VDEV_TREE),
+                    ZPOOL_CONFIG_CHILDREN, &child, &nchild) == 0);
+        REQUIRE(nchild == 1);
+
+        snprintf(name, sizeof(name), "vdev-0x%llx", (u_longlong_t)
+                fnvlist_lookup_uint64(child[0], ZPOOL_CONFIG_GUID));
+        nvlist_free(config);
+
+        ksp = kstat_hold_byname("zfs/test.4", 0, name, GLOBAL_ZONEID);
+        REQUIRE(ksp != nullptr);
+
+        knp = (kstat_named_t *)ksp->ks_data;
+        REQUIRE(strcmp(knp[0].name, "max_active") == 0);
+        REQUIRE(knp[0].value.ui32 == 1);
+        REQUIRE(strcmp(knp[2].name, "peak_active") == 0);
+        REQUIRE(knp[2].value.ui32 == 1);
+
+        kstat_rele(ksp);
+    }
+
+    // A file vdev takes its ashift and rotational flag from the queue of
+    // the device holding it, and an interior vdev is non-rotational only if
+    // all of its children are. Memory vdevs are always non-rotational.
+    SECTION("detect file vdev geometry") {
+        nvlist_t * vdevs[2];
+        nvlist_t * children[2];
+        nvlist_t * config;
+        nvlist_t ** top;
+        nvlist_t ** leaves;
+        uint_t ntop, nleaves;
+        scoped_tunable<uint64_t> size(vdev_memory_size, SPA_MINDEVSIZE);
+        uint64_t logical = 0, physical = 0, rotational, sector;
+        uint64_t ashift = SPA_MINBLOCKSHIFT;
+        uint64_t nonrot;
+
+        REQUIRE(spa.makefile("spa.12", SPA_MINDEVSIZE));
+
+        (void) queue_attr("spa.12", "logical_block_size", &logical);
+        (void) queue_attr("spa.12", "physical_block_size", &physical);
+        sector = std::max(logical, physical);
+        if (sector != 0 && ISP2(sector) && sector <= SPA_OLD_MAXBLOCKSIZE) {
+            ashift = std::max<uint64_t>(__builtin_ctzll(sector),
+                    SPA_MINBLOCKSHIFT);
+        }
+        nonrot = queue_attr("spa.12", "rotational", &rotational) ?
+            rotational == 0 : 1;
+
+        children[0] = spa.filedev("spa.12");
+        children[1] = spa.memdev();
+
+        vdevs[0] = fnvlist_alloc();
+        fnvlist_add_string(vdevs[0], ZPOOL_CONFIG_TYPE, VDEV_TYPE_MIRROR);
+        fnvlist_add_uint64(vdevs[0], ZPOOL_CONFIG_IS_LOG, B_FALSE);
+        fnvlist_add_nvlist_array(vdevs[0], ZPOOL_CONFIG_CHILDREN, children,
+                2);
+        vdevs[1] = spa.memdev();
 
         nvroot = fnvlist_alloc();
 
         fnvlist_add_string(nvroot, ZPOOL_CONFIG_TYPE, VDEV_TYPE_ROOT);
-        fnvlist_add_nvlist_array(nvroot, ZPOOL_CONFIG_CHILDREN, &vdev, 1);
+        fnvlist_add_nvlist_array(nvroot, ZPOOL_CONFIG_CHILDREN, vdevs, 2);
 
-        REQUIRE(spa_create("test.0", nvroot, props, zplprops) == 0);
+        REQUIRE(spa_create("test.12", nvroot, props, zplprops) == 0);
         nvlist_free(nvroot);
-        nvlist_free(vdev);
+        for (auto nv : { vdevs[0], vdevs[1], children[0], children[1] }) {
+            nvlist_free(nv);
+        }
+
+        REQUIRE(spa_get_stats("test.12", &config, nullptr, 0) == 0);
+        REQUIRE(nvlist_lookup_nvlist_array(
+                    fnvlist_lookup_nvlist(config, ZPOOL_CONFIG_VDEV_TREE),
+                    ZPOOL_CONFIG_CHILDREN, &top, &ntop) == 0);
+        REQUIRE(ntop == 2);
+        REQUIRE(nvlist_lookup_nvlist_array(top[0], ZPOOL_CONFIG_CHILDREN,
+                    &leaves, &nleaves) == 0);
+        REQUIRE(nleaves == 2);
+
+        INFO("logical " << logical << " physical " << physical);
+        CHECK(fnvlist_lookup_uint64(leaves[0], ZPOOL_CONFIG_NONROT) == nonrot);
+        CHECK(fnvlist_lookup_uint64(leaves[1], ZPOOL_CONFIG_NONROT) == 1);
+        CHECK(fnvlist_lookup_uint64(top[0], ZPOOL_CONFIG_NONROT) == nonrot);
+        CHECK(fnvlist_lookup_uint64(top[0], ZPOOL_CONFIG_ASHIFT) == ashift);
+        CHECK(fnvlist_lookup_uint64(top[1], ZPOOL_CONFIG_NONROT) == 1);
+        CHECK(fnvlist_lookup_uint64(top[1], ZPOOL_CONFIG_ASHIFT) ==
+                SPA_MINBLOCKSHIFT);
+
+        nvlist_free(config);
+    }
+
+    // Flush the write cache of a file vdev with each backend. A vdev opened
+    // O_SYNC has no cache to flush and refuses with ENOTSUP, which tells
+    // ZFS to stop asking.
+    SECTION("flush file vdev write caches") {
+        int n = 0;
+
+        for (int sync : { 0, 1 }) {
+            for (int io : { VDEV_FILE_BACKEND_URING, VDEV_FILE_BACKEND_AIO,
+                    VDEV_FILE_BACKEND_TASKQ }) {
+                std::string name = "test.13." + std::to_string(n);
+                std::string file = "spa.13." + std::to_string(n);
+                scoped_tunable<int> osync(vdev_file_osync, sync);
+                scoped_tunable<int> backend(vdev_file_io_backend, io);
+                spa_t * flushspa;
+                int error;
+
+                n++;
+                REQUIRE(spa.makefile(file.c_str(), SPA_MINDEVSIZE));
+                REQUIRE(spa.create_pool(name.c_str(),
+                            spa.filedev(file.c_str())) == 0);
+
+                REQUIRE(spa_open(name.c_str(), &flushspa, FTAG) == 0);
+                spa_config_enter(flushspa, SCL_STATE, FTAG, RW_READER);
+                error = zio_wait(zio_ioctl(nullptr, flushspa,
+                            vdev_lookup_top(flushspa, 0),
+                            DKIOCFLUSHWRITECACHE, nullptr, nullptr,
+                            ZIO_FLAG_CANFAIL));
+                spa_config_exit(flushspa, SCL_STATE, FTAG);
+                spa_close(flushspa, FTAG);
+
+                INFO("backend " << io << " osync " << sync);
+                REQUIRE(error == (sync ? ENOTSUP : 0));
+            }
+        }
+    }
+
+    // Creating a pool syncs a few txgs, each of which is recorded in the
+    // pool's txg history.
+    SECTION("record the txg history of a pool") {
+        kstat_t * ksp;
+        std::vector<spa_txg_history_t> sth;
+        uint_t nsynced = 0;
+
+        REQUIRE(spa.makefile("spa.8", SPA_MINDEVSIZE));
+        REQUIRE(spa.create_pool("test.8", spa.filedev("spa.8")) == 0);
+
+        ksp = kstat_hold_byname("zfs/test.8", 0, "txgs", GLOBAL_ZONEID);
+        REQUIRE(ksp != nullptr);
+        REQUIRE(ksp->ks_data_size % sizeof(spa_txg_history_t) == 0);
+
+        // Copy the history out, so that a failed check does not leave
+        // the kstat locked.
+        sth.resize(ksp->ks_data_size / sizeof(spa_txg_history_t));
+        mutex_enter((kmutex_t *)ksp->ks_lock);
+        memcpy(sth.data(), ksp->ks_data, ksp->ks_data_size);
+        mutex_exit((kmutex_t *)ksp->ks_lock);
+        kstat_rele(ksp);
+
+        for (const spa_txg_history_t & h : sth) {
+            if (h.sth_txg == 0 || h.sth_sync == 0) {
+                continue;
+            }
+
+            // A synced txg has been through every state, and wrote at
+            // least its uberblocks.
+            REQUIRE(h.sth_birth > 0);
+            REQUIRE(h.sth_passes > 0);
+            REQUIRE(h.sth_nwritten > 0);
+            REQUIRE(h.sth_writes > 0);
+            ++nsynced;
+        }
+
+        REQUIRE(nsynced > 0);
+    }
+
+    // Trim the free space of a pool, which punches holes in its file.
+    SECTION("trim a pool") {
+        spa_t * trimspa;
+        struct stat before, after;
+        kstat_t * ksp;
+        kstat_named_t * knp;
+
+        REQUIRE(spa.makefile("spa.5", SPA_MINDEVSIZE));
+        REQUIRE(spa.create_pool("test.5", spa.filedev("spa.5")) == 0);
+
+        REQUIRE(stat("spa.5", &before) == 0);
+        REQUIRE(spa_open("test.5", &trimspa, FTAG) == 0);
+        REQUIRE(spa_trim(trimspa) == 0);
+
+        ksp = kstat_hold_byname("zfs/test.5", 0, "trim", GLOBAL_ZONEID);
+        REQUIRE(ksp != nullptr);
+
+        knp = (kstat_named_t *)ksp->ks_data;
+        REQUIRE(strcmp(knp[5].name, "full_trims") == 0);
+        for (int i = 0; i < 1000 && knp[5].value.ui64 == 0; ++i) {
+            delay(hz / 100);
+        }
+
+        REQUIRE(knp[5].value.ui64 == 1);
+        REQUIRE(strcmp(knp[1].name, "bytes") == 0);
+        REQUIRE(knp[1].value.ui64 > 0);
+        REQUIRE(knp[3].value.ui64 == 0); // errors
+
+        kstat_rele(ksp);
+        spa_close(trimspa, FTAG);
+
+        REQUIRE(stat("spa.5", &after) == 0);
+        REQUIRE(after.st_blocks < before.st_blocks);
+    }
+
+    // Make a pool on a memory vdev and scrub it, which reads back every
+    // block that creating the pool wrote.
+    SECTION("create and scrub a pool on a memory vdev") {
+        scoped_tunable<uint64_t> size(vdev_memory_size, SPA_MINDEVSIZE);
+        pool_scan_stat_t pss;
+
+        REQUIRE(spa.create_pool("test.6", spa.memdev()) == 0);
+
+        pss = spa.scrub("test.6");
+        REQUIRE(pss.pss_state == DSS_FINISHED);
+        REQUIRE(pss.pss_examined > 0);
+        REQUIRE(pss.pss_errors == 0);
+    }
+
+    // Same again, but complete memory vdev I/O after a long-tail latency.
+    SECTION("create a pool on a memory vdev with I/O latency") {
+        scoped_tunable<uint64_t> size(vdev_memory_size, SPA_MINDEVSIZE);
+        scoped_tunable<int> model(vdev_memory_latency_model,
+                VDEV_MEMORY_LATENCY_LONGTAIL);
+        scoped_tunable<uint64_t> latency(vdev_memory_latency_ns, 20000);
+
+        REQUIRE(spa.create_pool("test.7", spa.memdev()) == 0);
+    }
+
+    // Delay every memory vdev I/O past the slow I/O threshold, so that
+    // each one lands in the slow I/O flight recorder.
+    SECTION("record slow I/Os") {
+        kstat_t * ksp;
+        std::vector<zio_slow_io_t> zsi;
+        uint_t nslow = 0;
+
+        {
+            scoped_tunable<uint64_t> size(vdev_memory_size, SPA_MINDEVSIZE);
+            scoped_tunable<int> model(vdev_memory_latency_model,
+                    VDEV_MEMORY_LATENCY_FIXED);
+            scoped_tunable<uint64_t> latency(vdev_memory_latency_ns,
+                    MSEC2NSEC(2));
+            scoped_tunable<int> slow(zio_slow_io_ms, 1);
+
+            REQUIRE(spa.create_pool("test.9", spa.memdev()) == 0);
+        }
+
+        ksp = kstat_hold_byname("zfs", 0, "slow_ios", GLOBAL_ZONEID);
+        REQUIRE(ksp != nullptr);
+        REQUIRE(ksp->ks_data_size ==
+                zio_slow_io_history * sizeof(zio_slow_io_t));
+
+        zsi.resize(zio_slow_io_history);
+        mutex_enter((kmutex_t *)ksp->ks_lock);
+        memcpy(zsi.data(), ksp->ks_data, ksp->ks_data_size);
+        mutex_exit((kmutex_t *)ksp->ks_lock);
+        kstat_rele(ksp);
+
+        // Only leaf I/Os pass through a vdev queue and on to the device.
+        int start = zio_stage_index(ZIO_STAGE_VDEV_IO_START);
+        int done = zio_stage_index(ZIO_STAGE_VDEV_IO_DONE);
+
+        for (const zio_slow_io_t & z : zsi) {
+            if (z.zsi_type != ZIO_TYPE_WRITE || z.zsi_vdev_device == 0) {
+                continue;
+            }
+
+            // A leaf write spends at least the modeled latency on the
+            // device, between starting and finishing its vdev I/O.
+            REQUIRE(z.zsi_vdev_guid != 0);
+            REQUIRE(z.zsi_latency >= MSEC2NSEC(2));
+            REQUIRE(z.zsi_vdev_device >= MSEC2NSEC(2));
+            REQUIRE(z.zsi_stage[start] > 0);
+            REQUIRE(z.zsi_stage[done] >=
+                    z.zsi_stage[start] + MSEC2NSEC(2));
+            REQUIRE(z.zsi_stage[done] <= z.zsi_latency);
+            ++nslow;
+        }
+
+        REQUIRE(nslow > 0);
+    }
+
+    // Creating a pool charges CPU time to the write pipeline stages, and
+    // scrubbing it adds to the read stages.
+    SECTION("account zio stage CPU time") {
+        scoped_tunable<int> stats(zio_stage_cpu_stats, 1);
+        scoped_tunable<uint64_t> size(vdev_memory_size, SPA_MINDEVSIZE);
+        std::vector<spa_zio_cpu_t> before, after;
+        uint64_t count, time, rcount, rtime;
+
+        REQUIRE(spa.create_pool("test.10", spa.memdev()) == 0);
+
+        before = zio_cpu_snapshot("test.10");
+        zio_cpu_sum(before, ZIO_TYPE_WRITE, &count, &time);
+        REQUIRE(count > 0);
+        REQUIRE(time > 0);
+        zio_cpu_sum(before, ZIO_TYPE_READ, &rcount, &rtime);
+
+        spa.scrub("test.10");
+
+        // No counter ever goes backwards, and the scrub reads ran
+        // through the read pipeline.
+        after = zio_cpu_snapshot("test.10");
+        for (size_t i = 0; i < after.size(); ++i) {
+            REQUIRE(after[i].szc_count >= before[i].szc_count);
+            REQUIRE(after[i].szc_time >= before[i].szc_time);
+        }
+
+        zio_cpu_sum(after, ZIO_TYPE_READ, &count, &time);
+        REQUIRE(count > rcount);
+        REQUIRE(time > rtime);
+    }
+
+    // Run a deep chain of null zios on this thread, each nested inside
+    // the DONE stage of the one before it.  Every stage is charged only
+    // the time that its nested zios did not already charge, so that the
+    // stage totals stay within the CPU time the thread actually used.
+    SECTION("account nested zio stage CPU time once") {
+        scoped_tunable<int> stats(zio_stage_cpu_stats, 1);
+        scoped_tunable<uint64_t> size(vdev_memory_size, SPA_MINDEVSIZE);
+        const int depth = 200;
+        std::vector<spa_zio_cpu_t> before, after;
+        uint64_t bcount, btime, acount, atime;
+        int remaining = depth;
+        hrtime_t vtime;
+        spa_t * nestspa;
+
+        REQUIRE(spa.create_pool("test.14", spa.memdev()) == 0);
+
+        REQUIRE(spa_open("test.14", &nestspa, FTAG) == 0);
+        before = zio_cpu_snapshot("test.14");
+
+        vtime = gethrvtime();
+        REQUIRE(zio_wait(zio_null(nullptr, nestspa, nullptr, zio_nest_done,
+                        &remaining, ZIO_FLAG_CANFAIL)) == 0);
+        vtime = gethrvtime() - vtime;
+
+        after = zio_cpu_snapshot("test.14");
+        spa_close(nestspa, FTAG);
+
+        zio_cpu_sum(before, ZIO_TYPE_NULL, &bcount, &btime);
+        zio_cpu_sum(after, ZIO_TYPE_NULL, &acount, &atime);
+        REQUIRE(remaining == 0);
+        REQUIRE(acount - bcount >= depth);
+        REQUIRE(atime - btime <= (uint64_t)vtime);
+    }
+
+    // Write blocks of each checksum that has a multi-buffer kernel with
+    // that kernel selected, so that their checksums are generated in
+    // batches, and scrub them back.
+    SECTION("batch checksum generation") {
+        struct {
+            uint8_t checksum;
+            int (*set)(const char *);
+            const char * (*get)(void);
+        } algos[] = {
+            { ZIO_CHECKSUM_SHA256, sha256_impl_set, sha256_impl_get },
+            { ZIO_CHECKSUM_SKEIN, skein_impl_set, skein_impl_get },
+            { ZIO_CHECKSUM_EDONR, edonr_impl_set, edonr_impl_get },
+        };
+
+        scoped_tunable<uint64_t> size(vdev_memory_size, SPA_MINDEVSIZE);
+        kstat_t * ksp;
+        pool_scan_stat_t pss;
+        int error;
+
+        props = fnvlist_alloc();
+        fnvlist_add_uint64(props, "feature@extensible_dataset", 0);
+        fnvlist_add_uint64(props, "feature@skein", 0);
+        fnvlist_add_uint64(props, "feature@edonr", 0);
+
+        error = spa.create_pool("test.11", spa.memdev(), props);
+        nvlist_free(props);
+        props = nullptr;
+        REQUIRE(error == 0);
+
+        ksp = kstat_hold_byname("zfs", 0, "zio_cksum_batch", GLOBAL_ZONEID);
+        REQUIRE(ksp != nullptr);
+
+        std::vector<bool> multi;
+        std::vector<uint64_t> batched;
+
+        for (const auto & algo : algos) {
+            std::string impl = algo.get();
+            uint64_t zios = ((kstat_named_t *)ksp->ks_data)[1].value.ui64;
+
+            multi.push_back(algo.set("avx2") == 0);
+            spa.write("test.11", algo.checksum, 32);
+            batched.push_back(
+                ((kstat_named_t *)ksp->ks_data)[1].value.ui64 - zios);
+            algo.set(impl.c_str());
+        }
+
+        // A batch that is already past its wait is computed by the zio
+        // that joins it, so with no wait every batch is a single zio.
+        if (multi[0]) {
+            scoped_tunable<int> wait(zio_checksum_batch_wait_ns, 0);
+            std::string impl = algos[0].get();
+            kstat_named_t * knp = (kstat_named_t *)ksp->ks_data;
+            uint64_t batches = knp[0].value.ui64;
+            uint64_t zios = knp[1].value.ui64;
+
+            REQUIRE(algos[0].set("avx2") == 0);
+            spa.write("test.11", algos[0].checksum, 32);
+            algos[0].set(impl.c_str());
+
+            REQUIRE(knp[1].value.ui64 > zios);
+            REQUIRE(knp[1].value.ui64 - zios == knp[0].value.ui64 - batches);
+        }
+
+        kstat_rele(ksp);
+
+        // Only a multi-buffer kernel makes batches worth forming.
+        for (size_t i = 0; i < multi.size(); i++) {
+            INFO("checksum " << (int)algos[i].checksum);
+            if (multi[i]) {
+                REQUIRE(batched[i] > 0);
+            } else {
+                REQUIRE(batched[i] == 0);
+            }
+        }
+
+        pss = spa.scrub("test.11");
+        REQUIRE(pss.pss_state == DSS_FINISHED);
+        REQUIRE(pss.pss_examined >= 3 * 32 * SPA_OLD_MAXBLOCKSIZE);
+        REQUIRE(pss.pss_errors == 0);
     }
 }
 
@@ -27,7 +27,13 @@
 #include <spl/random.h>
 #include <spl/byteorder.h>
 #include <spl/cred.h>
+#include <spl/kstat.h>
+#include <spl/mutex.h>
+#include <spl/taskq.h>
+#include <spl/taskq_impl.h>
+#include <atomic>
 #include <string.h>
+#include <unistd.h>
 
 // Basic atomic ops tests. We are not testing the atomicity here, just
 // that the APIs return the expected values (ie. the pre- or post- value.
@@ -147,4 +153,129 @@ TEST_CASE("Basic current GIDs", "[spl]")
     REQUIRE(sgid == crgetsgid(CRED()));
 }
 
+TEST_CASE("Basic kstat chain", "[spl]")
+{
+    kstat_t * ksp;
+    kstat_t * held;
+    kstat_named_t * knp;
+
+    ksp = kstat_create("spltest", 0, "named", "misc",
+            KSTAT_TYPE_NAMED, 2, 0);
+    REQUIRE(ksp != nullptr);
+
+    knp = (kstat_named_t *)ksp->ks_data;
+    kstat_named_init(&knp[0], "first", KSTAT_DATA_UINT64);
+    kstat_named_init(&knp[1], "second", KSTAT_DATA_UINT64);
+    knp[1].value.ui64 = 42;
+
+    // Not visible until installed.
+    REQUIRE(kstat_hold_byname("spltest", 0, "named", GLOBAL_ZONEID) == nullptr);
+
+    kstat_install(ksp);
+
+    held = kstat_hold_byname("spltest", 0, "named", GLOBAL_ZONEID);
+    REQUIRE(held == ksp);
+    REQUIRE(held->ks_ndata == 2);
+    REQUIRE(strcmp(((kstat_named_t *)held->ks_data)[1].name, "second") == 0);
+    REQUIRE(((kstat_named_t *)held->ks_data)[1].value.ui64 == 42);
+    kstat_rele(held);
+
+    REQUIRE(kstat_hold_byname("spltest", 1, "named", GLOBAL_ZONEID) == nullptr);
+
+    kstat_delete(ksp);
+    REQUIRE(kstat_hold_byname("spltest", 0, "named", GLOBAL_ZONEID) == nullptr);
+}
+
+// Every task holds its thread until the test releases it, so that the
+// rest queue up behind the first.
+struct taskq_test_gate {
+    std::atomic<bool> started;
+    std::atomic<bool> release;
+};
+
+static void
+taskq_test_task(void * arg)
+{
+    taskq_test_gate * gate = (taskq_test_gate *)arg;
+
+    gate->started = true;
+    while (!gate->release.load()) {
+        usleep(1000);
+    }
+
+    usleep(1000);
+}
+
+TEST_CASE("Basic taskq stats", "[spl]")
+{
+    const int ntasks = 8;
+    taskq_test_gate gate;
+    taskq_stats_t tqs;
+    taskq_t * tq;
+    kstat_t * ksp;
+    uint64_t nwait = 0, nrun = 0, nlong = 0;
+
+    tq = taskq_create("spltest_taskq", 1, minclsyspri, 1, ntasks, 0);
+    REQUIRE(tq != nullptr);
+
+    gate.started = false;
+    gate.release = false;
+
+    ksp = taskq_kstat(tq);
+    REQUIRE(ksp != nullptr);
+    REQUIRE(kstat_hold_bykid(ksp->ks_kid, GLOBAL_ZONEID) == ksp);
+    REQUIRE(ksp->ks_data_size == sizeof(taskq_stats_t));
+
+    for (int i = 0; i < ntasks; ++i) {
+        REQUIRE(taskq_dispatch(tq, taskq_test_task, &gate, TQ_SLEEP) != 0);
+    }
+
+    // One task is running, and the rest are queued behind it.
+    while (!gate.started.load()) {
+        usleep(1000);
+    }
+
+    mutex_enter((kmutex_t *)ksp->ks_lock);
+    tqs = *(taskq_stats_t *)ksp->ks_data;
+    mutex_exit((kmutex_t *)ksp->ks_lock);
+
+    REQUIRE(tqs.tqs_nthreads == 1);
+    REQUIRE(tqs.tqs_dispatched == ntasks);
+    REQUIRE(tqs.tqs_busy == 1);
+    REQUIRE(tqs.tqs_depth == ntasks - 1);
+    REQUIRE(tqs.tqs_depth_max >= ntasks - 1);
+
+    gate.release = true;
+    taskq_wait(tq);
+
+    mutex_enter((kmutex_t *)ksp->ks_lock);
+    tqs = *(taskq_stats_t *)ksp->ks_data;
+    mutex_exit((kmutex_t *)ksp->ks_lock);
+
+    REQUIRE(tqs.tqs_executed == ntasks);
+    REQUIRE(tqs.tqs_busy == 0);
+    REQUIRE(tqs.tqs_busy_max == 1);
+    REQUIRE(tqs.tqs_depth == 0);
+    REQUIRE(tqs.tqs_nomem == 0);
+
+    // Each task ran for at least a millisecond, and all but the first
+    // waited at least that long for the thread.  Bucket 20 starts at
+    // 2^19ns, and bucket 21 at 2^20ns, just over a millisecond.
+    REQUIRE(tqs.tqs_busy_time >= ntasks * MSEC2NSEC(1));
+    for (int i = 0; i < TASKQ_HIST_BUCKETS; ++i) {
+        nwait += tqs.tqs_wait_hist[i];
+        nrun += tqs.tqs_run_hist[i];
+        if (i >= 21) {
+            nlong += tqs.tqs_wait_hist[i];
+        }
+    }
+
+    REQUIRE(nwait == ntasks);
+    REQUIRE(nrun == ntasks);
+    REQUIRE(nlong >= ntasks - 1);
+
+    kstat_rele(ksp);
+    taskq_destroy(tq);
+}
+
 /* vim: set sts=4 sw=4 ts=4 tw=79 et: */